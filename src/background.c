@@ -17,6 +17,37 @@
  */
  
 #include "background.h"
+#include <meta/meta-background-image.h>
+
+#define BACKGROUND_FADE_TIME 1000 // ms
+
+/*
+ * The wallpaper is shared by every monitor's background. One GSettings
+ * watches org.gnome.desktop.background, and each configuration becomes one
+ * MetaBackground which all the background actors draw. Its image is loaded
+ * once through Mutter's image cache and held while it's in use, so that the
+ * background actors don't each decode it.
+ */
+typedef struct
+{
+	gchar *uri; // NULL for no image
+	GDesktopBackgroundStyle style;
+	GDesktopBackgroundShading shading;
+	ClutterColor primary, secondary;
+} WallpaperConfig;
+
+typedef struct
+{
+	MetaScreen *screen;
+	GSettings *settings;
+	WallpaperConfig config;
+	MetaBackground *background; // NULL until the first one has loaded
+	MetaBackgroundImage *image;
+	MetaBackground *loadingBackground;
+	MetaBackgroundImage *loadingImage;
+	gulong loadingId;
+	GList *backgrounds; // GrapheneWMBackgrounds
+} Wallpaper;
 
 struct _GrapheneWMBackground
 {
@@ -24,7 +55,7 @@ struct _GrapheneWMBackground
 	MetaScreen *screen;
 	guint monitor;
 	MetaBackgroundActor *actor;
-	GSettings *settings;
+	MetaBackgroundActor *fadingActor; // Replacing actor
 };
 
 enum
@@ -35,12 +66,14 @@ enum
 };
 
 static GParamSpec *properties[PROP_LAST];
+static Wallpaper *wallpaper = NULL;
 
 static void graphene_wm_background_constructed(GObject *self);
 static void graphene_wm_background_dispose(GObject *gobject);
 static void graphene_wm_background_set_property(GObject *self, guint propertyId, const GValue *value, GParamSpec *pspec);
 static void graphene_wm_background_get_property(GObject *self, guint propertyId, GValue *value, GParamSpec *pspec);
-static void update(GrapheneWMBackground *backgroundGroup);
+static void set_background(GrapheneWMBackground *self, MetaBackground *background, gboolean fade);
+static Wallpaper * wallpaper_get(MetaScreen *screen);
 
 G_DEFINE_TYPE (GrapheneWMBackground, graphene_wm_background, CLUTTER_TYPE_ACTOR);
 
@@ -70,15 +103,21 @@ static void graphene_wm_background_init(GrapheneWMBackground *self) {}
 static void graphene_wm_background_constructed(GObject *self_)
 {
 	GrapheneWMBackground *self = GRAPHENE_WM_BACKGROUND(self_);
-	self->settings = g_settings_new("org.gnome.desktop.background");
-	g_signal_connect_swapped(self->settings, "changed", G_CALLBACK(update), self);
-	update(self);
+	Wallpaper *w = wallpaper_get(self->screen);
+	w->backgrounds = g_list_prepend(w->backgrounds, self);
+
+	// If the wallpaper is still loading, this fades in when it's ready
+	if(w->background)
+		set_background(self, w->background, FALSE);
 }
 
 static void graphene_wm_background_dispose(GObject *gobject)
 {
-	g_clear_object(&GRAPHENE_WM_BACKGROUND(gobject)->screen);
-	g_clear_object(&GRAPHENE_WM_BACKGROUND(gobject)->actor);
+	GrapheneWMBackground *self = GRAPHENE_WM_BACKGROUND(gobject);
+	if(wallpaper)
+		wallpaper->backgrounds = g_list_remove(wallpaper->backgrounds, self);
+	g_clear_object(&self->screen);
+	self->actor = self->fadingActor = NULL; // Owned by self as children
 	G_OBJECT_CLASS(graphene_wm_background_parent_class)->dispose(gobject);
 }
 
@@ -93,50 +132,185 @@ static void graphene_wm_background_set_property(GObject *self, guint propertyId,
 
 static void graphene_wm_background_get_property(GObject *self, guint propertyId, GValue *value, GParamSpec *pspec) {}
 
-static void update_done(ClutterActor *newActor, GrapheneWMBackground *self)
+static void fade_done(ClutterActor *newActor, GrapheneWMBackground *self)
 {
 	clutter_actor_remove_all_transitions(newActor);
 	clutter_actor_set_opacity(newActor, 255);
-	g_signal_handlers_disconnect_by_func(newActor, update_done, NULL);
+	g_signal_handlers_disconnect_by_func(newActor, fade_done, self);
 
 	if(self->actor)
-		clutter_actor_remove_child(CLUTTER_ACTOR(self), CLUTTER_ACTOR(self->actor));
+		clutter_actor_destroy(CLUTTER_ACTOR(self->actor));
 	self->actor = META_BACKGROUND_ACTOR(newActor);
+	self->fadingActor = NULL;
 }
 
-static void update(GrapheneWMBackground *self)
+static void fit_to_monitor(GrapheneWMBackground *self, ClutterActor *actor)
 {
-	ClutterActor *newActor = meta_background_actor_new(self->screen, self->monitor);
-	MetaBackground *newBackground = meta_background_new(self->screen);
-	meta_background_actor_set_background(META_BACKGROUND_ACTOR(newActor), newBackground);
-	
 	MetaRectangle rect = meta_rect(0,0,0,0);
 	meta_screen_get_monitor_geometry(self->screen, self->monitor, &rect);
-	
-	clutter_actor_set_position(newActor, rect.x, rect.y);
-	clutter_actor_set_size(newActor, rect.width, rect.height);
-	clutter_actor_set_opacity(newActor, 0);
+	clutter_actor_set_position(actor, rect.x, rect.y);
+	clutter_actor_set_size(actor, rect.width, rect.height);
+}
+
+void graphene_wm_background_update_geometry(GrapheneWMBackground *self)
+{
+	g_return_if_fail(GRAPHENE_IS_WM_BACKGROUND(self));
+	if(self->actor)
+		fit_to_monitor(self, CLUTTER_ACTOR(self->actor));
+	if(self->fadingActor)
+		fit_to_monitor(self, CLUTTER_ACTOR(self->fadingActor));
+}
+
+/*
+ * Shows the background in a new actor, and crossfades from the old one if
+ * fade is TRUE.
+ */
+static void set_background(GrapheneWMBackground *self, MetaBackground *background, gboolean fade)
+{
+	// Finish any crossfade that's still going
+	if(self->fadingActor)
+		fade_done(CLUTTER_ACTOR(self->fadingActor), self);
+
+	ClutterActor *newActor = meta_background_actor_new(self->screen, self->monitor);
+	meta_background_actor_set_background(META_BACKGROUND_ACTOR(newActor), background);
+	fit_to_monitor(self, newActor);
 	clutter_actor_insert_child_at_index(CLUTTER_ACTOR(self), newActor, -1);
-	
-	ClutterColor *primaryColor = clutter_color_new(255, 255, 255, 255);
-	ClutterColor *secondaryColor = clutter_color_new(255, 255, 255, 255);
-	clutter_color_from_string(primaryColor, g_settings_get_string(self->settings, "primary-color"));
-	clutter_color_from_string(secondaryColor, g_settings_get_string(self->settings, "secondary-color"));
-	GDesktopBackgroundShading shading = g_settings_get_enum(self->settings, "color-shading-type");
-	meta_background_set_gradient(newBackground, shading, primaryColor, secondaryColor);
-	
-	char *imageURI = g_settings_get_string(self->settings, "picture-uri");
-	GDesktopBackgroundStyle style = g_settings_get_enum(self->settings, "picture-options");
-	GFile *imageFile = g_file_new_for_uri(imageURI);
-	meta_background_set_file(newBackground, imageFile, style);
-	g_object_unref(imageFile);
-	g_free(imageURI);
-	
 	clutter_actor_show(newActor);
-	g_signal_connect(newActor, "transitions_completed", G_CALLBACK(update_done), self);
+
+	if(!fade)
+	{
+		if(self->actor)
+			clutter_actor_destroy(CLUTTER_ACTOR(self->actor));
+		self->actor = META_BACKGROUND_ACTOR(newActor);
+		return;
+	}
+
+	self->fadingActor = META_BACKGROUND_ACTOR(newActor);
+	clutter_actor_set_opacity(newActor, 0);
+	g_signal_connect(newActor, "transitions_completed", G_CALLBACK(fade_done), self);
 	clutter_actor_save_easing_state(newActor);
 	clutter_actor_set_easing_mode(newActor, CLUTTER_EASE_IN_SINE);
-	clutter_actor_set_easing_duration(newActor, 1000);
+	clutter_actor_set_easing_duration(newActor, BACKGROUND_FADE_TIME);
 	clutter_actor_set_opacity(newActor, 255);
 	clutter_actor_restore_easing_state(newActor);
 }
+
+
+static void wallpaper_read_config(GSettings *settings, WallpaperConfig *config)
+{
+	gchar *primary = g_settings_get_string(settings, "primary-color");
+	gchar *secondary = g_settings_get_string(settings, "secondary-color");
+	config->primary = config->secondary = (ClutterColor){255, 255, 255, 255};
+	clutter_color_from_string(&config->primary, primary);
+	clutter_color_from_string(&config->secondary, secondary);
+	g_free(primary);
+	g_free(secondary);
+
+	config->shading = g_settings_get_enum(settings, "color-shading-type");
+	config->style = g_settings_get_enum(settings, "picture-options");
+	config->uri = g_settings_get_string(settings, "picture-uri");
+	if(config->style == G_DESKTOP_BACKGROUND_STYLE_NONE || !config->uri[0])
+		g_clear_pointer(&config->uri, g_free);
+}
+
+static gboolean wallpaper_config_equal(const WallpaperConfig *a, const WallpaperConfig *b)
+{
+	return g_strcmp0(a->uri, b->uri) == 0
+		&& a->style == b->style
+		&& a->shading == b->shading
+		&& clutter_color_equal(&a->primary, &b->primary)
+		&& clutter_color_equal(&a->secondary, &b->secondary);
+}
+
+static void wallpaper_cancel_load(Wallpaper *w)
+{
+	if(w->loadingId)
+		g_signal_handler_disconnect(w->loadingImage, w->loadingId);
+	w->loadingId = 0;
+	g_clear_object(&w->loadingImage);
+	g_clear_object(&w->loadingBackground);
+}
+
+/*
+ * Switches every monitor to the background which just finished loading.
+ */
+static void wallpaper_apply(Wallpaper *w)
+{
+	if(w->loadingId)
+		g_signal_handler_disconnect(w->loadingImage, w->loadingId);
+	w->loadingId = 0;
+
+	if(w->loadingImage && !meta_background_image_get_success(w->loadingImage))
+		g_warning("Failed to load wallpaper '%s'", w->config.uri);
+
+	g_clear_object(&w->background);
+	g_clear_object(&w->image);
+	w->background = w->loadingBackground;
+	w->image = w->loadingImage;
+	w->loadingBackground = NULL;
+	w->loadingImage = NULL;
+
+	for(GList *it=w->backgrounds;it;it=it->next)
+		set_background(GRAPHENE_WM_BACKGROUND(it->data), w->background, TRUE);
+}
+
+static void wallpaper_load(Wallpaper *w)
+{
+	wallpaper_cancel_load(w);
+
+	w->loadingBackground = meta_background_new(w->screen);
+	meta_background_set_gradient(w->loadingBackground, w->config.shading, &w->config.primary, &w->config.secondary);
+
+	if(w->config.uri)
+	{
+		GFile *file = g_file_new_for_uri(w->config.uri);
+		// Holding the image keeps it in the cache, where the background
+		// (and any later background using the same file) finds it
+		w->loadingImage = meta_background_image_cache_load(meta_background_image_cache_get_default(), file);
+		meta_background_set_file(w->loadingBackground, file, w->config.style);
+		g_object_unref(file);
+	}
+
+	// Wait for the image before crossfading, rather than fading to just
+	// the gradient
+	if(w->loadingImage && !meta_background_image_is_loaded(w->loadingImage))
+		w->loadingId = g_signal_connect_swapped(w->loadingImage, "loaded", G_CALLBACK(wallpaper_apply), w);
+	else
+		wallpaper_apply(w);
+}
+
+static void wallpaper_on_settings_changed(Wallpaper *w, const gchar *key, GSettings *settings)
+{
+	WallpaperConfig config = {0};
+	wallpaper_read_config(settings, &config);
+
+	// Other keys in the schema don't change what is drawn
+	if(wallpaper_config_equal(&config, &w->config))
+	{
+		g_free(config.uri);
+		return;
+	}
+
+	g_free(w->config.uri);
+	w->config = config;
+	wallpaper_load(w);
+}
+
+/*
+ * Returns the wallpaper, creating it on first use. It stays around for the
+ * rest of the session, so that re-creating every monitor's background (as
+ * on a monitor change) doesn't reload it.
+ */
+static Wallpaper * wallpaper_get(MetaScreen *screen)
+{
+	if(wallpaper)
+		return wallpaper;
+
+	wallpaper = g_new0(Wallpaper, 1);
+	wallpaper->screen = screen;
+	wallpaper->settings = g_settings_new("org.gnome.desktop.background");
+	g_signal_connect_swapped(wallpaper->settings, "changed", G_CALLBACK(wallpaper_on_settings_changed), wallpaper);
+	wallpaper_read_config(wallpaper->settings, &wallpaper->config);
+	wallpaper_load(wallpaper);
+	return wallpaper;
+}
@@ -17,6 +17,7 @@
  *
  * background.h/.c
  * The window manager's background actor. One of these is created for each monitor and assigned in on_monitors_changed() in wm.c.
+ * All of them share one wallpaper, which is loaded once and crossfaded in when its settings change.
  */
 
 #ifndef __GRAPHENE_WM_BACKGROUND_H__
@@ -34,6 +35,12 @@ G_DECLARE_FINAL_TYPE(GrapheneWMBackground, graphene_wm_background, GRAPHENE, WM_
 
 GrapheneWMBackground * graphene_wm_background_new(MetaScreen *screen, guint monitor);
 
+/*
+ * Moves and resizes the background to its monitor's current geometry,
+ * without reloading it.
+ */
+void graphene_wm_background_update_geometry(GrapheneWMBackground *background);
+
 G_END_DECLS
 
 #endif /* __GRAPHENE_WM_BACKGROUND_H__ */
@@ -418,6 +418,7 @@ static gboolean graphene_session_client_spawn_delay_cb(GrapheneSessionClient *se
 	else if(!self->args)
 	{
 		g_warning("Cannot spawn client '%s' because args is not set", graphene_session_client_get_best_name(self));
+		set_failed(self, TRUE);
 		return G_SOURCE_REMOVE;
 	}
 	else if(!test_condition(self))
@@ -442,6 +443,7 @@ static gboolean graphene_session_client_spawn_delay_cb(GrapheneSessionClient *se
 	{
 		g_critical("Failed to parse args '%s' (%s) to start process", self->args, e->message);
 		g_error_free(e);
+		set_failed(self, TRUE);
 		return G_SOURCE_REMOVE;
 	}
 	gchar *startupIdVar = g_strdup_printf("DESKTOP_AUTOSTART_ID=%s", self->id);
@@ -457,6 +459,7 @@ static gboolean graphene_session_client_spawn_delay_cb(GrapheneSessionClient *se
 	{
 		g_critical("Failed to start process with args '%s' (%s)", self->args, e->message);
 		g_error_free(e);
+		set_failed(self, TRUE);
 		return G_SOURCE_REMOVE;
 	}
 	
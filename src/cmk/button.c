@@ -7,6 +7,32 @@
 #include "button.h"
 #include <math.h>
 
+/*
+ * Natural sizes of the button's children along one dimension, for one
+ * for-size (the other dimension, or -1).
+ */
+typedef struct
+{
+	gboolean valid;
+	gfloat forSize;
+	gfloat content, text;
+} ChildSizes;
+
+/*
+ * The button's padding and its children's natural sizes, measured once and
+ * reused by get_preferred_width/height and allocate until the style
+ * changes or anything inside the button queues a relayout. A layout pass
+ * normally asks for the width with no for-size and then the height for
+ * the allocated width, so one entry per dimension is enough for allocate
+ * to reuse what the parent's requests measured.
+ */
+typedef struct
+{
+	gboolean paddingValid;
+	gfloat padding;
+	ChildSizes widths, heights;
+} ButtonMeasurements;
+
 typedef struct _CmkButtonPrivate CmkButtonPrivate;
 struct _CmkButtonPrivate 
 {
@@ -15,8 +41,24 @@ struct _CmkButtonPrivate
 	gboolean hover;
 	gboolean selected;
 	CmkButtonType type;
+	ClutterContent *hoverBackground;
+	ClutterContent *selectedBackground;
+	ButtonMeasurements measurements;
 };
 
+/*
+ * Identifies one pre-rendered button background. Buttons with the same
+ * shape, size and color (most tasklist and launcher buttons) share the
+ * same canvas, so it only gets drawn and uploaded once.
+ */
+typedef struct
+{
+	CmkButtonType type;
+	gint width, height;
+	gfloat radius;
+	ClutterColor color;
+} BackgroundKey;
+
 enum
 {
 	PROP_TEXT = 1,
@@ -38,16 +80,24 @@ static void cmk_button_get_property(GObject *self_, guint propertyId, GValue *va
 static void cmk_button_get_preferred_width(ClutterActor *self_, gfloat forHeight, gfloat *minWidth, gfloat *natWidth);
 static void cmk_button_get_preferred_height(ClutterActor *self_, gfloat forWidth, gfloat *minHeight, gfloat *natHeight);
 static void cmk_button_allocate(ClutterActor *self_, const ClutterActorBox *box, ClutterAllocationFlags flags);
+static void cmk_button_queue_relayout(ClutterActor *self_);
 static void on_clicked(ClutterClickAction *action, CmkButton *self);
 static gboolean on_crossing(ClutterActor *self_, ClutterCrossingEvent *event);
 static void on_style_changed(CmkWidget *self_);
 static void on_background_changed(CmkWidget *self_);
-static void on_size_changed(ClutterActor *self, GParamSpec *spec, ClutterCanvas *canvas);
-static gboolean on_draw_canvas(ClutterCanvas *canvas, cairo_t *cr, int width, int height, CmkButton *self);
+static void on_size_changed(ClutterActor *self_, GParamSpec *spec);
+static void cmk_button_dispose(GObject *self_);
+static void invalidate_background(CmkButton *self);
+static void update_background(CmkButton *self);
+static gboolean on_draw_background(ClutterCanvas *canvas, cairo_t *cr, int width, int height, BackgroundKey *key);
 
 G_DEFINE_TYPE_WITH_PRIVATE(CmkButton, cmk_button, CMK_TYPE_WIDGET);
 #define PRIVATE(button) ((CmkButtonPrivate *)cmk_button_get_instance_private(button))
 
+// BackgroundKey -> ClutterCanvas. The table does not hold a reference
+// to the canvases; each is removed when its last button lets go of it.
+static GHashTable *backgroundCache = NULL;
+
 
 
 CmkButton * cmk_button_new(void)
@@ -70,6 +120,7 @@ static void cmk_button_class_init(CmkButtonClass *class)
 	GObjectClass *base = G_OBJECT_CLASS(class);
 	base->set_property = cmk_button_set_property;
 	base->get_property = cmk_button_get_property;
+	base->dispose = cmk_button_dispose;
 
 	ClutterActorClass *actorClass = CLUTTER_ACTOR_CLASS(class);
 	actorClass->enter_event = on_crossing;
@@ -77,6 +128,7 @@ static void cmk_button_class_init(CmkButtonClass *class)
 	actorClass->get_preferred_width = cmk_button_get_preferred_width;
 	actorClass->get_preferred_height = cmk_button_get_preferred_height;
 	actorClass->allocate = cmk_button_allocate;
+	actorClass->queue_relayout = cmk_button_queue_relayout;
 
 	CMK_WIDGET_CLASS(class)->style_changed = on_style_changed;
 	CMK_WIDGET_CLASS(class)->background_changed = on_background_changed;
@@ -91,16 +143,12 @@ static void cmk_button_class_init(CmkButtonClass *class)
 
 static void cmk_button_init(CmkButton *self)
 {
-	ClutterContent *canvas = clutter_canvas_new();
-	g_signal_connect(canvas, "draw", G_CALLBACK(on_draw_canvas), self);
-
 	ClutterActor *actor = CLUTTER_ACTOR(self);
 	clutter_actor_set_reactive(actor, TRUE);
 
-	g_signal_connect(actor, "notify::size", G_CALLBACK(on_size_changed), canvas);
+	g_signal_connect(actor, "notify::size", G_CALLBACK(on_size_changed), NULL);
 
 	clutter_actor_set_content_gravity(actor, CLUTTER_CONTENT_GRAVITY_CENTER);
-	clutter_actor_set_content(actor, canvas);
 
 	// This handles grabbing the cursor when the user holds down the mouse
 	ClutterAction *action = clutter_click_action_new();
@@ -108,6 +156,15 @@ static void cmk_button_init(CmkButton *self)
 	clutter_actor_add_action(actor, action);
 }
 
+static void cmk_button_dispose(GObject *self_)
+{
+	CmkButtonPrivate *private = PRIVATE(CMK_BUTTON(self_));
+	clutter_actor_set_content(CLUTTER_ACTOR(self_), NULL);
+	g_clear_object(&private->hoverBackground);
+	g_clear_object(&private->selectedBackground);
+	G_OBJECT_CLASS(cmk_button_parent_class)->dispose(self_);
+}
+
 static void cmk_button_set_property(GObject *self_, guint propertyId, const GValue *value, GParamSpec *pspec)
 {
 	g_return_if_fail(CMK_IS_BUTTON(self_));
@@ -146,55 +203,94 @@ static void cmk_button_get_property(GObject *self_, guint propertyId, GValue *va
 	}
 }
 
-static void cmk_button_get_preferred_width(ClutterActor *self_, gfloat forHeight, gfloat *minWidth, gfloat *natWidth)
+static gfloat get_padding(CmkButton *self)
 {
-	CmkButtonPrivate *private = PRIVATE(CMK_BUTTON(self_));
-	*minWidth = 0;
-	float padding = cmk_widget_style_get_padding(CMK_WIDGET(self_));
-
-	if(private->content)
+	ButtonMeasurements *m = &PRIVATE(self)->measurements;
+	if(!m->paddingValid)
 	{
-		gfloat min, nat;
-		clutter_actor_get_preferred_width(CLUTTER_ACTOR(private->content), forHeight, &min, &nat);
-		*minWidth += nat;
+		m->padding = cmk_widget_style_get_padding(CMK_WIDGET(self));
+		m->paddingValid = TRUE;
 	}
-	
-	if(private->content && private->text)
-		*minWidth += padding;
+	return m->padding;
+}
 
-	if(private->text)
-	{
-		gfloat min, nat;
-		clutter_actor_get_preferred_width(CLUTTER_ACTOR(private->text), forHeight, &min, &nat);
-		*minWidth += nat;
-	}
+/*
+ * Returns the children's natural widths for the given height, measuring
+ * them unless they were last measured for the same height.
+ */
+static const ChildSizes * get_child_widths(CmkButton *self, gfloat forHeight)
+{
+	CmkButtonPrivate *private = PRIVATE(self);
+	ChildSizes *sizes = &private->measurements.widths;
+	if(sizes->valid && sizes->forSize == forHeight)
+		return sizes;
 
-	*minWidth += (padding*2);
-	*natWidth = *minWidth;
+	gfloat min;
+	sizes->content = sizes->text = 0;
+	if(private->content)
+		clutter_actor_get_preferred_width(CLUTTER_ACTOR(private->content), forHeight, &min, &sizes->content);
+	if(private->text)
+		clutter_actor_get_preferred_width(CLUTTER_ACTOR(private->text), forHeight, &min, &sizes->text);
+	sizes->forSize = forHeight;
+	sizes->valid = TRUE;
+	return sizes;
 }
 
-static void cmk_button_get_preferred_height(ClutterActor *self_, gfloat forWidth, gfloat *minHeight, gfloat *natHeight)
+/*
+ * Returns the children's natural heights for the given width, like
+ * get_child_widths.
+ */
+static const ChildSizes * get_child_heights(CmkButton *self, gfloat forWidth)
 {
-	CmkButtonPrivate *private = PRIVATE(CMK_BUTTON(self_));
-	*minHeight = 0;
-	float padding = cmk_widget_style_get_padding(CMK_WIDGET(self_));
-	
-	if(private->content)
-	{
-		gfloat min, nat;
-		clutter_actor_get_preferred_height(CLUTTER_ACTOR(private->content), forWidth, &min, &nat);
-		*minHeight = nat;
-	}
+	CmkButtonPrivate *private = PRIVATE(self);
+	ChildSizes *sizes = &private->measurements.heights;
+	if(sizes->valid && sizes->forSize == forWidth)
+		return sizes;
 
+	gfloat min;
+	sizes->content = sizes->text = 0;
+	if(private->content)
+		clutter_actor_get_preferred_height(CLUTTER_ACTOR(private->content), forWidth, &min, &sizes->content);
 	if(private->text)
-	{
-		gfloat min, nat;
-		clutter_actor_get_preferred_height(CLUTTER_ACTOR(private->text), forWidth, &min, &nat);
-		*minHeight = MAX(nat, *minHeight);
-	}
+		clutter_actor_get_preferred_height(CLUTTER_ACTOR(private->text), forWidth, &min, &sizes->text);
+	sizes->forSize = forWidth;
+	sizes->valid = TRUE;
+	return sizes;
+}
+
+static void invalidate_measurements(CmkButton *self)
+{
+	ButtonMeasurements *m = &PRIVATE(self)->measurements;
+	m->paddingValid = FALSE;
+	m->widths.valid = FALSE;
+	m->heights.valid = FALSE;
+}
+
+static gfloat measured_width(CmkButton *self, gfloat forHeight)
+{
+	CmkButtonPrivate *private = PRIVATE(self);
+	gfloat padding = get_padding(self);
+	const ChildSizes *widths = get_child_widths(self, forHeight);
+	gfloat width = widths->content + widths->text;
+	if(private->content && private->text)
+		width += padding;
+	return width + (padding*2);
+}
+
+static gfloat measured_height(CmkButton *self, gfloat forWidth)
+{
+	const ChildSizes *heights = get_child_heights(self, forWidth);
+	return MAX(heights->content, heights->text) + (get_padding(self)*2);
+}
+
+static void cmk_button_get_preferred_width(ClutterActor *self_, gfloat forHeight, gfloat *minWidth, gfloat *natWidth)
+{
+	*minWidth = *natWidth = measured_width(CMK_BUTTON(self_), forHeight);
+}
 
-	*minHeight += (padding*2);
-	*natHeight = *minHeight;
+static void cmk_button_get_preferred_height(ClutterActor *self_, gfloat forWidth, gfloat *minHeight, gfloat *natHeight)
+{
+	*minHeight = *natHeight = measured_height(CMK_BUTTON(self_), forWidth);
 }
 
 static void cmk_button_allocate(ClutterActor *self_, const ClutterActorBox *box, ClutterAllocationFlags flags)
@@ -213,29 +309,29 @@ static void cmk_button_allocate(ClutterActor *self_, const ClutterActorBox *box,
 	 * padding.
 	 */
 
-	CmkButtonPrivate *private = PRIVATE(CMK_BUTTON(self_));
+	CmkButton *self = CMK_BUTTON(self_);
+	CmkButtonPrivate *private = PRIVATE(self);
 	if(!private->content && !private->text)
 	{
 		CLUTTER_ACTOR_CLASS(cmk_button_parent_class)->allocate(self_, box, flags);
 		return;
 	}
 
-	float padding = cmk_widget_style_get_padding(CMK_WIDGET(self_));
-	
-	gfloat minHeight, natHeight, minWidth, natWidth;
-	clutter_actor_get_preferred_height(self_, -1, &minHeight, &natHeight);
-	clutter_actor_get_preferred_width(self_, -1, &minWidth, &natWidth);
-
 	gfloat maxHeight = box->y2 - box->y1;
 	gfloat maxWidth = box->x2 - box->x1;
+
+	// The same requests the parent made in a height-for-width layout, so
+	// these are normally already measured
+	float padding = get_padding(self);
+	gfloat minWidth = measured_width(self, -1);
+	gfloat minHeight = measured_height(self, maxWidth);
+	gfloat contentWidth = get_child_widths(self, -1)->content;
 	gfloat hPad = MIN(MAX((maxHeight - (minHeight-(padding*2)))/2, 0), padding);
 	gfloat wPad = MIN(MAX((maxWidth - (minWidth-(padding*2)))/2, 0), padding);
 
 	if(private->content && private->text)
 	{
-		gfloat min, nat;
-		clutter_actor_get_preferred_width(CLUTTER_ACTOR(private->content), -1, &min, &nat);
-		gfloat contentRight = MIN(wPad+nat, maxWidth);
+		gfloat contentRight = MIN(wPad+contentWidth, maxWidth);
 		ClutterActorBox contentBox = {wPad, hPad, contentRight, maxHeight-hPad};
 		clutter_actor_allocate(CLUTTER_ACTOR(private->content), &contentBox, flags);
 		gfloat textRight = MAX(contentRight+wPad, maxWidth-wPad);
@@ -254,6 +350,16 @@ static void cmk_button_allocate(ClutterActor *self_, const ClutterActorBox *box,
 	CLUTTER_ACTOR_CLASS(cmk_button_parent_class)->allocate(self_, box, flags);
 }
 
+/*
+ * Children queueing a relayout (text or icon changes) propagate up
+ * through here, so this is where stale measurements get dropped.
+ */
+static void cmk_button_queue_relayout(ClutterActor *self_)
+{
+	invalidate_measurements(CMK_BUTTON(self_));
+	CLUTTER_ACTOR_CLASS(cmk_button_parent_class)->queue_relayout(self_);
+}
+
 static void on_clicked(ClutterClickAction *action, CmkButton *self)
 {
 	g_signal_emit(self, signals[SIGNAL_ACTIVATE], 0);
@@ -266,13 +372,14 @@ static gboolean on_crossing(ClutterActor *self_, ClutterCrossingEvent *event)
 	else
 		PRIVATE(CMK_BUTTON(self_))->hover = FALSE;
 	
-	clutter_content_invalidate(clutter_actor_get_content(self_));
+	update_background(CMK_BUTTON(self_));
 	return TRUE;
 }
 
 static void on_style_changed(CmkWidget *self_)
 {
-	clutter_content_invalidate(clutter_actor_get_content(CLUTTER_ACTOR(self_)));
+	invalidate_background(CMK_BUTTON(self_));
+	invalidate_measurements(CMK_BUTTON(self_));
 	//float padding = cmk_style_get_padding(style);
 	//ClutterMargin margin = {padding, padding, padding, padding};
 	//clutter_actor_set_margin(CLUTTER_ACTOR(PRIVATE(CMK_BUTTON(self_))->text), &margin);
@@ -291,48 +398,140 @@ static void on_background_changed(CmkWidget *self_)
 	CMK_WIDGET_CLASS(cmk_button_parent_class)->background_changed(self_);
 }
 
-static void on_size_changed(ClutterActor *self, GParamSpec *spec, ClutterCanvas *canvas)
+static void on_size_changed(ClutterActor *self_, GParamSpec *spec)
+{
+	invalidate_background(CMK_BUTTON(self_));
+}
+
+static guint background_key_hash(gconstpointer key_)
+{
+	const BackgroundKey *key = key_;
+	guint hash = key->type;
+	hash = hash * 31 + key->width;
+	hash = hash * 31 + key->height;
+	hash = hash * 31 + (guint)(key->radius * 16);
+	hash = hash * 31 + clutter_color_hash(&key->color);
+	return hash;
+}
+
+static gboolean background_key_equal(gconstpointer a_, gconstpointer b_)
+{
+	const BackgroundKey *a = a_, *b = b_;
+	return a->type == b->type
+		&& a->width == b->width
+		&& a->height == b->height
+		&& a->radius == b->radius
+		&& clutter_color_equal(&a->color, &b->color);
+}
+
+static void on_background_finalized(gpointer key, GObject *canvas)
+{
+	g_hash_table_remove(backgroundCache, key);
+}
+
+/*
+ * Returns a new reference to the shared background canvas for the given
+ * style color at the button's current size, drawing it only if no other
+ * button already has one. Returns NULL if there is nothing to draw.
+ */
+static ClutterContent * acquire_background(CmkButton *self, const gchar *colorName)
 {
+	CmkButtonPrivate *private = PRIVATE(self);
+	const ClutterColor *color = cmk_widget_style_get_color(CMK_WIDGET(self), colorName);
+	if(!color || color->alpha == 0)
+		return NULL;
+
 	gfloat width, height;
-	clutter_actor_get_size(self, &width, &height);
-	clutter_canvas_set_size(CLUTTER_CANVAS(canvas), width, height);
+	clutter_actor_get_size(CLUTTER_ACTOR(self), &width, &height);
+	BackgroundKey key = {private->type, (gint)ceilf(width), (gint)ceilf(height), 0, *color};
+	if(key.width <= 0 || key.height <= 0)
+		return NULL;
+
+	if(private->type == CMK_BUTTON_TYPE_BEVELED)
+		key.radius = cmk_widget_style_get_bevel_radius(CMK_WIDGET(self));
+	else if(private->type == CMK_BUTTON_TYPE_CIRCLE)
+		key.radius = MIN(key.width, key.height)/2;
+	key.radius = MIN(MAX(key.radius, 0), MIN(key.width, key.height)/2);
+
+	if(!backgroundCache)
+		backgroundCache = g_hash_table_new_full(background_key_hash, background_key_equal, g_free, NULL);
+
+	ClutterContent *canvas = g_hash_table_lookup(backgroundCache, &key);
+	if(canvas)
+		return g_object_ref(canvas);
+
+	BackgroundKey *stored = g_new(BackgroundKey, 1);
+	*stored = key;
+	canvas = clutter_canvas_new();
+	g_signal_connect(canvas, "draw", G_CALLBACK(on_draw_background), stored);
+	g_object_weak_ref(G_OBJECT(canvas), on_background_finalized, stored);
+	g_hash_table_insert(backgroundCache, stored, canvas);
+	clutter_canvas_set_size(CLUTTER_CANVAS(canvas), key.width, key.height);
+	return canvas;
+}
+
+/*
+ * Drops the button's backgrounds after anything they were drawn from
+ * (size, type or style) changes. They are acquired again on demand.
+ */
+static void invalidate_background(CmkButton *self)
+{
+	CmkButtonPrivate *private = PRIVATE(self);
+	g_clear_object(&private->hoverBackground);
+	g_clear_object(&private->selectedBackground);
+	update_background(self);
+}
+
+/*
+ * Shows the background for the button's current state. Crossings and
+ * selection changes only swap which canvas is shown; nothing is redrawn.
+ */
+static void update_background(CmkButton *self)
+{
+	CmkButtonPrivate *private = PRIVATE(self);
+	ClutterContent *content = NULL;
+
+	if(private->hover)
+	{
+		if(!private->hoverBackground)
+			private->hoverBackground = acquire_background(self, "hover");
+		content = private->hoverBackground;
+	}
+	else if(private->selected)
+	{
+		if(!private->selectedBackground)
+			private->selectedBackground = acquire_background(self, "selected");
+		content = private->selectedBackground;
+	}
+
+	if(clutter_actor_get_content(CLUTTER_ACTOR(self)) != content)
+		clutter_actor_set_content(CLUTTER_ACTOR(self), content);
 }
 
-static gboolean on_draw_canvas(ClutterCanvas *canvas, cairo_t *cr, int width, int height, CmkButton *self)
+static gboolean on_draw_background(ClutterCanvas *canvas, cairo_t *cr, int width, int height, BackgroundKey *key)
 {
 	cairo_save(cr);
 	cairo_set_operator(cr, CAIRO_OPERATOR_CLEAR);
 	cairo_paint(cr);
 	cairo_restore(cr);
 
-	if(PRIVATE(self)->hover || PRIVATE(self)->selected)
+	cairo_set_source_clutter_color(cr, &key->color);
+	if(key->type == CMK_BUTTON_TYPE_BEVELED || key->type == CMK_BUTTON_TYPE_CIRCLE)
 	{
-		const gchar *color = PRIVATE(self)->hover ? "hover" : "selected";
-		cairo_set_source_clutter_color(cr, cmk_widget_style_get_color(CMK_WIDGET(self), color));
-		if(PRIVATE(self)->type == CMK_BUTTON_TYPE_BEVELED || PRIVATE(self)->type == CMK_BUTTON_TYPE_CIRCLE)
-		{
-			double radius;
-			double degrees = M_PI / 180.0;
-
-			if(PRIVATE(self)->type == CMK_BUTTON_TYPE_BEVELED)
-				radius = cmk_widget_style_get_bevel_radius(CMK_WIDGET(self));
-			else
-				radius = MIN(width, height)/2;
-
-			radius = MIN(MAX(radius, 0), MIN(width,height)/2);
-
-			cairo_new_sub_path(cr);
-			cairo_arc(cr, width - radius, radius, radius, -90 * degrees, 0 * degrees);
-			cairo_arc(cr, width - radius, height - radius, radius, 0 * degrees, 90 * degrees);
-			cairo_arc(cr, radius, height - radius, radius, 90 * degrees, 180 * degrees);
-			cairo_arc(cr, radius, radius, radius, 180 * degrees, 270 * degrees);
-			cairo_close_path(cr);
-			cairo_fill(cr);
-		}
-		else
-		{
-			cairo_paint(cr);
-		}
+		double radius = key->radius;
+		double degrees = M_PI / 180.0;
+
+		cairo_new_sub_path(cr);
+		cairo_arc(cr, width - radius, radius, radius, -90 * degrees, 0 * degrees);
+		cairo_arc(cr, width - radius, height - radius, radius, 0 * degrees, 90 * degrees);
+		cairo_arc(cr, radius, height - radius, radius, 90 * degrees, 180 * degrees);
+		cairo_arc(cr, radius, radius, radius, 180 * degrees, 270 * degrees);
+		cairo_close_path(cr);
+		cairo_fill(cr);
+	}
+	else
+	{
+		cairo_paint(cr);
 	}
 	return TRUE;
 }
@@ -353,7 +552,9 @@ void cmk_button_set_text(CmkButton *self, const gchar *text)
 	else if(PRIVATE(self)->text)
 	{
 		clutter_actor_remove_child(CLUTTER_ACTOR(self), CLUTTER_ACTOR(PRIVATE(self)->text));
+		PRIVATE(self)->text = NULL;
 	}
+	invalidate_measurements(self);
 }
 
 const gchar * cmk_button_get_text(CmkButton *self)
@@ -374,6 +575,7 @@ void cmk_button_set_content(CmkButton *self, CmkWidget *content)
 	PRIVATE(self)->content = content;
 	if(content)
 		clutter_actor_add_child(CLUTTER_ACTOR(self), CLUTTER_ACTOR(content));
+	invalidate_measurements(self);
 	//clutter_actor_queue_relayout(CLUTTER_ACTOR(self));
 }
 
@@ -389,8 +591,7 @@ void cmk_button_set_type(CmkButton *self, CmkButtonType type)
 	if(PRIVATE(self)->type != type)
 	{
 		PRIVATE(self)->type = type;
-		if(PRIVATE(self)->hover)
-			clutter_content_invalidate(clutter_actor_get_content(CLUTTER_ACTOR(self)));
+		invalidate_background(self);
 	}
 }
 
@@ -406,7 +607,7 @@ void cmk_button_set_selected(CmkButton *self, gboolean selected)
 	if(PRIVATE(self)->selected != selected)
 	{
 		PRIVATE(self)->selected = selected;
-		clutter_content_invalidate(clutter_actor_get_content(CLUTTER_ACTOR(self)));
+		update_background(self);
 	}
 }
 
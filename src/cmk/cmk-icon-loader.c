@@ -6,7 +6,16 @@
 
 #include "cmk-icon-loader.h"
 #include <gio/gio.h>
+#include <glib/gstdio.h>
 #include <librsvg/rsvg.h>
+#include <string.h>
+#include <errno.h>
+
+#define ICON_INDEX_MAGIC 0x434d4b49 // "CMKI"
+#define ICON_INDEX_VERSION 2
+
+// Default surface cache budget, overridable with CMK_ICON_CACHE_SIZE (KiB)
+#define DEFAULT_CACHE_SIZE (8*1024*1024)
 
 typedef struct
 {
@@ -34,6 +43,38 @@ struct _IconInfo
 	IconInfo *next; // Next version of this icon
 };
 
+/*
+ * On-disk theme index, stored in $XDG_CACHE_HOME/graphene/icons/<theme>.index
+ * and mmap'd when the theme is loaded. Layout:
+ *   IconIndexHeader
+ *   guint64 groupMtimes[numGroups]
+ *   IconIndexEntry entries[numEntries] (sorted by name)
+ *   gchar where[whereLength + 1]
+ *   gchar strings[] (NUL-terminated icon names)
+ * The index is only used if index.theme and every group directory still
+ * have the mtimes recorded in it; otherwise the theme is rescanned and the
+ * index rewritten. mtimes are in nanoseconds, so that a theme updated within
+ * a second of being indexed (as during a package update) isn't missed.
+ */
+typedef struct
+{
+	guint32 magic;
+	guint32 version;
+	guint32 numGroups; // Includes groups which failed to load
+	guint32 numEntries;
+	guint64 themeMtime; // mtime of index.theme, in nanoseconds
+	guint32 whereLength;
+	guint32 pad;
+} IconIndexHeader;
+
+typedef struct
+{
+	guint32 nameOffset; // Into the string table
+	guint16 group; // Index into IconTheme.groups
+	guint8 extFlags;
+	guint8 pad;
+} IconIndexEntry;
+
 typedef struct
 {
 	gchar *name;
@@ -44,9 +85,24 @@ typedef struct
 	
 	// Key: icon name (string)
 	// Value: IconInfo * (a linked list)
+	// If the theme was loaded from an index, this only holds icons which
+	// have been looked up so far (including NULL values for misses).
 	GTree *icons;
+
+	GMappedFile *index;
+	const IconIndexEntry *indexEntries;
+	gsize numIndexEntries;
+	const gchar *indexStrings;
+	gsize indexStringsLength;
 } IconTheme;
 
+typedef struct
+{
+	gchar *key;
+	cairo_surface_t *surface;
+	gsize size; // In bytes
+} CachedSurface;
+
 struct _CmkIconLoader
 {
 	GObject parent;
@@ -54,8 +110,38 @@ struct _CmkIconLoader
 	gchar *setDefaultTheme;
 	GSettings *settings;
 	GTree *themes;
+
+	// Surface cache. Key: "<size>@<scale>:<path>", Value: GList * link in
+	// surfaceLru. The least recently used surface is at the tail of the queue.
+	GHashTable *surfaces;
+	GQueue surfaceLru;
+	gsize cacheSize;
+	gsize cacheBudget;
+	guint cacheHits, cacheMisses, cacheEvictions;
+
+	// Async loads in progress. Key: same as surfaces, Value: LoadJob *
+	GThreadPool *loadPool;
+	GHashTable *pendingLoads;
 };
 
+/*
+ * A surface being rasterized on the load pool. Every load_async request
+ * for the same (path, size, scale) while the job is running shares it.
+ */
+typedef struct
+{
+	CmkIconLoader *loader;
+	gchar *key;
+	gchar *path;
+	guint size; // Already multiplied by scale
+	gboolean cache;
+	GList *tasks; // GTask *, protected by the pending_tasks lock
+	gboolean skipped; // Every request was cancelled; protected by the lock
+	cairo_surface_t *surface;
+} LoadJob;
+
+G_LOCK_DEFINE_STATIC(pending_tasks);
+
 enum
 {
 	PROP_SCALE = 1,
@@ -71,6 +157,7 @@ static void cmk_icon_loader_get_property(GObject *self_, guint propertyId, GValu
 static void on_scale_changed(CmkIconLoader *self);
 static void on_default_theme_changed(CmkIconLoader *self);
 static void free_icon_theme(IconTheme *theme);
+static void free_cached_surface(CachedSurface *cached);
 
 G_DEFINE_TYPE(CmkIconLoader, cmk_icon_loader, G_TYPE_OBJECT);
 
@@ -110,12 +197,30 @@ static void cmk_icon_loader_init(CmkIconLoader *self)
 	self->settings = g_settings_new("org.gnome.desktop.interface");
 	g_signal_connect_swapped(self->settings, "changed::scaling-factor", G_CALLBACK(on_scale_changed), self);
 	g_signal_connect_swapped(self->settings, "changed::icon-theme", G_CALLBACK(on_default_theme_changed), self);
+
+	self->surfaces = g_hash_table_new(g_str_hash, g_str_equal);
+	g_queue_init(&self->surfaceLru);
+	self->pendingLoads = g_hash_table_new(g_str_hash, g_str_equal);
+	self->cacheBudget = DEFAULT_CACHE_SIZE;
+	const gchar *budget = g_getenv("CMK_ICON_CACHE_SIZE");
+	if(budget)
+		self->cacheBudget = g_ascii_strtoull(budget, NULL, 10) * 1024;
 }
 
 static void cmk_icon_loader_dispose(GObject *self_)
 {
 	CmkIconLoader *self = CMK_ICON_LOADER(self_);
+	// Pending jobs hold a ref on the loader, so there are none left unless
+	// g_object_run_dispose was used. Let the pool finish them.
+	if(self->loadPool)
+		g_thread_pool_free(self->loadPool, FALSE, TRUE);
+	self->loadPool = NULL;
+	g_clear_pointer(&self->pendingLoads, g_hash_table_unref);
 	g_clear_pointer(&self->themes, g_tree_unref);
+	g_clear_pointer(&self->surfaces, g_hash_table_unref);
+	g_queue_foreach(&self->surfaceLru, (GFunc)free_cached_surface, NULL);
+	g_queue_clear(&self->surfaceLru);
+	self->cacheSize = 0;
 	g_clear_pointer(&self->setDefaultTheme, g_free);
 	g_clear_object(&self->settings);
 	G_OBJECT_CLASS(cmk_icon_loader_parent_class)->dispose(self_);
@@ -222,6 +327,8 @@ static void free_icon_theme(IconTheme *theme)
 	g_free(theme->groups);
 	if(theme->icons)
 		g_tree_unref(theme->icons);
+	if(theme->index)
+		g_mapped_file_unref(theme->index);
 	g_free(theme);
 }
 
@@ -285,15 +392,19 @@ static void search_theme_group(IconTheme *theme, IconThemeGroup *group)
 	while(entry = g_dir_read_name(dir))
 	{
 		const gchar *extStart = g_strrstr(entry, ".");
-		gsize basenameLength = extStart - entry;
-		gchar *name = g_strndup(entry, basenameLength);
+		if(!extStart)
+			continue;
 		guint extFlag = fext_to_flag(extStart+1);
 		if(extFlag == 0)
 			continue;
 
+		gchar *name = g_strndup(entry, extStart - entry);
 		IconInfo *infoList = NULL;
 		if(g_tree_lookup_extended(theme->icons, name, NULL, (gpointer *)&infoList) && infoList)
+		{
 			icon_info_list_add(infoList, group, extFlag);
+			g_free(name);
+		}
 		else
 			g_tree_insert(theme->icons, name, icon_info_list_add(NULL, group, extFlag));
 	}
@@ -345,7 +456,215 @@ static gboolean load_theme_group(GKeyFile *index, IconThemeGroup *group)
 	return TRUE;
 }
 
-static IconTheme * load_theme_from(const gchar *themeName, const gchar *dir)
+// In nanoseconds, where the filesystem supports it
+static guint64 get_mtime(const gchar *path)
+{
+	GStatBuf buf;
+	if(g_stat(path, &buf) != 0)
+		return 0;
+	return (guint64)buf.st_mtim.tv_sec * G_GUINT64_CONSTANT(1000000000) + (guint64)buf.st_mtim.tv_nsec;
+}
+
+/*
+ * Returns an array of numGroups mtimes, one for each group directory (0 for
+ * groups which failed to load or don't exist). Free with g_free.
+ */
+static guint64 * get_theme_mtimes(IconTheme *theme, guint64 *themeMtime)
+{
+	gchar *path = g_strdup_printf("%s/index.theme", theme->where);
+	*themeMtime = get_mtime(path);
+	g_free(path);
+
+	guint64 *mtimes = g_new0(guint64, MAX(theme->numGroups, 1));
+	for(gsize i=0;i<theme->numGroups;++i)
+	{
+		if(!theme->groups[i].where)
+			continue;
+		path = g_strdup_printf("%s/%s/", theme->where, theme->groups[i].where);
+		mtimes[i] = get_mtime(path);
+		g_free(path);
+	}
+	return mtimes;
+}
+
+static gchar * get_theme_index_path(const gchar *themeName)
+{
+	gchar *filename = g_strdup_printf("%s.index", themeName);
+	gchar *path = g_build_filename(g_get_user_cache_dir(), "graphene", "icons", filename, NULL);
+	g_free(filename);
+	return path;
+}
+
+/*
+ * Maps the theme's index file, if one exists and is still valid for the
+ * given mtimes. On success, theme->icons is left empty and is filled in
+ * from the index as icons are looked up.
+ */
+static gboolean open_theme_index(IconTheme *theme, const guint64 *mtimes, guint64 themeMtime)
+{
+	gchar *path = get_theme_index_path(theme->name);
+	GMappedFile *file = g_mapped_file_new(path, FALSE, NULL);
+	g_free(path);
+	if(!file)
+		return FALSE;
+
+	const gchar *data = g_mapped_file_get_contents(file);
+	gsize length = g_mapped_file_get_length(file);
+	const IconIndexHeader *header = (const IconIndexHeader *)data;
+	
+	if(length < sizeof(IconIndexHeader)
+	|| header->magic != ICON_INDEX_MAGIC
+	|| header->version != ICON_INDEX_VERSION
+	|| header->numGroups != theme->numGroups
+	|| header->themeMtime != themeMtime)
+	{
+		g_mapped_file_unref(file);
+		return FALSE;
+	}
+
+	gsize entriesOffset = sizeof(IconIndexHeader) + header->numGroups * sizeof(guint64);
+	gsize whereOffset = entriesOffset + (gsize)header->numEntries * sizeof(IconIndexEntry);
+	gsize stringsOffset = whereOffset + header->whereLength + 1;
+	if(stringsOffset >= length || data[length-1] != '\0'
+	|| memcmp(data + sizeof(IconIndexHeader), mtimes, header->numGroups * sizeof(guint64)) != 0
+	|| strlen(theme->where) != header->whereLength
+	|| strcmp(data + whereOffset, theme->where) != 0)
+	{
+		g_mapped_file_unref(file);
+		return FALSE;
+	}
+
+	const IconIndexEntry *entries = (const IconIndexEntry *)(data + entriesOffset);
+	gsize stringsLength = length - stringsOffset;
+	for(gsize i=0;i<header->numEntries;++i)
+	{
+		if(entries[i].nameOffset >= stringsLength
+		|| entries[i].group >= theme->numGroups
+		|| !theme->groups[entries[i].group].where)
+		{
+			g_mapped_file_unref(file);
+			return FALSE;
+		}
+	}
+
+	theme->index = file;
+	theme->indexEntries = entries;
+	theme->numIndexEntries = header->numEntries;
+	theme->indexStrings = data + stringsOffset;
+	theme->indexStringsLength = stringsLength;
+	return TRUE;
+}
+
+typedef struct
+{
+	IconTheme *theme;
+	GArray *entries;
+	GString *strings;
+} IndexWriter;
+
+static gboolean index_writer_add(const gchar *name, IconInfo *infoList, IndexWriter *writer)
+{
+	IconIndexEntry entry = {0};
+	entry.nameOffset = writer->strings->len;
+	g_string_append_len(writer->strings, name, strlen(name) + 1);
+
+	// Entries are written in list order so the loaded list matches the
+	// scanned one exactly (best_icon_from_info_list depends on order)
+	for(IconInfo *it=infoList;it!=NULL;it=it->next)
+	{
+		entry.group = it->group - writer->theme->groups;
+		entry.extFlags = it->extFlags;
+		g_array_append_val(writer->entries, entry);
+	}
+	return FALSE;
+}
+
+static void write_theme_index(IconTheme *theme, const guint64 *mtimes, guint64 themeMtime)
+{
+	if(theme->numGroups > G_MAXUINT16)
+		return;
+
+	IndexWriter writer;
+	writer.theme = theme;
+	writer.entries = g_array_new(FALSE, FALSE, sizeof(IconIndexEntry));
+	writer.strings = g_string_new(NULL);
+	g_tree_foreach(theme->icons, (GTraverseFunc)index_writer_add, &writer);
+
+	IconIndexHeader header = {0};
+	header.magic = ICON_INDEX_MAGIC;
+	header.version = ICON_INDEX_VERSION;
+	header.numGroups = theme->numGroups;
+	header.numEntries = writer.entries->len;
+	header.themeMtime = themeMtime;
+	header.whereLength = strlen(theme->where);
+
+	GByteArray *data = g_byte_array_sized_new(sizeof(IconIndexHeader)
+		+ theme->numGroups * sizeof(guint64)
+		+ writer.entries->len * sizeof(IconIndexEntry)
+		+ header.whereLength + 1
+		+ writer.strings->len);
+	g_byte_array_append(data, (const guint8 *)&header, sizeof(IconIndexHeader));
+	g_byte_array_append(data, (const guint8 *)mtimes, theme->numGroups * sizeof(guint64));
+	g_byte_array_append(data, (const guint8 *)writer.entries->data, writer.entries->len * sizeof(IconIndexEntry));
+	g_byte_array_append(data, (const guint8 *)theme->where, header.whereLength + 1);
+	g_byte_array_append(data, (const guint8 *)writer.strings->str, writer.strings->len);
+	if(writer.strings->len == 0)
+		g_byte_array_append(data, (const guint8 *)"", 1);
+
+	gchar *path = get_theme_index_path(theme->name);
+	gchar *dir = g_path_get_dirname(path);
+	GError *error = NULL;
+	if(g_mkdir_with_parents(dir, 0755) != 0
+	|| !g_file_set_contents(path, (const gchar *)data->data, data->len, &error))
+	{
+		g_warning("Failed to write icon theme index '%s': %s", path, error ? error->message : g_strerror(errno));
+		g_clear_error(&error);
+	}
+	
+	g_free(dir);
+	g_free(path);
+	g_byte_array_unref(data);
+	g_array_unref(writer.entries);
+	g_string_free(writer.strings, TRUE);
+}
+
+/*
+ * Builds the IconInfo list for an icon from the mmap'd index, in the same
+ * order it was written.
+ */
+static IconInfo * index_lookup(IconTheme *theme, const gchar *name)
+{
+	gsize lo = 0, hi = theme->numIndexEntries;
+	while(lo < hi)
+	{
+		gsize mid = lo + (hi - lo) / 2;
+		if(strcmp(theme->indexStrings + theme->indexEntries[mid].nameOffset, name) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	IconInfo *base = NULL, *tail = NULL;
+	for(gsize i=lo;i<theme->numIndexEntries;++i)
+	{
+		const IconIndexEntry *entry = &theme->indexEntries[i];
+		if(strcmp(theme->indexStrings + entry->nameOffset, name) != 0)
+			break;
+		
+		IconInfo *info = g_new(IconInfo, 1);
+		info->group = &theme->groups[entry->group];
+		info->extFlags = entry->extFlags;
+		info->next = NULL;
+		if(tail)
+			tail->next = info;
+		else
+			base = info;
+		tail = info;
+	}
+	return base;
+}
+
+static IconTheme * load_theme_from(const gchar *themeName, const gchar *dir, gboolean rebuildIndex)
 {
 	gchar *path = g_strdup_printf("%s/%s/index.theme", dir, themeName);
 	GKeyFile *index = g_key_file_new();
@@ -368,7 +687,7 @@ static IconTheme * load_theme_from(const gchar *themeName, const gchar *dir)
 	if(!directories)
 	{
 		free_icon_theme(theme);
-		g_object_unref(index);
+		g_key_file_unref(index);
 		return NULL;
 	}
 	
@@ -380,10 +699,7 @@ static IconTheme * load_theme_from(const gchar *themeName, const gchar *dir)
 	{
 		theme->groups[i].where = directories[i];
 		if(load_theme_group(index, &theme->groups[i]))
-		{
-			search_theme_group(theme, &theme->groups[i]);
 			noGroups = FALSE;
-		}
 		else
 			g_clear_pointer(&(theme->groups[i].where), g_free);
 	}
@@ -394,36 +710,56 @@ static IconTheme * load_theme_from(const gchar *themeName, const gchar *dir)
 	if(noGroups)
 	{
 		free_icon_theme(theme);
-		theme = NULL;
+		return NULL;
 	}
+
+	guint64 themeMtime = 0;
+	guint64 *mtimes = get_theme_mtimes(theme, &themeMtime);
+	if(rebuildIndex || !open_theme_index(theme, mtimes, themeMtime))
+	{
+		for(gsize i=0;i<theme->numGroups;++i)
+			search_theme_group(theme, &theme->groups[i]);
+		write_theme_index(theme, mtimes, themeMtime);
+	}
+	g_free(mtimes);
 	return theme;
 }
 
-static IconTheme * load_theme(const gchar *name)
+static IconTheme * load_theme(const gchar *name, gboolean rebuildIndex)
 {
 	gchar *homeIconsDir = g_strdup_printf("%s/.icons", g_get_home_dir());
 	
 	IconTheme *theme;
-	if(theme = load_theme_from(name, homeIconsDir))
+	if(theme = load_theme_from(name, homeIconsDir, rebuildIndex))
 	{
 		g_free(homeIconsDir);
 		return theme;
 	}
 	g_free(homeIconsDir);
-	if(theme = load_theme_from(name, "/usr/share/local/icons"))
+	if(theme = load_theme_from(name, "/usr/share/local/icons", rebuildIndex))
 		return theme;
-	if(theme = load_theme_from(name, "/usr/share/icons"))
+	if(theme = load_theme_from(name, "/usr/share/icons", rebuildIndex))
 		return theme;
 	return NULL;
 }
 
+gboolean cmk_icon_loader_rebuild_index(const gchar *themeName)
+{
+	g_return_val_if_fail(themeName, FALSE);
+	IconTheme *theme = load_theme(themeName, TRUE);
+	if(!theme)
+		return FALSE;
+	free_icon_theme(theme);
+	return TRUE;
+}
+
 static IconTheme * get_theme(CmkIconLoader *self, const gchar *name)
 {
 	// TODO: Check for changes to directory mtime or index.theme
 	IconTheme *theme = g_tree_lookup(self->themes, name);
 	if(theme)
 		return theme;
-	theme = load_theme(name);
+	theme = load_theme(name, FALSE);
 	if(theme)
 		g_tree_insert(self->themes, g_strdup(name), theme);
 	return theme;
@@ -470,9 +806,21 @@ static IconInfo * best_icon_from_info_list(IconInfo *infoList, guint size, guint
 	return icon;
 }
 
+static IconInfo * get_icon_info_list(IconTheme *theme, const gchar *name)
+{
+	IconInfo *infoList = NULL;
+	if(g_tree_lookup_extended(theme->icons, name, NULL, (gpointer *)&infoList) || !theme->index)
+		return infoList;
+	
+	// Remember misses too, so repeated lookups don't search the index again
+	infoList = index_lookup(theme, name);
+	g_tree_insert(theme->icons, g_strdup(name), infoList);
+	return infoList;
+}
+
 static gchar * find_icon_in_theme(IconTheme *theme, const gchar *name, guint size, guint scale)
 {
-	IconInfo *infoList = g_tree_lookup(theme->icons, name);
+	IconInfo *infoList = get_icon_info_list(theme, name);
 	if(!infoList)
 		return NULL;
 	
@@ -614,23 +962,244 @@ static cairo_surface_t * load_png(const gchar *path, guint size)
 	return surface;
 }
 
+static cairo_surface_t * load_surface(const gchar *path, guint size)
+{
+	if(g_str_has_suffix(path, ".svg"))
+		return load_svg(path, size);
+	else if(g_str_has_suffix(path, ".png"))
+		return load_png(path, size);
+	// TODO: Support other image types
+	return NULL;
+}
+
+static void free_cached_surface(CachedSurface *cached)
+{
+	g_free(cached->key);
+	cairo_surface_destroy(cached->surface);
+	g_free(cached);
+}
+
+static void cache_evict_to(CmkIconLoader *self, gsize budget)
+{
+	while(self->cacheSize > budget && self->surfaceLru.tail)
+	{
+		CachedSurface *cached = g_queue_pop_tail(&self->surfaceLru);
+		g_hash_table_remove(self->surfaces, cached->key);
+		self->cacheSize -= cached->size;
+		++self->cacheEvictions;
+		free_cached_surface(cached);
+	}
+}
+
+static cairo_surface_t * cache_lookup(CmkIconLoader *self, const gchar *key)
+{
+	GList *link = g_hash_table_lookup(self->surfaces, key);
+	if(!link)
+	{
+		++self->cacheMisses;
+		return NULL;
+	}
+	
+	++self->cacheHits;
+	g_queue_unlink(&self->surfaceLru, link);
+	g_queue_push_head_link(&self->surfaceLru, link);
+	return cairo_surface_reference(((CachedSurface *)link->data)->surface);
+}
+
+static void cache_insert(CmkIconLoader *self, gchar *key, cairo_surface_t *surface)
+{
+	// A sync load and an async job for the same icon can both finish.
+	// Keep the surface that is already cached, so the table's key and
+	// link stay those of the entry in surfaceLru.
+	GList *existing = g_hash_table_lookup(self->surfaces, key);
+	if(existing)
+	{
+		g_queue_unlink(&self->surfaceLru, existing);
+		g_queue_push_head_link(&self->surfaceLru, existing);
+		g_free(key);
+		return;
+	}
+
+	gsize size = cairo_image_surface_get_stride(surface) * cairo_image_surface_get_height(surface);
+	if(size > self->cacheBudget)
+	{
+		g_free(key);
+		return;
+	}
+
+	cache_evict_to(self, self->cacheBudget - size);
+
+	CachedSurface *cached = g_new(CachedSurface, 1);
+	cached->key = key;
+	cached->surface = cairo_surface_reference(surface);
+	cached->size = size;
+	g_queue_push_head(&self->surfaceLru, cached);
+	g_hash_table_insert(self->surfaces, key, self->surfaceLru.head);
+	self->cacheSize += size;
+}
+
 cairo_surface_t * cmk_icon_loader_load(CmkIconLoader *self, const gchar *path, guint size, guint scale, gboolean cache)
 {
+	g_return_val_if_fail(CMK_IS_ICON_LOADER(self), NULL);
 	if(!path)
 		return NULL;
 
-	size *= scale;
+	gchar *key = g_strdup_printf("%u@%u:%s", size, scale, path);
+	cairo_surface_t *surface = cache_lookup(self, key);
+	if(surface)
+	{
+		g_free(key);
+		return surface;
+	}
 
-	cairo_surface_t *surface = NULL;
-	if(g_str_has_suffix(path, ".svg"))
-		surface = load_svg(path, size);
-	else if(g_str_has_suffix(path, ".png"))
-		surface = load_png(path, size);
-	
-	// TODO: Support other image types
+	surface = load_surface(path, size * scale);
+	if(surface && cache)
+		cache_insert(self, key, surface);
+	else
+		g_free(key);
 	return surface;
 }
 
+static void free_load_job(LoadJob *job)
+{
+	g_object_unref(job->loader);
+	g_free(job->key);
+	g_free(job->path);
+	if(job->surface)
+		cairo_surface_destroy(job->surface);
+	g_free(job);
+}
+
+static gboolean load_job_complete(LoadJob *job)
+{
+	CmkIconLoader *self = job->loader;
+	// A skipped job may have been replaced by a new one for the same key
+	if(self->pendingLoads && g_hash_table_lookup(self->pendingLoads, job->key) == job)
+		g_hash_table_remove(self->pendingLoads, job->key);
+	if(job->surface && job->cache && self->surfaces)
+		cache_insert(self, g_strdup(job->key), job->surface);
+
+	G_LOCK(pending_tasks);
+	GList *tasks = job->tasks;
+	job->tasks = NULL;
+	G_UNLOCK(pending_tasks);
+
+	for(GList *it=tasks;it!=NULL;it=it->next)
+	{
+		GTask *task = it->data;
+		if(!g_task_return_error_if_cancelled(task))
+			g_task_return_pointer(task, job->surface ? cairo_surface_reference(job->surface) : NULL, (GDestroyNotify)cairo_surface_destroy);
+		g_object_unref(task);
+	}
+	g_list_free(tasks);
+	free_load_job(job);
+	return G_SOURCE_REMOVE;
+}
+
+// Runs on a load pool thread
+static void load_job_run(LoadJob *job, CmkIconLoader *self)
+{
+	// Skip the rasterization if every request was cancelled while queued
+	gboolean wanted = FALSE;
+	G_LOCK(pending_tasks);
+	for(GList *it=job->tasks;it!=NULL && !wanted;it=it->next)
+		wanted = !g_cancellable_is_cancelled(g_task_get_cancellable(G_TASK(it->data)));
+	// Decided under the lock, so a request can't join a job which won't
+	// load anything; load_async starts a new job instead
+	job->skipped = !wanted;
+	G_UNLOCK(pending_tasks);
+
+	if(wanted)
+		job->surface = load_surface(job->path, job->size);
+	g_main_context_invoke(NULL, (GSourceFunc)load_job_complete, job);
+}
+
+void cmk_icon_loader_load_async(CmkIconLoader *self, const gchar *path, guint size, guint scale, gboolean cache, GCancellable *cancellable, GAsyncReadyCallback callback, gpointer userdata)
+{
+	g_return_if_fail(CMK_IS_ICON_LOADER(self));
+
+	GTask *task = g_task_new(self, cancellable, callback, userdata);
+	g_task_set_source_tag(task, cmk_icon_loader_load_async);
+	if(!path)
+	{
+		g_task_return_pointer(task, NULL, NULL);
+		g_object_unref(task);
+		return;
+	}
+	
+	gchar *key = g_strdup_printf("%u@%u:%s", size, scale, path);
+	cairo_surface_t *surface = cache_lookup(self, key);
+	if(surface)
+	{
+		g_free(key);
+		g_task_return_pointer(task, surface, (GDestroyNotify)cairo_surface_destroy);
+		g_object_unref(task);
+		return;
+	}
+
+	LoadJob *job = g_hash_table_lookup(self->pendingLoads, key);
+	if(job)
+	{
+		G_LOCK(pending_tasks);
+		gboolean joined = !job->skipped;
+		if(joined)
+			job->tasks = g_list_prepend(job->tasks, task);
+		G_UNLOCK(pending_tasks);
+		if(joined)
+		{
+			g_free(key);
+			job->cache |= cache;
+			return;
+		}
+	}
+	
+	job = g_new0(LoadJob, 1);
+	job->loader = g_object_ref(self);
+	job->key = key;
+	job->path = g_strdup(path);
+	job->size = size * scale;
+	job->cache = cache;
+	job->tasks = g_list_prepend(NULL, task);
+	// Replaces the key too, since the key belongs to the job
+	g_hash_table_replace(self->pendingLoads, key, job);
+
+	if(!self->loadPool)
+		self->loadPool = g_thread_pool_new((GFunc)load_job_run, self, CLAMP(g_get_num_processors(), 1, 4), FALSE, NULL);
+	g_thread_pool_push(self->loadPool, job, NULL);
+}
+
+cairo_surface_t * cmk_icon_loader_load_finish(CmkIconLoader *self, GAsyncResult *result, GError **error)
+{
+	g_return_val_if_fail(g_task_is_valid(result, self), NULL);
+	return g_task_propagate_pointer(G_TASK(result), error);
+}
+
+void cmk_icon_loader_set_cache_size(CmkIconLoader *self, gsize bytes)
+{
+	g_return_if_fail(CMK_IS_ICON_LOADER(self));
+	self->cacheBudget = bytes;
+	cache_evict_to(self, bytes);
+}
+
+gsize cmk_icon_loader_get_cache_size(CmkIconLoader *self)
+{
+	g_return_val_if_fail(CMK_IS_ICON_LOADER(self), 0);
+	return self->cacheBudget;
+}
+
+void cmk_icon_loader_get_cache_stats(CmkIconLoader *self, guint *hits, guint *misses, guint *evictions, gsize *bytesUsed)
+{
+	g_return_if_fail(CMK_IS_ICON_LOADER(self));
+	if(hits)
+		*hits = self->cacheHits;
+	if(misses)
+		*misses = self->cacheMisses;
+	if(evictions)
+		*evictions = self->cacheEvictions;
+	if(bytesUsed)
+		*bytesUsed = self->cacheSize;
+}
+
 cairo_surface_t * cmk_icon_loader_get(CmkIconLoader *self, const gchar *name, guint size)
 {
 	guint scale = cmk_icon_loader_get_scale(self);
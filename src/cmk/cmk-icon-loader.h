@@ -7,7 +7,7 @@
 #ifndef __CMK_ICON_LOADER_H__
 #define __CMK_ICON_LOADER_H__
 
-#include <glib-object.h>
+#include <gio/gio.h>
 #include <cairo.h>
 
 G_BEGIN_DECLS
@@ -43,6 +43,15 @@ const gchar * cmk_icon_loader_get_default_theme(CmkIconLoader *loader);
  * Set the value returned by get_default_theme. If NUjj
  */
 
+/*
+ * Rescans the named icon theme and rewrites its on-disk index in
+ * $XDG_CACHE_HOME/graphene/icons. Themes are normally indexed automatically
+ * the first time they are loaded, and reindexed whenever index.theme or one
+ * of the theme's directories has a different mtime than when the index was
+ * written. Returns FALSE if the theme could not be found.
+ */
+gboolean cmk_icon_loader_rebuild_index(const gchar *themeName);
+
 /*
  * Lookup an icon's file path using the current default icon theme.
  * Equivelent to calling
@@ -76,9 +85,41 @@ gchar * cmk_icon_loader_lookup_full(CmkIconLoader *self, const gchar *name, gboo
  * match the given size. The returned surface's size should always be checked
  * with cairo_image_surface_check_width/height, and be scaled if necessary.
  * Free the returned surface with cairo_surface_destroy.
+ * The surface may be shared with other callers through the cache, so it
+ * must not be drawn to.
  */
 cairo_surface_t * cmk_icon_loader_load(CmkIconLoader *loader, const gchar *path, guint size, guint scale, gboolean cache);
 
+/*
+ * Same as cmk_icon_loader_load, but rasterizes the icon on a worker thread.
+ * The callback is called on the main context; get the surface with
+ * cmk_icon_loader_load_finish. Simultaneous requests for the same icon share
+ * one load, and a load is skipped if all of its requests are cancelled
+ * before it starts. path may be NULL, which results in a NULL surface.
+ */
+void cmk_icon_loader_load_async(CmkIconLoader *loader, const gchar *path, guint size, guint scale, gboolean cache, GCancellable *cancellable, GAsyncReadyCallback callback, gpointer userdata);
+
+/*
+ * Returns the surface loaded by cmk_icon_loader_load_async, or NULL if the
+ * icon could not be loaded or the request was cancelled (in which case
+ * error is set). Free the returned surface with cairo_surface_destroy.
+ */
+cairo_surface_t * cmk_icon_loader_load_finish(CmkIconLoader *loader, GAsyncResult *result, GError **error);
+
+/*
+ * Sets the maximum number of bytes of surface data kept in the loader's
+ * icon cache. Least recently used surfaces are dropped to fit the budget.
+ * The default is 8 MiB, or the value of the CMK_ICON_CACHE_SIZE environment
+ * variable (in KiB) if it is set.
+ */
+void cmk_icon_loader_set_cache_size(CmkIconLoader *loader, gsize bytes);
+gsize cmk_icon_loader_get_cache_size(CmkIconLoader *loader);
+
+/*
+ * Gets cache counters since the loader was created. Any argument may be NULL.
+ */
+void cmk_icon_loader_get_cache_stats(CmkIconLoader *loader, guint *hits, guint *misses, guint *evictions, gsize *bytesUsed);
+
 /*
  * Shorthand for calling lookup and load.
  */
@@ -15,6 +15,7 @@ struct _CmkIconPrivate
 	gboolean useForegroundColor;
 	CmkIconLoader *loader;
 	cairo_surface_t *iconSurface;
+	GCancellable *loadCancellable; // Cancels the in-progress icon load, if any
 
 	// A size "request" for the actor. Can be scaled by the style scale
 	// factor. If this is <=0, the actor's standard allocated size is used.
@@ -40,6 +41,7 @@ static void on_background_changed(CmkWidget *self_);
 static void on_default_icon_theme_changed(CmkIcon *self);
 static gboolean on_draw_canvas(ClutterCanvas *canvas, cairo_t *cr, int width, int height, CmkIcon *self);
 static void update_canvas(ClutterActor *self_);
+static void on_icon_loaded(CmkIconLoader *loader, GAsyncResult *result, CmkIcon *self);
 
 G_DEFINE_TYPE_WITH_PRIVATE(CmkIcon, cmk_icon, CMK_TYPE_WIDGET);
 #define PRIVATE(icon) ((CmkIconPrivate *)cmk_icon_get_instance_private(icon))
@@ -99,6 +101,9 @@ static void cmk_icon_init(CmkIcon *self)
 static void cmk_icon_dispose(GObject *self_)
 {
 	CmkIconPrivate *private = PRIVATE(CMK_ICON(self_));
+	if(private->loadCancellable)
+		g_cancellable_cancel(private->loadCancellable);
+	g_clear_object(&private->loadCancellable);
 	g_clear_object(&private->loader);
 	g_clear_pointer(&private->iconSurface, cairo_surface_destroy);
 	g_clear_pointer(&private->iconName, g_free);
@@ -209,7 +214,11 @@ static void update_canvas(ClutterActor *self_)
 	ClutterCanvas *canvas = CLUTTER_CANVAS(clutter_actor_get_content(self_));
 
 	CmkIconPrivate *private = PRIVATE(CMK_ICON(self_));
-	g_clear_pointer(&private->iconSurface, cairo_surface_destroy);
+	if(private->loadCancellable)
+	{
+		g_cancellable_cancel(private->loadCancellable);
+		g_clear_object(&private->loadCancellable);
+	}
 
 	guint scale = cmk_icon_loader_get_scale(private->loader);
 	gfloat width, height;
@@ -222,16 +231,43 @@ static void update_canvas(ClutterActor *self_)
 //	else
 		unscaledSize = size / scale;
 
+	gchar *path = NULL;
 	if(private->iconName)
+		path = cmk_icon_loader_lookup_full(private->loader, private->iconName, TRUE, private->themeName, TRUE, unscaledSize, scale);
+	
+	// Keep drawing the previous surface until the new one is loaded
+	if(path)
 	{
-		gchar *path = cmk_icon_loader_lookup_full(private->loader, private->iconName, TRUE, private->themeName, TRUE, unscaledSize, scale);
-		private->iconSurface = cmk_icon_loader_load(private->loader, path, unscaledSize, scale, TRUE);
+		private->loadCancellable = g_cancellable_new();
+		cmk_icon_loader_load_async(private->loader, path, unscaledSize, scale, TRUE, private->loadCancellable, (GAsyncReadyCallback)on_icon_loaded, g_object_ref(self_));
+		g_free(path);
 	}
+	else
+		g_clear_pointer(&private->iconSurface, cairo_surface_destroy);
 	
 	if(!clutter_canvas_set_size(canvas, size, size))
 		clutter_content_invalidate(CLUTTER_CONTENT(canvas));
 }
 
+static void on_icon_loaded(CmkIconLoader *loader, GAsyncResult *result, CmkIcon *self)
+{
+	GError *error = NULL;
+	cairo_surface_t *surface = cmk_icon_loader_load_finish(loader, result, &error);
+	if(error) // Cancelled; a newer load is in progress or the icon is gone
+	{
+		g_error_free(error);
+		g_object_unref(self);
+		return;
+	}
+
+	CmkIconPrivate *private = PRIVATE(self);
+	g_clear_object(&private->loadCancellable);
+	g_clear_pointer(&private->iconSurface, cairo_surface_destroy);
+	private->iconSurface = surface;
+	clutter_content_invalidate(clutter_actor_get_content(CLUTTER_ACTOR(self)));
+	g_object_unref(self);
+}
+
 void cmk_icon_set_icon(CmkIcon *self, const gchar *iconName)
 {
 	g_return_if_fail(CMK_IS_ICON(self));
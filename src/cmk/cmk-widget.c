@@ -6,12 +6,31 @@
 
 #include "cmk-widget.h"
 
+/*
+ * Style values as inherited through the widget's style parents, so that the
+ * getters don't have to walk the parent chain each time. A snapshot can only
+ * depend on the widget's style ancestors, so a style change (or a change of
+ * style parent) invalidates the snapshots of that widget and its style
+ * descendants, and no others; see invalidate_resolved_style.
+ */
+typedef struct
+{
+	gboolean valid;
+	float bevelRadius;
+	float padding; // Already scaled
+	float scaleFactor;
+	const gchar *backgroundColorName; // Owned by this widget or a style parent
+	const ClutterColor *foregroundColor; // NULL until first requested
+	GHashTable *colors; // GQuark -> const ClutterColor *, NULL value for not found
+} ResolvedStyle;
+
 typedef struct _CmkWidgetPrivate CmkWidgetPrivate;
 struct _CmkWidgetPrivate
 {
 	CmkWidget *styleParent; // Not ref'd
 	CmkWidget *actualStyleParent; // styleParent, real parent, or NULL (not ref'd)
-	GHashTable *colors;
+	GHashTable *colors; // GQuark -> ClutterColor
+	ResolvedStyle resolved;
 	float bevelRadius;
 	float padding;
 	float scaleFactor;
@@ -19,7 +38,8 @@ struct _CmkWidgetPrivate
 	gchar *backgroundColorName;
 	gboolean drawBackground;
 
-	gboolean emittingStyleChanged;
+	GList *styleChildren; // Widgets with this as their actualStyleParent
+	guint dirty; // StyleDirtyFlags waiting for the next flush_style
 	gboolean disposed; // Various callbacks (ex clutter canvas draws) like to emit even after their actor has been disposed. This is checked to avoid runtime "CRITICAL" messages on disposed objects (and unnecessary processing)
 };
 
@@ -37,20 +57,34 @@ enum
 	SIGNAL_LAST
 };
 
+typedef enum
+{
+	STYLE_DIRTY_BACKGROUND = 1 << 0, // Emit background-changed
+	STYLE_DIRTY_STYLE = 1 << 1, // Emit style-changed and background-changed
+} StyleDirtyFlags;
+
 static GParamSpec *properties[PROP_LAST];
 static guint signals[SIGNAL_LAST];
 
+// Style changes are batched and sent down the style tree once per frame;
+// see flush_style
+static GPtrArray *dirtyWidgets = NULL; // Ref'd
+static guint flushStyleId = 0;
+static guint statFlushes = 0, statStyleChanged = 0, statBackgroundChanged = 0;
+
 static void cmk_widget_constructed(GObject *self_);
 static void cmk_widget_dispose(GObject *self_);
 static void cmk_widget_set_property(GObject *self_, guint propertyId, const GValue *value, GParamSpec *pspec);
 static void cmk_widget_get_property(GObject *self_, guint propertyId, GValue *value, GParamSpec *pspec);
 static void emit_style_changed(CmkWidget *self);
+static void emit_background_changed(CmkWidget *self);
 static void on_parent_changed(ClutterActor *self_, ClutterActor *prevParent);
 static void set_actual_style_parent(CmkWidget *self, CmkWidget *parent);
 static void update_actual_style_parent(CmkWidget *self);
 static void on_style_changed(CmkWidget *self);
 static void on_background_changed(CmkWidget *self);
 static void update_named_background_color(CmkWidget *self);
+static void invalidate_resolved_style(CmkWidget *self);
 
 G_DEFINE_TYPE_WITH_PRIVATE(CmkWidget, cmk_widget, CLUTTER_TYPE_ACTOR);
 #define PRIVATE(widget) ((CmkWidgetPrivate *)cmk_widget_get_instance_private(widget))
@@ -95,28 +129,35 @@ static void cmk_widget_class_init(CmkWidgetClass *class)
 static void cmk_widget_init(CmkWidget *self)
 {
 	CmkWidgetPrivate *private = PRIVATE(self);
-	private->colors = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)clutter_color_free);
+	private->colors = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)clutter_color_free);
+	private->resolved.colors = g_hash_table_new(g_direct_hash, g_direct_equal);
 	private->padding = -1;
 	private->bevelRadius = -1;
 	private->scaleFactor = -1;
-	private->emittingStyleChanged = TRUE;
 	set_actual_style_parent(self, styleDefault);
-	private->emittingStyleChanged = FALSE;
 }
 
 static void cmk_widget_constructed(GObject *self_)
 {
-	emit_style_changed(CMK_WIDGET(self_));
+	// Subclasses expect their style to be set up as soon as they're
+	// constructed, so don't wait for the flush
+	CmkWidget *self = CMK_WIDGET(self_);
+	PRIVATE(self)->dirty = 0;
+	g_signal_emit(self, signals[SIGNAL_STYLE_CHANGED], 0);
+	g_signal_emit(self, signals[SIGNAL_BACKGROUND_CHANGED], 0);
 }
 
 static void cmk_widget_dispose(GObject *self_)
 {
 	CmkWidgetPrivate *private = PRIVATE(CMK_WIDGET(self_));
+	private->disposed = TRUE; // Before unsetting the style parent, so no flush is queued
+	invalidate_resolved_style(CMK_WIDGET(self_)); // Descendants' snapshots may point into this one
 	private->styleParent = NULL;
 	set_actual_style_parent(CMK_WIDGET(self_), NULL);
+	g_clear_pointer(&private->styleChildren, g_list_free);
 	g_clear_pointer(&private->colors, g_hash_table_unref);
+	g_clear_pointer(&private->resolved.colors, g_hash_table_unref);
 	g_clear_pointer(&private->backgroundColorName, g_free);
-	private->disposed = TRUE;
 	G_OBJECT_CLASS(cmk_widget_parent_class)->dispose(self_);
 }
 
@@ -158,15 +199,203 @@ gboolean cmk_widget_destroy(CmkWidget *widget)
 	return G_SOURCE_REMOVE;
 }
 
-static void emit_style_changed(CmkWidget *self)
+static gboolean has_dirty_style_ancestor(CmkWidget *self)
+{
+	for(CmkWidget *w=PRIVATE(self)->actualStyleParent;w;w=PRIVATE(w)->actualStyleParent)
+		if(!PRIVATE(w)->disposed && (PRIVATE(w)->dirty & STYLE_DIRTY_STYLE))
+			return TRUE;
+	return FALSE;
+}
+
+/*
+ * Emits the widget's pending style signals, and those its style children
+ * inherit from it, depth-first. inherited is the StyleDirtyFlags emitted on
+ * the style parent. A widget is reached once per round of flush_style, so
+ * each change reaches each widget once; a style parent which changes again
+ * in a later round passes that change down again.
+ */
+static void flush_style_widget(CmkWidget *self, guint inherited)
 {
 	CmkWidgetPrivate *private = PRIVATE(self);
-	if(private->emittingStyleChanged)
+	if(private->disposed)
 		return;
-	// Set to FALSE in on_style_changed, the top-level object signal handler for the style changed signal
-	// This helps with signal recursion when settings styles in the on_style_changed callback (which is called both when the parent style changes or when the current style changes). The style set handlers check for this anyway, but this removes a little extra work.
-	private->emittingStyleChanged = TRUE;
-	g_signal_emit(self, signals[SIGNAL_STYLE_CHANGED], 0);
+
+	guint own = private->dirty;
+	private->dirty = 0;
+
+	gboolean style = (own | inherited) & STYLE_DIRTY_STYLE;
+	// A widget with its own background color doesn't change with its parent's
+	gboolean background = style
+		|| (own & STYLE_DIRTY_BACKGROUND)
+		|| ((inherited & STYLE_DIRTY_BACKGROUND) && !private->backgroundColorName);
+	if(!style && !background)
+		return;
+
+	guint emitted = (style ? STYLE_DIRTY_STYLE : 0) | (background ? STYLE_DIRTY_BACKGROUND : 0);
+
+	g_object_ref(self);
+	if(style)
+	{
+		g_signal_emit(self, signals[SIGNAL_STYLE_CHANGED], 0);
+		++statStyleChanged;
+	}
+	if(background)
+	{
+		g_signal_emit(self, signals[SIGNAL_BACKGROUND_CHANGED], 0);
+		++statBackgroundChanged;
+	}
+
+	// Handlers may reparent or destroy children, so walk a copy
+	GList *children = g_list_copy_deep(private->styleChildren, (GCopyFunc)g_object_ref, NULL);
+	for(GList *it=children;it;it=it->next)
+		flush_style_widget(CMK_WIDGET(it->data), emitted);
+	g_list_free_full(children, g_object_unref);
+	g_object_unref(self);
+}
+
+/*
+ * Runs before the next frame is drawn. Style changes made by the signal
+ * handlers are flushed in the same call, as long as they settle.
+ */
+static gboolean flush_style(gpointer userdata)
+{
+	flushStyleId = 0;
+	++statFlushes;
+
+	for(guint round=0;dirtyWidgets && dirtyWidgets->len > 0;++round)
+	{
+		if(round == 8)
+		{
+			g_warning("CmkWidget style changes keep causing more style changes");
+			flushStyleId = g_idle_add_full(CLUTTER_PRIORITY_REDRAW - 10, flush_style, NULL, NULL);
+			break;
+		}
+
+		GPtrArray *roots = dirtyWidgets;
+		dirtyWidgets = g_ptr_array_new_with_free_func(g_object_unref);
+		for(guint i=0;i<roots->len;++i)
+		{
+			CmkWidget *root = g_ptr_array_index(roots, i);
+			// Widgets under another dirty widget are reached from there
+			if(!PRIVATE(root)->dirty || has_dirty_style_ancestor(root))
+				continue;
+			flush_style_widget(root, 0);
+		}
+		g_ptr_array_unref(roots);
+	}
+	return G_SOURCE_REMOVE;
+}
+
+static void queue_style_flush(CmkWidget *self, StyleDirtyFlags flags)
+{
+	CmkWidgetPrivate *private = PRIVATE(self);
+	if(private->disposed)
+		return;
+	if(!private->dirty)
+	{
+		if(!dirtyWidgets)
+			dirtyWidgets = g_ptr_array_new_with_free_func(g_object_unref);
+		g_ptr_array_add(dirtyWidgets, g_object_ref(self));
+	}
+	private->dirty |= flags;
+	if(!flushStyleId)
+		flushStyleId = g_idle_add_full(CLUTTER_PRIORITY_REDRAW - 10, flush_style, NULL, NULL);
+}
+
+static void emit_style_changed(CmkWidget *self)
+{
+	queue_style_flush(self, STYLE_DIRTY_STYLE);
+}
+
+static void emit_background_changed(CmkWidget *self)
+{
+	queue_style_flush(self, STYLE_DIRTY_BACKGROUND);
+}
+
+void cmk_widget_get_style_stats(guint *flushes, guint *styleChanged, guint *backgroundChanged)
+{
+	if(flushes)
+		*flushes = statFlushes;
+	if(styleChanged)
+		*styleChanged = statStyleChanged;
+	if(backgroundChanged)
+		*backgroundChanged = statBackgroundChanged;
+}
+
+/*
+ * Drops the ResolvedStyle snapshots of the widget and of its style
+ * descendants, the only widgets which inherit from it. A new widget has no
+ * style children, so creating and destroying leaf widgets (tasklist
+ * buttons, notifications) only touches their own snapshot.
+ */
+static void invalidate_resolved_style(CmkWidget *self)
+{
+	CmkWidgetPrivate *private = PRIVATE(self);
+	private->resolved.valid = FALSE;
+	for(GList *it=private->styleChildren;it;it=it->next)
+		invalidate_resolved_style(CMK_WIDGET(it->data));
+}
+
+/*
+ * Brings the widget's ResolvedStyle up to date, if any style has changed
+ * since it was last resolved. Colors are resolved individually as they are
+ * requested.
+ */
+static ResolvedStyle * get_resolved_style(CmkWidget *self)
+{
+	CmkWidgetPrivate *private = PRIVATE(self);
+	ResolvedStyle *resolved = &private->resolved;
+	if(resolved->valid)
+		return resolved;
+
+	resolved->bevelRadius = -1;
+	resolved->padding = -1;
+	resolved->scaleFactor = -1;
+	resolved->backgroundColorName = NULL;
+	resolved->foregroundColor = NULL;
+	g_hash_table_remove_all(resolved->colors);
+
+	for(CmkWidget *w=self;w;w=PRIVATE(w)->actualStyleParent)
+	{
+		CmkWidgetPrivate *p = PRIVATE(w);
+		if(p->disposed)
+			break;
+		if(resolved->bevelRadius < 0 && p->bevelRadius >= 0)
+			resolved->bevelRadius = p->bevelRadius; // TODO: Scale factor
+		if(resolved->padding < 0 && p->padding >= 0)
+			resolved->padding = p->padding;
+		if(resolved->scaleFactor < 0 && p->scaleFactor >= 0)
+			resolved->scaleFactor = p->scaleFactor;
+		if(!resolved->backgroundColorName && p->backgroundColorName)
+			resolved->backgroundColorName = p->backgroundColorName;
+	}
+
+	if(resolved->bevelRadius < 0)
+		resolved->bevelRadius = 0;
+	if(resolved->scaleFactor < 0)
+		resolved->scaleFactor = 1;
+	// Padding is scaled by this widget's scale, not the scale where it was set
+	resolved->padding = (resolved->padding < 0) ? 0 : resolved->padding * resolved->scaleFactor;
+
+	resolved->valid = TRUE;
+	return resolved;
+}
+
+static const ClutterColor * get_color_by_quark(CmkWidget *self, GQuark name)
+{
+	ResolvedStyle *resolved = get_resolved_style(self);
+	gpointer color = NULL;
+	if(g_hash_table_lookup_extended(resolved->colors, GUINT_TO_POINTER(name), NULL, &color))
+		return color;
+
+	for(CmkWidget *w=self;w && !color;w=PRIVATE(w)->actualStyleParent)
+	{
+		if(PRIVATE(w)->disposed)
+			break;
+		color = g_hash_table_lookup(PRIVATE(w)->colors, GUINT_TO_POINTER(name));
+	}
+	g_hash_table_insert(resolved->colors, GUINT_TO_POINTER(name), color);
+	return color;
 }
 
 const ClutterColor * cmk_widget_style_get_color(CmkWidget *self, const gchar *name)
@@ -175,23 +404,20 @@ const ClutterColor * cmk_widget_style_get_color(CmkWidget *self, const gchar *na
 	CmkWidgetPrivate *private = PRIVATE(self);
 	if(G_UNLIKELY(!name || private->disposed))
 		return NULL;
-	const ClutterColor *ret = NULL;
-	if(g_hash_table_size(private->colors) > 0)
-		ret = g_hash_table_lookup(private->colors, name);
-	if(ret)
-		return ret;
-	if(private->actualStyleParent)
-		return cmk_widget_style_get_color(private->actualStyleParent, name);
-	return NULL;
+	// A name which was never interned can't have been set on any widget
+	GQuark quark = g_quark_try_string(name);
+	if(!quark)
+		return NULL;
+	return get_color_by_quark(self, quark);
 }
 
 void cmk_widget_style_set_color(CmkWidget *self, const gchar *name, const ClutterColor *color)
 {
 	g_return_if_fail(CMK_IS_WIDGET(self));
 	ClutterColor *c = clutter_color_copy(color);
-	g_hash_table_insert(PRIVATE(self)->colors, g_strdup(name), c);
-	emit_style_changed(self);
-	g_signal_emit(self, signals[SIGNAL_BACKGROUND_CHANGED], 0);
+	g_hash_table_insert(PRIVATE(self)->colors, GUINT_TO_POINTER(g_quark_from_string(name)), c);
+	invalidate_resolved_style(self);
+	emit_style_changed(self); // Includes background-changed
 }
 
 void cmk_widget_style_set_bevel_radius(CmkWidget *self, float radius)
@@ -201,20 +427,18 @@ void cmk_widget_style_set_bevel_radius(CmkWidget *self, float radius)
 	gboolean diff = (radius != PRIVATE(self)->bevelRadius);
 	PRIVATE(self)->bevelRadius = radius;
 	if(diff)
+	{
+		invalidate_resolved_style(self);
 		emit_style_changed(self);
+	}
 }
 
 float cmk_widget_style_get_bevel_radius(CmkWidget *self)
 {
 	g_return_val_if_fail(CMK_IS_WIDGET(self), 0);
-	CmkWidgetPrivate *private = PRIVATE(self);
-	if(G_UNLIKELY(private->disposed))
+	if(G_UNLIKELY(PRIVATE(self)->disposed))
 		return 0;
-	if(private->bevelRadius >= 0)
-		return private->bevelRadius; // TODO: Scale factor
-	if(private->actualStyleParent)
-		return cmk_widget_style_get_bevel_radius(private->actualStyleParent);
-	return 0;
+	return get_resolved_style(self)->bevelRadius;
 }
 
 void cmk_widget_style_set_padding(CmkWidget *self, float padding)
@@ -224,25 +448,18 @@ void cmk_widget_style_set_padding(CmkWidget *self, float padding)
 	gboolean diff = (padding != PRIVATE(self)->padding);
 	PRIVATE(self)->padding = padding;
 	if(diff)
+	{
+		invalidate_resolved_style(self);
 		emit_style_changed(self);
-}
-
-static float _cmk_widget_style_get_padding_internal(CmkWidget *self, CmkWidget *origin)
-{
-	CmkWidgetPrivate *private = PRIVATE(self);
-	if(G_UNLIKELY(private->disposed))
-		return 0;
-	if(private->padding >= 0)
-		return private->padding * cmk_widget_style_get_scale_factor(origin);
-	if(private->actualStyleParent)
-		return _cmk_widget_style_get_padding_internal(private->actualStyleParent, origin);
-	return 0;
+	}
 }
 
 float cmk_widget_style_get_padding(CmkWidget *self)
 {
 	g_return_val_if_fail(CMK_IS_WIDGET(self), 0);
-	return _cmk_widget_style_get_padding_internal(self, self);
+	if(G_UNLIKELY(PRIVATE(self)->disposed))
+		return 0;
+	return get_resolved_style(self)->padding;
 }
 
 void cmk_widget_style_set_scale_factor(CmkWidget *self, float scale)
@@ -252,20 +469,18 @@ void cmk_widget_style_set_scale_factor(CmkWidget *self, float scale)
 	gboolean diff = (scale != PRIVATE(self)->scaleFactor);
 	PRIVATE(self)->scaleFactor = scale;
 	if(diff)
+	{
+		invalidate_resolved_style(self);
 		emit_style_changed(self);
+	}
 }
 
 float cmk_widget_style_get_scale_factor(CmkWidget *self)
 {
 	g_return_val_if_fail(CMK_IS_WIDGET(self), 0);
-	CmkWidgetPrivate *private = PRIVATE(self);
-	if(G_UNLIKELY(private->disposed))
+	if(G_UNLIKELY(PRIVATE(self)->disposed))
 		return 1;
-	if(private->scaleFactor >= 0)
-		return private->scaleFactor;
-	if(private->actualStyleParent)
-		return cmk_widget_style_get_scale_factor(private->actualStyleParent);
-	return 1;
+	return get_resolved_style(self)->scaleFactor;
 }
 
 const ClutterColor * cmk_widget_get_foreground_color(CmkWidget *self)
@@ -275,37 +490,23 @@ const ClutterColor * cmk_widget_get_foreground_color(CmkWidget *self)
 	if(G_UNLIKELY(PRIVATE(self)->disposed))
 		return black;
 
-	const gchar *bgColor = cmk_widget_get_background_color_name(self);
+	ResolvedStyle *resolved = get_resolved_style(self);
+	if(resolved->foregroundColor)
+		return resolved->foregroundColor;
+
 	const ClutterColor *color = NULL;
-	if(bgColor)
+	if(resolved->backgroundColorName)
 	{
-		gchar *name = g_strdup_printf("%s-foreground", bgColor);
+		gchar *name = g_strdup_printf("%s-foreground", resolved->backgroundColorName);
 		color = cmk_widget_style_get_color(self, name);
 		g_free(name);
-		if(color)
-			return color;
 	}
-	color = cmk_widget_style_get_color(self, "foreground");
-	if(color)
-		return color;
-	return black;
+	if(!color)
+		color = get_color_by_quark(self, g_quark_from_static_string("foreground"));
+	resolved->foregroundColor = color ? color : black;
+	return resolved->foregroundColor;
 } 
 
-static void on_style_parent_style_changed(CmkWidget *self)
-{
-	// Relay signal
-	emit_style_changed(self);
-	g_signal_emit(self, signals[SIGNAL_BACKGROUND_CHANGED], 0);
-}
-
-static void on_style_parent_background_changed(CmkWidget *self)
-{
-	g_return_if_fail(CMK_IS_WIDGET(self));
-	// Only say we've changed colors if we're not drawing our own background
-	if(!PRIVATE(self)->backgroundColorName)
-		g_signal_emit(self, signals[SIGNAL_BACKGROUND_CHANGED], 0);
-}
-
 static void on_style_parent_destroy(CmkWidget *self, CmkWidget *styleParent)
 {
 	if(PRIVATE(self)->styleParent == styleParent)
@@ -326,21 +527,21 @@ static void set_actual_style_parent(CmkWidget *self, CmkWidget *parent)
 		return;
 	if(private->actualStyleParent)
 	{
-		g_signal_handlers_disconnect_by_func(private->actualStyleParent, G_CALLBACK(on_style_parent_style_changed), self);
-		g_signal_handlers_disconnect_by_func(private->actualStyleParent, G_CALLBACK(on_style_parent_background_changed), self);
+		CmkWidgetPrivate *oldParent = PRIVATE(private->actualStyleParent);
+		oldParent->styleChildren = g_list_remove(oldParent->styleChildren, self);
 		g_signal_handlers_disconnect_by_func(private->actualStyleParent, G_CALLBACK(on_style_parent_destroy), self);
 	}
 	
 	private->actualStyleParent = parent;
+	invalidate_resolved_style(self);
 	if(parent)
 	{
-		g_signal_connect_swapped(private->actualStyleParent, "style-changed", G_CALLBACK(on_style_parent_style_changed), self);
-		g_signal_connect_swapped(private->actualStyleParent, "background-changed", G_CALLBACK(on_style_parent_background_changed), self);
+		// Style changes reach the widget through this list; see flush_style
+		PRIVATE(parent)->styleChildren = g_list_prepend(PRIVATE(parent)->styleChildren, self);
 		g_signal_connect_swapped(private->actualStyleParent, "destroy", G_CALLBACK(on_style_parent_destroy), self);
 	}
 
 	emit_style_changed(self);
-	g_signal_emit(self, signals[SIGNAL_BACKGROUND_CHANGED], 0);
 }
 
 static void update_actual_style_parent(CmkWidget *self)
@@ -380,7 +581,6 @@ static void on_style_changed(CmkWidget *self)
 {
 	g_return_if_fail(CMK_IS_WIDGET(self));
 	update_named_background_color(self);
-	PRIVATE(self)->emittingStyleChanged = FALSE; // see emit_style_changed
 }
 
 static void on_background_changed(CmkWidget *self)
@@ -396,8 +596,9 @@ void cmk_widget_set_background_color_name(CmkWidget *self, const gchar *namedCol
 		return;
 	g_clear_pointer(&(PRIVATE(self)->backgroundColorName), g_free);
 	PRIVATE(self)->backgroundColorName = g_strdup(namedColor);
+	invalidate_resolved_style(self);
 	g_object_notify_by_pspec(G_OBJECT(self), properties[PROP_BACKGROUND_COLOR_NAME]);
-	g_signal_emit(self, signals[SIGNAL_BACKGROUND_CHANGED], 0);
+	emit_background_changed(self);
 }
 
 /*
@@ -422,14 +623,9 @@ void cmk_widget_set_draw_background_color(CmkWidget *self, gboolean draw)
 const gchar * cmk_widget_get_background_color_name(CmkWidget *self)
 {
 	g_return_val_if_fail(CMK_IS_WIDGET(self), NULL);
-	CmkWidgetPrivate *private = PRIVATE(self);
-	if(G_UNLIKELY(private->disposed))
+	if(G_UNLIKELY(PRIVATE(self)->disposed))
 		return NULL;
-	if(private->backgroundColorName)
-		return private->backgroundColorName;
-	if(private->actualStyleParent)
-		return cmk_widget_get_background_color_name(private->actualStyleParent);
-	return NULL;
+	return get_resolved_style(self)->backgroundColorName;
 }
 
 const ClutterColor * cmk_widget_get_background_color(CmkWidget *self)
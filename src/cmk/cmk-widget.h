@@ -23,7 +23,9 @@ struct _CmkWidgetClass
 	/*
 	 * Emitted when a style property changes on the widget. This may include
 	 * changes to the style of parent widgets. Always emitted during object
-	 * construction (after init completes). Must chain up to parent class.
+	 * construction (after init completes). Otherwise, changes are batched
+	 * and this is emitted once, before the next frame, for each widget they
+	 * affect. Must chain up to parent class.
 	 */
 	void (*style_changed) (CmkWidget *self);
 
@@ -142,6 +144,13 @@ const gchar * cmk_widget_get_background_color_name(CmkWidget *widget);
  */
 const ClutterColor * cmk_widget_get_background_color(CmkWidget *widget);
 
+/*
+ * Gets counts of style change flushes, and of the style-changed and
+ * background-changed signals they emitted, since the program started. Any
+ * argument may be NULL.
+ */
+void cmk_widget_get_style_stats(guint *flushes, guint *styleChanged, guint *backgroundChanged);
+
 /*
  * Convenience for ClutterColor -> RGBA -> cairo_set_source_rgba.
  */
@@ -8,11 +8,31 @@
 #include <math.h>
 #include <string.h>
 
+/*
+ * A blurred shadow only depends on its radius and mask, as long as the
+ * shadow box is large enough that the blurred edges don't overlap. So the
+ * shadow is rendered once per (radius, mask) into a small template, which
+ * is cut into nine tiles (corners, edges, center) and shared by every
+ * CmkShadow with that radius and mask. Resizing a shadow only moves and
+ * stretches the tiles. (The radius is already in device pixels, so there
+ * is no separate scale in the key.)
+ */
+typedef struct
+{
+	guint key;
+	guint refCount;
+	ClutterContent *tiles[9]; // Row major, top left to bottom right
+} ShadowTiles;
+
+// Key: GUINT_TO_POINTER(tiles_key(radius, mask)), Value: ShadowTiles *
+static GHashTable *tileCache = NULL;
+
 struct _CmkShadow
 {
 	ClutterActor parent;
 	ClutterActor *shadow;
-	ClutterCanvas *canvas;
+	ClutterActor *tiles[9];
+	ShadowTiles *tileSet;
 	guint radius;
 	guint shadowMask;
 };
@@ -21,8 +41,9 @@ static void cmk_shadow_dispose(GObject *self_);
 static void cmk_shadow_get_preferred_width(ClutterActor *self_, gfloat forHeight, gfloat *minWidth, gfloat *natWidth);
 static void cmk_shadow_get_preferred_height(ClutterActor *self_, gfloat forWidth, gfloat *minHeight, gfloat *natHeight);
 static void cmk_shadow_allocate(ClutterActor *self_, const ClutterActorBox *box, ClutterAllocationFlags flags);
-static void on_shadow_size_changed(ClutterActor *shadow, GParamSpec *spec, gpointer userdata);
-static gboolean on_draw_canvas(ClutterCanvas *canvas, cairo_t *cr, int width, int height, CmkShadow *self);
+static void update_tiles(CmkShadow *self);
+static ShadowTiles * shadow_tiles_acquire(guint radius, guint shadowMask);
+static void shadow_tiles_release(ShadowTiles *tileSet);
 
 G_DEFINE_TYPE(CmkShadow, cmk_shadow, CMK_TYPE_WIDGET);
 
@@ -53,19 +74,21 @@ static void cmk_shadow_class_init(CmkShadowClass *class)
 static void cmk_shadow_init(CmkShadow *self)
 {
 	self->shadow = clutter_actor_new();
-
-	self->canvas = CLUTTER_CANVAS(clutter_canvas_new());
-	g_signal_connect(self->canvas, "draw", G_CALLBACK(on_draw_canvas), self);
-	clutter_actor_set_content_gravity(CLUTTER_ACTOR(self), CLUTTER_CONTENT_GRAVITY_CENTER);
-	clutter_actor_set_content(self->shadow, CLUTTER_CONTENT(self->canvas));
-
-	g_signal_connect(self->shadow, "notify::size", G_CALLBACK(on_shadow_size_changed), NULL);
+	// The tiles are allocated directly by cmk_shadow_allocate
+	clutter_actor_set_layout_manager(self->shadow, NULL);
+	for(guint i=0;i<9;++i)
+	{
+		self->tiles[i] = clutter_actor_new();
+		clutter_actor_set_content_gravity(self->tiles[i], CLUTTER_CONTENT_GRAVITY_RESIZE_FILL);
+		clutter_actor_add_child(self->shadow, self->tiles[i]);
+	}
 	clutter_actor_add_child(CLUTTER_ACTOR(self), self->shadow);
 }
 
 static void cmk_shadow_dispose(GObject *self_)
 {
 	CmkShadow *self = CMK_SHADOW(self_);
+	g_clear_pointer(&self->tileSet, shadow_tiles_release);
 	G_OBJECT_CLASS(cmk_shadow_parent_class)->dispose(self_);
 }
 
@@ -87,6 +110,41 @@ static void cmk_shadow_get_preferred_height(ClutterActor *self_, gfloat forWidth
 		clutter_actor_get_preferred_height(child, forWidth, minHeight, natHeight);
 }
 
+/*
+ * Splits a length into the sizes of the start, middle and end tiles. The
+ * start and end tiles have fixed sizes (2*radius and 2*radius+1) and the
+ * middle tile is stretched. If the length is too small for that, the end
+ * tiles are squashed proportionally.
+ */
+static void tile_sizes(gfloat length, guint radius, gfloat *start, gfloat *end)
+{
+	*start = radius*2;
+	*end = radius*2 + 1;
+	if(*start + *end > length)
+	{
+		*start = MAX(floorf(length * (radius*2) / (radius*4 + 1)), 0);
+		*end = MAX(length - *start, 0);
+	}
+}
+
+static void allocate_tiles(CmkShadow *self, gfloat width, gfloat height, ClutterAllocationFlags flags)
+{
+	gfloat left, right, top, bottom;
+	tile_sizes(width, self->radius, &left, &right);
+	tile_sizes(height, self->radius, &top, &bottom);
+
+	gfloat xs[4] = {0, left, width - right, width};
+	gfloat ys[4] = {0, top, height - bottom, height};
+	for(guint row=0;row<3;++row)
+	{
+		for(guint col=0;col<3;++col)
+		{
+			ClutterActorBox tileBox = {xs[col], ys[row], xs[col+1], ys[row+1]};
+			clutter_actor_allocate(self->tiles[row*3+col], &tileBox, flags);
+		}
+	}
+}
+
 static void cmk_shadow_allocate(ClutterActor *self_, const ClutterActorBox *box, ClutterAllocationFlags flags)
 {
 	CmkShadow *self = CMK_SHADOW(self_);
@@ -116,22 +174,19 @@ static void cmk_shadow_allocate(ClutterActor *self_, const ClutterActorBox *box,
 		height + (mBottom ? self->radius : 0)
 	};
 
-	// If the CmkShadow's box gets too small, it can mess with the shadow
-	// rendering. This makes sure the width and/or height (depending on
+	// If the CmkShadow's box gets too small, the blurred edge tiles have to
+	// be squashed. This makes sure the width and/or height (depending on
 	// edges being rendered) is always > self->radius*2, which is enough
-	// for the blurring code to not segfault. (The blur code also validates
-	// the width and height before attempting to render just in case, but
-	// if it errors it just doesn't render anything, which looks bad.)
+	// room for the blurred edge of a single-sided shadow.
 	// 
 	// Because of this expansion, a black region may start appearing off
-	// of the opposite edge of the shadow (required due to how the blurring
-	// works). To fix this in the easiest possible way, just use Clutter's
-	// clip function to hide the extra pixels created by the expansion.
+	// of the opposite edge of the shadow. To fix this in the easiest
+	// possible way, just use Clutter's clip function to hide the extra
+	// pixels created by the expansion.
 	//
 	// TODO: This still has issues when rendering shadows on opposite edges
-	// (ex TOP + BOTTOM, ALL) on very small areas. It won't segfault, but the
-	// blurring starts looking very choppy and eventually disspears completely.
-	// This might be fixed by also expanding the region in this case?
+	// (ex TOP + BOTTOM, ALL) on very small areas, where both edge tiles get
+	// squashed. This might be fixed by also expanding the region in this case?
 	guint clipTop = 0, clipBottom = 0, clipLeft = 0, clipRight = 0;
 	gfloat prev;
 
@@ -170,6 +225,7 @@ static void cmk_shadow_allocate(ClutterActor *self_, const ClutterActorBox *box,
 	}
 
 	clutter_actor_allocate(self->shadow, &shadowBox, flags);
+	allocate_tiles(self, shadowBox.x2 - shadowBox.x1, shadowBox.y2 - shadowBox.y1, flags);
 
 	// The clip is specified in distance from each edge, while the set_clip
 	// method takes a x,y,width,height. So convert it.
@@ -178,24 +234,23 @@ static void cmk_shadow_allocate(ClutterActor *self_, const ClutterActorBox *box,
 	CLUTTER_ACTOR_CLASS(cmk_shadow_parent_class)->allocate(self_, box, flags);
 }
 
-static void on_shadow_size_changed(ClutterActor *shadow, GParamSpec *spec, gpointer userdata)
-{
-	gfloat width, height;
-	clutter_actor_get_size(shadow, &width, &height);
-	clutter_canvas_set_size(CLUTTER_CANVAS(clutter_actor_get_content(shadow)), width, height);
-}
-
 void cmk_shadow_set_mask(CmkShadow *self, guint shadowMask)
 {
 	g_return_if_fail(CMK_IS_SHADOW(self));
+	if(self->shadowMask == shadowMask)
+		return;
 	self->shadowMask = shadowMask;
+	update_tiles(self);
 	clutter_actor_queue_relayout(CLUTTER_ACTOR(self));
 }
 
 void cmk_shadow_set_radius(CmkShadow *self, guint radius)
 {
 	g_return_if_fail(CMK_IS_SHADOW(self));
+	if(self->radius == radius)
+		return;
 	self->radius = radius;
+	update_tiles(self);
 	clutter_actor_queue_relayout(CLUTTER_ACTOR(self));
 }
 
@@ -213,198 +268,275 @@ ClutterActor * cmk_shadow_get_first_child(CmkShadow *shadow)
  * http://blog.ivank.net/fastest-gaussian-blur.html
  * The difference is that they can blur a specific region within the
  * buffer, which allows for edge-only blurring.
+ *
+ * They work directly on premultiplied black ARGB32 pixels (only the alpha
+ * byte is set), so no conversion pass is needed afterwards. The running
+ * sum is divided by 2r+1 with a 12.20 fixed-point multiply, which gives the
+ * same result as the rounded float division for these sizes. The vertical
+ * blur advances a whole row of columns at a time and the horizontal blur
+ * advances four rows at a time, using GCC vector extensions when available.
  */
 
+#define BLUR_SHIFT 20
+#define BLUR_HALF (1 << (BLUR_SHIFT-1))
+#define BLUR_MUL(r) (((1 << BLUR_SHIFT) + (r)) / ((r)*2 + 1)) // Rounded 1/(2r+1)
+
+#if defined(__GNUC__)
+typedef guint32 v4u32 __attribute__((vector_size(16)));
+
+static inline v4u32 load4(const guint32 *p)
+{
+	v4u32 v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline void store4(guint32 *p, v4u32 v)
+{
+	memcpy(p, &v, sizeof(v));
+}
+#endif
+
 /*
- * x + r <= ~stride/2 (?)
+ * x + w <= stride
  * y + h <= buffer height
- * w <= stride
- * 0 < r
+ * r*2 < w
  */
-static void boxBlurH(guchar *src, guchar *dst, guint stride, guint x, guint y, guint w, guint h, guint r)
+static void boxBlurH(const guint32 *src, guint32 *dst, guint stride, guint x, guint y, guint w, guint h, guint r)
 {
-    float iarr = 1.0 / (r+r+1.0);
-    for(guint i=y; i<y+h; i++)
+	const guint32 mul = BLUR_MUL(r);
+	guint i = y;
+
+#if defined(__GNUC__)
+	for(; i+4<=y+h; i+=4)
 	{
-        guint ti = i*stride+x, li = ti, ri = ti+r;
-        guint fv = src[ti], lv = src[ti+w-1], val = (r+1)*fv;
-        for(guint j=0; j<r; j++)
-			val += src[ti+j];
-        for(guint j=0; j<=r; j++) {
-			val += src[ri++] - fv;
-			dst[ti++] = round(val*iarr);
-		}
-        for(guint j=r+1; j<w-r; j++) {
-			val += src[ri++] - src[li++];
-			dst[ti++] = round(val*iarr);
-		}
-        for(guint j=w-r; j<w; j++) {
-			val += lv - src[li++];
-			dst[ti++] = round(val*iarr);
+		const guint32 *s0 = src + i*stride + x;
+		guint32 *d0 = dst + i*stride + x;
+		#define ROWS(p, o) ((v4u32){(p)[o] >> 24, (p)[stride+(o)] >> 24, (p)[stride*2+(o)] >> 24, (p)[stride*3+(o)] >> 24})
+		v4u32 fv = ROWS(s0, 0), lv = ROWS(s0, w-1);
+		v4u32 val = fv * (r+1);
+		for(guint j=0; j<r; j++)
+			val += ROWS(s0, j);
+		for(guint j=0; j<w; j++)
+		{
+			val += (j+r < w ? ROWS(s0, j+r) : lv) - (j > r ? ROWS(s0, j-r-1) : fv);
+			v4u32 out = ((val * mul + BLUR_HALF) >> BLUR_SHIFT) << 24;
+			d0[j] = out[0];
+			d0[stride+j] = out[1];
+			d0[stride*2+j] = out[2];
+			d0[stride*3+j] = out[3];
 		}
-    }
-}
+		#undef ROWS
+	}
+#endif
 
-static void boxBlurV(guchar *src, guchar *dst, guint stride, guint x, guint y, guint w, guint h, guint r)
-{
-    float iarr = 1.0 / (r+r+1.0);
-    for(guint i=x; i<x+w; i++)
+	for(; i<y+h; i++)
 	{
-        guint ti = i+y*stride, li = ti, ri = ti+r*stride;
-        guint fv = src[ti], lv = src[ti+stride*(h-1)], val = (r+1)*fv;
-        for(guint j=0; j<r; j++)
-			val += src[ti+j*stride];
-        for(guint j=0; j<=r; j++) {
-			val += src[ri] - fv;
-			dst[ti] = round(val*iarr);
-			ri+=stride;
-			ti+=stride;
-		}
-        for(guint j=r+1; j<h-r; j++) {
-			val += src[ri] - src[li];
-			dst[ti] = round(val*iarr);
-			li+=stride;
-			ri+=stride;
-			ti+=stride;
-		}
-        for(guint j=h-r; j<h; j++) {
-			val += lv - src[li];
-			dst[ti] = round(val*iarr);
-			li+=stride;
-			ti+=stride;
+		const guint32 *s0 = src + i*stride + x;
+		guint32 *d0 = dst + i*stride + x;
+		guint32 fv = s0[0] >> 24, lv = s0[w-1] >> 24, val = (r+1)*fv;
+		for(guint j=0; j<r; j++)
+			val += s0[j] >> 24;
+		for(guint j=0; j<w; j++)
+		{
+			val += (j+r < w ? s0[j+r] >> 24 : lv) - (j > r ? s0[j-r-1] >> 24 : fv);
+			d0[j] = ((val * mul + BLUR_HALF) >> BLUR_SHIFT) << 24;
 		}
-    }
+	}
 }
 
-//static unsigned long getms()
-//{
-//	struct timeval tv;
-//	gettimeofday(&tv, NULL);
-//	return 1000000 * tv.tv_sec + tv.tv_usec;
-//}
-
 /*
- * Draws a shadow onto the canvas. In reality, this just creates a blurred
- * black box. Only the edges specified in the shadow mask are actually
- * blurred, plus some optimizations are performed (like not filling/blurring
- * the center of the canvas where the "shadow-creating" object will be
- * covering this shadow actor).
+ * x + w <= stride
+ * y + h <= buffer height
+ * r*2 < h
  */
-static gboolean on_draw_canvas(ClutterCanvas *canvas, cairo_t *cr, gint width, gint height, CmkShadow *self)
+static void boxBlurV(const guint32 *src, guint32 *dst, guint stride, guint x, guint y, guint w, guint h, guint r)
 {
-	cairo_surface_t *surface = cairo_get_target(cr);
+	const guint32 mul = BLUR_MUL(r);
+	const guint32 *first = src + y*stride + x;
+	const guint32 *last = src + (y+h-1)*stride + x;
 
-	gboolean mTop = (self->shadowMask & CMK_SHADOW_MASK_TOP) == CMK_SHADOW_MASK_TOP;
-	gboolean mBottom = (self->shadowMask & CMK_SHADOW_MASK_BOTTOM) == CMK_SHADOW_MASK_BOTTOM;
-	gboolean mLeft = (self->shadowMask & CMK_SHADOW_MASK_LEFT) == CMK_SHADOW_MASK_LEFT;
-	gboolean mRight = (self->shadowMask & CMK_SHADOW_MASK_RIGHT) == CMK_SHADOW_MASK_RIGHT;
+	// One running sum per column
+	guint32 *acc = g_new(guint32, w);
+	for(guint i=0; i<w; i++)
+	{
+		acc[i] = (r+1) * (first[i] >> 24);
+		for(guint j=0; j<r; j++)
+			acc[i] += first[j*stride + i] >> 24;
+	}
 
-	// Make sure we should actually do the shadow. Some radius/width/height
-	// combinations could cause a segfault, so be very careful
-	if(cairo_image_surface_get_format(surface) != CAIRO_FORMAT_ARGB32
-	|| (self->radius == 0)
-	|| (!mTop && !mBottom && !mLeft && !mRight)
-	|| ((mLeft || mRight) && width <= self->radius*2)
-	|| ((mTop || mBottom) && height <= self->radius*2))
+	for(guint j=0; j<h; j++)
 	{
-		cairo_save(cr);
-		cairo_set_operator(cr, CAIRO_OPERATOR_CLEAR);
-		cairo_paint(cr);
-		cairo_restore(cr);
-		return TRUE;
+		const guint32 *add = (j+r < h) ? first + (j+r)*stride : last;
+		const guint32 *sub = (j > r) ? first + (j-r-1)*stride : first;
+		guint32 *out = dst + (y+j)*stride + x;
+		guint i = 0;
+#if defined(__GNUC__)
+		for(; i+4<=w; i+=4)
+		{
+			v4u32 val = load4(acc + i) + (load4(add + i) >> 24) - (load4(sub + i) >> 24);
+			store4(acc + i, val);
+			store4(out + i, ((val * mul + BLUR_HALF) >> BLUR_SHIFT) << 24);
+		}
+#endif
+		for(; i<w; i++)
+		{
+			acc[i] += (add[i] >> 24) - (sub[i] >> 24);
+			out[i] = ((acc[i] * mul + BLUR_HALF) >> BLUR_SHIFT) << 24;
+		}
 	}
+	
+	g_free(acc);
+}
 
-	// Get a pixel buffer to draw the shadow into
-	guchar *buffer = cairo_image_surface_get_data(surface);
-	guint length = width*height;
+static guint tiles_key(guint radius, guint shadowMask)
+{
+	return (radius << 4) | (shadowMask & CMK_SHADOW_MASK_ALL);
+}
 
-	// These buffers contain alpha-only versions of the shadow.
-	// There are two for a "double buffer" usage, of which 'source'
-	// will eventually be copied to buffer.
-	guchar *source = g_new(guchar, length*2);
-	guchar *osource = source;
-	guchar *dest = source + length;
-	guchar *tmp = NULL; // For buffer swaps
+static void fill_rect(guint32 *buffer, guint stride, guint x, guint y, guint w, guint h, guint32 value)
+{
+	for(guint j=y; j<y+h; ++j)
+		for(guint i=x; i<x+w; ++i)
+			buffer[j*stride + i] = value;
+}
 
-	// This creates an entirely black canvas, except for the edges that
+/*
+ * Renders a shadow into a premultiplied ARGB32 buffer of width x height.
+ * In reality, this just creates a blurred black box. Only the edges
+ * specified in the shadow mask are blurred. The caller must make sure that
+ * width and height are greater than radius*4.
+ */
+static void render_shadow(guint32 *pixels, guint width, guint height, guint radius, guint shadowMask)
+{
+	gboolean mTop = (shadowMask & CMK_SHADOW_MASK_TOP) == CMK_SHADOW_MASK_TOP;
+	gboolean mBottom = (shadowMask & CMK_SHADOW_MASK_BOTTOM) == CMK_SHADOW_MASK_BOTTOM;
+	gboolean mLeft = (shadowMask & CMK_SHADOW_MASK_LEFT) == CMK_SHADOW_MASK_LEFT;
+	gboolean mRight = (shadowMask & CMK_SHADOW_MASK_RIGHT) == CMK_SHADOW_MASK_RIGHT;
+
+	// 'source' holds the final result, and 'dest' is scratch space for the
+	// first pass of each blur. The blurs only ever read back the region they
+	// wrote, so 'dest' doesn't need to be initialized.
+	guint32 *source = pixels;
+	guint32 *dest = g_new(guint32, width*height);
+
+	// This creates an entirely black box, except for the edges that
 	// should be blurred (on those edges, a border of size radius is created). 
-	// This is pretty much the fastest I could get it: on my device, an area
-	// of ~2000x1000 gets filled with borders in ~1ms.
-	memset(source, 255, length*2);
+	fill_rect(source, width, 0, 0, width, height, 0xFF000000);
+	guint yStart = mTop ? radius : 0;
+	guint yEnd = mBottom ? (height-radius) : height;
 	if(mTop)
-	{
-		memset(source, 0, width*self->radius);
-		memset(dest, 0, width*self->radius);
-	}
+		fill_rect(source, width, 0, 0, width, radius, 0);
 	if(mBottom)
-	{
-		memset(source+(guint)((height-self->radius)*width), 0, width*self->radius);
-		memset(dest+(guint)((height-self->radius)*width), 0, width*self->radius);
-	}
+		fill_rect(source, width, 0, height-radius, width, radius, 0);
 	if(mLeft)
-	{
-		guint yStart = mTop ? self->radius : 0;
-		guint yEnd = mBottom ? (height-self->radius) : height;
-		for(guint y=yStart; y<yEnd; ++y)
-			memset(source+(y*width), 0, self->radius);
-		for(guint y=yStart; y<yEnd; ++y)
-			memset(dest+(y*width), 0, self->radius);
-	}
+		fill_rect(source, width, 0, yStart, radius, yEnd-yStart, 0);
 	if(mRight)
-	{
-		guint yStart = mTop ? self->radius : 0;
-		guint yEnd = mBottom ? (height-self->radius) : height;
-		for(guint y=yStart; y<yEnd; ++y)
-			memset(source+(guint)((y+1)*width-self->radius), 0, self->radius);
-		for(guint y=yStart; y<yEnd; ++y)
-			memset(dest+(guint)((y+1)*width-self->radius), 0, self->radius);
-	}
+		fill_rect(source, width, width-radius, yStart, radius, yEnd-yStart, 0);
 	
-	// By only blurring the required edges, render time goes from
-	// ~30ms for ~2000x1000 area to under 4ms (on my device).
-	// However, because blurring on an edge only transfers that set of
-	// pixels, the pixels have to be transfered back to the source buffer
-	// after a blur. Luckily, we want to do two passes of the blur anyway
-	// for better looks. So just blur in sets of two on the same edge,
-	// and solve both problems at once!
+	// Because blurring on an edge only transfers that set of pixels, the
+	// pixels have to be transfered back to the source buffer after a blur.
+	// Luckily, we want to do two passes of the blur anyway for better looks.
+	// So just blur in sets of two on the same edge, and solve both problems
+	// at once!
 	if(mTop)
 	{
-		boxBlurV(source, dest, width, 0, 0, width, self->radius*2, self->radius/2);
-		boxBlurV(dest, source, width, 0, 0, width, self->radius*2, self->radius/2);
+		boxBlurV(source, dest, width, 0, 0, width, radius*2, radius/2);
+		boxBlurV(dest, source, width, 0, 0, width, radius*2, radius/2);
 	}
 	if(mBottom)
 	{
-		boxBlurV(source, dest, width, 0, height - self->radius*2 - 1, width, self->radius*2, self->radius/2);
-		boxBlurV(dest, source, width, 0, height - self->radius*2 - 1, width, self->radius*2, self->radius/2);
+		boxBlurV(source, dest, width, 0, height - radius*2 - 1, width, radius*2, radius/2);
+		boxBlurV(dest, source, width, 0, height - radius*2 - 1, width, radius*2, radius/2);
 	}
 	if(mLeft)
 	{
-		boxBlurH(source, dest, width, 0, 0, self->radius*2, height, self->radius/2);
-		boxBlurH(dest, source, width, 0, 0, self->radius*2, height, self->radius/2);
+		boxBlurH(source, dest, width, 0, 0, radius*2, height, radius/2);
+		boxBlurH(dest, source, width, 0, 0, radius*2, height, radius/2);
 	}
 	if(mRight)
 	{
-		boxBlurH(source, dest, width, width - self->radius*2 - 1, 0, self->radius*2, height, self->radius/2);
-		boxBlurH(dest, source, width, width - self->radius*2 - 1, 0, self->radius*2, height, self->radius/2);
+		boxBlurH(source, dest, width, width - radius*2 - 1, 0, radius*2, height, radius/2);
+		boxBlurH(dest, source, width, width - radius*2 - 1, 0, radius*2, height, radius/2);
 	}
 
-	// Copy result to cairo
-	memset(buffer, 0, length*4);
+	g_free(dest);
+}
+
+static ShadowTiles * shadow_tiles_new(guint radius, guint shadowMask)
+{
+	// The template has a 2r start tile, a 1px middle tile that is never
+	// touched by the blur, and a 2r+1 end tile on each axis.
+	guint size = radius*4 + 2;
+	guint offsets[4] = {0, radius*2, radius*2 + 1, size};
+
+	guint32 *pixels = g_new(guint32, size*size);
+	render_shadow(pixels, size, size, radius, shadowMask);
 
-	//unsigned long start = getms();
+	ShadowTiles *tileSet = g_new0(ShadowTiles, 1);
+	tileSet->key = tiles_key(radius, shadowMask);
+	for(guint row=0;row<3;++row)
+	{
+		for(guint col=0;col<3;++col)
+		{
+			ClutterContent *image = clutter_image_new();
+			GError *error = NULL;
+			clutter_image_set_data(CLUTTER_IMAGE(image),
+				(const guint8 *)(pixels + offsets[row]*size + offsets[col]),
+				CLUTTER_CAIRO_FORMAT_ARGB32,
+				offsets[col+1] - offsets[col],
+				offsets[row+1] - offsets[row],
+				size*sizeof(guint32),
+				&error);
+			if(error)
+			{
+				g_warning("Failed to create shadow tile: %s", error->message);
+				g_error_free(error);
+			}
+			tileSet->tiles[row*3+col] = image;
+		}
+	}
+	g_free(pixels);
+	return tileSet;
+}
+
+static ShadowTiles * shadow_tiles_acquire(guint radius, guint shadowMask)
+{
+	if(!tileCache)
+		tileCache = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+	guint key = tiles_key(radius, shadowMask);
+	ShadowTiles *tileSet = g_hash_table_lookup(tileCache, GUINT_TO_POINTER(key));
+	if(!tileSet)
+	{
+		tileSet = shadow_tiles_new(radius, shadowMask);
+		g_hash_table_insert(tileCache, GUINT_TO_POINTER(key), tileSet);
+	}
+	++tileSet->refCount;
+	return tileSet;
+}
+
+static void shadow_tiles_release(ShadowTiles *tileSet)
+{
+	if(--tileSet->refCount > 0)
+		return;
+	g_hash_table_remove(tileCache, GUINT_TO_POINTER(tileSet->key));
+	for(guint i=0;i<9;++i)
+		g_clear_object(&tileSet->tiles[i]);
+	g_free(tileSet);
+}
+
+static void update_tiles(CmkShadow *self)
+{
+	ShadowTiles *old = self->tileSet;
+	self->tileSet = NULL;
+	if(self->radius > 0 && (self->shadowMask & CMK_SHADOW_MASK_ALL) != 0)
+		self->tileSet = shadow_tiles_acquire(self->radius, self->shadowMask);
+
+	// Release after acquiring, so an unchanged set isn't rendered again
+	if(old)
+		shadow_tiles_release(old);
 	
-	// Just this loop alone takes more time than generating the entire
-	// shadow. Fix? Possibly instead of using the extra source and dest
-	// buffers, modify the blur functions to take channels into account
-	// and just blur between this cairo buffer and a tmp buffer.
-	for(guint i=0,j=3;i<length;++i,j+=4)
-		buffer[j]=source[i];
-
-	//unsigned long end = getms();
-	//unsigned long delta = end - start;
-	//double deltams = delta / 1000.0;
-	//printf("shadowtime: %fms (for w: %i, h: %i, r: %i)\n", deltams, width, height, self->radius);
-
-	g_free(osource);
-	return TRUE;
+	for(guint i=0;i<9;++i)
+		clutter_actor_set_content(self->tiles[i], self->tileSet ? self->tileSet->tiles[i] : NULL);
 }
@@ -10,14 +10,24 @@
 
 #define MAX_DEVICE_NAME_LENGTH 75 // These include NULL terminator
 #define MAX_DEVICE_DESCRIPTION_LENGTH 100
+#define RECONNECT_DELAY 1 // Seconds to wait before reconnecting after the context fails
+
+/*
+ * Identifies a device in the manager's device table. PulseAudio sink and
+ * source indices are separate, so the same index can refer to both.
+ */
+typedef struct
+{
+	CskAudioDeviceType type;
+	guint32 index;
+} DeviceKey;
 
 struct _CskAudioDevice
 {
 	GObject parent;
 	
 	CskAudioDeviceManager *manager;
-	CskAudioDeviceType type;
-	guint32 index;
+	DeviceKey key; // Type and PulseAudio index
 
 	char *name;
 	char *hname; // "human readable" name
@@ -27,6 +37,8 @@ struct _CskAudioDevice
 	gboolean mute;
 
 	pa_cvolume cvolume;
+	pa_operation *volumeOp; // In-flight volume write, if any
+	gboolean volumePending; // cvolume changed while volumeOp was in flight
 };
 
 struct _CskAudioDeviceManager
@@ -39,7 +51,11 @@ struct _CskAudioDeviceManager
   	pa_context *context;
 	gboolean ready;
 	
-	GList *devices;
+	GHashTable *devices; // DeviceKey * -> CskAudioDevice * (owned)
+	GHashTable *dirty; // DeviceKey * -> removed (gboolean); events waiting for flushDirtyId
+	gboolean serverDirty;
+	guint flushDirtyId;
+	guint reconnectId;
 	char *defaultSinkName;
 	char *defaultSourceName;
 	CskAudioDevice *defaultOutput; // Pointers to items in devices list,
@@ -85,18 +101,31 @@ static void csk_audio_device_init(CskAudioDevice *self)
 {
 }
 
+static void cancel_volume_write(CskAudioDevice *device)
+{
+	// Cancelled operations don't call their callback
+	if(device->volumeOp)
+	{
+		pa_operation_cancel(device->volumeOp);
+		pa_operation_unref(device->volumeOp);
+	}
+	device->volumeOp = NULL;
+	device->volumePending = FALSE;
+}
+
 static void csk_audio_device_dispose(GObject *self_)
 {
 	CskAudioDevice *self = CSK_AUDIO_DEVICE(self_);
+	cancel_volume_write(self);
 	g_free(self->name);
 	g_free(self->hname);
 	g_free(self->description);
 	self->name = NULL;
 	self->hname = NULL;
 	self->description = NULL;
-	self->type = CSK_AUDIO_DEVICE_TYPE_INVALID;
+	self->key.type = CSK_AUDIO_DEVICE_TYPE_INVALID;
 	self->manager = NULL;
-	self->index = 0;
+	self->key.index = 0;
 	G_OBJECT_CLASS(csk_audio_device_parent_class)->dispose(self_);
 }
 
@@ -135,13 +164,13 @@ static void csk_audio_device_get_property(GObject *self_, guint propertyId, GVal
 
 static gboolean audio_device_valid(CskAudioDevice *device)
 {
-	return device->type != CSK_AUDIO_DEVICE_TYPE_INVALID;
+	return device->key.type != CSK_AUDIO_DEVICE_TYPE_INVALID;
 }
 
 CskAudioDeviceType csk_audio_device_get_type_(CskAudioDevice *device)
 {
 	g_return_val_if_fail(CSK_IS_AUDIO_DEVICE(device), CSK_AUDIO_DEVICE_TYPE_INVALID);
-	return device->type;
+	return device->key.type;
 }
 
 const char * csk_audio_device_get_name(CskAudioDevice *device)
@@ -165,6 +194,28 @@ float csk_audio_device_get_volume(CskAudioDevice *device)
 	return device->volume;
 }
 
+static void send_volume(CskAudioDevice *device);
+
+static void on_volume_set(pa_context *context, int success, CskAudioDevice *device)
+{
+	pa_operation_unref(device->volumeOp);
+	device->volumeOp = NULL;
+
+	// Send the latest value set while this write was in flight
+	if(device->volumePending)
+		send_volume(device);
+}
+
+static void send_volume(CskAudioDevice *device)
+{
+	device->volumePending = FALSE;
+	pa_context *context = device->manager->context;
+	if(device->key.type == CSK_AUDIO_DEVICE_TYPE_OUTPUT)
+		device->volumeOp = pa_context_set_sink_volume_by_index(context, device->key.index, &device->cvolume, (pa_context_success_cb_t)on_volume_set, device);
+	else if(device->key.type == CSK_AUDIO_DEVICE_TYPE_INPUT)
+		device->volumeOp = pa_context_set_source_volume_by_index(context, device->key.index, &device->cvolume, (pa_context_success_cb_t)on_volume_set, device);
+}
+
 void csk_audio_device_set_volume(CskAudioDevice *device, float volume)
 {
 	g_return_if_fail(CSK_IS_AUDIO_DEVICE(device));
@@ -173,9 +224,22 @@ void csk_audio_device_set_volume(CskAudioDevice *device, float volume)
 
 	pa_volume_t newVol = (pa_volume_t)(volume * (PA_VOLUME_NORM - PA_VOLUME_MUTED) + PA_VOLUME_MUTED);
 	pa_cvolume_scale(&device->cvolume, newVol);
-	pa_operation *o = pa_context_set_sink_volume_by_index(device->manager->context, device->index, &device->cvolume, NULL, NULL);
-	//gboolean success = (o != NULL);
-	if(o) pa_operation_unref(o);
+
+	// Take the new volume immediately, so that repeated relative changes
+	// (ex. holding a volume key) build on each other instead of on the
+	// last value the server reported
+	float prevVolume = device->volume;
+	device->volume = ((float)(pa_cvolume_max(&device->cvolume) - PA_VOLUME_MUTED))/(PA_VOLUME_NORM - PA_VOLUME_MUTED);
+
+	// Only one write is in flight at a time; further changes are collapsed
+	// into one write of the latest value once it completes
+	if(device->volumeOp)
+		device->volumePending = TRUE;
+	else
+		send_volume(device);
+
+	if(prevVolume != device->volume)
+		g_object_notify_by_pspec(G_OBJECT(device), propertiesD[PROP_VOLUME]);
 }
 
 float csk_audio_device_get_balance(CskAudioDevice *device)
@@ -205,9 +269,20 @@ void csk_audio_device_set_muted(CskAudioDevice *device, gboolean muted)
 	g_return_if_fail(CSK_IS_AUDIO_DEVICE_MANAGER(device->manager));
 	g_return_if_fail(audio_device_valid(device));
 
-	pa_operation *o = pa_context_set_sink_mute_by_index(device->manager->context, device->index, muted, NULL, NULL);
+	muted = !!muted;
+	if(device->mute == muted)
+		return;
+
+	pa_operation *o = NULL;
+	if(device->key.type == CSK_AUDIO_DEVICE_TYPE_OUTPUT)
+		o = pa_context_set_sink_mute_by_index(device->manager->context, device->key.index, muted, NULL, NULL);
+	else if(device->key.type == CSK_AUDIO_DEVICE_TYPE_INPUT)
+		o = pa_context_set_source_mute_by_index(device->manager->context, device->key.index, muted, NULL, NULL);
 	//gboolean success = (o != NULL);
 	if(o) pa_operation_unref(o);
+
+	device->mute = muted;
+	g_object_notify_by_pspec(G_OBJECT(device), propertiesD[PROP_MUTED]);
 }
 
 gboolean csk_audio_device_is_default(CskAudioDevice *device)
@@ -215,9 +290,9 @@ gboolean csk_audio_device_is_default(CskAudioDevice *device)
 	g_return_val_if_fail(CSK_IS_AUDIO_DEVICE(device), FALSE);
 	g_return_val_if_fail(CSK_IS_AUDIO_DEVICE_MANAGER(device->manager), FALSE);
 	g_return_val_if_fail(audio_device_valid(device), FALSE);
-	if(device->type == CSK_AUDIO_DEVICE_TYPE_OUTPUT)
+	if(device->key.type == CSK_AUDIO_DEVICE_TYPE_OUTPUT)
 		return device->manager->defaultOutput == device;
-	else if(device->type == CSK_AUDIO_DEVICE_TYPE_INPUT)
+	else if(device->key.type == CSK_AUDIO_DEVICE_TYPE_INPUT)
 		return device->manager->defaultInput == device;
 	return FALSE;
 }
@@ -242,8 +317,9 @@ enum
 
 enum
 {
-	SIGNAL_DEVICE_ADDED = 1,
-	SIGNAL_DEVICE_REMOVED = 1,
+	SIGNAL_0,
+	SIGNAL_DEVICE_ADDED,
+	SIGNAL_DEVICE_REMOVED,
 	SIGNAL_LAST
 };
 
@@ -255,6 +331,8 @@ static void csk_audio_device_manager_get_property(GObject *self_, guint property
 static void unref_all_devices(CskAudioDeviceManager *self);
 static void on_manager_pa_state_change(pa_context *context, CskAudioDeviceManager *self);
 static void on_manager_pa_event(pa_context *context, pa_subscription_event_type_t type, uint32_t index, CskAudioDeviceManager *self);
+static void clear_dirty(CskAudioDeviceManager *self);
+static void remove_device(CskAudioDeviceManager *self, CskAudioDevice *device);
 static void on_manager_server_get_info(pa_context *context, const pa_server_info *server, CskAudioDeviceManager *self);
 static void on_manager_sink_get_info(pa_context *context, const pa_sink_info *sink, int eol, CskAudioDeviceManager *self);
 static void on_manager_source_get_info(pa_context *context, const pa_source_info *source, int eol, CskAudioDeviceManager *self);
@@ -286,8 +364,24 @@ static void csk_audio_device_manager_class_init(CskAudioDeviceManagerClass *clas
 	signalsM[SIGNAL_DEVICE_REMOVED] = g_signal_new("device-removed", G_TYPE_FROM_CLASS(class), G_SIGNAL_RUN_FIRST, 0, NULL, NULL, NULL, G_TYPE_NONE, 1, CSK_TYPE_AUDIO_DEVICE);
 }
 
+static guint device_key_hash(gconstpointer key)
+{
+	const DeviceKey *k = key;
+	return (k->index << 2) ^ k->type;
+}
+
+static gboolean device_key_equal(gconstpointer a, gconstpointer b)
+{
+	const DeviceKey *ka = a, *kb = b;
+	return ka->type == kb->type && ka->index == kb->index;
+}
+
 static void csk_audio_device_manager_init(CskAudioDeviceManager *self)
 {
+	// The device table's keys point into the devices themselves
+	self->devices = g_hash_table_new_full(device_key_hash, device_key_equal, NULL, g_object_unref);
+	self->dirty = g_hash_table_new_full(device_key_hash, device_key_equal, g_free, NULL);
+
 	self->contextProps = pa_proplist_new();
 	//pa_proplist_sets(proplist, PA_PROP_APPLICATION_NAME, "graphene-window-manager");
 	// pa_proplist_sets(proplist, PA_PROP_APPLICATION_ID, g_application_get_application_id(g_application_get_default()));
@@ -310,7 +404,16 @@ static void csk_audio_device_manager_dispose(GObject *self_)
 {
 	CskAudioDeviceManager *self = CSK_AUDIO_DEVICE_MANAGER(self_);
 	
-	unref_all_devices(self);
+	if(self->devices)
+		unref_all_devices(self);
+	g_clear_pointer(&self->devices, g_hash_table_unref);
+	if(self->dirty)
+		clear_dirty(self);
+	g_clear_pointer(&self->dirty, g_hash_table_unref);
+
+	if(self->reconnectId)
+		g_source_remove(self->reconnectId);
+	self->reconnectId = 0;
 
 	if(self->context)
 	{
@@ -382,30 +485,40 @@ CskAudioDevice * csk_audio_device_manager_get_default_input(CskAudioDeviceManage
 	return self->defaultInput;
 }
 
+/*
+ * Invalidates the device, removes it from the device table, and emits
+ * device-removed. The device is unreffed.
+ */
+static void remove_device(CskAudioDeviceManager *self, CskAudioDevice *device)
+{
+	cancel_volume_write(device);
+	g_hash_table_steal(self->devices, &device->key);
+	device->key.type = CSK_AUDIO_DEVICE_TYPE_INVALID;
+
+	if(self->defaultOutput == device)
+		self->defaultOutput = NULL;
+	if(self->defaultInput == device)
+		self->defaultInput = NULL;
+
+	g_object_notify_by_pspec(G_OBJECT(device), propertiesD[PROP_TYPE]);
+	g_signal_emit(self, signalsM[SIGNAL_DEVICE_REMOVED], 0, device);
+	g_object_unref(device);
+}
+
 static void unref_all_devices(CskAudioDeviceManager *self)
 {
-	for(GList *it=self->devices; it!=NULL; it=self->devices)
-	{
-		CskAudioDevice *device = CSK_AUDIO_DEVICE(it->data);
-
-		device->type = CSK_AUDIO_DEVICE_TYPE_INVALID;
-		self->devices = g_list_delete_link(self->devices, it);
-
-		g_object_notify_by_pspec(G_OBJECT(device), propertiesD[PROP_TYPE]);
-		g_signal_emit(self, signalsM[SIGNAL_DEVICE_REMOVED], 0, device);
-		g_object_unref(device);
-		
-		if(self->defaultOutput == device)
-			self->defaultOutput = NULL;
-		if(self->defaultInput == device)
-			self->defaultInput = NULL;
-	}
+	GList *devices = g_hash_table_get_values(self->devices);
+	for(GList *it=devices; it!=NULL; it=it->next)
+		remove_device(self, CSK_AUDIO_DEVICE(it->data));
+	g_list_free(devices);
 }
 
 static gboolean reconnect(CskAudioDeviceManager *self)
 {
 	g_return_val_if_fail(CSK_IS_AUDIO_DEVICE_MANAGER(self), G_SOURCE_REMOVE);
+	self->reconnectId = 0;
 	unref_all_devices(self);
+	clear_dirty(self);
 
 	if(self->context)
 	{
@@ -430,7 +543,7 @@ static void on_manager_pa_state_change(pa_context *context, CskAudioDeviceManage
 	gboolean prevReady = self->ready;
 
 	int state = pa_context_get_state(context);
-	g_message("state: %i", state);
+	g_debug("PulseAudio context state: %i", state);
 	switch(state)
 	{
 	case PA_CONTEXT_READY:
@@ -461,9 +574,12 @@ static void on_manager_pa_state_change(pa_context *context, CskAudioDeviceManage
 	default:
 		self->ready = FALSE;
 		unref_all_devices(self);
+		clear_dirty(self);
 		// Reconnect
-		if(state == PA_CONTEXT_FAILED)
-			g_timeout_add_seconds(1, (GSourceFunc)reconnect, self);
+		// Only one reconnect is scheduled at a time, and it is removed
+		// if the manager is disposed first
+		if(state == PA_CONTEXT_FAILED && !self->reconnectId)
+			self->reconnectId = g_timeout_add_seconds(RECONNECT_DELAY, (GSourceFunc)reconnect, self);
 		break;
 	}
 
@@ -471,47 +587,86 @@ static void on_manager_pa_state_change(pa_context *context, CskAudioDeviceManage
 		g_object_notify_by_pspec(G_OBJECT(self), propertiesM[PROP_READY]);
 }
 
+static void clear_dirty(CskAudioDeviceManager *self)
+{
+	g_hash_table_remove_all(self->dirty);
+	self->serverDirty = FALSE;
+	if(self->flushDirtyId)
+		g_source_remove(self->flushDirtyId);
+	self->flushDirtyId = 0;
+}
+
+/*
+ * Requests info for every device which changed since the last flush, once
+ * each, however many events arrived for it.
+ */
+static gboolean flush_dirty(CskAudioDeviceManager *self)
+{
+	self->flushDirtyId = 0;
+	pa_operation *o = NULL;
+
+	if(self->serverDirty)
+	{
+		o = pa_context_get_server_info(self->context, (pa_server_info_cb_t)on_manager_server_get_info, self);
+		if(o) pa_operation_unref(o);
+		self->serverDirty = FALSE;
+	}
+
+	GHashTableIter iter;
+	gpointer key, removed;
+	g_hash_table_iter_init(&iter, self->dirty);
+	while(g_hash_table_iter_next(&iter, &key, &removed))
+	{
+		DeviceKey *k = key;
+		if(removed)
+		{
+			CskAudioDevice *device = get_device(self, k->index, k->type, FALSE, NULL);
+			if(device)
+				remove_device(self, device);
+			continue;
+		}
+
+		o = NULL;
+		if(k->type == CSK_AUDIO_DEVICE_TYPE_OUTPUT)
+			o = pa_context_get_sink_info_by_index(self->context, k->index, (pa_sink_info_cb_t)on_manager_sink_get_info, self);
+		else if(k->type == CSK_AUDIO_DEVICE_TYPE_INPUT)
+			o = pa_context_get_source_info_by_index(self->context, k->index, (pa_source_info_cb_t)on_manager_source_get_info, self);
+		if(o) pa_operation_unref(o);
+	}
+	g_hash_table_remove_all(self->dirty);
+	return G_SOURCE_REMOVE;
+}
+
 static void on_manager_pa_event(pa_context *context, pa_subscription_event_type_t type, uint32_t index, CskAudioDeviceManager *self)
 {
 	pa_subscription_event_type_t eFacility = (type & PA_SUBSCRIPTION_EVENT_FACILITY_MASK);
 	pa_subscription_event_type_t eType = (type & PA_SUBSCRIPTION_EVENT_TYPE_MASK);
-	pa_operation *o = NULL;
 	
+	// Events often come in bursts (ex. a stream starting changes the same
+	// sink several times), so they are collected and handled together
 	if(eFacility == PA_SUBSCRIPTION_EVENT_SERVER)
 	{
-		o = pa_context_get_server_info(self->context, (pa_server_info_cb_t)on_manager_server_get_info, self);
+		self->serverDirty = TRUE;
 	}
-	else if(eType == PA_SUBSCRIPTION_EVENT_NEW || eType == PA_SUBSCRIPTION_EVENT_CHANGE)
-	{
-		if(eFacility == PA_SUBSCRIPTION_EVENT_SINK)
-			o = pa_context_get_sink_info_by_index(self->context, index, (pa_sink_info_cb_t)on_manager_sink_get_info, self);
-		else if(eFacility == PA_SUBSCRIPTION_EVENT_SOURCE)
-			o = pa_context_get_source_info_by_index(self->context, index, (pa_source_info_cb_t)on_manager_source_get_info, self);
-	}
-	else if(eType == PA_SUBSCRIPTION_EVENT_REMOVE)
+	else
 	{
-		CskAudioDeviceType dt = CSK_AUDIO_DEVICE_TYPE_INVALID;
+		DeviceKey key = {CSK_AUDIO_DEVICE_TYPE_INVALID, index};
 		if(eFacility == PA_SUBSCRIPTION_EVENT_SINK)
-			dt = CSK_AUDIO_DEVICE_TYPE_OUTPUT;
+			key.type = CSK_AUDIO_DEVICE_TYPE_OUTPUT;
 		else if(eFacility == PA_SUBSCRIPTION_EVENT_SOURCE)
-			dt = CSK_AUDIO_DEVICE_TYPE_INPUT;
-
-		if(dt != CSK_AUDIO_DEVICE_TYPE_INVALID)
-		{
-			CskAudioDevice *device = get_device(self, index, dt, FALSE, NULL);
-			device->type = CSK_AUDIO_DEVICE_TYPE_INVALID;
-			self->devices = g_list_remove(self->devices, device);
-			g_object_notify_by_pspec(G_OBJECT(device), propertiesD[PROP_TYPE]);
-			g_signal_emit(self, signalsM[SIGNAL_DEVICE_REMOVED], 0, device);
-			g_object_unref(device);
-			if(self->defaultOutput == device)
-				self->defaultOutput = NULL;
-			if(self->defaultInput == device)
-				self->defaultInput = NULL;
-		}
+			key.type = CSK_AUDIO_DEVICE_TYPE_INPUT;
+		else
+			return;
+
+		// The latest event wins
+		gboolean removed = (eType == PA_SUBSCRIPTION_EVENT_REMOVE);
+		DeviceKey *dirtyKey = g_new(DeviceKey, 1);
+		*dirtyKey = key;
+		g_hash_table_insert(self->dirty, dirtyKey, GINT_TO_POINTER(removed));
 	}
 
-	if(o) pa_operation_unref(o);
+	if(!self->flushDirtyId)
+		self->flushDirtyId = g_idle_add((GSourceFunc)flush_dirty, self);
 }
 
 static void on_manager_server_get_info(pa_context *context, const pa_server_info *server, CskAudioDeviceManager *self)
@@ -524,12 +679,15 @@ static void on_manager_server_get_info(pa_context *context, const pa_server_info
 	self->defaultSinkName = g_strdup(server->default_sink_name);
 	self->defaultSourceName = g_strdup(server->default_source_name);
 	
-	for(GList *it=self->devices; it!=NULL; it=it->next)
+	GHashTableIter iter;
+	gpointer key, value;
+	g_hash_table_iter_init(&iter, self->devices);
+	while(g_hash_table_iter_next(&iter, &key, &value))
 	{
-		CskAudioDevice *device = CSK_AUDIO_DEVICE(it->data);
-		if(g_strcmp0(device->name, self->defaultSinkName))
+		CskAudioDevice *device = CSK_AUDIO_DEVICE(value);
+		if(device->key.type == CSK_AUDIO_DEVICE_TYPE_OUTPUT && g_strcmp0(device->name, self->defaultSinkName) == 0)
 			self->defaultOutput = device;
-		else if(g_strcmp0(device->name, self->defaultSourceName))
+		else if(device->key.type == CSK_AUDIO_DEVICE_TYPE_INPUT && g_strcmp0(device->name, self->defaultSourceName) == 0)
 			self->defaultInput = device;
 	}
 
@@ -589,14 +747,24 @@ static void manager_set_device_info(
 		descriptionChanged = TRUE;
 	}
 
-	device->volume = ((float)(pa_cvolume_max(&volume) - PA_VOLUME_MUTED))/(PA_VOLUME_NORM - PA_VOLUME_MUTED);
+	// While a volume write is in flight, the server's volume is older than
+	// ours. The server sends a change event after the last write lands.
+	if(!device->volumeOp)
+	{
+		device->volume = ((float)(pa_cvolume_max(&volume) - PA_VOLUME_MUTED))/(PA_VOLUME_NORM - PA_VOLUME_MUTED);
+		device->cvolume = volume;
+	}
 	device->balance = pa_cvolume_get_balance(&volume, &channelMap);
 	device->mute = mute;
-	device->cvolume = volume;
 
-	gboolean wasDefault = (self->defaultOutput == device);
-	if(g_strcmp0(device->name, self->defaultSinkName) == 0)
-		self->defaultOutput = device;
+	// Sinks are matched against the default sink, sources against the
+	// default source
+	gboolean input = (device->key.type == CSK_AUDIO_DEVICE_TYPE_INPUT);
+	CskAudioDevice **defaultDevice = input ? &self->defaultInput : &self->defaultOutput;
+	const char *defaultName = input ? self->defaultSourceName : self->defaultSinkName;
+	gboolean wasDefault = (*defaultDevice == device);
+	if(g_strcmp0(device->name, defaultName) == 0)
+		*defaultDevice = device;
 	
 	if(created)
 	{
@@ -614,12 +782,12 @@ static void manager_set_device_info(
 			g_object_notify_by_pspec(G_OBJECT(device), propertiesD[PROP_BALANCE]);
 		if(prevMute != device->mute)
 			g_object_notify_by_pspec(G_OBJECT(device), propertiesD[PROP_MUTED]);
-		if((self->defaultOutput == device) != wasDefault)
+		if((*defaultDevice == device) != wasDefault)
 			g_object_notify_by_pspec(G_OBJECT(device), propertiesD[PROP_IS_DEFAULT_DEVICE]);
 	}
 
-	if((self->defaultOutput == device) != wasDefault)
-		g_object_notify_by_pspec(G_OBJECT(self), propertiesM[PROP_DEFAULT_OUTPUT]);
+	if((*defaultDevice == device) != wasDefault)
+		g_object_notify_by_pspec(G_OBJECT(self), propertiesM[input ? PROP_DEFAULT_INPUT : PROP_DEFAULT_OUTPUT]);
 }
 
 static void on_manager_sink_get_info(pa_context *context, const pa_sink_info *sink, int eol, CskAudioDeviceManager *self)
@@ -678,19 +846,21 @@ static void on_manager_source_get_info(pa_context *context, const pa_source_info
 
 static CskAudioDevice * get_device(CskAudioDeviceManager *self, guint32 index, CskAudioDeviceType type, gboolean create, gboolean *created)
 {
-	// Find an existing device
-	for(GList *it=self->devices; it!=NULL; it=it->next)
-	{
-		CskAudioDevice *device = CSK_AUDIO_DEVICE(it->data);
-		if(device->type == type && device->index == index)
-			return device;
-	}
+	if(created)
+		*created = FALSE;
+
+	DeviceKey key = {type, index};
+	CskAudioDevice *device = g_hash_table_lookup(self->devices, &key);
+	if(device || !create)
+		return device;
 	
-	CskAudioDevice *device = CSK_AUDIO_DEVICE(g_object_new(CSK_TYPE_AUDIO_DEVICE, NULL));
+	device = CSK_AUDIO_DEVICE(g_object_new(CSK_TYPE_AUDIO_DEVICE, NULL));
 	device->manager = self;
-	device->type = type;
-	device->index = index;
+	device->key.type = type;
+	device->key.index = index;
 	
-	self->devices = g_list_prepend(self->devices, device);
+	g_hash_table_insert(self->devices, &device->key, device);
+	if(created)
+		*created = TRUE;
 	return device;
 }
@@ -0,0 +1,66 @@
+/*
+ * This file is part of graphene-desktop, the desktop environment of VeltOS.
+ * Copyright (C) 2016 Velt Technologies, Aidan Shafran <zelbrium@gmail.com>
+ * Licensed under the Apache License 2 <www.apache.org/licenses/LICENSE-2.0>.
+ *
+ * Prebuilds CmkIconLoader's icon theme indexes, so that the first session
+ * after installing or updating a theme doesn't have to scan it.
+ *
+ * Usage: graphene-icon-cache [THEME...]
+ * If no themes are given, every theme in the icon directories is indexed.
+ */
+
+#include "cmk/cmk-icon-loader.h"
+
+static void rebuild_all_in(const gchar *dirPath, GHashTable *done)
+{
+	GDir *dir = g_dir_open(dirPath, 0, NULL);
+	if(!dir)
+		return;
+
+	const gchar *entry = NULL;
+	while(entry = g_dir_read_name(dir))
+	{
+		// Themes earlier in the search path shadow later ones
+		if(g_hash_table_contains(done, entry))
+			continue;
+		gchar *index = g_build_filename(dirPath, entry, "index.theme", NULL);
+		gboolean isTheme = g_file_test(index, G_FILE_TEST_IS_REGULAR);
+		g_free(index);
+		if(!isTheme)
+			continue;
+
+		g_hash_table_add(done, g_strdup(entry));
+		if(cmk_icon_loader_rebuild_index(entry))
+			g_print("Indexed %s\n", entry);
+	}
+	g_dir_close(dir);
+}
+
+int main(int argc, char **argv)
+{
+	if(argc > 1)
+	{
+		int r = 0;
+		for(int i=1;i<argc;++i)
+		{
+			if(cmk_icon_loader_rebuild_index(argv[i]))
+				g_print("Indexed %s\n", argv[i]);
+			else
+			{
+				g_printerr("Icon theme '%s' not found\n", argv[i]);
+				r = 1;
+			}
+		}
+		return r;
+	}
+
+	GHashTable *done = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	gchar *homeIconsDir = g_strdup_printf("%s/.icons", g_get_home_dir());
+	rebuild_all_in(homeIconsDir, done);
+	g_free(homeIconsDir);
+	rebuild_all_in("/usr/share/local/icons", done);
+	rebuild_all_in("/usr/share/icons", done);
+	g_hash_table_unref(done);
+	return 0;
+}
@@ -17,9 +17,19 @@
 #define NOTIFICATION_SPACING 20 // pixels
 #define NOTIFICATION_WIDTH 320
 #define NOTIFICATION_HEIGHT 60
+#define NOTIFICATION_POOL_SIZE 4 // Released notification widgets kept for reuse
+#define NOTIFICATION_MAX_VISIBLE 4 // Critical notifications may go over this
+#define NOTIFICATION_MAX_PENDING 16 // Oldest are dropped past this
+#define NOTIFICATION_RATE_BURST 5 // Notifications a sender can post at once
+#define NOTIFICATION_RATE_INTERVAL 2000 // ms for a sender to earn another
 #define NOTIFICATION_DBUS_IFACE "org.freedesktop.Notifications"
 #define NOTIFICATION_DBUS_PATH "/org/freedesktop/Notifications"
 
+// Reasons for the NotificationClosed signal
+#define NOTIFICATION_CLOSED_EXPIRED 1
+#define NOTIFICATION_CLOSED_DISMISSED 2
+#define NOTIFICATION_CLOSED_BY_CALL 3
+
 #define GRAPHENE_TYPE_NOTIFICATION  graphene_notification_get_type()
 G_DECLARE_FINAL_TYPE(GrapheneNotification, graphene_notification, GRAPHENE, NOTIFICATION, CmkWidget)
 
@@ -32,6 +42,12 @@ struct _GrapheneNotificationBox
 	guint32 nextNotificationId;
 	guint32 failNotificationId;
 
+	GHashTable *notifications; // id -> GrapheneNotification, for those showing
+	GPtrArray *pool; // CmkShadows, each holding a released GrapheneNotification
+	GQueue visible; // GrapheneNotifications in display order, critical first
+	GQueue pending; // PendingNotifications waiting for space, oldest first
+	GHashTable *rateBuckets; // sender -> RateBucket
+
 	NotificationAddedCb notificationAddedCb;
 	gpointer cbUserdata;
 };
@@ -40,15 +56,41 @@ struct _GrapheneNotification
 {
 	CmkWidget parent;
 	
+	GrapheneNotificationBox *box;
+	gboolean announced;
 	guint32 id;
 	gint urgency;
 	gint timeout;
 	guint timeoutSourceId;
+	gchar *key; // For coalescing identical notifications
+	guint count;
 
 	CmkIcon *icon;
 	ClutterText *text;
+	ClutterText *badge;
 };
 
+/*
+ * A notification which arrived while NOTIFICATION_MAX_VISIBLE were already
+ * showing. It keeps the id it was given until it is shown.
+ */
+typedef struct
+{
+	guint32 id;
+	gint urgency;
+	gint timeout;
+	gchar *icon;
+	gchar *markup;
+	gchar *key;
+	guint count;
+} PendingNotification;
+
+typedef struct
+{
+	gdouble tokens;
+	gint64 updated; // Monotonic time, us
+} RateBucket;
+
 static void graphene_notification_box_dispose(GObject *self_);
 static void post_server_fail_notification(GrapheneNotificationBox *self);
 static void on_dbus_connection_acquired(GDBusConnection *connection, const gchar *name, GrapheneNotificationBox *self);
@@ -58,12 +100,15 @@ static gboolean on_dbus_call_get_capabilities(GrapheneNotificationBox *self, GDB
 static gboolean on_dbus_call_notify(GrapheneNotificationBox *self, GDBusMethodInvocation *invocation, const gchar *app_name, guint replaces_id, const gchar *app_icon, const gchar *summary, const gchar *body, const gchar * const *actions, GVariant *hints, gint expire_timeout, DBusNotifications *object);
 static gboolean on_dbus_call_close_notification(GrapheneNotificationBox *self, GDBusMethodInvocation *invocation, guint id, DBusNotifications *object);
 static gboolean on_dbus_call_get_server_information(GrapheneNotificationBox *self, GDBusMethodInvocation *invocation, DBusNotifications *object);
+static GrapheneNotification * acquire_notification(GrapheneNotificationBox *self);
 static void add_notification(GrapheneNotificationBox *self, GrapheneNotification *n);
-static gboolean remove_notification(GrapheneNotification *n);
+static void remove_notification(GrapheneNotification *n, guint reason);
 static void graphene_notification_box_allocate(ClutterActor *self_, const ClutterActorBox *box, ClutterAllocationFlags flags);
 
 GrapheneNotification * graphene_notification_new(void);
 static void graphene_notification_set_timeout(GrapheneNotification *self, gint timeout);
+static void graphene_notification_stop_timeout(GrapheneNotification *self);
+static void graphene_notification_set_count(GrapheneNotification *self, guint count);
 
 
 G_DEFINE_TYPE(GrapheneNotificationBox, graphene_notification_box, CMK_TYPE_WIDGET)
@@ -77,6 +122,14 @@ GrapheneNotificationBox * graphene_notification_box_new(NotificationAddedCb noti
 	{
 		box->notificationAddedCb = notificationAddedCb;
 		box->cbUserdata = userdata;
+
+		// Build the widgets ahead of time, so that the first notifications
+		// don't have to
+		GrapheneNotification *preload[NOTIFICATION_POOL_SIZE];
+		for(guint i=0;i<NOTIFICATION_POOL_SIZE;++i)
+			preload[i] = acquire_notification(box);
+		for(guint i=0;i<NOTIFICATION_POOL_SIZE;++i)
+			g_ptr_array_add(box->pool, clutter_actor_get_parent(CLUTTER_ACTOR(preload[i])));
 	}
 	return box;
 }
@@ -87,9 +140,28 @@ static void graphene_notification_box_class_init(GrapheneNotificationBoxClass *c
 	CLUTTER_ACTOR_CLASS(class)->allocate = graphene_notification_box_allocate;
 }
 
+static void destroy_pooled_notification(gpointer shadow)
+{
+	clutter_actor_destroy(CLUTTER_ACTOR(shadow));
+	g_object_unref(shadow);
+}
+
+static void free_pending_notification(PendingNotification *p)
+{
+	g_free(p->icon);
+	g_free(p->markup);
+	g_free(p->key);
+	g_free(p);
+}
+
 static void graphene_notification_box_init(GrapheneNotificationBox *self)
 {
 	self->nextNotificationId = 1;
+	self->notifications = g_hash_table_new(g_direct_hash, g_direct_equal);
+	self->pool = g_ptr_array_new();
+	g_queue_init(&self->visible);
+	g_queue_init(&self->pending);
+	self->rateBuckets = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
 
 	self->dbusNameId = g_bus_own_name(G_BUS_TYPE_SESSION,
 		NOTIFICATION_DBUS_IFACE,
@@ -113,20 +185,22 @@ static void graphene_notification_box_dispose(GObject *self_)
 	self->dbusNameId = 0;
 
 	g_clear_object(&self->dbusObject);
+	g_clear_pointer(&self->notifications, g_hash_table_unref);
+	g_clear_pointer(&self->rateBuckets, g_hash_table_unref);
+	g_queue_clear(&self->visible); // The children are destroyed by the parent
+	g_queue_foreach(&self->pending, (GFunc)free_pending_notification, NULL);
+	g_queue_clear(&self->pending);
+	if(self->pool)
+		g_ptr_array_foreach(self->pool, (GFunc)destroy_pooled_notification, NULL);
+	g_clear_pointer(&self->pool, g_ptr_array_unref);
 	G_OBJECT_CLASS(graphene_notification_box_parent_class)->dispose(self_);
 }
 
 static GrapheneNotification * get_notification_by_id(GrapheneNotificationBox *self, guint id)
 {
-	ClutterActor *child = clutter_actor_get_first_child(CLUTTER_ACTOR(self));
-	while(child)
-	{
-		ClutterActor *n_ = clutter_actor_get_first_child(child);
-		if(GRAPHENE_IS_NOTIFICATION(n_) && GRAPHENE_NOTIFICATION(n_)->id == id)
-			return GRAPHENE_NOTIFICATION(n_);
-		child = clutter_actor_get_next_sibling(child);
-	}
-	return NULL;
+	if(!self->notifications || id == 0)
+		return NULL;
+	return g_hash_table_lookup(self->notifications, GUINT_TO_POINTER(id));
 }
 
 static void remove_server_fail_notification(GrapheneNotificationBox *self)
@@ -135,7 +209,7 @@ static void remove_server_fail_notification(GrapheneNotificationBox *self)
 		return;
 	GrapheneNotification *n = get_notification_by_id(self, self->failNotificationId);
 	if(n)
-		remove_notification(n);
+		remove_notification(n, NOTIFICATION_CLOSED_DISMISSED);
 	self->failNotificationId = 0;
 }
 
@@ -144,9 +218,10 @@ static void post_server_fail_notification(GrapheneNotificationBox *self)
 	g_warning("Notification server failed");
 	remove_server_fail_notification(self);
 		
-	GrapheneNotification *n = graphene_notification_new();
+	GrapheneNotification *n = acquire_notification(self);
 	n->id = ++self->nextNotificationId;
 	n->urgency = NOTIFICATION_URGENCY_CRITICAL;
+	self->failNotificationId = n->id;
 
 	cmk_icon_set_icon(n->icon, "dialog-warning-symbolic");
 	clutter_text_set_markup(n->text, "<b>System Notifications Failed</b>\nYou may need to relog.");
@@ -184,6 +259,94 @@ static gboolean on_dbus_call_get_capabilities(GrapheneNotificationBox *self, GDB
 	return TRUE;
 }
 
+static PendingNotification * get_pending_by_id(GrapheneNotificationBox *self, guint id)
+{
+	if(id == 0)
+		return NULL;
+	for(GList *it=self->pending.head;it;it=it->next)
+		if(((PendingNotification *)it->data)->id == id)
+			return it->data;
+	return NULL;
+}
+
+static void emit_closed(GrapheneNotificationBox *self, guint32 id, guint reason)
+{
+	if(self->dbusObject && id != self->failNotificationId)
+		dbus_notifications_emit_notification_closed(self->dbusObject, id, reason);
+}
+
+/*
+ * Token bucket per sender: each sender can post NOTIFICATION_RATE_BURST
+ * notifications at once, and earns one more every NOTIFICATION_RATE_INTERVAL.
+ * Returns FALSE if the sender is out of tokens.
+ */
+static gboolean take_rate_token(GrapheneNotificationBox *self, const gchar *sender)
+{
+	if(!sender)
+		return TRUE;
+
+	gint64 now = g_get_monotonic_time();
+	gint64 refillTime = (gint64)NOTIFICATION_RATE_INTERVAL * 1000 * NOTIFICATION_RATE_BURST;
+
+	// Full buckets are the same as no bucket, so drop idle ones now and then
+	if(g_hash_table_size(self->rateBuckets) > 32)
+	{
+		GHashTableIter iter;
+		gpointer bucket;
+		g_hash_table_iter_init(&iter, self->rateBuckets);
+		while(g_hash_table_iter_next(&iter, NULL, &bucket))
+			if(now - ((RateBucket *)bucket)->updated >= refillTime)
+				g_hash_table_iter_remove(&iter);
+	}
+
+	RateBucket *bucket = g_hash_table_lookup(self->rateBuckets, sender);
+	if(!bucket)
+	{
+		bucket = g_new0(RateBucket, 1);
+		bucket->tokens = NOTIFICATION_RATE_BURST;
+		bucket->updated = now;
+		g_hash_table_insert(self->rateBuckets, g_strdup(sender), bucket);
+	}
+	else
+	{
+		bucket->tokens += (gdouble)(now - bucket->updated) / (NOTIFICATION_RATE_INTERVAL * 1000);
+		bucket->tokens = MIN(bucket->tokens, NOTIFICATION_RATE_BURST);
+		bucket->updated = now;
+	}
+
+	if(bucket->tokens < 1)
+		return FALSE;
+	bucket->tokens -= 1;
+	return TRUE;
+}
+
+static void show_notification(GrapheneNotificationBox *self, guint32 id, gint urgency, gint timeout, const gchar *icon, const gchar *markup, const gchar *key, guint count)
+{
+	GrapheneNotification *n = acquire_notification(self);
+	n->id = id;
+	n->urgency = urgency;
+	g_free(n->key);
+	n->key = g_strdup(key);
+	cmk_icon_set_icon(n->icon, icon);
+	clutter_text_set_markup(n->text, markup);
+	graphene_notification_set_count(n, count);
+	add_notification(self, n);
+	graphene_notification_set_timeout(n, timeout);
+}
+
+/*
+ * Shows pending notifications while there is room for them.
+ */
+static void show_pending(GrapheneNotificationBox *self)
+{
+	while(self->pending.length > 0 && self->visible.length < NOTIFICATION_MAX_VISIBLE)
+	{
+		PendingNotification *p = g_queue_pop_head(&self->pending);
+		show_notification(self, p->id, p->urgency, p->timeout, p->icon, p->markup, p->key, p->count);
+		free_pending_notification(p);
+	}
+}
+
 static gboolean on_dbus_call_notify(GrapheneNotificationBox *self,
 	GDBusMethodInvocation *invocation,
 	const gchar *app_name,
@@ -198,26 +361,131 @@ static gboolean on_dbus_call_notify(GrapheneNotificationBox *self,
 {
 	remove_server_fail_notification(self);
 
-	GrapheneNotification *n = graphene_notification_new();
-	n->id = ++self->nextNotificationId;
-	n->urgency = NOTIFICATION_URGENCY_NORMAL; // TODO: Get from hints
+	guchar urgency = NOTIFICATION_URGENCY_NORMAL;
+	if(hints)
+		g_variant_lookup(hints, "urgency", "y", &urgency);
+	gboolean critical = (urgency == NOTIFICATION_URGENCY_CRITICAL);
 
-	cmk_icon_set_icon(n->icon, app_icon);
-	gchar *text = g_strdup_printf("<b>%s</b>  %s", summary, body);
-	clutter_text_set_markup(n->text, text);
-	g_free(text);
+	// Critical notifications stay until they're dismissed
+	gint timeout = critical ? 0 : (expire_timeout < 0) ? NOTIFICATION_DEFAULT_SHOW_TIME : expire_timeout;
+	gchar *markup = g_strdup_printf("<b>%s</b>  %s", summary, body);
+	gchar *key = g_strjoin("\x1f", app_name, summary, body, NULL);
+	guint32 id = 0;
+	gboolean dropped = FALSE;
 
-	add_notification(self, n);
-	graphene_notification_set_timeout(n, expire_timeout);
-	
-	dbus_notifications_complete_notify(object, invocation, n->id);
+	GrapheneNotification *n = get_notification_by_id(self, replaces_id);
+	PendingNotification *p = n ? NULL : get_pending_by_id(self, replaces_id);
+
+	// Coalesce repeats of a notification which is still around into a count
+	if(!n && !p && !critical)
+	{
+		for(GList *it=self->visible.head;it && !n;it=it->next)
+			if(g_strcmp0(GRAPHENE_NOTIFICATION(it->data)->key, key) == 0)
+				n = it->data;
+		for(GList *it=self->pending.head;it && !n && !p;it=it->next)
+			if(g_strcmp0(((PendingNotification *)it->data)->key, key) == 0)
+				p = it->data;
+		if(n)
+			graphene_notification_set_count(n, n->count + 1);
+		else if(p)
+			p->count++;
+	}
+	else if(n)
+	{
+		// Replacing a notification which is still showing updates it in place
+		g_queue_remove(&self->visible, n);
+		n->urgency = urgency;
+		g_free(n->key);
+		n->key = g_strdup(key);
+		cmk_icon_set_icon(n->icon, app_icon);
+		clutter_text_set_markup(n->text, markup);
+		graphene_notification_set_count(n, 1);
+		add_notification(self, n); // Re-sorts it
+		clutter_actor_queue_relayout(CLUTTER_ACTOR(self));
+	}
+	else if(p)
+	{
+		g_free(p->icon);
+		g_free(p->markup);
+		g_free(p->key);
+		p->icon = g_strdup(app_icon);
+		p->markup = g_strdup(markup);
+		p->key = g_strdup(key);
+		p->urgency = urgency;
+		p->count = 1;
+	}
+
+	if(n)
+	{
+		id = n->id;
+		graphene_notification_set_timeout(n, n->urgency == NOTIFICATION_URGENCY_CRITICAL ? 0 : timeout);
+	}
+	else if(p)
+	{
+		id = p->id;
+		p->timeout = timeout;
+		if(critical)
+		{
+			g_queue_remove(&self->pending, p);
+			show_notification(self, p->id, p->urgency, p->timeout, p->icon, p->markup, p->key, p->count);
+			free_pending_notification(p);
+		}
+	}
+	else if(!critical && !take_rate_token(self, g_dbus_method_invocation_get_sender(invocation)))
+	{
+		// The sender still gets an id, but it is closed immediately
+		id = ++self->nextNotificationId;
+		g_debug("Dropping notification %u from %s: rate limit reached", id, app_name);
+		dropped = TRUE;
+	}
+	else if(critical || self->visible.length < NOTIFICATION_MAX_VISIBLE)
+	{
+		id = ++self->nextNotificationId;
+		show_notification(self, id, urgency, timeout, app_icon, markup, key, 1);
+	}
+	else
+	{
+		if(self->pending.length >= NOTIFICATION_MAX_PENDING)
+		{
+			PendingNotification *dropped = g_queue_pop_head(&self->pending);
+			emit_closed(self, dropped->id, NOTIFICATION_CLOSED_EXPIRED);
+			free_pending_notification(dropped);
+		}
+		p = g_new0(PendingNotification, 1);
+		p->id = id = ++self->nextNotificationId;
+		p->urgency = urgency;
+		p->timeout = timeout;
+		p->icon = g_strdup(app_icon);
+		p->markup = markup;
+		p->key = key;
+		p->count = 1;
+		g_queue_push_tail(&self->pending, p);
+		markup = key = NULL;
+	}
+
+	g_free(markup);
+	g_free(key);
+	dbus_notifications_complete_notify(object, invocation, id);
+
+	// Closed after the reply is sent, so the sender knows the id by the
+	// time the signal for it arrives
+	if(dropped)
+		emit_closed(self, id, NOTIFICATION_CLOSED_EXPIRED);
 	return TRUE;
 }
 
 static gboolean on_dbus_call_close_notification(GrapheneNotificationBox *self, GDBusMethodInvocation *invocation, guint id, DBusNotifications *object)
 {
 	GrapheneNotification *n = get_notification_by_id(self, id);
+	PendingNotification *p = n ? NULL : get_pending_by_id(self, id);
 	if(n)
+		remove_notification(n, NOTIFICATION_CLOSED_BY_CALL);
+	else if(p)
+	{
+		g_queue_remove(&self->pending, p);
+		emit_closed(self, p->id, NOTIFICATION_CLOSED_BY_CALL);
+		free_pending_notification(p);
+	}
 
 	dbus_notifications_complete_close_notification(object, invocation);
 	return TRUE;
@@ -234,44 +502,116 @@ static gboolean on_dbus_call_get_server_information(GrapheneNotificationBox *sel
 	return TRUE;
 }
 
-static void add_notification(GrapheneNotificationBox *self, GrapheneNotification *n)
+/*
+ * Returns a notification widget (inside its shadow) which isn't in the box,
+ * taken from the pool if possible. The caller owns a ref on the shadow until
+ * it is passed to add_notification, and must set the notification's contents.
+ * Widgets are only announced to notificationAddedCb once, since they're
+ * still the same actors when they come back out of the pool.
+ */
+static GrapheneNotification * acquire_notification(GrapheneNotificationBox *self)
 {
-	CmkShadow *shadow = cmk_shadow_new_full(CMK_SHADOW_MASK_ALL, 20);
-	clutter_actor_add_child(CLUTTER_ACTOR(shadow), CLUTTER_ACTOR(n));
-	clutter_actor_add_child(CLUTTER_ACTOR(self), CLUTTER_ACTOR(shadow));
-	if(self->notificationAddedCb)
+	GrapheneNotification *n;
+	if(self->pool->len > 0)
+	{
+		ClutterActor *shadow = g_ptr_array_index(self->pool, self->pool->len - 1);
+		g_ptr_array_remove_index_fast(self->pool, self->pool->len - 1);
+		n = GRAPHENE_NOTIFICATION(cmk_shadow_get_first_child(CMK_SHADOW(shadow)));
+	}
+	else
+	{
+		CmkShadow *shadow = g_object_ref_sink(cmk_shadow_new_full(CMK_SHADOW_MASK_ALL, 20));
+		n = graphene_notification_new();
+		n->box = self;
+		clutter_actor_add_child(CLUTTER_ACTOR(shadow), CLUTTER_ACTOR(n));
+	}
+
+	n->id = 0;
+	n->urgency = NOTIFICATION_URGENCY_NORMAL;
+	n->timeout = 0;
+	g_clear_pointer(&n->key, g_free);
+	graphene_notification_set_count(n, 1);
+
+	if(!n->announced && self->notificationAddedCb)
+	{
 		self->notificationAddedCb(self->cbUserdata, CLUTTER_ACTOR(n));
+		n->announced = TRUE;
+	}
+	return n;
 }
 
-static gboolean remove_notification(GrapheneNotification *n)
+/*
+ * Orders critical notifications above the rest, and newer above older.
+ */
+static gint notification_compare(const GrapheneNotification *a, const GrapheneNotification *b)
+{
+	gboolean aCritical = (a->urgency == NOTIFICATION_URGENCY_CRITICAL);
+	gboolean bCritical = (b->urgency == NOTIFICATION_URGENCY_CRITICAL);
+	if(aCritical != bCritical)
+		return aCritical ? -1 : 1;
+	return (a->id > b->id) ? -1 : (a->id < b->id);
+}
+
+/*
+ * Puts the notification in the box, and into its place in the visible queue.
+ * The queue is kept sorted here so that allocation doesn't have to; it only
+ * holds a few notifications, and new ones usually go near the top.
+ */
+static void add_notification(GrapheneNotificationBox *self, GrapheneNotification *n)
 {
-	ClutterActor *parent = clutter_actor_get_parent(CLUTTER_ACTOR(n));
-	if(CMK_IS_SHADOW(parent))
-		clutter_actor_destroy(parent);
+	GList *sibling = self->visible.head;
+	while(sibling && notification_compare(sibling->data, n) < 0)
+		sibling = sibling->next;
+	if(sibling)
+		g_queue_insert_before(&self->visible, sibling, n);
 	else
-		clutter_actor_destroy(CLUTTER_ACTOR(n));
-	return G_SOURCE_REMOVE;
+		g_queue_push_tail(&self->visible, n);
+
+	ClutterActor *shadow = clutter_actor_get_parent(CLUTTER_ACTOR(n));
+	if(clutter_actor_get_parent(shadow) == CLUTTER_ACTOR(self))
+		return;
+	g_hash_table_insert(self->notifications, GUINT_TO_POINTER(n->id), n);
+	clutter_actor_add_child(CLUTTER_ACTOR(self), shadow);
+	g_object_unref(shadow);
 }
 
-static gint notification_compare_func(gconstpointer a, gconstpointer b)
+/*
+ * Takes the notification off the screen and puts it back in the pool, or
+ * destroys it if the pool is full. A pending notification is shown in its
+ * place, if there is one.
+ */
+static void remove_notification(GrapheneNotification *n, guint reason)
 {
-	// TODO: Sort "critical" notifications to the top
-	a = cmk_shadow_get_first_child((CmkShadow *)a);
-	b = cmk_shadow_get_first_child((CmkShadow *)b);
-	return (((const GrapheneNotification *)a)->id < ((const GrapheneNotification *)b)->id) ? 1 : -1; // Sort newest to the top
+	GrapheneNotificationBox *self = n->box;
+	graphene_notification_stop_timeout(n);
+	if(!self->notifications || !g_hash_table_remove(self->notifications, GUINT_TO_POINTER(n->id)))
+		return;
+
+	g_queue_remove(&self->visible, n);
+	emit_closed(self, n->id, reason);
+	n->id = 0;
+
+	ClutterActor *shadow = clutter_actor_get_parent(CLUTTER_ACTOR(n));
+	if(self->pool->len < NOTIFICATION_POOL_SIZE)
+	{
+		g_ptr_array_add(self->pool, g_object_ref(shadow));
+		clutter_actor_remove_child(CLUTTER_ACTOR(self), shadow);
+	}
+	else
+		clutter_actor_destroy(shadow);
+
+	show_pending(self);
 }
 
 static void graphene_notification_box_allocate(ClutterActor *self_, const ClutterActorBox *box, ClutterAllocationFlags flags)
 {
-	GList *children = clutter_actor_get_children(self_);
-	children = g_list_sort(children, (GCompareFunc)notification_compare_func);
-	
+	GrapheneNotificationBox *self = GRAPHENE_NOTIFICATION_BOX(self_);
 	gfloat scale = cmk_widget_style_get_scale_factor(CMK_WIDGET(self_));
 
 	guint i=0;
-	for(GList *it=children; it!=NULL; it=it->next)
+	for(GList *it=self->visible.head; it!=NULL; it=it->next)
 	{
-		ClutterActor *n_ = CLUTTER_ACTOR(it->data);
+		ClutterActor *n_ = clutter_actor_get_parent(CLUTTER_ACTOR(it->data));
 		ClutterActorBox box;
 		box.x1 = NOTIFICATION_SPACING;
 		box.y1 = NOTIFICATION_SPACING + i*(NOTIFICATION_HEIGHT + NOTIFICATION_SPACING);
@@ -286,14 +626,11 @@ static void graphene_notification_box_allocate(ClutterActor *self_, const Clutte
 		clutter_actor_restore_easing_state(n_);
 		++i;
 	}
-	
-	g_list_free(children);
 
 	CLUTTER_ACTOR_CLASS(graphene_notification_box_parent_class)->allocate(self_, box, flags);
 }
 
 
-
 static void graphene_notification_dispose(GObject *self_);
 static void graphene_notification_stop_timeout(GrapheneNotification *self);
 static void graphene_notification_allocate(ClutterActor *self_, const ClutterActorBox *box, ClutterAllocationFlags flags);
@@ -327,6 +664,11 @@ static void graphene_notification_init(GrapheneNotification *self)
 	self->icon = cmk_icon_new();
 	clutter_actor_add_child(CLUTTER_ACTOR(self), CLUTTER_ACTOR(self->icon));
 
+	self->badge = CLUTTER_TEXT(clutter_text_new());
+	clutter_actor_hide(CLUTTER_ACTOR(self->badge));
+	clutter_actor_add_child(CLUTTER_ACTOR(self), CLUTTER_ACTOR(self->badge));
+	self->count = 1;
+
 	clutter_actor_set_reactive(CLUTTER_ACTOR(self), TRUE);
 
 	cmk_widget_set_draw_background_color(CMK_WIDGET(self), TRUE);
@@ -338,8 +680,9 @@ static void graphene_notification_dispose(GObject *self_)
 	GrapheneNotification *self = GRAPHENE_NOTIFICATION(self_);
 
 	graphene_notification_stop_timeout(self);
+	g_clear_pointer(&self->key, g_free);
 
-	G_OBJECT_CLASS(graphene_notification_box_parent_class)->dispose(self_);
+	G_OBJECT_CLASS(graphene_notification_parent_class)->dispose(self_);
 }
 
 static void graphene_notification_stop_timeout(GrapheneNotification *self)
@@ -349,12 +692,38 @@ static void graphene_notification_stop_timeout(GrapheneNotification *self)
 	self->timeoutSourceId = 0;
 }
 
+static gboolean on_notification_timeout(GrapheneNotification *self)
+{
+	self->timeoutSourceId = 0;
+	remove_notification(self, NOTIFICATION_CLOSED_EXPIRED);
+	return G_SOURCE_REMOVE;
+}
+
 static void graphene_notification_set_timeout(GrapheneNotification *self, gint timeout)
 {
 	graphene_notification_stop_timeout(self);
 	self->timeout = timeout;
 	if(timeout > 0)
-		self->timeoutSourceId = g_timeout_add(timeout, (GSourceFunc)remove_notification, self);
+		self->timeoutSourceId = g_timeout_add(timeout, (GSourceFunc)on_notification_timeout, self);
+}
+
+/*
+ * Shows how many times the notification has been posted, if more than once.
+ */
+static void graphene_notification_set_count(GrapheneNotification *self, guint count)
+{
+	if(self->count == count)
+		return;
+	self->count = count;
+	if(count > 1)
+	{
+		gchar *text = g_strdup_printf("\u00D7%u", count);
+		clutter_text_set_text(self->badge, text);
+		g_free(text);
+		clutter_actor_show(CLUTTER_ACTOR(self->badge));
+	}
+	else
+		clutter_actor_hide(CLUTTER_ACTOR(self->badge));
 }
 
 static void graphene_notification_allocate(ClutterActor *self_, const ClutterActorBox *box, ClutterAllocationFlags flags)
@@ -368,6 +737,15 @@ static void graphene_notification_allocate(ClutterActor *self_, const ClutterAct
 	ClutterActorBox iconBox = {padBox.x1, padBox.y1, padBox.x1+48*scale, padBox.y2};
 	padBox.x1 = iconBox.x2 + padding;
 
+	if(clutter_actor_is_visible(CLUTTER_ACTOR(self->badge)))
+	{
+		gfloat badgeWidth, badgeHeight;
+		clutter_actor_get_preferred_size(CLUTTER_ACTOR(self->badge), NULL, NULL, &badgeWidth, &badgeHeight);
+		ClutterActorBox badgeBox = {padBox.x2-badgeWidth, padBox.y1, padBox.x2, padBox.y1+badgeHeight};
+		clutter_actor_allocate(CLUTTER_ACTOR(self->badge), &badgeBox, flags);
+		padBox.x2 = badgeBox.x1 - padding;
+	}
+
 	clutter_actor_allocate(CLUTTER_ACTOR(self->icon), &iconBox, flags);
 	clutter_actor_allocate(CLUTTER_ACTOR(self->text), &padBox, flags);
 
@@ -376,7 +754,7 @@ static void graphene_notification_allocate(ClutterActor *self_, const ClutterAct
 
 static gboolean graphene_notification_press(ClutterActor *self_, ClutterButtonEvent *event)
 {
-	remove_notification(GRAPHENE_NOTIFICATION(self_));
+	remove_notification(GRAPHENE_NOTIFICATION(self_), NOTIFICATION_CLOSED_DISMISSED);
 	return TRUE;
 }
 
@@ -388,6 +766,9 @@ static gboolean graphene_notification_enter(ClutterActor *self_, ClutterCrossing
 
 static gboolean graphene_notification_leave(ClutterActor *self_, ClutterCrossingEvent *event)
 {
+	// Don't restart the timeout if this was just dismissed
+	if(GRAPHENE_NOTIFICATION(self_)->id == 0)
+		return TRUE;
 	graphene_notification_set_timeout(GRAPHENE_NOTIFICATION(self_), GRAPHENE_NOTIFICATION(self_)->timeout);
 	return TRUE;
 }
@@ -396,5 +777,6 @@ static void on_background_changed(CmkWidget *self_)
 {
 	const ClutterColor *color = cmk_widget_get_foreground_color(self_);
 	clutter_text_set_color(GRAPHENE_NOTIFICATION(self_)->text, color);
+	clutter_text_set_color(GRAPHENE_NOTIFICATION(self_)->badge, color);
 	CMK_WIDGET_CLASS(graphene_notification_parent_class)->background_changed(self_);
 }
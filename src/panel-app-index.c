@@ -0,0 +1,360 @@
+/*
+ * This file is part of graphene-desktop, the desktop environment of VeltOS.
+ * Copyright (C) 2016 Velt Technologies, Aidan Shafran <zelbrium@gmail.com>
+ * Licensed under the Apache License 2 <www.apache.org/licenses/LICENSE-2.0>.
+ *
+ * Keeps a flattened list of the applications in the menu, so the launcher
+ * doesn't have to load the GMenuTree every time it opens. The tree is
+ * loaded on a worker thread, and reloaded whenever it changes.
+ */
+
+#define GMENU_I_KNOW_THIS_IS_UNSTABLE // TODO: Maybe find an alternative?
+
+#include "panel-internal.h"
+#include <gmenu-tree.h>
+
+#define MENU_FILE "gnome-applications.menu"
+#define LAUNCH_COUNTS_GROUP "Launches"
+#define SAVE_LAUNCH_COUNTS_DELAY 10 // Seconds
+
+struct _GrapheneAppIndex
+{
+	GObject parent;
+	GPtrArray *entries; // GrapheneAppEntry *, in menu order
+	GMenuTree *tree; // Tree from the last load (even a failed one), kept for its changed signal
+	GCancellable *cancellable;
+	gboolean loading;
+	gboolean reloadPending;
+	GHashTable *launchCounts; // App ID -> count (as pointer)
+	guint saveLaunchCountsId;
+};
+
+typedef struct
+{
+	GMenuTree *tree;
+	GPtrArray *entries;
+	GError *error; // Entries are NULL if set
+} IndexLoad;
+
+enum
+{
+	SIGNAL_0,
+	SIGNAL_CHANGED,
+	SIGNAL_LAST
+};
+
+static guint signals[SIGNAL_LAST];
+
+static void graphene_app_index_dispose(GObject *self_);
+static void app_index_load(GrapheneAppIndex *self);
+static void on_tree_changed(GrapheneAppIndex *self, GMenuTree *tree);
+static void load_launch_counts(GrapheneAppIndex *self);
+static void save_launch_counts(GrapheneAppIndex *self);
+
+G_DEFINE_TYPE(GrapheneAppIndex, graphene_app_index, G_TYPE_OBJECT)
+
+
+GrapheneAppIndex * graphene_app_index_new(void)
+{
+	return GRAPHENE_APP_INDEX(g_object_new(GRAPHENE_TYPE_APP_INDEX, NULL));
+}
+
+static void graphene_app_index_class_init(GrapheneAppIndexClass *class)
+{
+	G_OBJECT_CLASS(class)->dispose = graphene_app_index_dispose;
+
+	/*
+	 * Emitted when a new set of entries has finished loading.
+	 */
+	signals[SIGNAL_CHANGED] = g_signal_new("changed", G_TYPE_FROM_CLASS(class), G_SIGNAL_RUN_FIRST, 0, NULL, NULL, NULL, G_TYPE_NONE, 0);
+}
+
+static void graphene_app_index_init(GrapheneAppIndex *self)
+{
+	self->entries = g_ptr_array_new();
+	self->cancellable = g_cancellable_new();
+	self->launchCounts = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	load_launch_counts(self);
+	app_index_load(self);
+}
+
+static void graphene_app_index_dispose(GObject *self_)
+{
+	GrapheneAppIndex *self = GRAPHENE_APP_INDEX(self_);
+	if(self->saveLaunchCountsId)
+	{
+		// Don't lose launches from the last few seconds
+		g_source_remove(self->saveLaunchCountsId);
+		self->saveLaunchCountsId = 0;
+		save_launch_counts(self);
+	}
+	if(self->cancellable)
+		g_cancellable_cancel(self->cancellable);
+	g_clear_object(&self->cancellable);
+	if(self->tree)
+		g_signal_handlers_disconnect_by_data(self->tree, self);
+	g_clear_object(&self->tree);
+	g_clear_pointer(&self->entries, g_ptr_array_unref);
+	g_clear_pointer(&self->launchCounts, g_hash_table_unref);
+	G_OBJECT_CLASS(graphene_app_index_parent_class)->dispose(self_);
+}
+
+static void free_app_entry(GrapheneAppEntry *entry)
+{
+	g_free(entry->name);
+	g_free(entry->iconName);
+	g_free(entry->category);
+	g_free(entry->searchName);
+	g_strfreev(entry->searchExtra);
+	g_clear_object(&entry->appInfo);
+	g_free(entry);
+}
+
+static GrapheneAppEntry * app_entry_new(GDesktopAppInfo *appInfo, const gchar *category)
+{
+	GrapheneAppEntry *entry = g_new0(GrapheneAppEntry, 1);
+	entry->appInfo = g_object_ref(appInfo);
+	entry->name = g_strdup(g_app_info_get_display_name(G_APP_INFO(appInfo)));
+	entry->category = g_strdup(category);
+
+	// Normalized here, on the loading thread, so that searches don't have to
+	entry->searchName = graphene_app_search_normalize(entry->name);
+	entry->searchMask = graphene_app_search_char_mask(entry->searchName);
+
+	const gchar * const *keywords = g_desktop_app_info_get_keywords(appInfo);
+	guint numKeywords = keywords ? g_strv_length((gchar **)keywords) : 0;
+	entry->searchExtra = g_new0(gchar *, numKeywords + 3);
+	guint numExtra = 0;
+	const gchar *genericName = g_desktop_app_info_get_generic_name(appInfo);
+	if(genericName)
+		entry->searchExtra[numExtra++] = graphene_app_search_normalize(genericName);
+	for(guint i=0;i<numKeywords;++i)
+		entry->searchExtra[numExtra++] = graphene_app_search_normalize(keywords[i]);
+	const gchar *executable = g_app_info_get_executable(G_APP_INFO(appInfo));
+	if(executable)
+	{
+		gchar *basename = g_path_get_basename(executable);
+		entry->searchExtra[numExtra++] = graphene_app_search_normalize(basename);
+		g_free(basename);
+	}
+	for(guint i=0;i<numExtra;++i)
+		entry->searchMask |= graphene_app_search_char_mask(entry->searchExtra[i]);
+
+	GIcon *gicon = g_app_info_get_icon(G_APP_INFO(appInfo));
+	if(G_IS_THEMED_ICON(gicon))
+	{
+		const gchar * const *names = g_themed_icon_get_names(G_THEMED_ICON(gicon));
+		if(names && names[0])
+			entry->iconName = g_strdup(names[0]);
+	}
+	return entry;
+}
+
+static void flatten_directory(GPtrArray *entries, GMenuTreeDirectory *directory, const gchar *category)
+{
+	GMenuTreeIter *it = gmenu_tree_directory_iter(directory);
+
+	while(TRUE)
+	{
+		GMenuTreeItemType type = gmenu_tree_iter_next(it);
+		if(type == GMENU_TREE_ITEM_INVALID)
+			break;
+
+		if(type == GMENU_TREE_ITEM_ENTRY)
+		{
+			GMenuTreeEntry *entry = gmenu_tree_iter_get_entry(it);
+			GDesktopAppInfo *appInfo = gmenu_tree_entry_get_app_info(entry);
+			if(appInfo && !g_desktop_app_info_get_nodisplay(appInfo))
+				g_ptr_array_add(entries, app_entry_new(appInfo, category));
+			gmenu_tree_item_unref(entry);
+		}
+		else if(type == GMENU_TREE_ITEM_DIRECTORY)
+		{
+			GMenuTreeDirectory *subdirectory = gmenu_tree_iter_get_directory(it);
+			flatten_directory(entries, subdirectory, gmenu_tree_directory_get_name(subdirectory));
+			gmenu_tree_item_unref(subdirectory);
+		}
+	}
+
+	gmenu_tree_iter_unref(it);
+}
+
+static void free_index_load(IndexLoad *load)
+{
+	g_clear_object(&load->tree);
+	if(load->entries)
+		g_ptr_array_unref(load->entries);
+	g_clear_error(&load->error);
+	g_free(load);
+}
+
+// Runs on a worker thread
+static void app_index_load_thread(GTask *task, gpointer source, gpointer taskData, GCancellable *cancellable)
+{
+	// Each load uses a new tree, so the main thread can keep using the
+	// previous one for change notifications while this runs. A tree which
+	// failed to load is still returned, since it monitors the menu files and
+	// emits changed when they're fixed.
+	IndexLoad *load = g_new0(IndexLoad, 1);
+	load->tree = gmenu_tree_new(MENU_FILE, GMENU_TREE_FLAGS_SORT_DISPLAY_NAME);
+	if(!gmenu_tree_load_sync(load->tree, &load->error))
+	{
+		g_task_return_pointer(task, load, (GDestroyNotify)free_index_load);
+		return;
+	}
+
+	load->entries = g_ptr_array_new_with_free_func((GDestroyNotify)free_app_entry);
+	GMenuTreeDirectory *root = gmenu_tree_get_root_directory(load->tree);
+	if(root)
+	{
+		flatten_directory(load->entries, root, NULL);
+		gmenu_tree_item_unref(root);
+	}
+	g_task_return_pointer(task, load, (GDestroyNotify)free_index_load);
+}
+
+static void on_app_index_loaded(GObject *source, GAsyncResult *result, gpointer userdata)
+{
+	// The task only fails if it was cancelled, which means self is gone
+	IndexLoad *load = g_task_propagate_pointer(G_TASK(result), NULL);
+	if(!load)
+		return;
+
+	GrapheneAppIndex *self = GRAPHENE_APP_INDEX(source);
+	self->loading = FALSE;
+
+	if(self->tree)
+		g_signal_handlers_disconnect_by_data(self->tree, self);
+	g_clear_object(&self->tree);
+	self->tree = g_steal_pointer(&load->tree);
+	g_signal_connect_swapped(self->tree, "changed", G_CALLBACK(on_tree_changed), self);
+
+	if(load->error)
+	{
+		// Keep the entries from the last successful load, if any, and
+		// retry when the tree changes
+		g_warning("Failed to load application menu: %s", load->error->message);
+	}
+	else
+	{
+		g_ptr_array_unref(self->entries);
+		self->entries = g_steal_pointer(&load->entries);
+
+		for(guint i=0;i<self->entries->len;++i)
+		{
+			GrapheneAppEntry *entry = g_ptr_array_index(self->entries, i);
+			const gchar *id = g_app_info_get_id(G_APP_INFO(entry->appInfo));
+			if(id)
+				entry->launchCount = GPOINTER_TO_UINT(g_hash_table_lookup(self->launchCounts, id));
+		}
+		g_signal_emit(self, signals[SIGNAL_CHANGED], 0);
+	}
+	free_index_load(load);
+
+	// Changes which arrived during the load
+	if(self->reloadPending)
+		app_index_load(self);
+}
+
+static void app_index_load(GrapheneAppIndex *self)
+{
+	if(self->loading)
+	{
+		self->reloadPending = TRUE;
+		return;
+	}
+	self->loading = TRUE;
+	self->reloadPending = FALSE;
+
+	GTask *task = g_task_new(self, self->cancellable, on_app_index_loaded, NULL);
+	g_task_set_return_on_cancel(task, TRUE);
+	g_task_run_in_thread(task, app_index_load_thread);
+	g_object_unref(task);
+}
+
+static void on_tree_changed(GrapheneAppIndex *self, GMenuTree *tree)
+{
+	app_index_load(self);
+}
+
+GPtrArray * graphene_app_index_get_entries(GrapheneAppIndex *self)
+{
+	g_return_val_if_fail(GRAPHENE_IS_APP_INDEX(self), NULL);
+	return g_ptr_array_ref(self->entries);
+}
+
+static gchar * get_launch_counts_path(void)
+{
+	return g_build_filename(g_get_user_data_dir(), "graphene", "launch-counts", NULL);
+}
+
+static void load_launch_counts(GrapheneAppIndex *self)
+{
+	gchar *path = get_launch_counts_path();
+	GKeyFile *keyfile = g_key_file_new();
+	if(g_key_file_load_from_file(keyfile, path, G_KEY_FILE_NONE, NULL))
+	{
+		gchar **ids = g_key_file_get_keys(keyfile, LAUNCH_COUNTS_GROUP, NULL, NULL);
+		for(guint i=0;ids && ids[i];++i)
+		{
+			guint count = g_key_file_get_integer(keyfile, LAUNCH_COUNTS_GROUP, ids[i], NULL);
+			if(count > 0)
+				g_hash_table_insert(self->launchCounts, g_strdup(ids[i]), GUINT_TO_POINTER(count));
+		}
+		g_strfreev(ids);
+	}
+	g_key_file_unref(keyfile);
+	g_free(path);
+}
+
+static void save_launch_counts(GrapheneAppIndex *self)
+{
+	GKeyFile *keyfile = g_key_file_new();
+	GHashTableIter iter;
+	gpointer id, count;
+	g_hash_table_iter_init(&iter, self->launchCounts);
+	while(g_hash_table_iter_next(&iter, &id, &count))
+		g_key_file_set_integer(keyfile, LAUNCH_COUNTS_GROUP, id, GPOINTER_TO_UINT(count));
+
+	gchar *path = get_launch_counts_path();
+	gchar *dir = g_path_get_dirname(path);
+	g_mkdir_with_parents(dir, 0755);
+	gsize length = 0;
+	gchar *data = g_key_file_to_data(keyfile, &length, NULL);
+	GError *error = NULL;
+	if(!g_file_set_contents(path, data, length, &error))
+	{
+		g_warning("Failed to save launch counts: %s", error->message);
+		g_error_free(error);
+	}
+	g_free(data);
+	g_free(dir);
+	g_free(path);
+	g_key_file_unref(keyfile);
+}
+
+static gboolean on_save_launch_counts(GrapheneAppIndex *self)
+{
+	self->saveLaunchCountsId = 0;
+	save_launch_counts(self);
+	return G_SOURCE_REMOVE;
+}
+
+void graphene_app_index_record_launch(GrapheneAppIndex *self, GrapheneAppEntry *entry)
+{
+	g_return_if_fail(GRAPHENE_IS_APP_INDEX(self));
+	g_return_if_fail(entry);
+
+	const gchar *id = g_app_info_get_id(G_APP_INFO(entry->appInfo));
+	if(!id)
+		return;
+
+	// The entry may be from an older load, so count from the table
+	entry->launchCount = GPOINTER_TO_UINT(g_hash_table_lookup(self->launchCounts, id)) + 1;
+	g_hash_table_insert(self->launchCounts, g_strdup(id), GUINT_TO_POINTER(entry->launchCount));
+
+	// Launching an app is already busy enough without writing a file, and
+	// launches often come in bursts; save them together a little later
+	if(!self->saveLaunchCountsId)
+		self->saveLaunchCountsId = g_timeout_add_seconds(SAVE_LAUNCH_COUNTS_DELAY, (GSourceFunc)on_save_launch_counts, self);
+}
@@ -0,0 +1,306 @@
+/*
+ * This file is part of graphene-desktop, the desktop environment of VeltOS.
+ * Copyright (C) 2016 Velt Technologies, Aidan Shafran <zelbrium@gmail.com>
+ * Licensed under the Apache License 2 <www.apache.org/licenses/LICENSE-2.0>.
+ *
+ * Fuzzy, ranked search over the launcher's application entries.
+ *
+ * Each query term must match as a subsequence of the entry's name or one
+ * of its other search fields (GenericName, Keywords, executable). Matches
+ * are scored like fzf: matched characters at the start of words and runs
+ * of consecutive characters score higher, and gaps between characters
+ * score lower. Entries the user launches often get a small boost.
+ *
+ * The search fields are normalized once when the entries are loaded, along
+ * with a mask of the characters they contain, which rejects most entries
+ * without looking at their text. When a query extends the previous one,
+ * only the previous results are searched again.
+ */
+
+#include "panel-internal.h"
+#include <string.h>
+
+#define SCORE_MATCH 16
+#define SCORE_GAP_START -3
+#define SCORE_GAP_EXTENSION -1
+#define BONUS_BOUNDARY 8
+#define BONUS_TEXT_START 4 // On top of BONUS_BOUNDARY
+#define BONUS_CONSECUTIVE 4
+#define BONUS_LAUNCH 4 // Per doubling of the launch count
+#define NO_MATCH G_MININT
+
+typedef struct
+{
+	GrapheneAppEntry *entry;
+	gint score;
+	guint order; // Position in the entries array, for stable ranking
+} SearchMatch;
+
+struct _GrapheneAppSearch
+{
+	GPtrArray *entries;
+	gchar *lastQuery; // Normalized
+	GArray *matches; // SearchMatch, for lastQuery
+	GArray *scratch;
+	GPtrArray *results;
+};
+
+
+GrapheneAppSearch * graphene_app_search_new(void)
+{
+	GrapheneAppSearch *self = g_new0(GrapheneAppSearch, 1);
+	self->matches = g_array_new(FALSE, FALSE, sizeof(SearchMatch));
+	self->scratch = g_array_new(FALSE, FALSE, sizeof(SearchMatch));
+	self->results = g_ptr_array_new();
+	return self;
+}
+
+void graphene_app_search_free(GrapheneAppSearch *self)
+{
+	if(!self)
+		return;
+	if(self->entries)
+		g_ptr_array_unref(self->entries);
+	g_free(self->lastQuery);
+	g_array_unref(self->matches);
+	g_array_unref(self->scratch);
+	g_ptr_array_unref(self->results);
+	g_free(self);
+}
+
+void graphene_app_search_set_entries(GrapheneAppSearch *self, GPtrArray *entries)
+{
+	g_return_if_fail(self);
+	if(self->entries)
+		g_ptr_array_unref(self->entries);
+	self->entries = entries ? g_ptr_array_ref(entries) : NULL;
+	g_clear_pointer(&self->lastQuery, g_free);
+	g_array_set_size(self->matches, 0);
+	g_ptr_array_set_size(self->results, 0);
+}
+
+gchar * graphene_app_search_normalize(const gchar *text)
+{
+	if(!text)
+		return g_strdup("");
+
+	gchar *decomposed = g_utf8_normalize(text, -1, G_NORMALIZE_ALL);
+	if(!decomposed) // Invalid UTF-8
+		return g_strdup("");
+	gchar *folded = g_utf8_casefold(decomposed, -1);
+	g_free(decomposed);
+
+	// Drop combining marks, so that accented letters match their base letter
+	GString *normalized = g_string_sized_new(strlen(folded));
+	for(const gchar *p=folded;*p;p=g_utf8_next_char(p))
+	{
+		gunichar c = g_utf8_get_char(p);
+		if(!g_unichar_ismark(c))
+			g_string_append_unichar(normalized, c);
+	}
+	g_free(folded);
+	return g_string_free(normalized, FALSE);
+}
+
+guint64 graphene_app_search_char_mask(const gchar *normalized)
+{
+	guint64 mask = 0;
+	for(const guchar *p=(const guchar *)normalized;p && *p;++p)
+	{
+		if(*p >= 'a' && *p <= 'z')
+			mask |= G_GUINT64_CONSTANT(1) << (*p - 'a');
+		else if(*p >= '0' && *p <= '9')
+			mask |= G_GUINT64_CONSTANT(1) << (26 + *p - '0');
+		else if(*p >= 0x80)
+			mask |= G_GUINT64_CONSTANT(1) << 63;
+	}
+	return mask;
+}
+
+static gboolean is_word_char(gunichar c)
+{
+	return g_unichar_isalnum(c);
+}
+
+/*
+ * Scores term as a subsequence of text, fzf v1 style: the first occurrence
+ * of the whole subsequence is found scanning forward, then its start is
+ * pulled as far right as possible scanning backward, so that the match is
+ * as tight as possible.
+ */
+static gint score_term(const gchar *text, const gunichar *term, guint termLength)
+{
+	if(!text || termLength == 0)
+		return NO_MATCH;
+
+	const gchar *start = NULL, *end = NULL;
+	guint t = 0;
+	for(const gchar *p=text;*p;p=g_utf8_next_char(p))
+	{
+		if(g_utf8_get_char(p) != term[t])
+			continue;
+		if(t == 0)
+			start = p;
+		if(++t == termLength)
+		{
+			end = g_utf8_next_char(p);
+			break;
+		}
+	}
+	if(!end)
+		return NO_MATCH;
+
+	const gchar *p = end;
+	t = termLength;
+	while(p > start)
+	{
+		p = g_utf8_prev_char(p);
+		if(g_utf8_get_char(p) == term[t-1] && --t == 0)
+			break;
+	}
+	start = p;
+
+	gint score = 0;
+	gboolean consecutive = FALSE, inGap = FALSE;
+	gunichar prev = (start > text) ? g_utf8_get_char(g_utf8_prev_char(start)) : 0;
+	t = 0;
+	for(p=start;p<end;p=g_utf8_next_char(p))
+	{
+		gunichar c = g_utf8_get_char(p);
+		if(t < termLength && c == term[t])
+		{
+			score += SCORE_MATCH;
+			if(p == text)
+				score += BONUS_BOUNDARY + BONUS_TEXT_START;
+			else if(!is_word_char(prev) && is_word_char(c))
+				score += BONUS_BOUNDARY;
+			if(consecutive)
+				score += BONUS_CONSECUTIVE;
+			consecutive = TRUE;
+			inGap = FALSE;
+			++t;
+		}
+		else
+		{
+			score += inGap ? SCORE_GAP_EXTENSION : SCORE_GAP_START;
+			consecutive = FALSE;
+			inGap = TRUE;
+		}
+		prev = c;
+	}
+	return score;
+}
+
+static gint score_entry(GrapheneAppEntry *entry, gunichar **terms, guint *termLengths, guint64 mask)
+{
+	if((entry->searchMask & mask) != mask)
+		return NO_MATCH;
+
+	gint total = 0;
+	for(guint i=0;terms[i];++i)
+	{
+		gint best = score_term(entry->searchName, terms[i], termLengths[i]);
+		for(guint j=0;entry->searchExtra && entry->searchExtra[j];++j)
+		{
+			// Matches outside of the name count for less
+			gint score = score_term(entry->searchExtra[j], terms[i], termLengths[i]);
+			if(score != NO_MATCH && (best == NO_MATCH || score/2 > best))
+				best = score/2;
+		}
+		if(best == NO_MATCH)
+			return NO_MATCH;
+		total += best;
+	}
+	return total + BONUS_LAUNCH * g_bit_storage(entry->launchCount);
+}
+
+static gint compare_matches(gconstpointer a_, gconstpointer b_)
+{
+	const SearchMatch *a = a_, *b = b_;
+	if(a->score != b->score)
+		return (a->score > b->score) ? -1 : 1;
+	gsize lengthA = strlen(a->entry->searchName), lengthB = strlen(b->entry->searchName);
+	if(lengthA != lengthB)
+		return (lengthA < lengthB) ? -1 : 1;
+	return (a->order < b->order) ? -1 : (a->order > b->order);
+}
+
+GPtrArray * graphene_app_search_query(GrapheneAppSearch *self, const gchar *query)
+{
+	g_return_val_if_fail(self, NULL);
+
+	g_ptr_array_set_size(self->results, 0);
+	gchar *normalized = graphene_app_search_normalize(query);
+	gchar **words = g_strsplit_set(normalized, " \t\n", -1);
+
+	guint numTerms = 0;
+	for(guint i=0;words[i];++i)
+		if(words[i][0])
+			++numTerms;
+
+	if(numTerms == 0 || !self->entries)
+	{
+		g_strfreev(words);
+		g_free(normalized);
+		g_clear_pointer(&self->lastQuery, g_free);
+		g_array_set_size(self->matches, 0);
+		return self->results;
+	}
+
+	gunichar **terms = g_new0(gunichar *, numTerms + 1);
+	guint *termLengths = g_new0(guint, numTerms);
+	for(guint i=0, t=0;words[i];++i)
+	{
+		if(!words[i][0])
+			continue;
+		glong length = 0;
+		terms[t] = g_utf8_to_ucs4_fast(words[i], -1, &length);
+		termLengths[t++] = length;
+	}
+	guint64 mask = graphene_app_search_char_mask(normalized);
+
+	// Every match for an extended query also matched the previous query,
+	// since each term is either unchanged, a new term, or an extension of
+	// the last term.
+	gboolean refine = self->lastQuery && g_str_has_prefix(normalized, self->lastQuery);
+
+	g_array_set_size(self->scratch, 0);
+	if(refine)
+	{
+		for(guint i=0;i<self->matches->len;++i)
+		{
+			SearchMatch match = g_array_index(self->matches, SearchMatch, i);
+			match.score = score_entry(match.entry, terms, termLengths, mask);
+			if(match.score != NO_MATCH)
+				g_array_append_val(self->scratch, match);
+		}
+	}
+	else
+	{
+		for(guint i=0;i<self->entries->len;++i)
+		{
+			SearchMatch match = {g_ptr_array_index(self->entries, i), 0, i};
+			match.score = score_entry(match.entry, terms, termLengths, mask);
+			if(match.score != NO_MATCH)
+				g_array_append_val(self->scratch, match);
+		}
+	}
+
+	g_array_sort(self->scratch, compare_matches);
+
+	GArray *swap = self->matches;
+	self->matches = self->scratch;
+	self->scratch = swap;
+	g_free(self->lastQuery);
+	self->lastQuery = normalized;
+
+	for(guint i=0;i<self->matches->len;++i)
+		g_ptr_array_add(self->results, g_array_index(self->matches, SearchMatch, i).entry);
+
+	for(guint i=0;i<numTerms;++i)
+		g_free(terms[i]);
+	g_free(terms);
+	g_free(termLengths);
+	g_strfreev(words);
+	return self->results;
+}
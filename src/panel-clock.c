@@ -5,8 +5,10 @@
  */
 
 #include "panel-internal.h"
+#include <string.h>
 
 #define FORMAT_STRING_LENGTH 25
+#define LOCALTIME_PATH "/etc/localtime"
 
 struct _GrapheneClockLabel
 {
@@ -14,10 +16,18 @@ struct _GrapheneClockLabel
 	GSettings *interfaceSettings;
 	GSource *source;
 	gchar *format;
+	guint interval; // Seconds between changes of the formatted time
+	GTimeZone *timeZone;
+	GFileMonitor *localtimeMonitor;
+	GCancellable *cancel;
+	GDBusConnection *systemBus;
+	guint sleepSubscriptionId;
 };
 
 static void graphene_clock_label_dispose(GObject *self_);
 static void on_interface_settings_changed(GrapheneClockLabel *self, gchar *key, GSettings *settings);
+static void on_localtime_changed(GrapheneClockLabel *self, GFile *file, GFile *otherFile, GFileMonitorEvent event, GFileMonitor *monitor);
+static void on_system_bus_acquired(GObject *source, GAsyncResult *res, gpointer userdata);
 static gboolean update(GSource *source, GSourceFunc callback, gpointer userdata);
 
 G_DEFINE_TYPE(GrapheneClockLabel, graphene_clock_label, CMK_TYPE_LABEL);
@@ -36,6 +46,8 @@ static void graphene_clock_label_init(GrapheneClockLabel *self)
 {
 	self->format = g_new(gchar, FORMAT_STRING_LENGTH);
 	self->format[0] = '\0'; // Empty string
+	self->interval = 60;
+	self->timeZone = g_time_zone_new(NULL);
 	
 	self->interfaceSettings = g_settings_new("org.gnome.desktop.interface");
 	g_signal_connect_swapped(self->interfaceSettings, "changed", G_CALLBACK(on_interface_settings_changed), self);
@@ -46,14 +58,35 @@ static void graphene_clock_label_init(GrapheneClockLabel *self)
 	g_source_set_callback(self->source, NULL, self, NULL); // Sets the userdata passed to update - the callback itself is ignored
 	g_source_set_ready_time(self->source, 0);
 	g_source_attach(self->source, NULL);
+
+	// The local time zone is only read once, so watch for it changing
+	GFile *localtime = g_file_new_for_path(LOCALTIME_PATH);
+	self->localtimeMonitor = g_file_monitor_file(localtime, G_FILE_MONITOR_NONE, NULL, NULL);
+	g_object_unref(localtime);
+	if(self->localtimeMonitor)
+		g_signal_connect_swapped(self->localtimeMonitor, "changed", G_CALLBACK(on_localtime_changed), self);
+
+	// Timeouts are in monotonic time, which doesn't count time spent
+	// suspended, so logind tells when to resync
+	self->cancel = g_cancellable_new();
+	g_bus_get(G_BUS_TYPE_SYSTEM, self->cancel, on_system_bus_acquired, self);
 }
 
 static void graphene_clock_label_dispose(GObject *self_)
 {
 	GrapheneClockLabel *self = GRAPHENE_CLOCK_LABEL(self_);
+	if(self->cancel)
+		g_cancellable_cancel(self->cancel);
+	g_clear_object(&self->cancel);
+	if(self->sleepSubscriptionId)
+		g_dbus_connection_signal_unsubscribe(self->systemBus, self->sleepSubscriptionId);
+	self->sleepSubscriptionId = 0;
+	g_clear_object(&self->systemBus);
+	g_clear_object(&self->localtimeMonitor);
 	g_clear_object(&self->interfaceSettings);
 	g_clear_pointer(&self->source, g_source_destroy);
 	g_clear_pointer(&self->format, g_free);
+	g_clear_pointer(&self->timeZone, g_time_zone_unref);
 	G_OBJECT_CLASS(graphene_clock_label_parent_class)->dispose(self_);
 }
 
@@ -79,17 +112,69 @@ static void on_interface_settings_changed(GrapheneClockLabel *self, gchar *key,
 		g_strlcat(self->format, ":%S", FORMAT_STRING_LENGTH); // :55
 	if(format == 1)
 		g_strlcat(self->format, " %p", FORMAT_STRING_LENGTH); // PM
+
+	// Without seconds, the label only changes on the minute
+	self->interval = strstr(self->format, "%S") ? 1 : 60;
 	
 	if(self->source)
 		g_source_set_ready_time(self->source, 0); // Update label now
 }
 
+static void on_localtime_changed(GrapheneClockLabel *self, GFile *file, GFile *otherFile, GFileMonitorEvent event, GFileMonitor *monitor)
+{
+	if(event != G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT
+	&& event != G_FILE_MONITOR_EVENT_CREATED
+	&& event != G_FILE_MONITOR_EVENT_DELETED)
+		return;
+
+	// g_time_zone_new(NULL) isn't cached, unlike g_time_zone_new_local
+	g_time_zone_unref(self->timeZone);
+	self->timeZone = g_time_zone_new(NULL);
+	g_source_set_ready_time(self->source, 0);
+}
+
+static void on_prepare_for_sleep(GDBusConnection *connection, const gchar *sender, const gchar *path, const gchar *iface, const gchar *signal, GVariant *parameters, gpointer userdata)
+{
+	gboolean sleeping = FALSE;
+	g_variant_get(parameters, "(b)", &sleeping);
+	if(!sleeping) // Resumed
+		g_source_set_ready_time(GRAPHENE_CLOCK_LABEL(userdata)->source, 0);
+}
+
+static void on_system_bus_acquired(GObject *source, GAsyncResult *res, gpointer userdata)
+{
+	GError *error = NULL;
+	GDBusConnection *systemBus = g_bus_get_finish(res, &error);
+	if(!systemBus)
+	{
+		// Cancelled by dispose, or there's no system bus; either way the
+		// clock works, just without resyncing after a suspend
+		if(!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+			g_warning("Clock could not connect to the system bus: %s", error->message);
+		g_clear_error(&error);
+		return;
+	}
+
+	GrapheneClockLabel *self = GRAPHENE_CLOCK_LABEL(userdata);
+	self->systemBus = systemBus;
+	self->sleepSubscriptionId = g_dbus_connection_signal_subscribe(systemBus,
+		"org.freedesktop.login1",
+		"org.freedesktop.login1.Manager",
+		"PrepareForSleep",
+		"/org/freedesktop/login1",
+		NULL,
+		G_DBUS_SIGNAL_FLAGS_NONE,
+		on_prepare_for_sleep,
+		self,
+		NULL);
+}
+
 static gboolean update(GSource *source, GSourceFunc callback, gpointer userdata)
 {
 	GrapheneClockLabel *self = GRAPHENE_CLOCK_LABEL(userdata);
 	
 	// Get the time as a formatted string
-	GDateTime *dt = g_date_time_new_now_local();
+	GDateTime *dt = g_date_time_new_now(self->timeZone);
 	gchar *formatted = g_date_time_format(dt, self->format);
 	g_date_time_unref(dt);
 	
@@ -99,14 +184,17 @@ static gboolean update(GSource *source, GSourceFunc callback, gpointer userdata)
 	else
 		cmk_label_set_text(CMK_LABEL(self), formatted);
 	
-	// Get monotonic time of the start of the next second
-	// This keeps it from falling out of sync
+	// Get monotonic time of the start of the next second (or minute, if
+	// seconds aren't shown). This keeps it from falling out of sync.
+	// Every time zone offset is a whole number of minutes, so wall-clock
+	// minutes start at the same time in every zone.
+	gint64 interval = (gint64)self->interval * G_USEC_PER_SEC;
 	gint64 realNow = g_get_real_time(); // wall-clock time
-	gint64 usUntilNextSecond = G_USEC_PER_SEC - (realNow - ((realNow / G_USEC_PER_SEC) * G_USEC_PER_SEC));
-	usUntilNextSecond = CLAMP(usUntilNextSecond, 0, G_USEC_PER_SEC);
-	gint64 updateTime = g_source_get_time(source) + usUntilNextSecond; // monotonic time
+	gint64 usUntilNextTick = interval - (realNow % interval);
+	usUntilNextTick = CLAMP(usUntilNextTick, 0, interval);
+	gint64 updateTime = g_source_get_time(source) + usUntilNextTick; // monotonic time
 	
-	// Set source to dispatch at the next second
+	// Set source to dispatch at the next tick
 	g_source_set_ready_time(source, updateTime);
 	return G_SOURCE_CONTINUE;
 }
@@ -9,19 +9,95 @@
 
 #include "cmk/cmk-widget.h"
 #include "cmk/cmk-label.h"
+#include "window.h"
+#include <gio/gdesktopappinfo.h>
 
 G_BEGIN_DECLS
 
 typedef void (*CSettingsLogoutCallback)(gpointer userdata);
 
+typedef struct
+{
+	gchar *name; // Display name
+	gchar *iconName; // May be NULL
+	gchar *category; // Name of the menu directory containing the app
+	GDesktopAppInfo *appInfo;
+	gchar *searchName; // Normalized with graphene_app_search_normalize
+	gchar **searchExtra; // Normalized GenericName, Keywords and executable
+	guint64 searchMask; // graphene_app_search_char_mask of all search fields
+	guint launchCount;
+} GrapheneAppEntry;
+
+typedef struct _GrapheneAppSearch GrapheneAppSearch;
+
+#define GRAPHENE_TYPE_APP_INDEX graphene_app_index_get_type()
+G_DECLARE_FINAL_TYPE(GrapheneAppIndex, graphene_app_index, GRAPHENE, APP_INDEX, GObject)
+GrapheneAppIndex * graphene_app_index_new(void);
+
+/*
+ * Returns a new ref to the current array of GrapheneAppEntry *, in menu
+ * order (entries in the same category are adjacent). The array is
+ * replaced, not modified, when the "changed" signal is emitted. It is
+ * empty until the first load completes.
+ */
+GPtrArray * graphene_app_index_get_entries(GrapheneAppIndex *index);
+
+/*
+ * Counts a launch of the entry's application, which ranks it higher in
+ * searches. Counts are saved in $XDG_DATA_HOME/graphene/launch-counts.
+ */
+void graphene_app_index_record_launch(GrapheneAppIndex *index, GrapheneAppEntry *entry);
+
+GrapheneAppSearch * graphene_app_search_new(void);
+void graphene_app_search_free(GrapheneAppSearch *search);
+
+/*
+ * Sets the array of GrapheneAppEntry * to search, and forgets the results
+ * of previous queries.
+ */
+void graphene_app_search_set_entries(GrapheneAppSearch *search, GPtrArray *entries);
+
+/*
+ * Returns the entries matching query, best match first. The array belongs
+ * to the search, and is only valid until the next call. It is empty if the
+ * query is empty.
+ */
+GPtrArray * graphene_app_search_query(GrapheneAppSearch *search, const gchar *query);
+
+/*
+ * Decomposes, casefolds, and strips combining marks from text. Safe to
+ * call from any thread. Free the result with g_free.
+ */
+gchar * graphene_app_search_normalize(const gchar *text);
+
+/*
+ * Returns a bitmask of the characters in a normalized string, for quickly
+ * rejecting entries which can't match a query.
+ */
+guint64 graphene_app_search_char_mask(const gchar *normalized);
+
 #define GRAPHENE_TYPE_LAUNCHER_POPUP graphene_launcher_popup_get_type()
 G_DECLARE_FINAL_TYPE(GrapheneLauncherPopup, graphene_launcher_popup, GRAPHENE, LAUNCHER_POPUP, CmkWidget)
-GrapheneLauncherPopup * graphene_launcher_popup_new(void);
+GrapheneLauncherPopup * graphene_launcher_popup_new(GrapheneAppIndex *index);
 
 #define GRAPHENE_TYPE_SETTINGS_POPUP graphene_settings_popup_get_type()
 G_DECLARE_FINAL_TYPE(GrapheneSettingsPopup, graphene_settings_popup, GRAPHENE, SETTINGS_POPUP, CmkWidget)
 GrapheneSettingsPopup * graphene_settings_popup_new(CSettingsLogoutCallback logoutCb, gpointer userdata);
 
+#define GRAPHENE_TYPE_TASKLIST graphene_tasklist_get_type()
+G_DECLARE_FINAL_TYPE(GrapheneTasklist, graphene_tasklist, GRAPHENE, TASKLIST, CmkWidget)
+GrapheneTasklist * graphene_tasklist_new(guint iconSize);
+
+/*
+ * Adds, removes, or updates the button for a window. Windows with
+ * GRAPHENE_WINDOW_FLAG_SKIP_TASKBAR get no button. The window must stay
+ * valid until it's removed; its button lets go of it right away, even
+ * while the button animates out.
+ */
+void graphene_tasklist_add_window(GrapheneTasklist *tasklist, GrapheneWindow *window);
+void graphene_tasklist_remove_window(GrapheneTasklist *tasklist, GrapheneWindow *window);
+void graphene_tasklist_update_window(GrapheneTasklist *tasklist, GrapheneWindow *window);
+
 #define GRAPHENE_TYPE_CLOCK_LABEL graphene_clock_label_get_type()
 G_DECLARE_FINAL_TYPE(GrapheneClockLabel, graphene_clock_label, GRAPHENE, CLOCK_LABEL, CmkLabel);
 GrapheneClockLabel * graphene_clock_label_new(void);
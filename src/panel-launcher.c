@@ -4,18 +4,41 @@
 // * Licensed under the Apache License 2 <www.apache.org/licenses/LICENSE-2.0>.
 // */
  
-#define GMENU_I_KNOW_THIS_IS_UNSTABLE // TODO: Maybe find an alternative? 
-
 #include "panel-internal.h"
 #include "cmk/cmk-label.h"
 #include "cmk/button.h"
 #include "cmk/cmk-icon.h"
 #include "cmk/shadow.h"
 #include <gdk/gdkx.h>
-#include <gmenu-tree.h>
-#include <gio/gdesktopappinfo.h>
+#include <string.h>
 
 #define LAUNCHER_WIDTH 600
+#define LIST_OVERSCAN 3 // Rows materialized above and below the viewport
+
+/*
+ * A row in the filtered application list. Only the items near the
+ * viewport have a ListRow bound to them.
+ */
+typedef struct
+{
+	GrapheneAppEntry *entry; // NULL for category headers
+	const gchar *category;
+	gfloat y;
+} ListItem;
+
+/*
+ * A recycled row actor. App rows are a CmkButton with a CmkIcon, header
+ * rows are a CmkLabel. Each is followed by a separator.
+ */
+typedef struct
+{
+	ClutterActor *actor;
+	CmkIcon *icon;
+	ClutterActor *separator;
+	gboolean header;
+	gconstpointer bound; // Entry or category string the row is showing
+	gint item; // Index into items, or -1 if the row is unused
+} ListRow;
 
 struct _GrapheneLauncherPopup
 {
@@ -23,8 +46,14 @@ struct _GrapheneLauncherPopup
 	
 	CmkShadow *sdc;
 	CmkWidget *window;
-	ClutterScrollActor *scroll;
-	CmkButton *firstApp;
+	ClutterActor *list; // Viewport; row actors are its children
+	GArray *items; // ListItem, passing the filter
+	GPtrArray *rows; // ListRow *
+	gboolean itemsDirty; // Item offsets need recalculating
+	gfloat appHeight, headerHeight, listHeight;
+	gfloat viewHeight; // Height of the list at its last allocation
+	guint resizeUpdateId;
+	GrapheneAppEntry *firstApp;
 	gdouble scrollAmount;
 	
 	ClutterText *searchBox;
@@ -32,7 +61,9 @@ struct _GrapheneLauncherPopup
 	ClutterActor *searchSeparator;
 	gchar *filter;
 	
-	GMenuTree *appTree;
+	GrapheneAppIndex *appIndex;
+	GPtrArray *entries; // GrapheneAppEntry *, from appIndex
+	GrapheneAppSearch *search;
 };
 
 
@@ -46,17 +77,22 @@ static void on_background_changed(CmkWidget *self_);
 static void on_search_box_mapped(ClutterActor *actor);
 static void on_search_box_text_changed(GrapheneLauncherPopup *self, ClutterText *searchBox);
 static void on_search_box_activate(GrapheneLauncherPopup *self, ClutterText *searchBox);
-static gboolean on_scroll(ClutterScrollActor *scroll, ClutterScrollEvent *event, GrapheneLauncherPopup *self);
+static gboolean on_scroll(ClutterActor *list, ClutterScrollEvent *event, GrapheneLauncherPopup *self);
 static ClutterActor * separator_new();
 static void popup_applist_refresh(GrapheneLauncherPopup *self);
 static void popup_applist_populate(GrapheneLauncherPopup *self);
-static guint popup_applist_populate_directory(GrapheneLauncherPopup *self, GMenuTreeDirectory *directory);
+static void popup_applist_update(GrapheneLauncherPopup *self);
+static void popup_applist_allocate(GrapheneLauncherPopup *self, gfloat width, gfloat height, ClutterAllocationFlags flags);
 static void applist_on_item_clicked(GrapheneLauncherPopup *self, CmkButton *button);
 //static void applist_launch_first(GrapheneLauncherPopup *self);
 
-GrapheneLauncherPopup* graphene_launcher_popup_new(void)
+GrapheneLauncherPopup* graphene_launcher_popup_new(GrapheneAppIndex *index)
 {
-	return GRAPHENE_LAUNCHER_POPUP(g_object_new(GRAPHENE_TYPE_LAUNCHER_POPUP, NULL));
+	GrapheneLauncherPopup *self = GRAPHENE_LAUNCHER_POPUP(g_object_new(GRAPHENE_TYPE_LAUNCHER_POPUP, NULL));
+	self->appIndex = g_object_ref(index);
+	g_signal_connect_swapped(index, "changed", G_CALLBACK(popup_applist_refresh), self);
+	popup_applist_refresh(self);
+	return self;
 }
 
 static void graphene_launcher_popup_class_init(GrapheneLauncherPopupClass *class)
@@ -81,14 +117,18 @@ static void graphene_launcher_popup_init(GrapheneLauncherPopup *self)
 	// isn't actually a child of the window actor; it is a child of self.
 	// This makes allocation/sizing easer, and helps keep the scroll window
 	// from expanding too far.
-	self->scroll = CLUTTER_SCROLL_ACTOR(clutter_scroll_actor_new());
-	clutter_scroll_actor_set_scroll_mode(self->scroll, CLUTTER_SCROLL_VERTICALLY);
-	ClutterBoxLayout *listLayout = CLUTTER_BOX_LAYOUT(clutter_box_layout_new());
-	clutter_box_layout_set_orientation(listLayout, CLUTTER_ORIENTATION_VERTICAL); 
-	clutter_actor_set_layout_manager(CLUTTER_ACTOR(self->scroll), CLUTTER_LAYOUT_MANAGER(listLayout));
-	clutter_actor_set_reactive(CLUTTER_ACTOR(self->scroll), TRUE);
-	g_signal_connect(self->scroll, "scroll-event", G_CALLBACK(on_scroll), self);
-	clutter_actor_add_child(CLUTTER_ACTOR(self), CLUTTER_ACTOR(self->scroll));
+	// The list only has actors for the rows near the viewport, which are
+	// recycled as it scrolls or the filter changes. They are positioned
+	// by popup_applist_allocate rather than a layout manager.
+	self->list = clutter_actor_new();
+	clutter_actor_set_layout_manager(self->list, NULL);
+	clutter_actor_set_clip_to_allocation(self->list, TRUE);
+	clutter_actor_set_reactive(self->list, TRUE);
+	g_signal_connect(self->list, "scroll-event", G_CALLBACK(on_scroll), self);
+	clutter_actor_add_child(CLUTTER_ACTOR(self), self->list);
+	self->items = g_array_new(FALSE, FALSE, sizeof(ListItem));
+	self->rows = g_ptr_array_new_with_free_func(g_free);
+	self->search = graphene_app_search_new();
 
 	self->searchIcon = cmk_icon_new_full("gnome-searchtool", NULL, 16, TRUE);
 	clutter_actor_set_x_align(CLUTTER_ACTOR(self->searchIcon), CLUTTER_ACTOR_ALIGN_CENTER);
@@ -111,16 +151,21 @@ static void graphene_launcher_popup_init(GrapheneLauncherPopup *self)
 	pango_font_description_set_size(desc, 16*PANGO_SCALE); // 16pt
 	clutter_text_set_font_description(self->searchBox, desc);
 	pango_font_description_free(desc);
-
-	// Load applications
-	self->appTree = gmenu_tree_new("gnome-applications.menu", GMENU_TREE_FLAGS_SORT_DISPLAY_NAME);
-	popup_applist_refresh(self);
 }
 
 static void graphene_launcher_popup_dispose(GObject *self_)
 {
 	GrapheneLauncherPopup *self = GRAPHENE_LAUNCHER_POPUP(self_);
-	g_clear_object(&self->appTree);
+	if(self->resizeUpdateId)
+		g_source_remove(self->resizeUpdateId);
+	self->resizeUpdateId = 0;
+	if(self->appIndex)
+		g_signal_handlers_disconnect_by_data(self->appIndex, self);
+	g_clear_object(&self->appIndex);
+	g_clear_pointer(&self->entries, g_ptr_array_unref);
+	g_clear_pointer(&self->items, g_array_unref);
+	g_clear_pointer(&self->rows, g_ptr_array_unref);
+	g_clear_pointer(&self->search, graphene_app_search_free);
 	g_clear_pointer(&self->filter, g_free);
 	G_OBJECT_CLASS(graphene_launcher_popup_parent_class)->dispose(self_);
 }
@@ -151,7 +196,8 @@ static void graphene_launcher_popup_allocate(ClutterActor *self_, const ClutterA
 	clutter_actor_allocate(CLUTTER_ACTOR(self->searchBox), &searchBox, flags);
 	clutter_actor_allocate(CLUTTER_ACTOR(self->searchIcon), &iconBox, flags);
 	clutter_actor_allocate(CLUTTER_ACTOR(self->searchSeparator), &separatorBox, flags);
-	clutter_actor_allocate(CLUTTER_ACTOR(self->scroll), &scrollBox, flags);
+	clutter_actor_allocate(self->list, &scrollBox, flags);
+	popup_applist_allocate(self, scrollBox.x2 - scrollBox.x1, scrollBox.y2 - scrollBox.y1, flags);
 
 	CLUTTER_ACTOR_CLASS(graphene_launcher_popup_parent_class)->allocate(self_, box, flags);
 }
@@ -186,12 +232,19 @@ static void on_search_box_mapped(ClutterActor *actor)
 static void on_search_box_text_changed(GrapheneLauncherPopup *self, ClutterText *searchBox)
 {
 	g_clear_pointer(&self->filter, g_free);
-	self->filter = g_utf8_strdown(clutter_text_get_text(searchBox), -1);
+	self->filter = g_strdup(clutter_text_get_text(searchBox));
+	self->scrollAmount = 0;
 	popup_applist_populate(self);
+}
 
-	self->scrollAmount = 0;
-	ClutterPoint p = {0, self->scrollAmount};
-	clutter_scroll_actor_scroll_to_point(self->scroll, &p);
+static void launch_entry(GrapheneLauncherPopup *self, GrapheneAppEntry *entry)
+{
+	// The entry belongs to self->entries, which is freed with self
+	graphene_app_index_record_launch(self->appIndex, entry);
+	GDesktopAppInfo *appInfo = g_object_ref(entry->appInfo);
+	clutter_actor_destroy(CLUTTER_ACTOR(self));
+	g_app_info_launch(G_APP_INFO(appInfo), NULL, NULL, NULL);
+	g_object_unref(appInfo);
 }
 
 static void on_search_box_activate(GrapheneLauncherPopup *self, ClutterText *searchBox)
@@ -201,10 +254,10 @@ static void on_search_box_activate(GrapheneLauncherPopup *self, ClutterText *sea
 	if(!self->firstApp)
 		return;
 
-	g_signal_emit_by_name(self->firstApp, "activate");
+	launch_entry(self, self->firstApp);
 }
 
-static gboolean on_scroll(ClutterScrollActor *scroll, ClutterScrollEvent *event, GrapheneLauncherPopup *self)
+static gboolean on_scroll(ClutterActor *list, ClutterScrollEvent *event, GrapheneLauncherPopup *self)
 {
 	// TODO: Disable button highlight when scrolling, so it feels smoother
 	if(event->direction == CLUTTER_SCROLL_SMOOTH)
@@ -212,41 +265,28 @@ static gboolean on_scroll(ClutterScrollActor *scroll, ClutterScrollEvent *event,
 		gdouble dx, dy;
 		clutter_event_get_scroll_delta((ClutterEvent *)event, &dx, &dy);
 		self->scrollAmount += dy*50; // TODO: Not magic number for multiplier
+
+		// Clamped to the list height by popup_applist_update
 		if(self->scrollAmount < 0)
 			self->scrollAmount = 0;
-	
-		gfloat min, nat;
-		clutter_layout_manager_get_preferred_height(clutter_actor_get_layout_manager(CLUTTER_ACTOR(scroll)), CLUTTER_CONTAINER(scroll), -1, &min, &nat);
-
-		gfloat height = clutter_actor_get_height(CLUTTER_ACTOR(scroll));
-		gfloat maxScroll = MAX(nat - height, 0);
-
-		if(self->scrollAmount > maxScroll)
-			self->scrollAmount = maxScroll;
-
-		ClutterPoint p = {0, self->scrollAmount};
-		clutter_scroll_actor_scroll_to_point(scroll, &p);
+		popup_applist_update(self);
 	}
 	return TRUE;
 }
 
 static void popup_applist_refresh(GrapheneLauncherPopup *self)
 {
-	// TODO: This lags the entire WM. Do it not synced, also cache it
-	gmenu_tree_load_sync(self->appTree, NULL);
-
+	if(self->entries)
+		g_ptr_array_unref(self->entries);
+	self->entries = graphene_app_index_get_entries(self->appIndex);
+	graphene_app_search_set_entries(self->search, self->entries);
+
+	// Rows may still point at strings from the old entries
+	for(guint i=0;i<self->rows->len;++i)
+		((ListRow *)g_ptr_array_index(self->rows, i))->bound = NULL;
 	popup_applist_populate(self);
 }
 
-static void popup_applist_populate(GrapheneLauncherPopup *self)
-{
-	clutter_actor_destroy_all_children(CLUTTER_ACTOR(self->scroll));
-	self->firstApp = NULL;
-	GMenuTreeDirectory *directory = gmenu_tree_get_root_directory(self->appTree);
-	popup_applist_populate_directory(self, directory);
-	gmenu_tree_item_unref(directory);
-}
-
 static ClutterActor * separator_new()
 {
 	ClutterActor *sep = clutter_actor_new();
@@ -257,100 +297,284 @@ static ClutterActor * separator_new()
 	return sep;
 }
 
-static gboolean add_app(GrapheneLauncherPopup *self, GDesktopAppInfo *appInfo)
-{	
-	if(g_desktop_app_info_get_nodisplay(appInfo))
-		return FALSE;
+static ListRow * list_row_new(GrapheneLauncherPopup *self, gboolean header)
+{
+	ListRow *row = g_new0(ListRow, 1);
+	row->header = header;
+	row->item = -1;
 
-	if(self->filter)
+	if(header)
 	{
-		gchar *displayNameDown = g_utf8_strdown(g_app_info_get_display_name(G_APP_INFO(appInfo)), -1);
-		gboolean passedFilter = g_strstr_len(displayNameDown, -1, self->filter) != NULL;
-		g_free(displayNameDown);
-		if(!passedFilter)
-			return FALSE;
+		CmkLabel *label = cmk_label_new();
+		clutter_actor_set_x_align(CLUTTER_ACTOR(label), CLUTTER_ACTOR_ALIGN_START);
+		ClutterMargin margin = {50, 40, 20, 20};
+		clutter_actor_set_margin(CLUTTER_ACTOR(label), &margin);
+		row->actor = CLUTTER_ACTOR(label);
 	}
-	
-	CmkButton *button = cmk_button_new();
-	const gchar *iconName;
-	GIcon *gicon = g_app_info_get_icon(G_APP_INFO(appInfo));
-	if(G_IS_THEMED_ICON(gicon))
+	else
 	{
-		const gchar * const * names = g_themed_icon_get_names(G_THEMED_ICON(gicon));
-		iconName = names[0];
+		CmkButton *button = cmk_button_new();
+		row->icon = cmk_icon_new();
+		cmk_icon_set_size(row->icon, 24);
+		cmk_button_set_content(button, CMK_WIDGET(row->icon));
+		g_object_set_data(G_OBJECT(button), "row", row);
+		g_signal_connect_swapped(button, "activate", G_CALLBACK(applist_on_item_clicked), self);
+		row->actor = CLUTTER_ACTOR(button);
 	}
 
-	CmkIcon *icon = cmk_icon_new_from_name(iconName ? iconName : "open-menu-symbolic");
-	cmk_icon_set_size(icon, 24);
-	cmk_button_set_content(button, CMK_WIDGET(icon));
-	cmk_button_set_text(button, g_app_info_get_display_name(G_APP_INFO(appInfo)));
-	cmk_widget_set_style_parent(CMK_WIDGET(button), self->window);
-	clutter_actor_set_x_expand(CLUTTER_ACTOR(button), TRUE);
-	clutter_actor_add_child(CLUTTER_ACTOR(self->scroll), CLUTTER_ACTOR(button));
-	
-	g_object_set_data_full(G_OBJECT(button), "appinfo", g_object_ref(appInfo), g_object_unref);
-	g_signal_connect_swapped(button, "activate", G_CALLBACK(applist_on_item_clicked), self);
+	cmk_widget_set_style_parent(CMK_WIDGET(row->actor), self->window);
+	row->separator = separator_new();
+	clutter_actor_add_child(self->list, row->actor);
+	clutter_actor_add_child(self->list, row->separator);
+	g_ptr_array_add(self->rows, row);
+	return row;
+}
 
-	if(!self->firstApp)
-		self->firstApp = button;
-	
-	clutter_actor_add_child(CLUTTER_ACTOR(self->scroll), separator_new());
-	return TRUE;
+static void list_row_bind(ListRow *row, ListItem *item)
+{
+	if(row->header)
+	{
+		if(row->bound != item->category)
+			cmk_label_set_text(CMK_LABEL(row->actor), item->category);
+		row->bound = item->category;
+	}
+	else
+	{
+		GrapheneAppEntry *entry = item->entry;
+		if(row->bound != entry)
+		{
+			cmk_button_set_text(CMK_BUTTON(row->actor), entry->name);
+			const gchar *iconName = entry->iconName ? entry->iconName : "open-menu-symbolic";
+			if(g_strcmp0(cmk_icon_get_icon(row->icon), iconName) != 0)
+				cmk_icon_set_icon(row->icon, iconName);
+		}
+		row->bound = entry;
+	}
 }
 
-static guint popup_applist_populate_directory(GrapheneLauncherPopup *self, GMenuTreeDirectory *directory)
+/*
+ * Gets a row to bind to the given item. Prefers an unused row which is
+ * already showing the item, so that its text and icon don't need to be
+ * reloaded.
+ */
+static ListRow * list_take_row(GrapheneLauncherPopup *self, ListItem *item)
 {
-	guint count = 0;
-	GMenuTreeIter *it = gmenu_tree_directory_iter(directory);
-	
-	while(TRUE)
+	gboolean header = (item->entry == NULL);
+	gconstpointer bound = header ? (gconstpointer)item->category : (gconstpointer)item->entry;
+	ListRow *unused = NULL;
+	for(guint i=0;i<self->rows->len;++i)
 	{
-		GMenuTreeItemType type = gmenu_tree_iter_next(it);
-		if(type == GMENU_TREE_ITEM_INVALID)
+		ListRow *row = g_ptr_array_index(self->rows, i);
+		if(row->item >= 0 || row->header != header)
+			continue;
+		if(row->bound == bound)
+			return row;
+		if(!unused)
+			unused = row;
+	}
+	return unused ? unused : list_row_new(self, header);
+}
+
+/*
+ * Measures the height of a row of the given type, including separator.
+ * Returns -1 if there are no rows of that type and create is FALSE.
+ */
+static gfloat measure_row(GrapheneLauncherPopup *self, gboolean header, gboolean create)
+{
+	// All rows of a type are the same height; measure one which is already
+	// showing something if possible.
+	ListRow *measure = NULL;
+	for(guint i=0;i<self->rows->len;++i)
+	{
+		ListRow *row = g_ptr_array_index(self->rows, i);
+		if(row->header != header)
+			continue;
+		measure = row;
+		if(row->bound)
 			break;
-			
-		if(type == GMENU_TREE_ITEM_ENTRY)
+	}
+	if(!measure && !create)
+		return -1;
+	if(!measure)
+		measure = list_row_new(self, header);
+
+	gfloat min, nat, sepMin, sepNat;
+	clutter_actor_get_preferred_height(measure->actor, -1, &min, &nat);
+	clutter_actor_get_preferred_height(measure->separator, -1, &sepMin, &sepNat);
+	return nat + sepNat;
+}
+
+/*
+ * Binds rows to the items which intersect the viewport (plus overscan).
+ * Rows outside of that range are hidden until reused. This creates and
+ * changes actors, so it must not run during allocation; it is called when
+ * the items, the scroll position or the viewport height change.
+ */
+static void popup_applist_update(GrapheneLauncherPopup *self)
+{
+	guint numItems = self->items->len;
+
+	gfloat appHeight = measure_row(self, FALSE, TRUE);
+	gfloat headerHeight = measure_row(self, TRUE, TRUE);
+	if(self->itemsDirty || appHeight != self->appHeight || headerHeight != self->headerHeight)
+	{
+		gfloat y = 0;
+		for(guint i=0;i<numItems;++i)
 		{
-			GMenuTreeEntry *entry = gmenu_tree_iter_get_entry(it);
-			if(add_app(self, gmenu_tree_entry_get_app_info(entry)))
-				count += 1;
-			gmenu_tree_item_unref(entry);
+			ListItem *item = &g_array_index(self->items, ListItem, i);
+			item->y = y;
+			y += item->entry ? appHeight : headerHeight;
 		}
-		else if(type == GMENU_TREE_ITEM_DIRECTORY)
+		self->listHeight = y;
+		self->appHeight = appHeight;
+		self->headerHeight = headerHeight;
+		self->itemsDirty = FALSE;
+	}
+
+	gfloat height = self->viewHeight;
+	gfloat maxScroll = MAX(self->listHeight - height, 0);
+	if(self->scrollAmount > maxScroll)
+		self->scrollAmount = maxScroll;
+	gfloat top = self->scrollAmount;
+
+	// Last item starting at or above the top of the viewport
+	guint lo = 0, hi = numItems;
+	while(hi - lo > 1)
+	{
+		guint mid = (lo + hi) / 2;
+		if(g_array_index(self->items, ListItem, mid).y <= top)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	guint start = (lo > LIST_OVERSCAN) ? lo - LIST_OVERSCAN : 0;
+	guint end = lo;
+	while(end < numItems && g_array_index(self->items, ListItem, end).y < top + height)
+		++end;
+	end = MIN(end + LIST_OVERSCAN, numItems);
+
+	// Free rows which have left the range, then bind the items without rows
+	gboolean *hasRow = g_newa(gboolean, end - start + 1);
+	memset(hasRow, 0, sizeof(gboolean) * (end - start + 1));
+	for(guint i=0;i<self->rows->len;++i)
+	{
+		ListRow *row = g_ptr_array_index(self->rows, i);
+		if(row->item >= (gint)start && row->item < (gint)end)
+			hasRow[row->item - start] = TRUE;
+		else
+			row->item = -1;
+	}
+	for(guint i=start;i<end;++i)
+	{
+		if(hasRow[i - start])
+			continue;
+		ListItem *item = &g_array_index(self->items, ListItem, i);
+		ListRow *row = list_take_row(self, item);
+		list_row_bind(row, item);
+		row->item = i;
+	}
+
+	for(guint i=0;i<self->rows->len;++i)
+	{
+		ListRow *row = g_ptr_array_index(self->rows, i);
+		clutter_actor_set_visible(row->actor, row->item >= 0);
+		clutter_actor_set_visible(row->separator, row->item >= 0);
+	}
+
+	clutter_actor_queue_relayout(CLUTTER_ACTOR(self));
+}
+
+static gboolean on_resize_update(GrapheneLauncherPopup *self)
+{
+	self->resizeUpdateId = 0;
+	popup_applist_update(self);
+	return G_SOURCE_REMOVE;
+}
+
+/*
+ * Positions the rows bound by popup_applist_update. If the viewport
+ * height or the row heights have changed, the rows are rebound after this
+ * layout pass.
+ */
+static void popup_applist_allocate(GrapheneLauncherPopup *self, gfloat width, gfloat height, ClutterAllocationFlags flags)
+{
+	gfloat appHeight = measure_row(self, FALSE, FALSE);
+	gfloat headerHeight = measure_row(self, TRUE, FALSE);
+	if(height != self->viewHeight
+	|| (appHeight >= 0 && appHeight != self->appHeight)
+	|| (headerHeight >= 0 && headerHeight != self->headerHeight))
+	{
+		self->viewHeight = height;
+		if(!self->resizeUpdateId)
+			self->resizeUpdateId = g_idle_add_full(CLUTTER_PRIORITY_REDRAW - 10, (GSourceFunc)on_resize_update, self, NULL);
+	}
+
+	gfloat top = self->scrollAmount;
+	for(guint i=0;i<self->rows->len;++i)
+	{
+		ListRow *row = g_ptr_array_index(self->rows, i);
+		if(row->item < 0 || row->item >= (gint)self->items->len)
+			continue;
+
+		ListItem *item = &g_array_index(self->items, ListItem, row->item);
+		gfloat y = item->y - top;
+		gfloat rowHeight = item->entry ? self->appHeight : self->headerHeight;
+		gfloat sepMin, sepNat;
+		clutter_actor_get_preferred_height(row->separator, width, &sepMin, &sepNat);
+
+		ClutterActorBox rowBox = {0, y, width, y + rowHeight - sepNat};
+		ClutterActorBox sepBox = {0, rowBox.y2, width, y + rowHeight};
+		clutter_actor_allocate(row->actor, &rowBox, flags);
+		clutter_actor_allocate(row->separator, &sepBox, flags);
+	}
+}
+
+static void add_item(GrapheneLauncherPopup *self, GrapheneAppEntry *entry, const gchar *category)
+{
+	ListItem item = {entry, category, 0};
+	g_array_append_val(self->items, item);
+}
+
+static void popup_applist_populate(GrapheneLauncherPopup *self)
+{
+	g_array_set_size(self->items, 0);
+	self->firstApp = NULL;
+
+	GPtrArray *results = graphene_app_search_query(self->search, self->filter);
+	if(results->len > 0)
+	{
+		// Ranked, so no category labels
+		for(guint i=0;i<results->len;++i)
+			add_item(self, g_ptr_array_index(results, i), NULL);
+		self->firstApp = g_ptr_array_index(results, 0);
+	}
+	else if(!self->filter || !self->filter[0])
+	{
+		// Entries in the same category are adjacent, so each category's
+		// label goes before its first entry.
+		const gchar *category = NULL;
+		for(guint i=0;i<self->entries->len;++i)
 		{
-			GMenuTreeDirectory *directory = gmenu_tree_iter_get_directory(it);
-	
-			CmkLabel *label = cmk_label_new_with_text(gmenu_tree_directory_get_name(directory));
-			cmk_widget_set_style_parent(CMK_WIDGET(label), self->window);
-			clutter_actor_set_x_expand(CLUTTER_ACTOR(label), TRUE);
-			clutter_actor_set_x_align(CLUTTER_ACTOR(label), CLUTTER_ACTOR_ALIGN_START);
-			ClutterMargin margin = {50, 40, 20, 20};
-			clutter_actor_set_margin(CLUTTER_ACTOR(label), &margin);
-			clutter_actor_add_child(CLUTTER_ACTOR(self->scroll), CLUTTER_ACTOR(label));
-
-			ClutterActor *sep = separator_new();
-			clutter_actor_add_child(CLUTTER_ACTOR(self->scroll), sep);
-			
-			guint subcount = popup_applist_populate_directory(self, directory);
-			gmenu_tree_item_unref(directory);
-
-			if(subcount == 0)
-			{
-				clutter_actor_destroy(CLUTTER_ACTOR(label));
-				clutter_actor_destroy(sep);
-			}
+			GrapheneAppEntry *entry = g_ptr_array_index(self->entries, i);
+			if(entry->category && (i == 0 || g_strcmp0(entry->category, category) != 0))
+				add_item(self, NULL, entry->category);
+			category = entry->category;
+			add_item(self, entry, category);
 		}
 	}
-	
-	gmenu_tree_iter_unref(it);
-	return count;
+
+	// Item indices have changed, so every row is up for rebinding. Rows
+	// keep what they were showing, in case it is still in view.
+	for(guint i=0;i<self->rows->len;++i)
+		((ListRow *)g_ptr_array_index(self->rows, i))->item = -1;
+	self->itemsDirty = TRUE;
+	popup_applist_update(self);
 }
 
 static void applist_on_item_clicked(GrapheneLauncherPopup *self, CmkButton *button)
 {
-	clutter_actor_destroy(CLUTTER_ACTOR(self));
-
-	GDesktopAppInfo *appInfo = g_object_get_data(G_OBJECT(button), "appinfo");
-	if(appInfo)
-		g_app_info_launch(G_APP_INFO(appInfo), NULL, NULL, NULL);
+	ListRow *row = g_object_get_data(G_OBJECT(button), "row");
+	if(row && row->bound)
+		launch_entry(self, (GrapheneAppEntry *)row->bound);
 }
@@ -0,0 +1,172 @@
+/*
+ * This file is part of graphene-desktop, the desktop environment of VeltOS.
+ * Copyright (C) 2016 Velt Technologies, Aidan Shafran <zelbrium@gmail.com>
+ * Licensed under the Apache License 2 <www.apache.org/licenses/LICENSE-2.0>.
+ *
+ * The panel's row of window buttons. Windows map to their buttons through
+ * a hash table, and each button points back to its window with qdata, so
+ * both directions are O(1).
+ */
+
+#include "panel-internal.h"
+#include "cmk/button.h"
+#include "cmk/cmk-icon.h"
+
+// See wm.c
+#define TRANSITION_MEMLEAK_FIX(actor, tname) g_signal_connect_after(clutter_actor_get_transition(CLUTTER_ACTOR(actor), (tname)), "stopped", G_CALLBACK(g_object_unref), NULL)
+
+struct _GrapheneTasklist
+{
+	CmkWidget parent;
+	guint iconSize;
+	GHashTable *windows; // GrapheneWindow * (not owned) to CmkWidget * (not refed)
+	                     // Each button points back with tasklist_window_quark
+};
+
+static void graphene_tasklist_dispose(GObject *self_);
+
+G_DEFINE_TYPE(GrapheneTasklist, graphene_tasklist, CMK_TYPE_WIDGET);
+
+
+
+GrapheneTasklist * graphene_tasklist_new(guint iconSize)
+{
+	GrapheneTasklist *tasklist = GRAPHENE_TASKLIST(g_object_new(GRAPHENE_TYPE_TASKLIST, NULL));
+	tasklist->iconSize = iconSize;
+	return tasklist;
+}
+
+static void graphene_tasklist_class_init(GrapheneTasklistClass *class)
+{
+	G_OBJECT_CLASS(class)->dispose = graphene_tasklist_dispose;
+}
+
+static void graphene_tasklist_init(GrapheneTasklist *self)
+{
+	self->windows = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)clutter_actor_destroy);
+	clutter_actor_set_layout_manager(CLUTTER_ACTOR(self), clutter_box_layout_new());
+}
+
+static void graphene_tasklist_dispose(GObject *self_)
+{
+	GrapheneTasklist *self = GRAPHENE_TASKLIST(self_);
+	g_clear_pointer(&self->windows, g_hash_table_unref);
+	G_OBJECT_CLASS(graphene_tasklist_parent_class)->dispose(self_);
+}
+
+static GQuark tasklist_window_quark()
+{
+	return g_quark_from_static_string("graphene-tasklist-window");
+}
+
+static void on_tasklist_button_activate(CmkButton *button, GrapheneTasklist *self)
+{
+	GrapheneWindow *window = g_object_get_qdata(G_OBJECT(button), tasklist_window_quark());
+	if(!window)
+		return;
+
+	if((window->flags & GRAPHENE_WINDOW_FLAG_MINIMIZED) || !(window->flags & GRAPHENE_WINDOW_FLAG_FOCUSED))
+		window->show(window);
+	else
+		window->minimize(window);
+}
+
+static void on_tasklist_button_allocation_changed(CmkButton *button, ClutterActorBox *box, ClutterAllocationFlags flags, GrapheneWindow *window)
+{
+	gfloat x, y, width, height;
+	clutter_actor_get_transformed_position(CLUTTER_ACTOR(button), &x, &y);
+	clutter_actor_get_transformed_size(CLUTTER_ACTOR(button), &width, &height);
+	window->setIconBox(window, x, y, width, height);
+}
+
+void graphene_tasklist_add_window(GrapheneTasklist *self, GrapheneWindow *window)
+{
+	g_return_if_fail(GRAPHENE_IS_TASKLIST(self));
+	if(window->flags & GRAPHENE_WINDOW_FLAG_SKIP_TASKBAR)
+		return;
+	CmkIcon *icon = cmk_icon_new();
+	cmk_icon_set_size(icon, self->iconSize);
+
+	CmkButton *button = cmk_button_new();
+	g_signal_connect(button, "activate", G_CALLBACK(on_tasklist_button_activate), self);
+	g_signal_connect(button, "allocation-changed", G_CALLBACK(on_tasklist_button_allocation_changed), window);
+	cmk_button_set_content(button, CMK_WIDGET(icon));
+
+	clutter_actor_add_child(CLUTTER_ACTOR(self), CLUTTER_ACTOR(button));
+	g_hash_table_insert(self->windows, window, button);
+	g_object_set_qdata(G_OBJECT(button), tasklist_window_quark(), window);
+	
+	// Clutter doesn't animate unmapped actors, so there would be no
+	// transitions to fix up
+	ClutterActor *buttonActor = CLUTTER_ACTOR(button);
+	if(clutter_actor_is_mapped(buttonActor))
+	{
+		clutter_actor_set_pivot_point(buttonActor, 0.5, 0.5);
+		clutter_actor_set_scale(buttonActor, 0, 0);
+		clutter_actor_save_easing_state(buttonActor);
+		clutter_actor_set_easing_mode(buttonActor, CLUTTER_EASE_OUT_BACK);
+		clutter_actor_set_easing_duration(buttonActor, 200);
+		clutter_actor_set_scale(buttonActor, 1, 1);
+		clutter_actor_restore_easing_state(buttonActor);
+		TRANSITION_MEMLEAK_FIX(button, "scale-x");
+		TRANSITION_MEMLEAK_FIX(button, "scale-y");
+	}
+
+	graphene_tasklist_update_window(self, window);
+}
+
+static void remove_window_complete(CmkButton *button)
+{
+	clutter_actor_destroy(CLUTTER_ACTOR(button));
+}
+
+void graphene_tasklist_remove_window(GrapheneTasklist *self, GrapheneWindow *window)
+{
+	g_return_if_fail(GRAPHENE_IS_TASKLIST(self));
+	ClutterActor *button = CLUTTER_ACTOR(g_hash_table_lookup(self->windows, window));
+	if(!button)
+		return;
+
+	// Unlink both directions now rather than when the animation ends, as
+	// the window may be freed (and its address reused) before then. The
+	// button is destroyed by remove_window_complete instead of the table.
+	g_hash_table_steal(self->windows, window);
+	g_object_set_qdata(G_OBJECT(button), tasklist_window_quark(), NULL);
+	g_signal_handlers_disconnect_by_func(button, on_tasklist_button_allocation_changed, window);
+
+	// An unmapped button wouldn't animate, so transitions_completed would
+	// never be emitted
+	if(!clutter_actor_is_mapped(button))
+	{
+		clutter_actor_destroy(button);
+		return;
+	}
+
+	g_signal_connect(button, "transitions_completed", G_CALLBACK(remove_window_complete), NULL);
+	clutter_actor_save_easing_state(button);
+	clutter_actor_set_easing_mode(button, CLUTTER_EASE_IN_BACK);
+	clutter_actor_set_easing_duration(button, 200);
+	clutter_actor_set_scale(button, 0, 0);
+	clutter_actor_restore_easing_state(button);
+	TRANSITION_MEMLEAK_FIX(button, "scale-x");
+	TRANSITION_MEMLEAK_FIX(button, "scale-y");
+}
+
+void graphene_tasklist_update_window(GrapheneTasklist *self, GrapheneWindow *window)
+{
+	g_return_if_fail(GRAPHENE_IS_TASKLIST(self));
+	CmkButton *button = g_hash_table_lookup(self->windows, window);
+	if(button)
+	{
+		CmkWidget *content = cmk_button_get_content(button);
+		cmk_icon_set_icon(CMK_ICON(content), window->icon);
+	}
+
+	if(button)
+		cmk_button_set_selected(button, (window->flags & GRAPHENE_WINDOW_FLAG_FOCUSED));
+
+	if(!button && !(window->flags & GRAPHENE_WINDOW_FLAG_SKIP_TASKBAR))
+		graphene_tasklist_add_window(self, window);
+	else if(button && (window->flags & GRAPHENE_WINDOW_FLAG_SKIP_TASKBAR))
+		graphene_tasklist_remove_window(self, window);
+}
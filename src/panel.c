@@ -15,9 +15,6 @@
 
 #define PANEL_HEIGHT 32 // Pixels; multiplied by the window scale factor
 
-// See wm.c
-#define TRANSITION_MEMLEAK_FIX(actor, tname) g_signal_connect_after(clutter_actor_get_transition(CLUTTER_ACTOR(actor), (tname)), "stopped", G_CALLBACK(g_object_unref), NULL)
-
 struct _GraphenePanel
 {
 	CmkWidget parent;
@@ -37,8 +34,9 @@ struct _GraphenePanel
 	guint popupEventFilterId;
 	ClutterBoxLayout *settingsAppletLayout;
 
-	CmkWidget *tasklist;
-	GHashTable *windows; // GrapheneWindow * (not owned) to CmkWidget * (not refed)
+	GrapheneTasklist *tasklist;
+
+	GrapheneAppIndex *appIndex;
 };
 
 static void graphene_panel_dispose(GObject *self_);
@@ -87,6 +85,7 @@ static void graphene_panel_init(GraphenePanel *self)
 	clutter_actor_set_clip_to_allocation(CLUTTER_ACTOR(self), TRUE);
 
 	// Launcher
+	self->appIndex = graphene_app_index_new();
 	self->launcher = cmk_button_new();
 	CmkIcon *launcherIcon = cmk_icon_new_full("open-menu-symbolic", "Adwaita", PANEL_HEIGHT, TRUE);
 	cmk_button_set_content(self->launcher, CMK_WIDGET(launcherIcon));
@@ -94,9 +93,7 @@ static void graphene_panel_init(GraphenePanel *self)
 	clutter_actor_add_child(CLUTTER_ACTOR(self->bar), CLUTTER_ACTOR(self->launcher));
 
 	// Tasklist
-	self->windows = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)clutter_actor_destroy);
-	self->tasklist = cmk_widget_new();
-	clutter_actor_set_layout_manager(CLUTTER_ACTOR(self->tasklist), clutter_box_layout_new());
+	self->tasklist = graphene_tasklist_new(PANEL_HEIGHT * 3 / 4); // Icon is 75% of panel height. 64 -> 48, 32 -> 24, etc.
 	clutter_actor_set_x_expand(CLUTTER_ACTOR(self->tasklist), TRUE);
 	clutter_actor_add_child(CLUTTER_ACTOR(self->bar), CLUTTER_ACTOR(self->tasklist));
 
@@ -122,7 +119,7 @@ static void graphene_panel_init(GraphenePanel *self)
 static void graphene_panel_dispose(GObject *self_)
 {
 	GraphenePanel *self = GRAPHENE_PANEL(self_);
-	g_hash_table_unref(self->windows);
+	g_clear_object(&self->appIndex);
 	G_OBJECT_CLASS(graphene_panel_parent_class)->dispose(self_);
 }
 
@@ -235,7 +232,7 @@ static void on_launcher_button_activate(CmkButton *button, GraphenePanel *self)
 
 	if(self->modalCb)
 		self->modalCb(TRUE, self->cbUserdata);
-	self->popup = CMK_WIDGET(graphene_launcher_popup_new());
+	self->popup = CMK_WIDGET(graphene_launcher_popup_new(self->appIndex));
 	self->popupSource = button;
 	clutter_actor_add_child(CLUTTER_ACTOR(self), CLUTTER_ACTOR(self->popup));
 	g_signal_connect(self->popup, "destroy", G_CALLBACK(on_popup_destroy), self);
@@ -271,111 +268,17 @@ static void on_settings_button_activate(CmkButton *button, GraphenePanel *self)
  * Tasklist
  */
 
-static void on_tasklist_button_activate(CmkButton *button, GraphenePanel *self)
-{
-	GrapheneWindow *window = NULL;
-	GHashTableIter iter;
-	gpointer key, value;
-	g_hash_table_iter_init(&iter, self->windows);
-	while(g_hash_table_iter_next(&iter, &key, &value))
-	{
-		if(value == button)
-		{
-			window = key;
-			break;
-		}
-	}
-	
-	if(!window)
-		return;
-
-	if((window->flags & GRAPHENE_WINDOW_FLAG_MINIMIZED) || !(window->flags & GRAPHENE_WINDOW_FLAG_FOCUSED))
-		window->show(window);
-	else
-		window->minimize(window);
-}
-
-static void on_tasklist_button_allocation_changed(CmkButton *button, ClutterActorBox *box, ClutterAllocationFlags flags, GrapheneWindow *window)
-{
-	gfloat x, y, width, height;
-	clutter_actor_get_transformed_position(CLUTTER_ACTOR(button), &x, &y);
-	clutter_actor_get_transformed_size(CLUTTER_ACTOR(button), &width, &height);
-	window->setIconBox(window, x, y, width, height);
-}
-
 void graphene_panel_add_window(GraphenePanel *self, GrapheneWindow *window)
 {
-	if(window->flags & GRAPHENE_WINDOW_FLAG_SKIP_TASKBAR)
-		return;
-	CmkIcon *icon = cmk_icon_new();
-	cmk_icon_set_size(icon, PANEL_HEIGHT * 3 / 4); // Icon is 75% of panel height. 64 -> 48, 32 -> 24, etc.
-
-	CmkButton *button = cmk_button_new();
-	g_signal_connect(button, "activate", G_CALLBACK(on_tasklist_button_activate), self);
-	g_signal_connect(button, "allocation-changed", G_CALLBACK(on_tasklist_button_allocation_changed), window);
-	cmk_button_set_content(button, CMK_WIDGET(icon));
-
-	clutter_actor_add_child(CLUTTER_ACTOR(self->tasklist), CLUTTER_ACTOR(button));
-	g_hash_table_insert(self->windows, window, button);
-	
-	ClutterActor *buttonActor = CLUTTER_ACTOR(button);
-	clutter_actor_set_pivot_point(buttonActor, 0.5, 0.5);
-	clutter_actor_set_scale(buttonActor, 0, 0);
-	clutter_actor_save_easing_state(buttonActor);
-	clutter_actor_set_easing_mode(buttonActor, CLUTTER_EASE_OUT_BACK);
-	clutter_actor_set_easing_duration(buttonActor, 200);
-	clutter_actor_set_scale(buttonActor, 1, 1);
-	clutter_actor_restore_easing_state(buttonActor);
-	TRANSITION_MEMLEAK_FIX(button, "scale-x");
-	TRANSITION_MEMLEAK_FIX(button, "scale-y");
-
-	graphene_panel_update_window(self, window);
-}
-
-static void remove_window_complete(GraphenePanel *self, CmkButton *button)
-{
-	GHashTableIter iter;
-	gpointer key, value;
-	g_hash_table_iter_init(&iter, self->windows);
-	while(g_hash_table_iter_next(&iter, &key, &value))
-	{
-		if(value == button)
-		{
-			g_hash_table_iter_remove(&iter);
-			return;
-		}
-	}
+	graphene_tasklist_add_window(self->tasklist, window);
 }
 
 void graphene_panel_remove_window(GraphenePanel *self, GrapheneWindow *window)
 {
-	ClutterActor *button = CLUTTER_ACTOR(g_hash_table_lookup(self->windows, window));
-	if(!button)
-		return;
-	g_signal_connect_swapped(button, "transitions_completed", G_CALLBACK(remove_window_complete), self);
-	clutter_actor_save_easing_state(button);
-	clutter_actor_set_easing_mode(button, CLUTTER_EASE_IN_BACK);
-	clutter_actor_set_easing_duration(button, 200);
-	clutter_actor_set_scale(button, 0, 0);
-	clutter_actor_restore_easing_state(button);
-	TRANSITION_MEMLEAK_FIX(button, "scale-x");
-	TRANSITION_MEMLEAK_FIX(button, "scale-y");
+	graphene_tasklist_remove_window(self->tasklist, window);
 }
 
 void graphene_panel_update_window(GraphenePanel *self, GrapheneWindow *window)
 {
-	CmkButton *button = g_hash_table_lookup(self->windows, window);
-	if(button)
-	{
-		CmkWidget *content = cmk_button_get_content(button);
-		cmk_icon_set_icon(CMK_ICON(content), window->icon);
-	}
-
-	if(button)
-		cmk_button_set_selected(button, (window->flags & GRAPHENE_WINDOW_FLAG_FOCUSED));
-
-	if(!button && !(window->flags & GRAPHENE_WINDOW_FLAG_SKIP_TASKBAR))
-		graphene_panel_add_window(self, window);
-	else if(button && (window->flags & GRAPHENE_WINDOW_FLAG_SKIP_TASKBAR))
-		graphene_panel_remove_window(self, window);
+	graphene_tasklist_update_window(self->tasklist, window);
 }
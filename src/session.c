@@ -28,8 +28,11 @@
  *    lost (in any phase), this is a fatal error, and quit.
  * 1. Startup
  *    Spawn base processes listed in .desktop files. This includes the Panel,
- *    File Manager, etc. Wait for all of these to register or complete before
- *    moving to phase two.
+ *    File Manager, etc. These are started in the order of their
+ *    X-GNOME-Autostart-Phase (Initialization, WindowManager, Panel, Desktop).
+ *    Each startup phase waits for its clients to register or complete, or
+ *    for its deadline to pass, before the next one starts. Once the Desktop
+ *    phase is done, move to phase two.
  * 2. Running
  *    Spawn any remaining .desktop files (mostly user-specified startup apps)
  *    and idle. Listen for clients to register/unregister or to set inhibits
@@ -61,6 +64,8 @@
 #define SESSION_DBUS_PATH "/org/gnome/SessionManager"
 #define POLKIT_AUTH_AGENT_DBUS_PATH "/io/velt/PolicyKit1/AuthenticationAgent"
 #define SHOW_ALL_OUTPUT TRUE // Set to TRUE for release; FALSE only shows output from .desktop files with 'Graphene-ShowOutput=true'
+#define STARTUP_MAX_PARALLEL 4 // Clients spawned at once within a startup phase
+#define STARTUP_TRACE_ENV "GRAPHENE_STARTUP_TRACE" // If set, path to write the startup trace to
 
 // Generated name is a bit too long...
 typedef DBusOrgFreedesktopPolicyKit1AuthenticationAgent DBusPolkitAuthAgent; 
@@ -72,6 +77,31 @@ typedef enum {
 	SESSION_PHASE_LOGOUT,
 } SessionPhase;
 
+/*
+ * Startup phases, from X-GNOME-Autostart-Phase. All but Applications are
+ * run during SESSION_PHASE_STARTUP, in order. Applications are launched
+ * once the session is running, and aren't waited on.
+ */
+typedef enum {
+	STARTUP_PHASE_INITIALIZATION = 0,
+	STARTUP_PHASE_WINDOW_MANAGER,
+	STARTUP_PHASE_PANEL,
+	STARTUP_PHASE_DESKTOP,
+	STARTUP_PHASE_APPLICATIONS,
+	STARTUP_PHASE_COUNT
+} StartupPhase;
+
+static const struct {
+	const gchar *name;
+	guint deadline; // Seconds to wait for the phase's clients to become ready
+} StartupPhases[STARTUP_PHASE_COUNT] = {
+	{"Initialization", 10},
+	{"WindowManager", 10},
+	{"Panel", 10},
+	{"Desktop", 20},
+	{"Applications", 0},
+};
+
 typedef struct {
 	CSMStartupCompleteCallback startupCb;
 	CSMDialogCallback dialogCb;
@@ -91,6 +121,14 @@ typedef struct {
 
 	SessionPhase phase;
 	GList *clients;
+
+	StartupPhase startupPhase;
+	GQueue startupQueues[STARTUP_PHASE_COUNT]; // GDesktopAppInfo *, waiting to be spawned
+	guint startupPending[STARTUP_PHASE_COUNT]; // Spawned clients which aren't ready yet
+	guint startupDeadlineId;
+	gboolean startupScheduling;
+	gint64 startupTime; // Monotonic time the startup phase began
+	GString *startupTrace; // Comma separated trace event objects
 } GrapheneSession;
 
 
@@ -105,14 +143,18 @@ static void on_dbus_name_acquired(GDBusConnection *connection, const gchar *name
 static void on_dbus_name_lost(GDBusConnection *connection, const gchar *name, void *userdata);
 
 static void run_phase(SessionPhase phase);
-static gboolean check_startup_complete();
 
 static void on_client_notify_ready(GrapheneSessionClient *client);
 static void on_client_notify_complete(GrapheneSessionClient *client);
+static void on_client_notify_failed(GrapheneSessionClient *client);
 
-static void launch_desktop();
+static void startup_begin();
+static void startup_schedule();
+static void startup_client_settled(GrapheneSessionClient *client);
+static void startup_trace(const gchar *name, const gchar *category, const gchar *type, guint id);
+static void startup_write_trace();
 static void launch_apps();
-static void launch_autostart(GDesktopAppInfo *desktopInfo);
+static GrapheneSessionClient * launch_autostart(GDesktopAppInfo *desktopInfo);
 
 static void connect_dbus_methods();
 
@@ -166,6 +208,18 @@ static gboolean graphene_session_exit_internal(gboolean failed)
 	// (In a successful logout, there should be no clients left anyway)
 	g_list_free_full(session->clients, g_object_unref);
 	session->clients = NULL;
+
+	if(session->startupDeadlineId)
+		g_source_remove(session->startupDeadlineId);
+	session->startupDeadlineId = 0;
+	for(guint i=0;i<STARTUP_PHASE_COUNT;++i)
+	{
+		g_queue_foreach(&session->startupQueues[i], (GFunc)g_object_unref, NULL);
+		g_queue_clear(&session->startupQueues[i]);
+	}
+	if(session->startupTrace)
+		g_string_free(session->startupTrace, TRUE);
+	session->startupTrace = NULL;
 	
 	// May be blocking according to g_bus_unown_name source code
 	if(session->dbusNameId)
@@ -429,7 +483,6 @@ static void on_dbus_name_lost(GDBusConnection *eBus, const gchar *name, void *us
 
 static gboolean run_phase_idle(SessionPhase phase)
 {
-	// TODO: Phase timer
 	SessionPhase prevPhase = session->phase;
 	session->phase = phase;
 	switch(phase)
@@ -440,8 +493,7 @@ static gboolean run_phase_idle(SessionPhase phase)
 		g_message("------------------------");
 		g_message("Running startup phase");
 		g_message("------------------------");
-		launch_desktop();
-		check_startup_complete();
+		startup_begin();
 		break;
 	case SESSION_PHASE_RUNNING:
 		g_message("------------------------");
@@ -457,6 +509,7 @@ static gboolean run_phase_idle(SessionPhase phase)
 			if(session->startupCb)
 				session->startupCb(session->cbUserdata);
 			launch_apps();
+			startup_write_trace();
 		}
 		break;
 	case SESSION_PHASE_LOGOUT:
@@ -479,26 +532,6 @@ static void run_phase(SessionPhase phase)
 	g_idle_add((GSourceFunc)run_phase_idle, GINT_TO_POINTER(phase));
 }
 
-static gboolean check_startup_complete()
-{
-	if(session->phase != SESSION_PHASE_STARTUP)
-		return FALSE;
-	g_message("Checking startup complete...");
-	for(GList *it = session->clients; it != NULL; it = it->next)
-	{
-		if(!graphene_session_client_get_is_ready(it->data))
-		{
-			g_message("Client '%s' is not ready\n", graphene_session_client_get_best_name(it->data));
-			return FALSE;
-		}
-	}
-
-	run_phase(SESSION_PHASE_RUNNING);
-	return TRUE;
-}
-
-
-
 /*
  * Client Events
  * Some of these are sent back from the GrapheneSessionClient object, while
@@ -562,7 +595,15 @@ static void on_client_notify_ready(GrapheneSessionClient *client)
 	if(!graphene_session_client_get_is_ready(client))
 		return;
 	g_message("Client %s is ready.", graphene_session_client_get_best_name(client));
-	check_startup_complete();
+	startup_client_settled(client);
+}
+
+static void on_client_notify_failed(GrapheneSessionClient *client)
+{
+	if(!graphene_session_client_get_is_failed(client))
+		return;
+	g_message("Client %s failed.", graphene_session_client_get_best_name(client));
+	startup_client_settled(client);
 }
 
 static gboolean on_client_unregister(DBusSessionManager *object, GDBusMethodInvocation *invocation, const gchar *clientObjectPath, gpointer userdata)
@@ -584,17 +625,15 @@ static void on_client_notify_complete(GrapheneSessionClient *client)
 		return;
 	g_message("Client %s is complete.", graphene_session_client_get_best_name(client));
 	session->clients = g_list_remove(session->clients, client);
+	startup_client_settled(client);
 	g_object_unref(client);
 	
-	if(!check_startup_complete())
-	{
-		// If all clients die, exit
-		// This will happen at the end of a successful Logout
-		// Exit on idle because on_client_notify_complete can be called indirectly from
-		// on_client_register, a DBus callback.
-		if(session->clients == NULL)
-			graphene_session_exit_internal_on_idle(FALSE);
-	}
+	// If all clients die, exit
+	// This will happen at the end of a successful Logout
+	// Exit on idle because on_client_notify_complete can be called indirectly from
+	// on_client_register, a DBus callback.
+	if(session->phase != SESSION_PHASE_STARTUP && session->clients == NULL)
+		graphene_session_exit_internal_on_idle(FALSE);
 }
 
 
@@ -676,51 +715,247 @@ static GHashTable * list_autostarts()
   return desktopInfoTable;
 }
 
-static void launch_desktop()
+/*
+ * Startup Phases
+ */
+
+static GQuark startup_phase_quark()
+{
+	return g_quark_from_static_string("graphene-startup-phase");
+}
+
+static StartupPhase get_startup_phase(GDesktopAppInfo *desktopInfo)
+{
+	gchar *name = g_desktop_app_info_get_string(desktopInfo, "X-GNOME-Autostart-Phase");
+	StartupPhase phase = STARTUP_PHASE_APPLICATIONS;
+	for(guint i=0;i<STARTUP_PHASE_APPLICATIONS;++i)
+		if(g_strcmp0(name, StartupPhases[i].name) == 0)
+			phase = i;
+	g_free(name);
+	return phase;
+}
+
+/*
+ * Sorts all autostart .desktop files into the startup phase queues, and
+ * starts the first phase.
+ */
+static void startup_begin()
 {
+	session->startupTime = g_get_monotonic_time();
+	session->startupTrace = g_string_new(NULL);
+
+	// Sorted so that the launch order within a phase doesn't change randomly
 	GHashTable *autostarts = list_autostarts();
-	GHashTableIter iter;
-	gpointer key, value;
-	g_hash_table_iter_init(&iter, autostarts);
-	while(g_hash_table_iter_next(&iter, &key, &value))
-	{    
-		GDesktopAppInfo *desktopInfo = G_DESKTOP_APP_INFO(value);
-    	gchar *phase = g_desktop_app_info_get_string(desktopInfo, "X-GNOME-Autostart-Phase");
-	
-		// Just launch all of the startup phases at once. Maybe give it order later,
-		// but it doesn't make much difference.
-		if(g_strcmp0(phase, "Initialization") == 0
-		|| g_strcmp0(phase, "Panel") == 0
-		|| g_strcmp0(phase, "Desktop") == 0)
+	GList *names = g_list_sort(g_hash_table_get_keys(autostarts), (GCompareFunc)g_strcmp0);
+	for(GList *it=names;it!=NULL;it=it->next)
+	{
+		GDesktopAppInfo *desktopInfo = g_hash_table_lookup(autostarts, it->data);
+		StartupPhase phase = get_startup_phase(desktopInfo);
+
+		// Graphene is the window manager, so don't start another one
+		if(phase == STARTUP_PHASE_WINDOW_MANAGER)
 		{
-			launch_autostart(desktopInfo);
+			g_message("Skipping '%s' because Graphene is the window manager.", (gchar *)it->data);
+			continue;
 		}
+		g_queue_push_tail(&session->startupQueues[phase], g_object_ref(desktopInfo));
 	}
+	g_list_free(names);
+	g_hash_table_unref(autostarts);
+
+	session->startupPhase = STARTUP_PHASE_INITIALIZATION;
+	startup_trace(StartupPhases[session->startupPhase].name, "phase", "B", 0);
+	startup_schedule();
 }
 
-static void launch_apps()
+static gboolean startup_on_deadline(gpointer userdata)
 {
-	GHashTable *autostarts = list_autostarts();
-	GHashTableIter iter;
-	gpointer key, value;
-	g_hash_table_iter_init(&iter, autostarts);
-	while(g_hash_table_iter_next(&iter, &key, &value))
-	{    
-		GDesktopAppInfo *desktopInfo = G_DESKTOP_APP_INFO(value);
-    	gchar *phase = g_desktop_app_info_get_string(desktopInfo, "X-GNOME-Autostart-Phase");
-
-		// Only launch applications not launched in launch_desktop
-		if(g_strcmp0(phase, "Initialization") != 0
-		&& g_strcmp0(phase, "WindowManager") != 0
-		&& g_strcmp0(phase, "Panel") != 0
-		&& g_strcmp0(phase, "Desktop") != 0)
+	session->startupDeadlineId = 0;
+	StartupPhase phase = session->startupPhase;
+	g_warning("Startup phase %s did not complete within %is", StartupPhases[phase].name, StartupPhases[phase].deadline);
+
+	// Stop waiting on the phase's clients. Ones which haven't been spawned
+	// yet are still spawned, but not waited on.
+	for(GList *it=session->clients;it!=NULL;it=it->next)
+	{
+		if(GPOINTER_TO_UINT(g_object_get_qdata(it->data, startup_phase_quark())) != phase + 1)
+			continue;
+		g_message("Client '%s' is not ready", graphene_session_client_get_best_name(it->data));
+		startup_trace(graphene_session_client_get_best_name(it->data), "client", "e", GPOINTER_TO_UINT(it->data));
+		g_object_set_qdata(it->data, startup_phase_quark(), NULL);
+	}
+	session->startupPending[phase] = 0;
+
+	GDesktopAppInfo *desktopInfo;
+	while((desktopInfo = g_queue_pop_head(&session->startupQueues[phase])))
+	{
+		launch_autostart(desktopInfo);
+		g_object_unref(desktopInfo);
+	}
+
+	startup_schedule();
+	return G_SOURCE_REMOVE;
+}
+
+static void startup_spawn(GDesktopAppInfo *desktopInfo, StartupPhase phase)
+{
+	// Spawning can settle the client synchronously, and completing it
+	// drops the session's reference, so hold one until done with it
+	GrapheneSessionClient *client = g_object_ref(launch_autostart(desktopInfo));
+	if(graphene_session_client_get_is_ready(client)
+	|| graphene_session_client_get_is_failed(client)
+	|| !g_list_find(session->clients, client))
+	{
+		// Settled immediately, ex. its condition is false or it failed to spawn
+		g_object_unref(client);
+		return;
+	}
+
+	// The phase is stored on the client, so that settling it is O(1)
+	session->startupPending[phase]++;
+	g_object_set_qdata(G_OBJECT(client), startup_phase_quark(), GUINT_TO_POINTER(phase + 1));
+	startup_trace(graphene_session_client_get_best_name(client), "client", "b", GPOINTER_TO_UINT(client));
+	g_object_unref(client);
+}
+
+/*
+ * Spawns queued clients of the current startup phase, up to
+ * STARTUP_MAX_PARALLEL at once, and moves to the next phase once all of
+ * them are ready. Runs the session once the last startup phase is done.
+ */
+static void startup_schedule()
+{
+	if(session->phase != SESSION_PHASE_STARTUP || session->startupScheduling)
+		return;
+	session->startupScheduling = TRUE;
+
+	while(session->startupPhase < STARTUP_PHASE_APPLICATIONS)
+	{
+		StartupPhase phase = session->startupPhase;
+		GQueue *queue = &session->startupQueues[phase];
+		while(!g_queue_is_empty(queue) && session->startupPending[phase] < STARTUP_MAX_PARALLEL)
+		{
+			GDesktopAppInfo *desktopInfo = g_queue_pop_head(queue);
+			startup_spawn(desktopInfo, phase);
+			g_object_unref(desktopInfo);
+		}
+
+		if(!g_queue_is_empty(queue) || session->startupPending[phase] > 0)
 		{
-			launch_autostart(desktopInfo);
+			if(!session->startupDeadlineId)
+				session->startupDeadlineId = g_timeout_add_seconds(StartupPhases[phase].deadline, startup_on_deadline, NULL);
+			break;
 		}
+
+		if(session->startupDeadlineId)
+			g_source_remove(session->startupDeadlineId);
+		session->startupDeadlineId = 0;
+		startup_trace(StartupPhases[phase].name, "phase", "E", 0);
+		g_message("Startup phase %s complete (%.2fs)", StartupPhases[phase].name, (g_get_monotonic_time() - session->startupTime) / (gdouble)G_USEC_PER_SEC);
+		session->startupPhase++;
+		if(session->startupPhase < STARTUP_PHASE_APPLICATIONS)
+			startup_trace(StartupPhases[session->startupPhase].name, "phase", "B", 0);
+	}
+
+	session->startupScheduling = FALSE;
+	if(session->startupPhase == STARTUP_PHASE_APPLICATIONS)
+		run_phase(SESSION_PHASE_RUNNING);
+}
+
+/*
+ * Call when a client becomes ready, fails, or completes. If the current
+ * startup phase is waiting on the client, it stops waiting.
+ */
+static void startup_client_settled(GrapheneSessionClient *client)
+{
+	if(!session)
+		return;
+	guint phase = GPOINTER_TO_UINT(g_object_get_qdata(G_OBJECT(client), startup_phase_quark()));
+	if(phase == 0)
+		return;
+	phase -= 1;
+	g_object_set_qdata(G_OBJECT(client), startup_phase_quark(), NULL);
+	startup_trace(graphene_session_client_get_best_name(client), "client", "e", GPOINTER_TO_UINT(client));
+
+	if(session->startupPending[phase] > 0)
+		session->startupPending[phase]--;
+	startup_schedule();
+}
+
+static void json_append_string(GString *json, const gchar *str)
+{
+	g_string_append_c(json, '"');
+	for(const gchar *c=str;c && *c;++c)
+	{
+		if(*c == '"' || *c == '\\')
+			g_string_append_printf(json, "\\%c", *c);
+		else if((guchar)*c < 0x20)
+			g_string_append_printf(json, "\\u%04x", (guchar)*c);
+		else
+			g_string_append_c(json, *c);
+	}
+	g_string_append_c(json, '"');
+}
+
+/*
+ * Records a Trace Event Format event (viewable in chrome://tracing).
+ * Phases are B/E duration events, and clients are b/e async events with
+ * an id, since they overlap.
+ */
+static void startup_trace(const gchar *name, const gchar *category, const gchar *type, guint id)
+{
+	if(!session->startupTrace)
+		return;
+	GString *trace = session->startupTrace;
+	if(trace->len > 0)
+		g_string_append(trace, ",\n");
+	g_string_append(trace, "{\"name\":");
+	json_append_string(trace, name);
+	g_string_append_printf(trace, ",\"cat\":\"%s\",\"ph\":\"%s\",\"ts\":%" G_GINT64_FORMAT ",\"pid\":1,\"tid\":1",
+		category, type, g_get_monotonic_time() - session->startupTime);
+	if(id)
+		g_string_append_printf(trace, ",\"id\":%u", id);
+	g_string_append_c(trace, '}');
+}
+
+/*
+ * Writes the startup trace as JSON to the path in $GRAPHENE_STARTUP_TRACE,
+ * if it is set.
+ */
+static void startup_write_trace()
+{
+	const gchar *path = g_getenv(STARTUP_TRACE_ENV);
+	if(!path || !session->startupTrace)
+		return;
+
+	gchar *json = g_strdup_printf("[\n%s\n]\n", session->startupTrace->str);
+	GError *error = NULL;
+	if(g_file_set_contents(path, json, -1, &error))
+		g_message("Wrote startup trace to %s", path);
+	else
+	{
+		g_warning("Failed to write startup trace: %s", error->message);
+		g_error_free(error);
+	}
+	g_free(json);
+}
+
+/*
+ * Launches the Applications phase. These are launched all at once, and
+ * the session doesn't wait for them.
+ */
+static void launch_apps()
+{
+	GDesktopAppInfo *desktopInfo;
+	while((desktopInfo = g_queue_pop_head(&session->startupQueues[STARTUP_PHASE_APPLICATIONS])))
+	{
+		launch_autostart(desktopInfo);
+		startup_trace(g_app_info_get_display_name(G_APP_INFO(desktopInfo)), "client", "i", 0);
+		g_object_unref(desktopInfo);
 	}
 }
 
-static void launch_autostart(GDesktopAppInfo *desktopInfo)
+static GrapheneSessionClient * launch_autostart(GDesktopAppInfo *desktopInfo)
 {
 	GrapheneSessionClient *client = graphene_session_client_new(session->eBus, NULL);
 	session->clients = g_list_prepend(session->clients, client);
@@ -755,10 +990,12 @@ static void launch_autostart(GDesktopAppInfo *desktopInfo)
 	g_object_connect(client,
 		"signal::notify::ready", on_client_notify_ready, NULL,
 		"signal::notify::complete", on_client_notify_complete, NULL,
+		"signal::notify::failed", on_client_notify_failed, NULL,
 		//"signal::end-session-response", on_client_end_session_response, NULL,
 		NULL);
 
 	graphene_session_client_spawn(client); // Ignored if autostart condition is false
+	return client;
 }
 
 
@@ -7,12 +7,24 @@
 #include "settings-battery.h"
 #include <gio/gio.h>
 
+// UPower.Device's properties, as last read
+typedef struct
+{
+  guint32 type; // 0: Unknown, 1: Line Power, 2: Battery, 3: Ups, 4: Monitor, 5: Mouse, 6: Keyboard, 7: Pda, 8: Phone
+  guint32 state;
+  gdouble percentage;
+  gint64 timeToFull, timeToEmpty;
+  gchar *iconName; // NULL if UPower didn't give one
+} BatteryState;
+
 struct _GrapheneBatteryInfo
 {
   GObject parent;
   
   GDBusProxy *batteryDeviceProxy;
-  guint batteryRefreshTimerId;
+  GCancellable *cancel;
+  BatteryState state;
+  guint updateIdleId;
 };
 
 enum
@@ -25,7 +37,7 @@ enum
 static guint signals[SIGNAL_LAST];
 
 static void graphene_battery_info_dispose(GObject *self_);
-static gboolean refresh_battery_info(GrapheneBatteryInfo *self);
+static void on_upproxy_display_device_ready(GObject *source, GAsyncResult *res, gpointer userdata);
 static void on_upproxy_display_device_property_changed(GrapheneBatteryInfo *self, GVariant *changed_properties, GStrv invalidated_properties, GDBusProxy *proxy);
 static gchar * get_icon_name(GrapheneBatteryInfo *self);
 
@@ -55,7 +67,8 @@ static void graphene_battery_info_class_init(GrapheneBatteryInfoClass *klass)
   gobjectClass->dispose = graphene_battery_info_dispose;
   
   /*
-   * Emitted when the status of the battery changes
+   * Emitted when the status of the battery changes. Changes arriving
+   * together (even over several PropertiesChanged signals) are emitted once.
    */ 
   signals[SIGNAL_UPDATE] = g_signal_new("update", G_TYPE_FROM_CLASS(klass), G_SIGNAL_RUN_FIRST,
     0, NULL, NULL, NULL, G_TYPE_NONE, 0);
@@ -63,41 +76,115 @@ static void graphene_battery_info_class_init(GrapheneBatteryInfoClass *klass)
 
 static void graphene_battery_info_init(GrapheneBatteryInfo *self)
 {
-  GError *error = NULL;
-  self->batteryDeviceProxy = g_dbus_proxy_new_for_bus_sync(G_BUS_TYPE_SYSTEM, 0, NULL,
+  // UPower pushes property changes as the battery changes, so there is no
+  // need to poll it. Until the proxy is ready, the battery is unavailable.
+  self->cancel = g_cancellable_new();
+  g_dbus_proxy_new_for_bus(G_BUS_TYPE_SYSTEM, 0, NULL,
     "org.freedesktop.UPower",
     "/org/freedesktop/UPower/devices/DisplayDevice",
     "org.freedesktop.UPower.Device",
-    NULL, &error);
-  
-  if(!self->batteryDeviceProxy)
-  {
-    g_warning("Failed to connect to UPower display device: %s", error->message);
-    g_clear_error(&error);
-    return;
-  }
-  
-  g_signal_connect_swapped(self->batteryDeviceProxy, "g-properties-changed", G_CALLBACK(on_upproxy_display_device_property_changed), self);
-  
-  self->batteryRefreshTimerId = g_timeout_add_seconds(10, (GSourceFunc)refresh_battery_info, self);
-  refresh_battery_info(self);
+    self->cancel,
+    on_upproxy_display_device_ready,
+    self);
 }
 
 static void graphene_battery_info_dispose(GObject *self_)
 {
   GrapheneBatteryInfo *self = GRAPHENE_BATTERY_INFO(self_);
+  if(self->cancel)
+    g_cancellable_cancel(self->cancel);
+  g_clear_object(&self->cancel);
   g_clear_object(&self->batteryDeviceProxy);
-  if(self->batteryRefreshTimerId)
-    g_source_remove(self->batteryRefreshTimerId);
-  self->batteryRefreshTimerId = 0;
+  g_clear_pointer(&self->state.iconName, g_free);
+  if(self->updateIdleId)
+    g_source_remove(self->updateIdleId);
+  self->updateIdleId = 0;
   G_OBJECT_CLASS(graphene_battery_info_parent_class)->dispose(self_);
 }
 
-static gboolean refresh_battery_info(GrapheneBatteryInfo *self)
+static gboolean emit_update(GrapheneBatteryInfo *self)
+{
+  self->updateIdleId = 0;
+  g_signal_emit(self, signals[SIGNAL_UPDATE], 0);
+  return G_SOURCE_REMOVE;
+}
+
+static guint32 get_cached_uint32(GDBusProxy *proxy, const gchar *name)
 {
+  GVariant *variant = g_dbus_proxy_get_cached_property(proxy, name);
+  if(!variant)
+    return 0;
+  guint32 value = g_variant_is_of_type(variant, G_VARIANT_TYPE_UINT32) ? g_variant_get_uint32(variant) : 0;
+  g_variant_unref(variant);
+  return value;
+}
+
+static gint64 get_cached_int64(GDBusProxy *proxy, const gchar *name)
+{
+  GVariant *variant = g_dbus_proxy_get_cached_property(proxy, name);
+  if(!variant)
+    return 0;
+  gint64 value = g_variant_is_of_type(variant, G_VARIANT_TYPE_INT64) ? g_variant_get_int64(variant) : 0;
+  g_variant_unref(variant);
+  return value;
+}
+
+/*
+ * Decodes the proxy's cached properties into self->state, and schedules an
+ * update signal if anything changed.
+ */
+static void read_state(GrapheneBatteryInfo *self)
+{
+  BatteryState state = {0};
   if(self->batteryDeviceProxy)
-    g_dbus_proxy_call(self->batteryDeviceProxy, "Refresh", NULL, G_DBUS_CALL_FLAGS_NONE, 100, NULL, NULL, NULL);
-  return TRUE; // true to continue the timer callback
+  {
+    GDBusProxy *proxy = self->batteryDeviceProxy;
+    state.type = get_cached_uint32(proxy, "Type");
+    state.state = get_cached_uint32(proxy, "State");
+    state.timeToFull = get_cached_int64(proxy, "TimeToFull");
+    state.timeToEmpty = get_cached_int64(proxy, "TimeToEmpty");
+
+    GVariant *variant = g_dbus_proxy_get_cached_property(proxy, "Percentage");
+    if(variant && g_variant_is_of_type(variant, G_VARIANT_TYPE_DOUBLE))
+      state.percentage = g_variant_get_double(variant);
+    g_clear_pointer(&variant, g_variant_unref);
+
+    variant = g_dbus_proxy_get_cached_property(proxy, "IconName");
+    if(variant && g_variant_is_of_type(variant, G_VARIANT_TYPE_STRING))
+      state.iconName = g_variant_dup_string(variant, NULL);
+    g_clear_pointer(&variant, g_variant_unref);
+  }
+
+  gboolean changed = state.type != self->state.type
+    || state.state != self->state.state
+    || state.percentage != self->state.percentage
+    || state.timeToFull != self->state.timeToFull
+    || state.timeToEmpty != self->state.timeToEmpty
+    || g_strcmp0(state.iconName, self->state.iconName) != 0;
+
+  g_free(self->state.iconName);
+  self->state = state;
+
+  if(changed && !self->updateIdleId)
+    self->updateIdleId = g_idle_add((GSourceFunc)emit_update, self);
+}
+
+static void on_upproxy_display_device_ready(GObject *source, GAsyncResult *res, gpointer userdata)
+{
+  GError *error = NULL;
+  GDBusProxy *proxy = g_dbus_proxy_new_for_bus_finish(res, &error);
+  if(!proxy)
+  {
+    if(!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+      g_warning("Failed to connect to UPower display device: %s", error->message);
+    g_clear_error(&error);
+    return;
+  }
+
+  GrapheneBatteryInfo *self = GRAPHENE_BATTERY_INFO(userdata);
+  self->batteryDeviceProxy = proxy;
+  g_signal_connect_swapped(self->batteryDeviceProxy, "g-properties-changed", G_CALLBACK(on_upproxy_display_device_property_changed), self);
+  read_state(self);
 }
 
 gboolean graphene_battery_info_is_available(GrapheneBatteryInfo *self)
@@ -109,56 +196,23 @@ gboolean graphene_battery_info_is_available(GrapheneBatteryInfo *self)
     refSelf = TRUE;
   }
   
-  if(!G_IS_DBUS_PROXY(self->batteryDeviceProxy))
-  {
-    if(refSelf)
-      g_object_unref(self);
-    return FALSE;
-  }
-  
-  guint32 deviceType = 0;
-  GVariant *typeVariant = g_dbus_proxy_get_cached_property(self->batteryDeviceProxy, "Type");
-  if(typeVariant)
-  {
-    deviceType = g_variant_get_uint32(typeVariant);
-    g_variant_unref(typeVariant);
-  }
+  gboolean available = self->state.type == 2; // Battery
   
   if(refSelf)
     g_object_unref(self);
-  
-  // 0: Unknown, 1: Line Power, 2: Battery, 3: Ups, 4: Monitor, 5: Mouse, 6: Keyboard, 7: Pda, 8: Phone
-  return deviceType == 2;
+  return available;
 }
 gdouble graphene_battery_info_get_percent(GrapheneBatteryInfo *self)
 {
   g_return_val_if_fail(graphene_battery_info_is_available(self), 0.0);
-  
-  gdouble percentage = 0.0;
-  GVariant *percentageVariant = g_dbus_proxy_get_cached_property(self->batteryDeviceProxy, "Percentage");
-  if(percentageVariant)
-  {
-    percentage = g_variant_get_double(percentageVariant);
-    g_variant_unref(percentageVariant);
-  }
-  
-  return percentage;
+  return self->state.percentage;
 }
 guint32 graphene_battery_info_get_state(GrapheneBatteryInfo *self)
 {
   // 0: Unknown, 1: Charging, 2: Discharging, 3: Empty, 4: Fully charged, 5: Pending charge, 6: Pending discharge
   
   g_return_val_if_fail(graphene_battery_info_is_available(self), 0);
-
-  guint32 state = 0;
-  GVariant *stateVariant = g_dbus_proxy_get_cached_property(self->batteryDeviceProxy, "State");
-  if(stateVariant)
-  {
-    state = g_variant_get_uint32(stateVariant);
-    g_variant_unref(stateVariant);
-  }
-  
-  return state;
+  return self->state.state;
 }
 const gchar * graphene_battery_info_get_state_string(GrapheneBatteryInfo *self)
 {
@@ -180,14 +234,8 @@ gchar * graphene_battery_info_get_icon_name(GrapheneBatteryInfo *self)
   
   g_return_val_if_fail(graphene_battery_info_is_available(self), g_strdup("battery-full-charged-symbolic"));
 
-  GVariant *iconNameVariant = g_dbus_proxy_get_cached_property(self->batteryDeviceProxy, "IconName");
-  if(iconNameVariant)
-  {
-    gchar *iconName = g_strdup(g_variant_get_string(iconNameVariant, NULL));
-    g_variant_unref(iconNameVariant);
-    return iconName;
-  }
-  
+  if(self->state.iconName)
+    return g_strdup(self->state.iconName);
   return get_icon_name(self);
 }
 gint64 graphene_battery_info_get_time(GrapheneBatteryInfo *self)
@@ -196,27 +244,14 @@ gint64 graphene_battery_info_get_time(GrapheneBatteryInfo *self)
   
   g_return_val_if_fail(graphene_battery_info_is_available(self), 0);
 
-  guint32 state = graphene_battery_info_get_state(self);
-
-  const gchar *prop = "";
-  if     (state == 1) prop = "TimeToFull";
-  else if(state == 2) prop = "TimeToEmpty";
-  else                return 0;
-  
-  gint64 time = 0;
-  GVariant *timeVariant = g_dbus_proxy_get_cached_property(self->batteryDeviceProxy, prop);
-  if(timeVariant)
-  {
-    time = g_variant_get_int64(timeVariant);
-    g_variant_unref(timeVariant);
-  }
-  
-  return time;
+  if     (self->state.state == 1) return self->state.timeToFull;
+  else if(self->state.state == 2) return self->state.timeToEmpty;
+  return 0;
 }
 
 static void on_upproxy_display_device_property_changed(GrapheneBatteryInfo *self, GVariant *changed_properties, GStrv invalidated_properties, GDBusProxy *proxy)
 {
-  g_signal_emit_by_name(self, "update");
+  read_state(self);
 }
 
 static gchar * get_icon_name(GrapheneBatteryInfo *self)
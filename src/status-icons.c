@@ -174,6 +174,15 @@ static void graphene_battery_icon_dispose(GObject *self_)
 
 static void battery_icon_on_update(GrapheneBatteryIcon *self, GrapheneBatteryInfo *info)
 {
+	// UPower is read asynchronously, so the battery isn't available yet
+	// when the icon is created, and may go away later
+	if(!graphene_battery_info_is_available(info))
+	{
+		cmk_icon_set_icon(CMK_ICON(self), "battery-missing-symbolic");
+		cmk_widget_set_background_color_name(CMK_WIDGET(self), NULL);
+		return;
+	}
+
 	gchar *iconName = graphene_battery_info_get_icon_name(info);
 	cmk_icon_set_icon(CMK_ICON(self), iconName);
 	g_free(iconName);
@@ -29,6 +29,7 @@
 #include <meta/util.h>
 #include <glib-unix.h>
 #include <stdio.h>
+#include <string.h>
 
 #define WM_VERSION_STRING "1.0.0"
 #define WM_PERCENT_BAR_STEPS 15
@@ -61,6 +62,14 @@ static const float GraphenePadding = 10.0;
  */
 #define TRANSITION_MEMLEAK_FIX(actor, tname) g_signal_connect_after(clutter_actor_get_transition((actor), (tname)), "stopped", G_CALLBACK(g_object_unref), NULL)
 
+// The actors kept for each monitor, and the geometry they were laid out for
+typedef struct
+{
+	MetaRectangle rect;
+	ClutterActor *background; // GrapheneWMBackground
+	ClutterActor *cover;
+} MonitorState;
+
 
 extern void wm_request_logout(gpointer userdata);
 static void on_monitors_changed(MetaScreen *screen, GrapheneWM *self);
@@ -70,6 +79,8 @@ static void reset_clutter_dpi();
 static void on_global_scale_changed(CmkIconLoader *iconLoader);
 static void xfixes_add_input_actor(GrapheneWM *self, ClutterActor *actor);
 static void xfixes_remove_input_actor(GrapheneWM *self, ClutterActor *actor);
+static void xfixes_queue_input_region(GrapheneWM *self);
+static void xfixes_update_input_region(GrapheneWM *self);
 static void graphene_wm_begin_modal(GrapheneWM *self);
 static void graphene_wm_end_modal(GrapheneWM *self);
 static void on_panel_request_modal(gboolean modal, GrapheneWM *self);
@@ -169,6 +180,7 @@ void graphene_wm_start(MetaPlugin *self_)
 	clutter_actor_insert_child_above(self->stage, ACTOR(self->percentBar), NULL);
 
 	// Update actors when the monitors change/resize
+	self->monitors = g_array_new(FALSE, TRUE, sizeof(MonitorState));
 	g_signal_connect(screen, "monitors_changed", G_CALLBACK(on_monitors_changed), self);
 	on_monitors_changed(screen, self);
 	
@@ -183,30 +195,60 @@ void graphene_wm_start(MetaPlugin *self_)
 	graphene_wm_begin_modal(self);
 }
 
+/*
+ * Only the monitors which were added, removed, or moved/resized get their
+ * actors touched. Backgrounds of moved monitors are refitted rather than
+ * recreated, so a hotplug doesn't reload the wallpaper on every monitor.
+ */
 static void on_monitors_changed(MetaScreen *screen, GrapheneWM *self)
 {
 	ClutterActor *bgGroup = ACTOR(self->backgroundGroup);
-	clutter_actor_destroy_all_children(bgGroup);
-	clutter_actor_destroy_all_children(self->coverGroup);
-	
-	ClutterColor *coverColor = clutter_color_new(0,0,0,140);
+	const ClutterColor coverColor = {0,0,0,140};
+
+	guint numMonitors = meta_screen_get_n_monitors(screen);
+	guint added = 0, removed = 0, moved = 0;
 
-	gint numMonitors = meta_screen_get_n_monitors(screen);
-	for(int i=0;i<numMonitors;++i)
+	for(guint i=numMonitors;i<self->monitors->len;++i)
+	{
+		MonitorState *state = &g_array_index(self->monitors, MonitorState, i);
+		clutter_actor_destroy(state->background);
+		clutter_actor_destroy(state->cover);
+		++removed;
+	}
+	if(self->monitors->len > numMonitors)
+		g_array_set_size(self->monitors, numMonitors);
+
+	for(guint i=0;i<numMonitors;++i)
 	{
-		clutter_actor_add_child(bgGroup, ACTOR(graphene_wm_background_new(screen, i)));
-	
 		MetaRectangle rect = meta_rect(0,0,0,0);
 		meta_screen_get_monitor_geometry(screen, i, &rect);
 
-		ClutterActor *cover = clutter_actor_new();
-		clutter_actor_set_background_color(cover, coverColor);
-		clutter_actor_set_position(cover, rect.x, rect.y);
-		clutter_actor_set_size(cover, rect.width, rect.height);
-		clutter_actor_add_child(self->coverGroup, cover);
+		if(i >= self->monitors->len)
+		{
+			MonitorState state = {rect, NULL, NULL};
+			state.background = ACTOR(graphene_wm_background_new(screen, i));
+			clutter_actor_add_child(bgGroup, state.background);
+			state.cover = clutter_actor_new();
+			clutter_actor_set_background_color(state.cover, &coverColor);
+			clutter_actor_set_position(state.cover, rect.x, rect.y);
+			clutter_actor_set_size(state.cover, rect.width, rect.height);
+			clutter_actor_add_child(self->coverGroup, state.cover);
+			g_array_append_val(self->monitors, state);
+			++added;
+			continue;
+		}
+
+		MonitorState *state = &g_array_index(self->monitors, MonitorState, i);
+		if(meta_rectangle_equal(&state->rect, &rect))
+			continue;
+		state->rect = rect;
+		graphene_wm_background_update_geometry(GRAPHENE_WM_BACKGROUND(state->background));
+		clutter_actor_set_position(state->cover, rect.x, rect.y);
+		clutter_actor_set_size(state->cover, rect.width, rect.height);
+		++moved;
 	}
-	
-	clutter_color_free(coverColor);
+
+	g_debug("Monitors changed: %u added, %u removed, %u moved", added, removed, moved);
 
 	int primaryMonitor = meta_screen_get_primary_monitor(screen);
 	MetaRectangle primary;
@@ -413,29 +455,35 @@ static void update_struts(GrapheneWM *self)
  * or resize this input region must be recalculated.
  *
  * Use the xfixes_add/remove_input_actor functions for this. They will
- * automatically handle watching for size/position changes. 
+ * automatically handle watching for size/position changes. Changes are
+ * batched, and the region is recalculated at most once per frame, after
+ * the stage has been laid out and painted. The X region is only updated if
+ * one of the actors' rectangles actually changed.
  */
-static void xfixes_calculate_input_region(GrapheneWM *self)
+static void xfixes_update_input_region(GrapheneWM *self)
 {
+	self->xInputDirty = FALSE;
 	if(meta_is_wayland_compositor())
 		return;
 
 	MetaScreen *screen = meta_plugin_get_screen(META_PLUGIN(self));
 	Display *xDisplay = meta_display_get_xdisplay(meta_screen_get_display(screen));
 
-	guint numActors = g_list_length(self->xInputActors);
+	if(!self->xInputRects)
+		self->xInputRects = g_array_new(FALSE, FALSE, sizeof(XRectangle));
 
-	if(self->modalCount > 0 || numActors == 0)
+	if(self->modalCount > 0 || !self->xInputActors)
 	{
 		meta_empty_stage_input_region(screen);
 		if(self->xInputRegion)
 			XFixesDestroyRegion(xDisplay, self->xInputRegion);
 		self->xInputRegion = 0;
+		g_array_set_size(self->xInputRects, 0);
 		return;
 	}
 
-	XRectangle *rects = g_new(XRectangle, numActors);
-	guint i = 0;
+	XRectangle *rects = g_newa(XRectangle, g_list_length(self->xInputActors));
+	guint numRects = 0;
 
 	for(GList *it = self->xInputActors; it != NULL; it = it->next)
 	{
@@ -443,23 +491,79 @@ static void xfixes_calculate_input_region(GrapheneWM *self)
 			continue;
 		ClutterActor *actor = ACTOR(it->data);
 		if(!clutter_actor_is_mapped(actor) || !clutter_actor_get_reactive(actor))
-			return;
+			continue;
 		gfloat x, y, width, height;
 		clutter_actor_get_transformed_position(actor, &x, &y);
 		clutter_actor_get_transformed_size(actor, &width, &height);
-		rects[i].x = (short)x;
-		rects[i].y = (short)y+1; // It seems that the X region is offset by one pixel. Not sure why.
-		rects[i].width = (unsigned short)width;
-		rects[i].height = (unsigned short)height;
-		i++;
+		rects[numRects].x = (short)x;
+		rects[numRects].y = (short)y+1; // It seems that the X region is offset by one pixel. Not sure why.
+		rects[numRects].width = (unsigned short)width;
+		rects[numRects].height = (unsigned short)height;
+		numRects++;
 	}
 
-	if(self->xInputRegion)
-		XFixesDestroyRegion(xDisplay, self->xInputRegion);
+	// Nothing moved since the last update
+	if(self->xInputRegion
+	&& numRects == self->xInputRects->len
+	&& memcmp(rects, self->xInputRects->data, sizeof(XRectangle) * numRects) == 0)
+	{
+		self->xInputSkips++;
+		return;
+	}
 
-	self->xInputRegion = XFixesCreateRegion(xDisplay, rects, i);
-	g_free(rects);
+	g_array_set_size(self->xInputRects, 0);
+	g_array_append_vals(self->xInputRects, rects, numRects);
+
+	if(self->xInputRegion)
+		XFixesSetRegion(xDisplay, self->xInputRegion, rects, numRects);
+	else
+		self->xInputRegion = XFixesCreateRegion(xDisplay, rects, numRects);
 	meta_set_stage_input_region(screen, self->xInputRegion);
+	self->xInputRebuilds++;
+}
+
+void graphene_wm_get_input_region_stats(GrapheneWM *self, guint *rebuilds, guint *skips)
+{
+	g_return_if_fail(GRAPHENE_IS_WM(self));
+	if(rebuilds)
+		*rebuilds = self->xInputRebuilds;
+	if(skips)
+		*skips = self->xInputSkips;
+}
+
+static gboolean xfixes_on_post_paint(gpointer userdata)
+{
+	GrapheneWM *self = GRAPHENE_WM(userdata);
+	self->xInputRepaintId = 0;
+	if(self->xInputDirty)
+		xfixes_update_input_region(self);
+	return G_SOURCE_REMOVE;
+}
+
+/*
+ * Marks the input region as needing to be recalculated. This happens after
+ * the next frame, once the stage has been laid out and the input actors'
+ * allocations are final; a frame is queued if none is pending.
+ */
+static void xfixes_queue_input_region(GrapheneWM *self)
+{
+	self->xInputDirty = TRUE;
+	if(!self->xInputRepaintId)
+		self->xInputRepaintId = clutter_threads_add_repaint_func_full(CLUTTER_REPAINT_FLAGS_POST_PAINT | CLUTTER_REPAINT_FLAGS_QUEUE_REDRAW_ON_ADD, xfixes_on_post_paint, self, NULL);
+}
+
+static void xfixes_on_input_actor_moved(ClutterActor *actor, GParamSpec *pspec, GrapheneWM *self)
+{
+	xfixes_queue_input_region(self);
+}
+
+static void xfixes_on_input_actor_changed(ClutterActor *actor, GParamSpec *pspec, GrapheneWM *self)
+{
+	xfixes_queue_input_region(self);
+
+	// Changing reactivity doesn't paint anything by itself, so make sure
+	// there is a frame to update the region in
+	clutter_actor_queue_redraw(self->stage);
 }
 
 /*
@@ -475,12 +579,12 @@ static void xfixes_add_input_actor(GrapheneWM *self, ClutterActor *actor)
 	g_return_if_fail(CLUTTER_IS_ACTOR(actor));
 	self->xInputActors = g_list_prepend(self->xInputActors, actor);
 	
-	g_signal_connect_swapped(actor, "notify::allocation", G_CALLBACK(xfixes_calculate_input_region), self);
-	g_signal_connect_swapped(actor, "notify::mapped", G_CALLBACK(xfixes_calculate_input_region), self);
-	g_signal_connect_swapped(actor, "notify::reactive", G_CALLBACK(xfixes_calculate_input_region), self);
+	g_signal_connect(actor, "notify::allocation", G_CALLBACK(xfixes_on_input_actor_moved), self);
+	g_signal_connect(actor, "notify::mapped", G_CALLBACK(xfixes_on_input_actor_moved), self);
+	g_signal_connect(actor, "notify::reactive", G_CALLBACK(xfixes_on_input_actor_changed), self);
 	g_signal_connect_swapped(actor, "destroy", G_CALLBACK(xfixes_remove_input_actor), self);
 
-	xfixes_calculate_input_region(self);
+	xfixes_queue_input_region(self);
 }
 
 static void xfixes_remove_input_actor(GrapheneWM *self, ClutterActor *actor)
@@ -495,7 +599,8 @@ static void xfixes_remove_input_actor(GrapheneWM *self, ClutterActor *actor)
 		{
 			GList *temp = it;
 			it = it->next;
-			g_signal_handlers_disconnect_by_func(temp->data, xfixes_calculate_input_region, self);
+			g_signal_handlers_disconnect_by_func(temp->data, xfixes_on_input_actor_moved, self);
+			g_signal_handlers_disconnect_by_func(temp->data, xfixes_on_input_actor_changed, self);
 			g_signal_handlers_disconnect_by_func(temp->data, xfixes_remove_input_actor, self);
 			self->xInputActors = g_list_delete_link(self->xInputActors, temp);
 			changed = TRUE;
@@ -505,7 +610,7 @@ static void xfixes_remove_input_actor(GrapheneWM *self, ClutterActor *actor)
 	}
 
 	if(changed)	
-		xfixes_calculate_input_region(self);
+		xfixes_queue_input_region(self);
 }
 
 static void graphene_wm_begin_modal(GrapheneWM *self)
@@ -520,7 +625,7 @@ static void graphene_wm_begin_modal(GrapheneWM *self)
 	// this doesn't work to grab their mouse.
 	self->modalCount ++;
 	meta_plugin_begin_modal(META_PLUGIN(self), 0, 0);
-	xfixes_calculate_input_region(self);
+	xfixes_update_input_region(self);
 }
 
 static void graphene_wm_end_modal(GrapheneWM *self)
@@ -531,7 +636,7 @@ static void graphene_wm_end_modal(GrapheneWM *self)
 
 	self->modalCount = 0;
 	meta_plugin_end_modal(META_PLUGIN(self), 0);
-	xfixes_calculate_input_region(self);
+	xfixes_update_input_region(self);
 }
 
 static void on_panel_request_modal(gboolean modal, GrapheneWM *self)
@@ -43,19 +43,31 @@ struct _GrapheneWM {
 	GraphenePercentFloater *percentBar;
 	CskAudioDeviceManager *audioManager;
 	ClutterActor *coverGroup;
+	GArray *monitors; // MonitorState (wm.c), by monitor index
 	ClutterActor *dialog;
 	GraphenePanel *panel;
 	GrapheneNotificationBox *notificationBox;
 	gint modalCount;
 	
 	// For fixing an input issue with the X backend
-	// See xfixes_calculate_input_region (wm.c) for more details
+	// See xfixes_update_input_region (wm.c) for more details
 	GList *xInputActors; // List of ClutterActors
 	XserverRegion xInputRegion;
+	GArray *xInputRects; // XRectangle, one per mapped actor, as last sent to X
+	gboolean xInputDirty;
+	guint xInputRepaintId;
+	guint xInputRebuilds, xInputSkips; // See graphene_wm_get_input_region_stats
 };
 
 void graphene_wm_show_dialog(GrapheneWM *wm, ClutterActor *actor);
 
+/*
+ * Gets how many times the X input region has been rebuilt, and how many
+ * batched updates found it unchanged and skipped the rebuild, since the WM
+ * started. Either argument may be NULL.
+ */
+void graphene_wm_get_input_region_stats(GrapheneWM *wm, guint *rebuilds, guint *skips);
+
 const MetaPluginInfo * graphene_wm_plugin_info(MetaPlugin *plugin);
 void graphene_wm_start(MetaPlugin *plugin);
 void graphene_wm_minimize(MetaPlugin *plugin, MetaWindowActor *windowActor);
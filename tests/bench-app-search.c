@@ -0,0 +1,122 @@
+/*
+ * This file is part of graphene-desktop, the desktop environment of VeltOS.
+ * Copyright (C) 2016 Velt Technologies, Aidan Shafran <zelbrium@gmail.com>
+ * Licensed under the Apache License 2 <www.apache.org/licenses/LICENSE-2.0>.
+ *
+ * Types queries one character at a time into GrapheneAppSearch over 5,000
+ * generated entries, and reports the time per keystroke when each query
+ * refines the previous results and when every query searches all entries.
+ */
+
+#include "panel-internal.h"
+#include <string.h>
+
+#define ENTRIES 5000
+#define ROUNDS 20
+
+static const gchar *words[] = {
+	"web", "browser", "file", "manager", "text", "editor", "terminal",
+	"system", "monitor", "office", "writer", "calc", "media", "player",
+	"image", "viewer", "mail", "client", "disk", "usage", "settings",
+	"sound", "recorder", "photo", "music", "video", "chat", "map", "clock",
+	"weather", "notes", "archive", "backup", "font", "color", "network",
+};
+
+static const gchar *queries[] = {
+	"settings", "web browser", "mail client", "disk usage", "vid play", "zq",
+};
+
+static void free_entry(GrapheneAppEntry *entry)
+{
+	g_free(entry->name);
+	g_free(entry->searchName);
+	g_strfreev(entry->searchExtra);
+	g_free(entry);
+}
+
+static gchar * random_words(GRand *rand, guint n)
+{
+	GString *text = g_string_new(NULL);
+	for(guint i=0;i<n;++i)
+	{
+		if(i > 0)
+			g_string_append_c(text, ' ');
+		g_string_append(text, words[g_rand_int_range(rand, 0, G_N_ELEMENTS(words))]);
+	}
+	return g_string_free(text, FALSE);
+}
+
+static GPtrArray * corpus_new(void)
+{
+	GRand *rand = g_rand_new_with_seed(1);
+	GPtrArray *entries = g_ptr_array_new_with_free_func((GDestroyNotify)free_entry);
+	for(guint i=0;i<ENTRIES;++i)
+	{
+		GrapheneAppEntry *entry = g_new0(GrapheneAppEntry, 1);
+		entry->name = random_words(rand, g_rand_int_range(rand, 1, 4));
+		entry->searchName = graphene_app_search_normalize(entry->name);
+		entry->searchExtra = g_new0(gchar *, 4);
+		entry->searchMask = graphene_app_search_char_mask(entry->searchName);
+		for(guint j=0;j<3;++j)
+		{
+			entry->searchExtra[j] = random_words(rand, g_rand_int_range(rand, 1, 3));
+			entry->searchMask |= graphene_app_search_char_mask(entry->searchExtra[j]);
+		}
+		entry->launchCount = g_rand_int_range(rand, 0, 4) == 0 ? g_rand_int_range(rand, 1, 50) : 0;
+		g_ptr_array_add(entries, entry);
+	}
+	g_rand_free(rand);
+	return entries;
+}
+
+// Types every query into search, returning the number of keystrokes
+static guint type_queries(GrapheneAppSearch *search, GPtrArray *entries, gboolean refine, guint *results)
+{
+	guint keystrokes = 0;
+	for(guint i=0;i<G_N_ELEMENTS(queries);++i)
+	{
+		guint length = strlen(queries[i]);
+		for(guint j=1;j<=length;++j, ++keystrokes)
+		{
+			// Setting the entries forgets the previous query
+			if(!refine)
+				graphene_app_search_set_entries(search, entries);
+			gchar *query = g_strndup(queries[i], j);
+			*results += graphene_app_search_query(search, query)->len;
+			g_free(query);
+		}
+	}
+	return keystrokes;
+}
+
+int main(int argc, char **argv)
+{
+	GPtrArray *entries = corpus_new();
+	GrapheneAppSearch *search = graphene_app_search_new();
+	graphene_app_search_set_entries(search, entries);
+
+	gdouble elapsed[2];
+	guint results[2] = {0, 0};
+	guint keystrokes = 0;
+	GTimer *timer = g_timer_new();
+	for(guint refine=0;refine<2;++refine)
+	{
+		g_timer_start(timer);
+		keystrokes = 0;
+		for(guint i=0;i<ROUNDS;++i)
+			keystrokes += type_queries(search, entries, refine, &results[refine]);
+		g_timer_stop(timer);
+		elapsed[refine] = g_timer_elapsed(timer, NULL) * 1e6 / keystrokes;
+	}
+
+	g_print("%u entries, %u keystrokes: %.1f us/keystroke refining, %.1f us/keystroke searching all\n",
+		ENTRIES, keystrokes, elapsed[1], elapsed[0]);
+
+	// Refining must not change the results
+	g_assert_cmpuint(results[0], ==, results[1]);
+
+	g_timer_destroy(timer);
+	graphene_app_search_free(search);
+	g_ptr_array_unref(entries);
+	return 0;
+}
@@ -0,0 +1,111 @@
+/*
+ * This file is part of graphene-desktop, the desktop environment of VeltOS.
+ * Copyright (C) 2016 Velt Technologies, Aidan Shafran <zelbrium@gmail.com>
+ * Licensed under the Apache License 2 <www.apache.org/licenses/LICENSE-2.0>.
+ *
+ * Sends enter and leave events to 500 laid out CmkButtons, as a pointer
+ * sweeping over the launcher does, and counts how many times a background
+ * canvas is drawn. Buttons of the same size share their hover background,
+ * so the canvases should be drawn once per distinct size, not per crossing.
+ */
+
+#include "cmk/button.h"
+#include <math.h>
+
+#define BUTTONS 500
+#define SWEEPS 100
+
+static guint draws = 0;
+
+static gboolean on_canvas_draw(GSignalInvocationHint *hint, guint n, const GValue *params, gpointer userdata)
+{
+	++draws;
+	return TRUE;
+}
+
+static void layout(ClutterActor *box, gfloat width)
+{
+	gfloat min, nat;
+	clutter_actor_get_preferred_height(box, width, &min, &nat);
+	ClutterActorBox alloc = {0, 0, width, nat};
+	clutter_actor_allocate(box, &alloc, CLUTTER_ALLOCATION_NONE);
+}
+
+static void cross(ClutterActor *actor, ClutterEventType type)
+{
+	ClutterEvent *event = clutter_event_new(type);
+	clutter_event_set_source(event, actor);
+	clutter_actor_event(actor, event, FALSE);
+	clutter_event_free(event);
+}
+
+static guint size_hash(gconstpointer key)
+{
+	return GPOINTER_TO_UINT(key);
+}
+
+int main(int argc, char **argv)
+{
+	if(clutter_init(&argc, &argv) != CLUTTER_INIT_SUCCESS)
+		return 77;
+
+	// Actors are only allocated on a stage; it doesn't have to be shown
+	ClutterActor *stage = clutter_stage_new();
+	CmkWidget *box = cmk_widget_new();
+	ClutterColor hover = {0, 0, 0, 40};
+	cmk_widget_style_set_color(box, "hover", &hover);
+	ClutterLayoutManager *boxLayout = clutter_box_layout_new();
+	clutter_box_layout_set_orientation(CLUTTER_BOX_LAYOUT(boxLayout), CLUTTER_ORIENTATION_VERTICAL);
+	clutter_actor_set_layout_manager(CLUTTER_ACTOR(box), boxLayout);
+	clutter_actor_add_child(stage, CLUTTER_ACTOR(box));
+
+	CmkButton *buttons[BUTTONS];
+	for(guint i=0;i<BUTTONS;++i)
+	{
+		gchar *text = g_strdup_printf("Application %u", i);
+		buttons[i] = cmk_button_new_with_text(text);
+		g_free(text);
+		if(i % 2)
+		{
+			CmkWidget *content = cmk_widget_new();
+			clutter_actor_set_size(CLUTTER_ACTOR(content), 24, 24);
+			cmk_button_set_content(buttons[i], content);
+		}
+		clutter_actor_add_child(CLUTTER_ACTOR(box), CLUTTER_ACTOR(buttons[i]));
+	}
+	layout(CLUTTER_ACTOR(box), 300);
+	while(g_main_context_iteration(NULL, FALSE));
+
+	// Backgrounds are keyed by whole-pixel size
+	GHashTable *sizes = g_hash_table_new(size_hash, g_direct_equal);
+	for(guint i=0;i<BUTTONS;++i)
+	{
+		gfloat width, height;
+		clutter_actor_get_size(CLUTTER_ACTOR(buttons[i]), &width, &height);
+		g_hash_table_add(sizes, GUINT_TO_POINTER(((guint)ceilf(width) << 16) | (guint)ceilf(height)));
+	}
+
+	g_type_class_ref(CLUTTER_TYPE_CANVAS);
+	g_signal_add_emission_hook(g_signal_lookup("draw", CLUTTER_TYPE_CANVAS), 0, on_canvas_draw, NULL, NULL);
+
+	GTimer *timer = g_timer_new();
+	for(guint i=0;i<SWEEPS;++i)
+	{
+		for(guint j=0;j<BUTTONS;++j)
+		{
+			cross(CLUTTER_ACTOR(buttons[j]), CLUTTER_ENTER);
+			cross(CLUTTER_ACTOR(buttons[j]), CLUTTER_LEAVE);
+		}
+	}
+	g_timer_stop(timer);
+
+	guint crossings = SWEEPS * BUTTONS * 2;
+	g_print("%u crossings over %u button sizes: %u canvas draws, %.3f us/crossing\n",
+		crossings, g_hash_table_size(sizes), draws, g_timer_elapsed(timer, NULL) * 1e6 / crossings);
+	g_assert_cmpuint(draws, <=, g_hash_table_size(sizes));
+
+	g_timer_destroy(timer);
+	g_hash_table_unref(sizes);
+	clutter_actor_destroy(stage);
+	return 0;
+}
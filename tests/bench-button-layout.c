@@ -0,0 +1,83 @@
+/*
+ * This file is part of graphene-desktop, the desktop environment of VeltOS.
+ * Copyright (C) 2016 Velt Technologies, Aidan Shafran <zelbrium@gmail.com>
+ * Licensed under the Apache License 2 <www.apache.org/licenses/LICENSE-2.0>.
+ *
+ * Times layout passes over 500 CmkButtons (with text, and half with
+ * content) in a vertical ClutterBoxLayout, as in the launcher and the
+ * tasklist. "restyled" passes invalidate every button first, as a style
+ * change does. "resized" passes only change the container's width, cycling
+ * through more widths than Clutter caches requests for, so each pass asks
+ * the buttons for their heights at a new width.
+ */
+
+#include "cmk/button.h"
+
+#define BUTTONS 500
+#define PASSES 200
+#define WIDTHS 8
+
+static void layout(ClutterActor *box, gfloat width)
+{
+	gfloat min, nat;
+	clutter_actor_get_preferred_height(box, width, &min, &nat);
+	ClutterActorBox alloc = {0, 0, width, nat};
+	clutter_actor_allocate(box, &alloc, CLUTTER_ALLOCATION_NONE);
+}
+
+static void report(const gchar *name, GTimer *timer)
+{
+	g_print("%-10s %8.3f ms/pass\n", name, g_timer_elapsed(timer, NULL) * 1000 / PASSES);
+}
+
+int main(int argc, char **argv)
+{
+	if(clutter_init(&argc, &argv) != CLUTTER_INIT_SUCCESS)
+		return 77;
+
+	// Actors are only allocated on a stage; it doesn't have to be shown
+	ClutterActor *stage = clutter_stage_new();
+	ClutterActor *box = clutter_actor_new();
+	ClutterLayoutManager *boxLayout = clutter_box_layout_new();
+	clutter_box_layout_set_orientation(CLUTTER_BOX_LAYOUT(boxLayout), CLUTTER_ORIENTATION_VERTICAL);
+	clutter_actor_set_layout_manager(box, boxLayout);
+	clutter_actor_add_child(stage, box);
+
+	CmkButton *buttons[BUTTONS];
+	for(guint i=0;i<BUTTONS;++i)
+	{
+		gchar *text = g_strdup_printf("Application %u", i);
+		buttons[i] = cmk_button_new_with_text(text);
+		g_free(text);
+		if(i % 2)
+		{
+			CmkWidget *content = cmk_widget_new();
+			clutter_actor_set_size(CLUTTER_ACTOR(content), 24, 24);
+			cmk_button_set_content(buttons[i], content);
+		}
+		clutter_actor_add_child(box, CLUTTER_ACTOR(buttons[i]));
+	}
+	layout(box, 300);
+
+	GTimer *timer = g_timer_new();
+
+	g_timer_start(timer);
+	for(guint i=0;i<PASSES;++i)
+	{
+		for(guint j=0;j<BUTTONS;++j)
+			clutter_actor_queue_relayout(CLUTTER_ACTOR(buttons[j]));
+		layout(box, 300);
+	}
+	g_timer_stop(timer);
+	report("restyled", timer);
+
+	g_timer_start(timer);
+	for(guint i=0;i<PASSES;++i)
+		layout(box, 300 + (i % WIDTHS) * 10);
+	g_timer_stop(timer);
+	report("resized", timer);
+
+	g_timer_destroy(timer);
+	clutter_actor_destroy(stage);
+	return 0;
+}
@@ -0,0 +1,206 @@
+/*
+ * This file is part of graphene-desktop, the desktop environment of VeltOS.
+ * Copyright (C) 2016 Velt Technologies, Aidan Shafran <zelbrium@gmail.com>
+ * Licensed under the Apache License 2 <www.apache.org/licenses/LICENSE-2.0>.
+ *
+ * Runs a GrapheneNotificationBox on an unshown stage and a private session
+ * bus. A client thread calls Notify and CloseNotification RATE times a
+ * second for DURATION seconds, keeping up to KEEP_OPEN notifications open,
+ * while the main thread serves the calls and lays out the box once a
+ * frame. Reports call latencies, notification widgets created, and the
+ * number of actors in the box. The notifications are critical, so that
+ * the sender's rate limit doesn't turn them away before they're shown.
+ */
+
+#include "notifications.h"
+#include <gio/gio.h>
+
+#define RATE 100 // Notify calls per second
+#define DURATION 5 // Seconds
+#define KEEP_OPEN 3 // One more is open between Notify and CloseNotification; the pool holds 4
+#define FRAME_MS 16
+
+static gchar *address;
+static volatile gint clientDone = 0;
+static GArray *notifyLatencies, *closeLatencies; // gint64 us, written by the client
+static guint widgetsCreated = 0;
+static guint maxActors = 0;
+
+static void on_notification_added(gpointer userdata, ClutterActor *notification)
+{
+	++widgetsCreated;
+}
+
+static guint count_actors(ClutterActor *actor)
+{
+	guint n = 1;
+	for(ClutterActor *child=clutter_actor_get_first_child(actor);child;child=clutter_actor_get_next_sibling(child))
+		n += count_actors(child);
+	return n;
+}
+
+static gboolean on_frame(ClutterActor *box)
+{
+	ClutterActorBox alloc = {0, 0, 1920, 1080};
+	clutter_actor_allocate(box, &alloc, CLUTTER_ALLOCATION_NONE);
+	maxActors = MAX(maxActors, count_actors(box));
+	return G_SOURCE_CONTINUE;
+}
+
+static gint64 timed_call(GDBusConnection *connection, const gchar *method, GVariant *params, const GVariantType *replyType, GVariant **reply)
+{
+	gint64 start = g_get_monotonic_time();
+	GError *error = NULL;
+	*reply = g_dbus_connection_call_sync(connection, "org.freedesktop.Notifications", "/org/freedesktop/Notifications",
+		"org.freedesktop.Notifications", method, params, replyType, G_DBUS_CALL_FLAGS_NONE, -1, NULL, &error);
+	if(error)
+		g_error("%s failed: %s", method, error->message);
+	return g_get_monotonic_time() - start;
+}
+
+static gpointer client_thread(gpointer userdata)
+{
+	GDBusConnection *connection = g_dbus_connection_new_for_address_sync(address,
+		G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT | G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION,
+		NULL, NULL, NULL);
+	g_assert_nonnull(connection);
+
+	GQueue open = G_QUEUE_INIT;
+	gint64 start = g_get_monotonic_time();
+	for(guint i=0;i<RATE*DURATION;++i)
+	{
+		// Evenly paced, without drifting
+		gint64 wait = start + (gint64)i * G_USEC_PER_SEC / RATE - g_get_monotonic_time();
+		if(wait > 0)
+			g_usleep(wait);
+
+		GVariantBuilder hints;
+		g_variant_builder_init(&hints, G_VARIANT_TYPE("a{sv}"));
+		g_variant_builder_add(&hints, "{sv}", "urgency", g_variant_new_byte(2));
+		gchar *summary = g_strdup_printf("Notification %u", i);
+		GVariant *reply;
+		const gchar *actions[] = {NULL};
+		gint64 latency = timed_call(connection, "Notify",
+			g_variant_new("(susss^asa{sv}i)", "bench", 0, "dialog-information", summary, "Body text", actions, &hints, -1),
+			G_VARIANT_TYPE("(u)"), &reply);
+		g_array_append_val(notifyLatencies, latency);
+		guint32 id;
+		g_variant_get(reply, "(u)", &id);
+		g_variant_unref(reply);
+		g_free(summary);
+		g_queue_push_tail(&open, GUINT_TO_POINTER(id));
+
+		if(open.length > KEEP_OPEN)
+		{
+			id = GPOINTER_TO_UINT(g_queue_pop_head(&open));
+			latency = timed_call(connection, "CloseNotification", g_variant_new("(u)", id), NULL, &reply);
+			g_array_append_val(closeLatencies, latency);
+			g_variant_unref(reply);
+		}
+	}
+
+	g_queue_clear(&open);
+	g_dbus_connection_close_sync(connection, NULL, NULL);
+	g_object_unref(connection);
+	g_atomic_int_set(&clientDone, 1);
+	g_main_context_wakeup(NULL);
+	return NULL;
+}
+
+static gint compare_latency(gconstpointer a, gconstpointer b)
+{
+	gint64 x = *(const gint64 *)a, y = *(const gint64 *)b;
+	return (x > y) - (x < y);
+}
+
+static void report(const gchar *method, GArray *latencies)
+{
+	g_array_sort(latencies, compare_latency);
+	g_print("%-18s %5u calls  p50 %6" G_GINT64_FORMAT " us  p99 %6" G_GINT64_FORMAT " us\n", method, latencies->len,
+		g_array_index(latencies, gint64, latencies->len / 2),
+		g_array_index(latencies, gint64, latencies->len * 99 / 100));
+}
+
+static void on_name_appeared(GDBusConnection *connection, const gchar *name, const gchar *owner, gboolean *appeared)
+{
+	*appeared = TRUE;
+}
+
+static gboolean on_timeout(gboolean *timedOut)
+{
+	*timedOut = TRUE;
+	return G_SOURCE_REMOVE;
+}
+
+int main(int argc, char **argv)
+{
+	g_setenv("GSETTINGS_BACKEND", "memory", TRUE);
+
+	// GTestDBus needs a dbus-daemon to run the private bus
+	gchar *daemon = g_find_program_in_path("dbus-daemon");
+	if(!daemon)
+		return 77;
+	g_free(daemon);
+
+	// Notification icons follow the desktop's settings, which need the schema
+	GSettingsSchemaSource *source = g_settings_schema_source_get_default();
+	GSettingsSchema *schema = source ? g_settings_schema_source_lookup(source, "org.gnome.desktop.interface", TRUE) : NULL;
+	if(!schema)
+		return 77;
+	g_settings_schema_unref(schema);
+
+	// Before Clutter, which may use the session bus
+	GTestDBus *bus = g_test_dbus_new(G_TEST_DBUS_NONE);
+	g_test_dbus_up(bus);
+	address = g_strdup(g_test_dbus_get_bus_address(bus));
+
+	if(clutter_init(&argc, &argv) != CLUTTER_INIT_SUCCESS)
+	{
+		g_test_dbus_down(bus);
+		return 77;
+	}
+
+	// Actors are only allocated on a stage; it doesn't have to be shown
+	ClutterActor *stage = clutter_stage_new();
+	GrapheneNotificationBox *box = graphene_notification_box_new(on_notification_added, NULL);
+	clutter_actor_add_child(stage, CLUTTER_ACTOR(box));
+	guint preloaded = widgetsCreated;
+
+	gboolean appeared = FALSE, timedOut = FALSE;
+	guint watch = g_bus_watch_name(G_BUS_TYPE_SESSION, "org.freedesktop.Notifications", G_BUS_NAME_WATCHER_FLAGS_NONE,
+		(GBusNameAppearedCallback)on_name_appeared, NULL, &appeared, NULL);
+	guint timeout = g_timeout_add_seconds(5, (GSourceFunc)on_timeout, &timedOut);
+	while(!appeared && !timedOut)
+		g_main_context_iteration(NULL, TRUE);
+	g_assert_false(timedOut);
+	g_source_remove(timeout);
+	g_bus_unwatch_name(watch);
+
+	notifyLatencies = g_array_new(FALSE, FALSE, sizeof(gint64));
+	closeLatencies = g_array_new(FALSE, FALSE, sizeof(gint64));
+	guint frame = g_timeout_add(FRAME_MS, (GSourceFunc)on_frame, box);
+	GThread *client = g_thread_new("notification-client", client_thread, NULL);
+	while(!g_atomic_int_get(&clientDone))
+		g_main_context_iteration(NULL, TRUE);
+	g_thread_join(client);
+	g_source_remove(frame);
+	while(g_main_context_iteration(NULL, FALSE));
+	on_frame(CLUTTER_ACTOR(box));
+
+	g_print("%u Notify calls over %us, %u kept open\n", RATE*DURATION, DURATION, KEEP_OPEN);
+	report("Notify", notifyLatencies);
+	report("CloseNotification", closeLatencies);
+	g_print("Notification widgets: %u preloaded, %u created while running\n", preloaded, widgetsCreated - preloaded);
+	g_print("Actors in the box: %u at most, %u at the end\n", maxActors, count_actors(CLUTTER_ACTOR(box)));
+
+	// With fewer open than the pool holds, every widget comes from the pool
+	g_assert_cmpuint(widgetsCreated, ==, preloaded);
+
+	g_array_unref(notifyLatencies);
+	g_array_unref(closeLatencies);
+	clutter_actor_destroy(stage);
+	g_test_dbus_down(bus);
+	g_object_unref(bus);
+	g_free(address);
+	return 0;
+}
@@ -0,0 +1,48 @@
+/*
+ * This file is part of graphene-desktop, the desktop environment of VeltOS.
+ * Copyright (C) 2016 Velt Technologies, Aidan Shafran <zelbrium@gmail.com>
+ * Licensed under the Apache License 2 <www.apache.org/licenses/LICENSE-2.0>.
+ *
+ * Times rendering a CmkShadow template with all four edges blurred, with
+ * the fixed-point renderer in shadow.c and with the original float
+ * renderer in shadow-reference.c, at a few radii.
+ */
+
+// render_shadow is private to shadow.c
+#include "cmk/shadow.c"
+#include "shadow-reference.h"
+
+#define RENDERS 200
+
+static const guint radii[] = {4, 10, 20, 40, 60};
+
+int main(int argc, char **argv)
+{
+	GTimer *timer = g_timer_new();
+	g_print("%-8s %12s %12s\n", "radius", "fixed (us)", "float (us)");
+	for(guint i=0;i<G_N_ELEMENTS(radii);++i)
+	{
+		guint radius = radii[i];
+		guint size = radius*4 + 2;
+		guint32 *pixels = g_new(guint32, size*size);
+		guchar *alpha = g_new(guchar, size*size);
+
+		g_timer_start(timer);
+		for(guint j=0;j<RENDERS;++j)
+			render_shadow(pixels, size, size, radius, CMK_SHADOW_MASK_ALL);
+		g_timer_stop(timer);
+		gdouble fixed = g_timer_elapsed(timer, NULL) * 1e6 / RENDERS;
+
+		g_timer_start(timer);
+		for(guint j=0;j<RENDERS;++j)
+			reference_render_shadow(alpha, size, size, radius, CMK_SHADOW_MASK_ALL);
+		g_timer_stop(timer);
+		gdouble reference = g_timer_elapsed(timer, NULL) * 1e6 / RENDERS;
+
+		g_print("%-8u %12.1f %12.1f\n", radius, fixed, reference);
+		g_free(pixels);
+		g_free(alpha);
+	}
+	g_timer_destroy(timer);
+	return 0;
+}
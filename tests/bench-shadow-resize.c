@@ -0,0 +1,73 @@
+/*
+ * This file is part of graphene-desktop, the desktop environment of VeltOS.
+ * Copyright (C) 2016 Velt Technologies, Aidan Shafran <zelbrium@gmail.com>
+ * Licensed under the Apache License 2 <www.apache.org/licenses/LICENSE-2.0>.
+ *
+ * Resizes a CmkShadow through 1,000 sizes, as dragging a window edge
+ * does, and reports the time per resize. For comparison it also times
+ * what each resize used to cost: blurring the whole shadow box with the
+ * float renderer in shadow-reference.c. The 9-slice template should be
+ * rendered once, on the first allocation, and shared by every size after.
+ */
+
+// tileCache is private to shadow.c
+#include "cmk/shadow.c"
+#include "shadow-reference.h"
+
+#define SIZES 1000
+#define RADIUS 20
+
+static void size_at(guint i, gfloat *width, gfloat *height)
+{
+	*width = 200 + i;
+	*height = 150 + i/2;
+}
+
+int main(int argc, char **argv)
+{
+	if(clutter_init(&argc, &argv) != CLUTTER_INIT_SUCCESS)
+		return 77;
+
+	// Actors are only allocated on a stage; it doesn't have to be shown
+	ClutterActor *stage = clutter_stage_new();
+	CmkShadow *shadow = cmk_shadow_new_full(CMK_SHADOW_MASK_ALL, RADIUS);
+	clutter_actor_add_child(CLUTTER_ACTOR(shadow), clutter_actor_new());
+	clutter_actor_add_child(stage, CLUTTER_ACTOR(shadow));
+	g_assert_cmpuint(g_hash_table_size(tileCache), ==, 1);
+
+	GTimer *timer = g_timer_new();
+	for(guint i=0;i<SIZES;++i)
+	{
+		gfloat width, height;
+		size_at(i, &width, &height);
+		ClutterActorBox box = {0, 0, width, height};
+		clutter_actor_allocate(CLUTTER_ACTOR(shadow), &box, CLUTTER_ALLOCATION_NONE);
+	}
+	g_timer_stop(timer);
+	gdouble tiled = g_timer_elapsed(timer, NULL) * 1e6 / SIZES;
+
+	// Resizing must not have rendered another template
+	g_assert_cmpuint(g_hash_table_size(tileCache), ==, 1);
+
+	// Every tenth size is enough to time the full-box blur
+	g_timer_start(timer);
+	guint blurs = 0;
+	for(guint i=0;i<SIZES;i+=10, ++blurs)
+	{
+		gfloat width, height;
+		size_at(i, &width, &height);
+		guint w = width + RADIUS*2, h = height + RADIUS*2;
+		guchar *alpha = g_new(guchar, w*h);
+		reference_render_shadow(alpha, w, h, RADIUS, CMK_SHADOW_MASK_ALL);
+		g_free(alpha);
+	}
+	g_timer_stop(timer);
+	gdouble blurred = g_timer_elapsed(timer, NULL) * 1e6 / blurs;
+
+	g_print("%u resizes at radius %u: %.3f us/resize with shared tiles, %.3f us/resize blurring the whole box\n",
+		SIZES, RADIUS, tiled, blurred);
+
+	g_timer_destroy(timer);
+	clutter_actor_destroy(stage);
+	return 0;
+}
@@ -0,0 +1,139 @@
+/*
+ * This file is part of graphene-desktop, the desktop environment of VeltOS.
+ * Copyright (C) 2016 Velt Technologies, Aidan Shafran <zelbrium@gmail.com>
+ * Licensed under the Apache License 2 <www.apache.org/licenses/LICENSE-2.0>.
+ *
+ * Times CmkWidget style lookups from the bottom of a 6-deep style parent
+ * chain, with all style values set at the top. Cold lookups have to resolve
+ * the chain again after each style change; warm lookups should not, and
+ * neither should lookups while unrelated widgets are created and destroyed.
+ *
+ * Before timing, checks that style changes made in one frame emit
+ * style-changed once on each widget in the chain, and that a change made by
+ * a style-changed handler reaches the whole chain again.
+ */
+
+#include "cmk/cmk-widget.h"
+
+#define DEPTH 6
+#define LOOKUPS 1000000
+#define CHANGES 20000
+
+static void flush(void)
+{
+	while(g_main_context_iteration(NULL, FALSE));
+}
+
+// Reads each kind of style value once
+static gfloat lookup(CmkWidget *w)
+{
+	const ClutterColor *c = cmk_widget_style_get_color(w, "primary");
+	const ClutterColor *fg = cmk_widget_get_foreground_color(w);
+	return cmk_widget_style_get_padding(w)
+		+ cmk_widget_style_get_bevel_radius(w)
+		+ c->red + fg->red;
+}
+
+static guint redirties = 0;
+
+// Changes the root's style again from its own handler, redirties times
+static void on_root_style_changed(CmkWidget *root)
+{
+	if(redirties == 0)
+		return;
+	--redirties;
+	cmk_widget_style_set_padding(root, cmk_widget_style_get_padding(root) + 1);
+}
+
+// Returns the number of style-changed emissions caused by flushing
+static guint count_style_changed(void)
+{
+	guint before, after;
+	cmk_widget_get_style_stats(NULL, &before, NULL);
+	flush();
+	cmk_widget_get_style_stats(NULL, &after, NULL);
+	return after - before;
+}
+
+static void report(const gchar *name, GTimer *timer, guint n)
+{
+	g_print("%-36s %8.1f ns/iteration\n", name, g_timer_elapsed(timer, NULL) * 1e9 / n);
+}
+
+int main(int argc, char **argv)
+{
+	if(clutter_init(&argc, &argv) != CLUTTER_INIT_SUCCESS)
+		return 77;
+
+	ClutterColor primary = {200, 0, 0, 255};
+	ClutterColor background = {255, 255, 255, 255};
+	ClutterColor foreground = {0, 0, 0, 255};
+
+	CmkWidget *chain[DEPTH];
+	chain[0] = cmk_widget_new();
+	cmk_widget_style_set_color(chain[0], "primary", &primary);
+	cmk_widget_style_set_color(chain[0], "background", &background);
+	cmk_widget_style_set_color(chain[0], "background-foreground", &foreground);
+	cmk_widget_style_set_padding(chain[0], 10);
+	cmk_widget_style_set_bevel_radius(chain[0], 3);
+	cmk_widget_set_background_color_name(chain[0], "background");
+	for(guint i=1;i<DEPTH;++i)
+	{
+		chain[i] = cmk_widget_new();
+		cmk_widget_set_style_parent(chain[i], chain[i-1]);
+	}
+	CmkWidget *leaf = chain[DEPTH-1];
+	flush();
+
+	// Several changes in one frame are sent down the chain once
+	cmk_widget_style_set_padding(chain[0], 12);
+	cmk_widget_style_set_bevel_radius(chain[0], 4);
+	g_assert_cmpuint(count_style_changed(), ==, DEPTH);
+
+	// A change made while flushing is sent down again, to every widget
+	g_signal_connect(chain[0], "style-changed", G_CALLBACK(on_root_style_changed), NULL);
+	redirties = 1;
+	cmk_widget_style_set_padding(chain[0], 10);
+	g_assert_cmpuint(count_style_changed(), ==, 2 * DEPTH);
+	g_assert_cmpuint(redirties, ==, 0);
+	g_assert_cmpfloat(cmk_widget_style_get_padding(leaf), ==, 11);
+	g_signal_handlers_disconnect_by_func(chain[0], on_root_style_changed, NULL);
+	cmk_widget_style_set_padding(chain[0], 10);
+	cmk_widget_style_set_bevel_radius(chain[0], 3);
+	flush();
+
+	volatile gfloat sink = 0;
+	GTimer *timer = g_timer_new();
+
+	g_timer_start(timer);
+	for(guint i=0;i<CHANGES;++i)
+	{
+		cmk_widget_style_set_padding(chain[0], (i & 1) ? 10 : 11);
+		sink += lookup(leaf);
+	}
+	g_timer_stop(timer);
+	report("cold (style change each lookup)", timer, CHANGES);
+	flush();
+
+	g_timer_start(timer);
+	for(guint i=0;i<LOOKUPS;++i)
+		sink += lookup(leaf);
+	g_timer_stop(timer);
+	report("warm", timer, LOOKUPS);
+
+	g_timer_start(timer);
+	for(guint i=0;i<CHANGES;++i)
+	{
+		CmkWidget *other = cmk_widget_new();
+		sink += lookup(leaf);
+		clutter_actor_destroy(CLUTTER_ACTOR(other));
+	}
+	g_timer_stop(timer);
+	report("warm (unrelated widget churn)", timer, CHANGES);
+
+	g_timer_destroy(timer);
+	for(guint i=DEPTH;i>0;--i)
+		clutter_actor_destroy(CLUTTER_ACTOR(chain[i-1]));
+	flush();
+	return 0;
+}
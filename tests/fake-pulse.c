@@ -0,0 +1,705 @@
+/*
+ * This file is part of graphene-desktop, the desktop environment of VeltOS.
+ * Copyright (C) 2016 Velt Technologies, Aidan Shafran <zelbrium@gmail.com>
+ * Licensed under the Apache License 2 <www.apache.org/licenses/LICENSE-2.0>.
+ *
+ * Defines the libpulse calls used by src/csk/audio.c against an in-process
+ * server. Only the behavior audio.c depends on is modelled: state changes
+ * are reported synchronously like libpulse does, replies and subscription
+ * events are delivered later from the main loop, and operations whose
+ * context fails before they complete are cancelled without a callback.
+ */
+
+#include "fake-pulse.h"
+#include <pulse/pulseaudio.h>
+#include <pulse/glib-mainloop.h>
+#include <string.h>
+
+typedef struct
+{
+	gboolean source;
+	guint32 index;
+	gchar *name;
+	gchar *description;
+	pa_cvolume volume;
+	gboolean mute;
+	guint volumeWrites;
+} FakeDevice;
+
+struct pa_context
+{
+	gint refs;
+	pa_context_state_t state;
+	gboolean waiting; // Connecting with NOFAIL, waiting for the server to start
+	pa_context_notify_cb_t stateCb;
+	void *stateUserdata;
+	pa_context_subscribe_cb_t subscribeCb;
+	void *subscribeUserdata;
+	pa_subscription_mask_t mask;
+};
+
+struct pa_operation
+{
+	gint refs;
+	pa_operation_state_t state;
+	pa_context *context;
+	guint sourceId;
+	void (*run)(pa_operation *o);
+	void (*cb)(void);
+	void *userdata;
+
+	// Arguments, as used by run
+	gboolean source;
+	guint32 index;
+	pa_cvolume volume;
+	int mute;
+	pa_subscription_mask_t mask;
+};
+
+struct pa_proplist
+{
+	GHashTable *props;
+};
+
+struct pa_glib_mainloop
+{
+	pa_mainloop_api api;
+};
+
+typedef struct
+{
+	pa_context *context;
+	pa_subscription_event_type_t type;
+	guint32 index;
+} FakeEvent;
+
+static struct
+{
+	gboolean running;
+	guint latency;
+	GList *devices; // FakeDevice *, in the order they were added
+	gchar *defaultSink;
+	gchar *defaultSource;
+	GList *contexts; // Every live pa_context
+	guint connects;
+} fake;
+
+static guint defer(GSourceFunc func, gpointer data, GDestroyNotify destroy)
+{
+	if(fake.latency)
+		return g_timeout_add_full(G_PRIORITY_DEFAULT, fake.latency, func, data, destroy);
+	return g_idle_add_full(G_PRIORITY_DEFAULT_IDLE, func, data, destroy);
+}
+
+static FakeDevice * find_device(gboolean source, guint32 index)
+{
+	for(GList *it=fake.devices; it!=NULL; it=it->next)
+	{
+		FakeDevice *device = it->data;
+		if(device->source == source && device->index == index)
+			return device;
+	}
+	return NULL;
+}
+
+static void free_device(FakeDevice *device)
+{
+	g_free(device->name);
+	g_free(device->description);
+	g_free(device);
+}
+
+static void set_volume(pa_cvolume *cvolume, gdouble volume)
+{
+	pa_cvolume_init(cvolume);
+	cvolume->channels = 2;
+	cvolume->values[0] = cvolume->values[1] = (pa_volume_t)(volume * PA_VOLUME_NORM);
+}
+
+
+
+/* Contexts */
+
+static void set_state(pa_context *c, pa_context_state_t state)
+{
+	if(c->state == state)
+		return;
+	c->state = state;
+	if(state != PA_CONTEXT_CONNECTING)
+		c->waiting = FALSE;
+	if(c->stateCb)
+		c->stateCb(c, c->stateUserdata);
+}
+
+static gboolean on_connected(pa_context *c)
+{
+	if(c->state == PA_CONTEXT_CONNECTING)
+		set_state(c, fake.running ? PA_CONTEXT_READY : PA_CONTEXT_FAILED);
+	return G_SOURCE_REMOVE;
+}
+
+static void defer_connected(pa_context *c)
+{
+	defer((GSourceFunc)on_connected, pa_context_ref(c), (GDestroyNotify)pa_context_unref);
+}
+
+pa_context * pa_context_new_with_proplist(pa_mainloop_api *mainloop, const char *name, const pa_proplist *proplist)
+{
+	pa_context *c = g_new0(pa_context, 1);
+	c->refs = 1;
+	c->state = PA_CONTEXT_UNCONNECTED;
+	fake.contexts = g_list_prepend(fake.contexts, c);
+	return c;
+}
+
+pa_context * pa_context_ref(pa_context *c)
+{
+	++c->refs;
+	return c;
+}
+
+void pa_context_unref(pa_context *c)
+{
+	if(--c->refs > 0)
+		return;
+	fake.contexts = g_list_remove(fake.contexts, c);
+	g_free(c);
+}
+
+void pa_context_set_state_callback(pa_context *c, pa_context_notify_cb_t cb, void *userdata)
+{
+	c->stateCb = cb;
+	c->stateUserdata = userdata;
+}
+
+void pa_context_set_subscribe_callback(pa_context *c, pa_context_subscribe_cb_t cb, void *userdata)
+{
+	c->subscribeCb = cb;
+	c->subscribeUserdata = userdata;
+}
+
+pa_context_state_t pa_context_get_state(const pa_context *c)
+{
+	return c->state;
+}
+
+int pa_context_connect(pa_context *c, const char *server, pa_context_flags_t flags, const pa_spawn_api *api)
+{
+	g_return_val_if_fail(c->state == PA_CONTEXT_UNCONNECTED, -1);
+	++fake.connects;
+	set_state(c, PA_CONTEXT_CONNECTING);
+
+	// With NOFAIL, a missing server isn't an error; the context waits
+	if(!fake.running && (flags & PA_CONTEXT_NOFAIL))
+		c->waiting = TRUE;
+	else
+		defer_connected(c);
+	return 0;
+}
+
+void pa_context_disconnect(pa_context *c)
+{
+	if(c->state != PA_CONTEXT_FAILED && c->state != PA_CONTEXT_TERMINATED)
+		set_state(c, PA_CONTEXT_TERMINATED);
+}
+
+
+
+/* Operations */
+
+static gboolean on_operation_complete(pa_operation *o)
+{
+	o->sourceId = 0;
+	if(o->context->state == PA_CONTEXT_READY)
+	{
+		o->run(o);
+		o->state = PA_OPERATION_DONE;
+	}
+	else
+	{
+		o->state = PA_OPERATION_CANCELLED;
+	}
+	pa_operation_unref(o);
+	return G_SOURCE_REMOVE;
+}
+
+// Returns NULL, like libpulse, if the context isn't ready
+static pa_operation * operation_new(pa_context *c, void (*run)(pa_operation *o), void (*cb)(void), void *userdata)
+{
+	if(c->state != PA_CONTEXT_READY)
+		return NULL;
+	pa_operation *o = g_new0(pa_operation, 1);
+	o->refs = 2; // The caller's, and the pending reply's
+	o->state = PA_OPERATION_RUNNING;
+	o->context = pa_context_ref(c);
+	o->run = run;
+	o->cb = cb;
+	o->userdata = userdata;
+	o->sourceId = defer((GSourceFunc)on_operation_complete, o, NULL);
+	return o;
+}
+
+void pa_operation_unref(pa_operation *o)
+{
+	if(--o->refs > 0)
+		return;
+	pa_context_unref(o->context);
+	g_free(o);
+}
+
+void pa_operation_cancel(pa_operation *o)
+{
+	if(o->state != PA_OPERATION_RUNNING)
+		return;
+	o->state = PA_OPERATION_CANCELLED;
+	if(o->sourceId)
+	{
+		g_source_remove(o->sourceId);
+		o->sourceId = 0;
+		pa_operation_unref(o);
+	}
+}
+
+
+
+/* Events */
+
+static gboolean on_event(FakeEvent *event)
+{
+	pa_context *c = event->context;
+	if(c->state == PA_CONTEXT_READY && c->subscribeCb)
+		c->subscribeCb(c, event->type, event->index, c->subscribeUserdata);
+	return G_SOURCE_REMOVE;
+}
+
+static void free_event(FakeEvent *event)
+{
+	pa_context_unref(event->context);
+	g_free(event);
+}
+
+static void post_event(pa_subscription_event_type_t type, guint32 index)
+{
+	pa_subscription_mask_t facilityMask = 1 << (type & PA_SUBSCRIPTION_EVENT_FACILITY_MASK);
+	for(GList *it=fake.contexts; it!=NULL; it=it->next)
+	{
+		pa_context *c = it->data;
+		if(c->state != PA_CONTEXT_READY || !(c->mask & facilityMask))
+			continue;
+		FakeEvent *event = g_new0(FakeEvent, 1);
+		event->context = pa_context_ref(c);
+		event->type = type;
+		event->index = index;
+		defer((GSourceFunc)on_event, event, (GDestroyNotify)free_event);
+	}
+}
+
+static pa_subscription_event_type_t facility(gboolean source)
+{
+	return source ? PA_SUBSCRIPTION_EVENT_SOURCE : PA_SUBSCRIPTION_EVENT_SINK;
+}
+
+
+
+/* Requests */
+
+static void run_subscribe(pa_operation *o)
+{
+	o->context->mask = o->mask;
+	if(o->cb)
+		((pa_context_success_cb_t)o->cb)(o->context, 1, o->userdata);
+}
+
+pa_operation * pa_context_subscribe(pa_context *c, pa_subscription_mask_t m, pa_context_success_cb_t cb, void *userdata)
+{
+	pa_operation *o = operation_new(c, run_subscribe, (void (*)(void))cb, userdata);
+	if(o)
+		o->mask = m;
+	return o;
+}
+
+static void run_get_server_info(pa_operation *o)
+{
+	pa_server_info info;
+	memset(&info, 0, sizeof(info));
+	info.server_name = "fake-pulse";
+	info.default_sink_name = fake.defaultSink;
+	info.default_source_name = fake.defaultSource;
+	((pa_server_info_cb_t)o->cb)(o->context, &info, o->userdata);
+}
+
+pa_operation * pa_context_get_server_info(pa_context *c, pa_server_info_cb_t cb, void *userdata)
+{
+	return operation_new(c, run_get_server_info, (void (*)(void))cb, userdata);
+}
+
+static void fill_channel_map(pa_channel_map *map)
+{
+	memset(map, 0, sizeof(pa_channel_map));
+	map->channels = 2;
+	map->map[0] = PA_CHANNEL_POSITION_FRONT_LEFT;
+	map->map[1] = PA_CHANNEL_POSITION_FRONT_RIGHT;
+}
+
+static void send_device_info(pa_operation *o, FakeDevice *device)
+{
+	if(device->source)
+	{
+		pa_source_info info;
+		memset(&info, 0, sizeof(info));
+		info.index = device->index;
+		info.name = device->name;
+		info.description = device->description;
+		info.volume = device->volume;
+		info.mute = device->mute;
+		fill_channel_map(&info.channel_map);
+		((pa_source_info_cb_t)o->cb)(o->context, &info, 0, o->userdata);
+	}
+	else
+	{
+		pa_sink_info info;
+		memset(&info, 0, sizeof(info));
+		info.index = device->index;
+		info.name = device->name;
+		info.description = device->description;
+		info.volume = device->volume;
+		info.mute = device->mute;
+		fill_channel_map(&info.channel_map);
+		((pa_sink_info_cb_t)o->cb)(o->context, &info, 0, o->userdata);
+	}
+}
+
+static void send_info_end(pa_operation *o, int eol)
+{
+	if(o->source)
+		((pa_source_info_cb_t)o->cb)(o->context, NULL, eol, o->userdata);
+	else
+		((pa_sink_info_cb_t)o->cb)(o->context, NULL, eol, o->userdata);
+}
+
+static void run_get_info_list(pa_operation *o)
+{
+	for(GList *it=fake.devices; it!=NULL; it=it->next)
+		if(((FakeDevice *)it->data)->source == o->source)
+			send_device_info(o, it->data);
+	send_info_end(o, 1);
+}
+
+static void run_get_info_by_index(pa_operation *o)
+{
+	FakeDevice *device = find_device(o->source, o->index);
+	if(!device)
+	{
+		send_info_end(o, -1);
+		return;
+	}
+	send_device_info(o, device);
+	send_info_end(o, 1);
+}
+
+pa_operation * pa_context_get_sink_info_list(pa_context *c, pa_sink_info_cb_t cb, void *userdata)
+{
+	return operation_new(c, run_get_info_list, (void (*)(void))cb, userdata);
+}
+
+pa_operation * pa_context_get_source_info_list(pa_context *c, pa_source_info_cb_t cb, void *userdata)
+{
+	pa_operation *o = operation_new(c, run_get_info_list, (void (*)(void))cb, userdata);
+	if(o)
+		o->source = TRUE;
+	return o;
+}
+
+pa_operation * pa_context_get_sink_info_by_index(pa_context *c, uint32_t idx, pa_sink_info_cb_t cb, void *userdata)
+{
+	pa_operation *o = operation_new(c, run_get_info_by_index, (void (*)(void))cb, userdata);
+	if(o)
+		o->index = idx;
+	return o;
+}
+
+pa_operation * pa_context_get_source_info_by_index(pa_context *c, uint32_t idx, pa_source_info_cb_t cb, void *userdata)
+{
+	pa_operation *o = operation_new(c, run_get_info_by_index, (void (*)(void))cb, userdata);
+	if(o)
+	{
+		o->source = TRUE;
+		o->index = idx;
+	}
+	return o;
+}
+
+static void run_set_volume(pa_operation *o)
+{
+	FakeDevice *device = find_device(o->source, o->index);
+	if(device)
+	{
+		device->volume = o->volume;
+		post_event(facility(o->source) | PA_SUBSCRIPTION_EVENT_CHANGE, o->index);
+	}
+	if(o->cb)
+		((pa_context_success_cb_t)o->cb)(o->context, device != NULL, o->userdata);
+}
+
+static pa_operation * set_volume_by_index(pa_context *c, gboolean source, uint32_t idx, const pa_cvolume *volume, pa_context_success_cb_t cb, void *userdata)
+{
+	FakeDevice *device = find_device(source, idx);
+	if(device)
+		++device->volumeWrites;
+	pa_operation *o = operation_new(c, run_set_volume, (void (*)(void))cb, userdata);
+	if(o)
+	{
+		o->source = source;
+		o->index = idx;
+		o->volume = *volume;
+	}
+	return o;
+}
+
+pa_operation * pa_context_set_sink_volume_by_index(pa_context *c, uint32_t idx, const pa_cvolume *volume, pa_context_success_cb_t cb, void *userdata)
+{
+	return set_volume_by_index(c, FALSE, idx, volume, cb, userdata);
+}
+
+pa_operation * pa_context_set_source_volume_by_index(pa_context *c, uint32_t idx, const pa_cvolume *volume, pa_context_success_cb_t cb, void *userdata)
+{
+	return set_volume_by_index(c, TRUE, idx, volume, cb, userdata);
+}
+
+static void run_set_mute(pa_operation *o)
+{
+	FakeDevice *device = find_device(o->source, o->index);
+	if(device)
+	{
+		device->mute = o->mute;
+		post_event(facility(o->source) | PA_SUBSCRIPTION_EVENT_CHANGE, o->index);
+	}
+	if(o->cb)
+		((pa_context_success_cb_t)o->cb)(o->context, device != NULL, o->userdata);
+}
+
+static pa_operation * set_mute_by_index(pa_context *c, gboolean source, uint32_t idx, int mute, pa_context_success_cb_t cb, void *userdata)
+{
+	pa_operation *o = operation_new(c, run_set_mute, (void (*)(void))cb, userdata);
+	if(o)
+	{
+		o->source = source;
+		o->index = idx;
+		o->mute = !!mute;
+	}
+	return o;
+}
+
+pa_operation * pa_context_set_sink_mute_by_index(pa_context *c, uint32_t idx, int mute, pa_context_success_cb_t cb, void *userdata)
+{
+	return set_mute_by_index(c, FALSE, idx, mute, cb, userdata);
+}
+
+pa_operation * pa_context_set_source_mute_by_index(pa_context *c, uint32_t idx, int mute, pa_context_success_cb_t cb, void *userdata)
+{
+	return set_mute_by_index(c, TRUE, idx, mute, cb, userdata);
+}
+
+
+
+/* Volumes, property lists and the main loop */
+
+pa_cvolume * pa_cvolume_init(pa_cvolume *a)
+{
+	memset(a, 0, sizeof(pa_cvolume));
+	return a;
+}
+
+pa_volume_t pa_cvolume_max(const pa_cvolume *a)
+{
+	pa_volume_t max = PA_VOLUME_MUTED;
+	for(guint i=0;i<a->channels;++i)
+		if(a->values[i] > max)
+			max = a->values[i];
+	return max;
+}
+
+pa_cvolume * pa_cvolume_scale(pa_cvolume *v, pa_volume_t max)
+{
+	pa_volume_t t = pa_cvolume_max(v);
+	for(guint i=0;i<v->channels;++i)
+		v->values[i] = (t <= PA_VOLUME_MUTED) ? max : (pa_volume_t)(((guint64)v->values[i] * max) / t);
+	return v;
+}
+
+float pa_cvolume_get_balance(const pa_cvolume *v, const pa_channel_map *map)
+{
+	// Every fake device is front left and right
+	if(v->channels != 2 || v->values[0] == v->values[1])
+		return 0;
+	if(v->values[0] > v->values[1])
+		return -1.0f + (float)v->values[1] / v->values[0];
+	return 1.0f - (float)v->values[0] / v->values[1];
+}
+
+pa_proplist * pa_proplist_new(void)
+{
+	pa_proplist *p = g_new0(pa_proplist, 1);
+	p->props = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_free);
+	return p;
+}
+
+void pa_proplist_free(pa_proplist *p)
+{
+	g_hash_table_unref(p->props);
+	g_free(p);
+}
+
+int pa_proplist_sets(pa_proplist *p, const char *key, const char *value)
+{
+	g_hash_table_insert(p->props, g_strdup(key), g_strdup(value));
+	return 0;
+}
+
+const char * pa_proplist_gets(const pa_proplist *p, const char *key)
+{
+	return g_hash_table_lookup(p->props, key);
+}
+
+int pa_proplist_contains(const pa_proplist *p, const char *key)
+{
+	return g_hash_table_contains(p->props, key);
+}
+
+pa_glib_mainloop * pa_glib_mainloop_new(GMainContext *c)
+{
+	// The fake always uses the default main context
+	return g_new0(pa_glib_mainloop, 1);
+}
+
+pa_mainloop_api * pa_glib_mainloop_get_api(pa_glib_mainloop *g)
+{
+	return &g->api;
+}
+
+void pa_glib_mainloop_free(pa_glib_mainloop *g)
+{
+	g_free(g);
+}
+
+
+
+/* Scripting */
+
+// Runs f on every live context, holding a ref in case a callback drops it
+static void foreach_context(void (*f)(pa_context *c))
+{
+	GList *contexts = g_list_copy(fake.contexts);
+	g_list_foreach(contexts, (GFunc)pa_context_ref, NULL);
+	for(GList *it=contexts; it!=NULL; it=it->next)
+		f(it->data);
+	g_list_free_full(contexts, (GDestroyNotify)pa_context_unref);
+}
+
+static void start_context(pa_context *c)
+{
+	if(c->waiting)
+	{
+		c->waiting = FALSE;
+		defer_connected(c);
+	}
+}
+
+static void stop_context(pa_context *c)
+{
+	if(c->state == PA_CONTEXT_READY)
+		set_state(c, PA_CONTEXT_FAILED);
+}
+
+void fake_pulse_start(void)
+{
+	fake.running = TRUE;
+	foreach_context(start_context);
+}
+
+void fake_pulse_stop(void)
+{
+	fake.running = FALSE;
+	foreach_context(stop_context);
+}
+
+void fake_pulse_set_latency(guint ms)
+{
+	fake.latency = ms;
+}
+
+void fake_pulse_add_device(gboolean source, guint32 index, const gchar *name, const gchar *description, gdouble volume)
+{
+	g_return_if_fail(!find_device(source, index));
+	FakeDevice *device = g_new0(FakeDevice, 1);
+	device->source = source;
+	device->index = index;
+	device->name = g_strdup(name);
+	device->description = g_strdup(description);
+	set_volume(&device->volume, volume);
+	fake.devices = g_list_append(fake.devices, device);
+	post_event(facility(source) | PA_SUBSCRIPTION_EVENT_NEW, index);
+}
+
+void fake_pulse_remove_device(gboolean source, guint32 index)
+{
+	FakeDevice *device = find_device(source, index);
+	g_return_if_fail(device);
+	fake.devices = g_list_remove(fake.devices, device);
+	free_device(device);
+	post_event(facility(source) | PA_SUBSCRIPTION_EVENT_REMOVE, index);
+}
+
+void fake_pulse_set_default(gboolean source, const gchar *name)
+{
+	gchar **defaultName = source ? &fake.defaultSource : &fake.defaultSink;
+	g_free(*defaultName);
+	*defaultName = g_strdup(name);
+	post_event(PA_SUBSCRIPTION_EVENT_SERVER | PA_SUBSCRIPTION_EVENT_CHANGE, PA_INVALID_INDEX);
+}
+
+void fake_pulse_set_volume(gboolean source, guint32 index, gdouble volume)
+{
+	FakeDevice *device = find_device(source, index);
+	g_return_if_fail(device);
+	set_volume(&device->volume, volume);
+	post_event(facility(source) | PA_SUBSCRIPTION_EVENT_CHANGE, index);
+}
+
+gdouble fake_pulse_get_volume(gboolean source, guint32 index)
+{
+	FakeDevice *device = find_device(source, index);
+	g_return_val_if_fail(device, 0);
+	return (gdouble)pa_cvolume_max(&device->volume) / PA_VOLUME_NORM;
+}
+
+gboolean fake_pulse_get_mute(gboolean source, guint32 index)
+{
+	FakeDevice *device = find_device(source, index);
+	g_return_val_if_fail(device, FALSE);
+	return device->mute;
+}
+
+guint fake_pulse_get_volume_writes(gboolean source, guint32 index)
+{
+	FakeDevice *device = find_device(source, index);
+	g_return_val_if_fail(device, 0);
+	return device->volumeWrites;
+}
+
+guint fake_pulse_get_connects(void)
+{
+	return fake.connects;
+}
+
+void fake_pulse_reset(void)
+{
+	fake_pulse_stop();
+	g_list_free_full(fake.devices, (GDestroyNotify)free_device);
+	fake.devices = NULL;
+	g_free(fake.defaultSink);
+	g_free(fake.defaultSource);
+	fake.defaultSink = fake.defaultSource = NULL;
+	fake.latency = 0;
+	fake.connects = 0;
+}
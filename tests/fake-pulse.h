@@ -0,0 +1,53 @@
+/*
+ * This file is part of graphene-desktop, the desktop environment of VeltOS.
+ * Copyright (C) 2016 Velt Technologies, Aidan Shafran <zelbrium@gmail.com>
+ * Licensed under the Apache License 2 <www.apache.org/licenses/LICENSE-2.0>.
+ *
+ * An in-process stand-in for the PulseAudio server. fake-pulse.c defines
+ * the part of libpulse that src/csk/audio.c uses, so tests link it instead
+ * of libpulse. Replies and events are delivered from the GLib main loop,
+ * after the latency set with fake_pulse_set_latency.
+ */
+
+#ifndef __GRAPHENE_FAKE_PULSE_H__
+#define __GRAPHENE_FAKE_PULSE_H__
+
+#include <glib.h>
+
+/*
+ * Starts or stops the server. Stopping fails every connected context;
+ * starting completes every context waiting to connect with NOFAIL.
+ */
+void fake_pulse_start(void);
+void fake_pulse_stop(void);
+
+/*
+ * Delay before each reply or event is delivered, in milliseconds. 0 (the
+ * default) delivers from an idle.
+ */
+void fake_pulse_set_latency(guint ms);
+
+/*
+ * Hotplugs a sink (source = FALSE) or source. Volumes are linear, with 1
+ * as PA_VOLUME_NORM. Subscribed contexts get a new or remove event.
+ */
+void fake_pulse_add_device(gboolean source, guint32 index, const gchar *name, const gchar *description, gdouble volume);
+void fake_pulse_remove_device(gboolean source, guint32 index);
+void fake_pulse_set_default(gboolean source, const gchar *name);
+
+// Changes a device as another client would, sending a change event
+void fake_pulse_set_volume(gboolean source, guint32 index, gdouble volume);
+
+gdouble fake_pulse_get_volume(gboolean source, guint32 index);
+gboolean fake_pulse_get_mute(gboolean source, guint32 index);
+
+// Number of set_*_volume_by_index operations issued for the device
+guint fake_pulse_get_volume_writes(gboolean source, guint32 index);
+
+// Number of pa_context_connect calls made
+guint fake_pulse_get_connects(void);
+
+// Removes every device and clears the counters. The server is stopped.
+void fake_pulse_reset(void);
+
+#endif /* __GRAPHENE_FAKE_PULSE_H__ */
@@ -0,0 +1,156 @@
+/*
+ * This file is part of graphene-desktop, the desktop environment of VeltOS.
+ * Copyright (C) 2016 Velt Technologies, Aidan Shafran <zelbrium@gmail.com>
+ * Licensed under the Apache License 2 <www.apache.org/licenses/LICENSE-2.0>.
+ *
+ * The blur and render_shadow from src/cmk/shadow.c as they were before the
+ * fixed-point renderer, unchanged apart from their names.
+ */
+
+#include "shadow-reference.h"
+#include "cmk/shadow.h"
+#include <math.h>
+#include <string.h>
+
+/*
+ * x + r <= ~stride/2 (?)
+ * y + h <= buffer height
+ * w <= stride
+ * 0 < r
+ */
+static void ref_box_blur_h(guchar *src, guchar *dst, guint stride, guint x, guint y, guint w, guint h, guint r)
+{
+    float iarr = 1.0 / (r+r+1.0);
+    for(guint i=y; i<y+h; i++)
+	{
+        guint ti = i*stride+x, li = ti, ri = ti+r;
+        guint fv = src[ti], lv = src[ti+w-1], val = (r+1)*fv;
+        for(guint j=0; j<r; j++)
+			val += src[ti+j];
+        for(guint j=0; j<=r; j++) {
+			val += src[ri++] - fv;
+			dst[ti++] = round(val*iarr);
+		}
+        for(guint j=r+1; j<w-r; j++) {
+			val += src[ri++] - src[li++];
+			dst[ti++] = round(val*iarr);
+		}
+        for(guint j=w-r; j<w; j++) {
+			val += lv - src[li++];
+			dst[ti++] = round(val*iarr);
+		}
+    }
+}
+
+static void ref_box_blur_v(guchar *src, guchar *dst, guint stride, guint x, guint y, guint w, guint h, guint r)
+{
+    float iarr = 1.0 / (r+r+1.0);
+    for(guint i=x; i<x+w; i++)
+	{
+        guint ti = i+y*stride, li = ti, ri = ti+r*stride;
+        guint fv = src[ti], lv = src[ti+stride*(h-1)], val = (r+1)*fv;
+        for(guint j=0; j<r; j++)
+			val += src[ti+j*stride];
+        for(guint j=0; j<=r; j++) {
+			val += src[ri] - fv;
+			dst[ti] = round(val*iarr);
+			ri+=stride;
+			ti+=stride;
+		}
+        for(guint j=r+1; j<h-r; j++) {
+			val += src[ri] - src[li];
+			dst[ti] = round(val*iarr);
+			li+=stride;
+			ri+=stride;
+			ti+=stride;
+		}
+        for(guint j=h-r; j<h; j++) {
+			val += lv - src[li];
+			dst[ti] = round(val*iarr);
+			li+=stride;
+			ti+=stride;
+		}
+    }
+}
+
+/*
+ * Renders a shadow into an alpha buffer of width x height. In reality,
+ * this just creates a blurred black box. Only the edges specified in the
+ * shadow mask are blurred. The caller must make sure that width and height
+ * are greater than radius*4.
+ */
+void reference_render_shadow(guchar *alpha, guint width, guint height, guint radius, guint shadowMask)
+{
+	gboolean mTop = (shadowMask & CMK_SHADOW_MASK_TOP) == CMK_SHADOW_MASK_TOP;
+	gboolean mBottom = (shadowMask & CMK_SHADOW_MASK_BOTTOM) == CMK_SHADOW_MASK_BOTTOM;
+	gboolean mLeft = (shadowMask & CMK_SHADOW_MASK_LEFT) == CMK_SHADOW_MASK_LEFT;
+	gboolean mRight = (shadowMask & CMK_SHADOW_MASK_RIGHT) == CMK_SHADOW_MASK_RIGHT;
+
+	guint length = width*height;
+
+	// Two alpha-only buffers for a "double buffer" usage, of which 'source'
+	// holds the final result.
+	guchar *source = alpha;
+	guchar *dest = g_new(guchar, length);
+
+	// This creates an entirely black box, except for the edges that
+	// should be blurred (on those edges, a border of size radius is created). 
+	memset(source, 255, length);
+	memset(dest, 255, length);
+	if(mTop)
+	{
+		memset(source, 0, width*radius);
+		memset(dest, 0, width*radius);
+	}
+	if(mBottom)
+	{
+		memset(source+(height-radius)*width, 0, width*radius);
+		memset(dest+(height-radius)*width, 0, width*radius);
+	}
+	if(mLeft)
+	{
+		guint yStart = mTop ? radius : 0;
+		guint yEnd = mBottom ? (height-radius) : height;
+		for(guint y=yStart; y<yEnd; ++y)
+			memset(source+(y*width), 0, radius);
+		for(guint y=yStart; y<yEnd; ++y)
+			memset(dest+(y*width), 0, radius);
+	}
+	if(mRight)
+	{
+		guint yStart = mTop ? radius : 0;
+		guint yEnd = mBottom ? (height-radius) : height;
+		for(guint y=yStart; y<yEnd; ++y)
+			memset(source+((y+1)*width-radius), 0, radius);
+		for(guint y=yStart; y<yEnd; ++y)
+			memset(dest+((y+1)*width-radius), 0, radius);
+	}
+	
+	// Because blurring on an edge only transfers that set of pixels, the
+	// pixels have to be transfered back to the source buffer after a blur.
+	// Luckily, we want to do two passes of the blur anyway for better looks.
+	// So just blur in sets of two on the same edge, and solve both problems
+	// at once!
+	if(mTop)
+	{
+		ref_box_blur_v(source, dest, width, 0, 0, width, radius*2, radius/2);
+		ref_box_blur_v(dest, source, width, 0, 0, width, radius*2, radius/2);
+	}
+	if(mBottom)
+	{
+		ref_box_blur_v(source, dest, width, 0, height - radius*2 - 1, width, radius*2, radius/2);
+		ref_box_blur_v(dest, source, width, 0, height - radius*2 - 1, width, radius*2, radius/2);
+	}
+	if(mLeft)
+	{
+		ref_box_blur_h(source, dest, width, 0, 0, radius*2, height, radius/2);
+		ref_box_blur_h(dest, source, width, 0, 0, radius*2, height, radius/2);
+	}
+	if(mRight)
+	{
+		ref_box_blur_h(source, dest, width, width - radius*2 - 1, 0, radius*2, height, radius/2);
+		ref_box_blur_h(dest, source, width, width - radius*2 - 1, 0, radius*2, height, radius/2);
+	}
+
+	g_free(dest);
+}
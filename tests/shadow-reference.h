@@ -0,0 +1,23 @@
+/*
+ * This file is part of graphene-desktop, the desktop environment of VeltOS.
+ * Copyright (C) 2016 Velt Technologies, Aidan Shafran <zelbrium@gmail.com>
+ * Licensed under the Apache License 2 <www.apache.org/licenses/LICENSE-2.0>.
+ *
+ * CmkShadow's original shadow renderer: a float box blur on a separate
+ * alpha buffer. Kept as the reference for the fixed-point renderer in
+ * src/cmk/shadow.c.
+ */
+
+#ifndef __GRAPHENE_SHADOW_REFERENCE_H__
+#define __GRAPHENE_SHADOW_REFERENCE_H__
+
+#include <glib.h>
+
+/*
+ * Renders a shadow into an alpha buffer of width x height, with the edges
+ * in shadowMask (CmkShadow's mask bits) blurred. width and height must be
+ * greater than radius*4.
+ */
+void reference_render_shadow(guchar *alpha, guint width, guint height, guint radius, guint shadowMask);
+
+#endif /* __GRAPHENE_SHADOW_REFERENCE_H__ */
@@ -0,0 +1,191 @@
+/*
+ * This file is part of graphene-desktop, the desktop environment of VeltOS.
+ * Copyright (C) 2016 Velt Technologies, Aidan Shafran <zelbrium@gmail.com>
+ * Licensed under the Apache License 2 <www.apache.org/licenses/LICENSE-2.0>.
+ *
+ * Runs GrapheneAppSearch over a fixed corpus of launcher entries. Checks
+ * the ranking for representative queries (word starts, ties broken by
+ * length, launch counts, accents, multiple terms), and that refining a
+ * query from its previous results gives the same results as searching
+ * every entry.
+ */
+
+#include "panel-internal.h"
+
+typedef struct
+{
+	const gchar *name;
+	const gchar *genericName;
+	const gchar *keywords;
+	const gchar *executable;
+	guint launchCount;
+} CorpusEntry;
+
+static const CorpusEntry corpus[] = {
+	{"Firefox Web Browser", "Web Browser", "Internet;WWW;Explorer", "firefox", 0},
+	{"Chromium Web Browser", "Web Browser", "Internet;WWW", "chromium-browser", 0},
+	{"Files", "File Manager", "folder;manager;explore;disk", "nautilus", 0},
+	{"Terminal", "Terminal Emulator", "shell;prompt;command;commandline", "gnome-terminal", 0},
+	{"Text Editor", "Text Editor", "text;editor;plaintext;write", "gedit", 0},
+	{"Calculator", "Calculator", "calculation;arithmetic;scientific", "gnome-calculator", 0},
+	{"Settings", "Settings", "preferences;configuration", "graphene-settings", 0},
+	{"System Monitor", "Process Viewer", "process;task;cpu;memory", "gnome-system-monitor", 0},
+	{"Software", "Package Manager", "updates;upgrade;sources;repositories", "gnome-software", 0},
+	{"LibreOffice Writer", "Word Processor", "text;letter;document", "libreoffice", 0},
+	{"LibreOffice Calc", "Spreadsheet", "accounting;stats;chart", "libreoffice", 0},
+	{"Café Player", "Media Player", "video;music;movie", "cafe-player", 0},
+	{"Maps", "Maps", "maps;location", "gnome-maps", 0},
+	{"Mail", "Mail Client", "email;e-mail", "geary", 5},
+	{"Calendar", "Calendar", "event;reminder", "gnome-calendar", 0},
+};
+
+static void free_entry(GrapheneAppEntry *entry)
+{
+	g_free(entry->name);
+	g_free(entry->searchName);
+	g_strfreev(entry->searchExtra);
+	g_free(entry);
+}
+
+// Fills in the search fields as the app index does
+static void set_search_name(GrapheneAppEntry *entry, const gchar *name)
+{
+	g_free(entry->searchName);
+	entry->searchName = graphene_app_search_normalize(name);
+	entry->searchMask = graphene_app_search_char_mask(entry->searchName);
+	for(guint i=0;entry->searchExtra && entry->searchExtra[i];++i)
+		entry->searchMask |= graphene_app_search_char_mask(entry->searchExtra[i]);
+}
+
+static GPtrArray * corpus_new(void)
+{
+	GPtrArray *entries = g_ptr_array_new_with_free_func((GDestroyNotify)free_entry);
+	for(guint i=0;i<G_N_ELEMENTS(corpus);++i)
+	{
+		GrapheneAppEntry *entry = g_new0(GrapheneAppEntry, 1);
+		entry->name = g_strdup(corpus[i].name);
+		gchar **keywords = g_strsplit(corpus[i].keywords, ";", -1);
+		GPtrArray *extra = g_ptr_array_new();
+		g_ptr_array_add(extra, graphene_app_search_normalize(corpus[i].genericName));
+		for(guint j=0;keywords[j];++j)
+			g_ptr_array_add(extra, graphene_app_search_normalize(keywords[j]));
+		g_ptr_array_add(extra, graphene_app_search_normalize(corpus[i].executable));
+		g_ptr_array_add(extra, NULL);
+		entry->searchExtra = (gchar **)g_ptr_array_free(extra, FALSE);
+		g_strfreev(keywords);
+		set_search_name(entry, corpus[i].name);
+		entry->launchCount = corpus[i].launchCount;
+		g_ptr_array_add(entries, entry);
+	}
+	return entries;
+}
+
+static gchar * join_names(GPtrArray *results)
+{
+	GString *names = g_string_new(NULL);
+	for(guint i=0;i<results->len;++i)
+	{
+		if(i > 0)
+			g_string_append(names, ", ");
+		g_string_append(names, ((GrapheneAppEntry *)g_ptr_array_index(results, i))->name);
+	}
+	return g_string_free(names, FALSE);
+}
+
+// Checks the results of query, in order. expected is comma-separated.
+static void assert_query(GrapheneAppSearch *search, const gchar *query, const gchar *expected)
+{
+	gchar *names = join_names(graphene_app_search_query(search, query));
+	if(g_strcmp0(names, expected) != 0)
+		g_error("Query \"%s\" returned \"%s\", expected \"%s\"", query, names, expected);
+	g_free(names);
+}
+
+static void test_ranking(void)
+{
+	GPtrArray *entries = corpus_new();
+	GrapheneAppSearch *search = graphene_app_search_new();
+	graphene_app_search_set_entries(search, entries);
+
+	// Word starts beat letters inside words
+	assert_query(search, "fi", "Files, Firefox Web Browser, LibreOffice Calc, LibreOffice Writer, Settings, Calculator");
+	assert_query(search, "file", "Files");
+	assert_query(search, "set", "Settings, System Monitor, Calculator, Terminal, LibreOffice Calc, Software");
+
+	// Equal scores go to the shorter name
+	assert_query(search, "web", "Firefox Web Browser, Chromium Web Browser");
+	assert_query(search, "cal", "Calendar, Calculator, LibreOffice Calc, Café Player, Terminal");
+	assert_query(search, "calc", "Calculator, LibreOffice Calc");
+
+	// Mail has been launched, so ranks above Maps
+	assert_query(search, "ma", "Mail, Maps, Terminal, Files, Software, Café Player, Calendar, Calculator");
+
+	// Accents are ignored on both sides
+	assert_query(search, "cafe", "Café Player");
+	assert_query(search, "CAFÉ", "Café Player");
+
+	// Keywords and executables count for less than the name
+	assert_query(search, "term", "Terminal, LibreOffice Writer");
+	assert_query(search, "sysmon", "System Monitor");
+
+	// Every term has to match
+	assert_query(search, "text ed", "Text Editor, LibreOffice Writer");
+	assert_query(search, "libre calc", "LibreOffice Calc");
+	assert_query(search, "zzz", "");
+	assert_query(search, "  ", "");
+
+	graphene_app_search_free(search);
+	g_ptr_array_unref(entries);
+}
+
+static const gchar *typed[] = {
+	"c", "ca", "cal", "calc", "calcu", "calc", "cal", "cal ", "cal e", "cal ed",
+	"w", "we", "web", "web ", "web b", "web br", "m", "ma", "mai", "mail",
+	NULL
+};
+
+static void test_refinement(void)
+{
+	GPtrArray *entries = corpus_new();
+	GrapheneAppSearch *search = graphene_app_search_new();
+	GrapheneAppSearch *fresh = graphene_app_search_new();
+	graphene_app_search_set_entries(search, entries);
+
+	// Typing and deleting one character at a time, each query either
+	// refines the last or starts over. Either way, the results must be
+	// those of searching every entry.
+	for(guint i=0;typed[i];++i)
+	{
+		graphene_app_search_set_entries(fresh, entries);
+		gchar *expected = join_names(graphene_app_search_query(fresh, typed[i]));
+		assert_query(search, typed[i], expected);
+		g_free(expected);
+	}
+
+	// An extended query only searches the previous results. Renaming an
+	// entry which didn't match "fil" to match "file" shows it.
+	assert_query(search, "fil", "Files, LibreOffice Calc");
+	GrapheneAppEntry *maps = g_ptr_array_index(entries, 12);
+	set_search_name(maps, "File Maps");
+	assert_query(search, "file", "Files");
+
+	// But a new set of entries, or a query that doesn't extend the last,
+	// starts over
+	assert_query(search, "fi", "Files, Maps, Firefox Web Browser, LibreOffice Calc, LibreOffice Writer, Settings, Calculator");
+	assert_query(search, "file", "Files, Maps");
+	set_search_name(maps, "Maps");
+	graphene_app_search_set_entries(search, entries);
+	assert_query(search, "file", "Files");
+
+	graphene_app_search_free(fresh);
+	graphene_app_search_free(search);
+	g_ptr_array_unref(entries);
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+	g_test_add_func("/app-search/ranking", test_ranking);
+	g_test_add_func("/app-search/refinement", test_refinement);
+	return g_test_run();
+}
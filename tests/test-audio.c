@@ -0,0 +1,282 @@
+/*
+ * This file is part of graphene-desktop, the desktop environment of VeltOS.
+ * Copyright (C) 2016 Velt Technologies, Aidan Shafran <zelbrium@gmail.com>
+ * Licensed under the Apache License 2 <www.apache.org/licenses/LICENSE-2.0>.
+ *
+ * Runs CskAudioDeviceManager against the in-process PulseAudio stand-in in
+ * fake-pulse.c. Checks device discovery and hotplug, volume and mute
+ * round-trips in both directions, coalescing of volume writes, and
+ * reconnecting after the server goes away, with and without reply latency.
+ */
+
+#include "csk/audio.h"
+#include "fake-pulse.h"
+
+#define SINK 1
+#define SOURCE 2
+
+static CskAudioDeviceManager *manager;
+static GPtrArray *devices; // Devices added and not yet removed, reffed
+static guint added, removed;
+
+static void on_device_added(CskAudioDeviceManager *manager, CskAudioDevice *device)
+{
+	++added;
+	g_ptr_array_add(devices, g_object_ref(device));
+}
+
+static void on_device_removed(CskAudioDeviceManager *manager, CskAudioDevice *device)
+{
+	++removed;
+	g_ptr_array_remove(devices, device);
+}
+
+static CskAudioDevice * find_device(CskAudioDeviceType type, const gchar *hname)
+{
+	for(guint i=0;i<devices->len;++i)
+	{
+		CskAudioDevice *device = devices->pdata[i];
+		if(csk_audio_device_get_type_(device) == type && g_strcmp0(csk_audio_device_get_name(device), hname) == 0)
+			return device;
+	}
+	return NULL;
+}
+
+static gboolean on_timeout(gboolean *timedOut)
+{
+	*timedOut = TRUE;
+	return G_SOURCE_REMOVE;
+}
+
+// Runs the main loop until check returns TRUE, or fails after 5s
+static void wait_until(gboolean (*check)(gconstpointer), gconstpointer data)
+{
+	gboolean timedOut = FALSE;
+	guint timeout = g_timeout_add_seconds(5, (GSourceFunc)on_timeout, &timedOut);
+	while(!check(data) && !timedOut)
+		g_main_context_iteration(NULL, TRUE);
+	g_assert_false(timedOut);
+	g_source_remove(timeout);
+}
+
+static gboolean is_ready(gconstpointer data)
+{
+	return csk_audio_device_manager_is_ready(manager) == GPOINTER_TO_INT(data);
+}
+
+static gboolean added_reaches(gconstpointer n)
+{
+	return added >= GPOINTER_TO_UINT(n);
+}
+
+static gboolean removed_reaches(gconstpointer n)
+{
+	return removed >= GPOINTER_TO_UINT(n);
+}
+
+static gboolean connects_reach(gconstpointer n)
+{
+	return fake_pulse_get_connects() >= GPOINTER_TO_UINT(n);
+}
+
+// Sink 1 and source 2, each at 100%, with the sink the default output
+static void setup(void)
+{
+	fake_pulse_reset();
+	fake_pulse_add_device(FALSE, SINK, "sink-a", "Speakers", 1);
+	fake_pulse_add_device(TRUE, SOURCE, "source-a", "Microphone", 1);
+	fake_pulse_set_default(FALSE, "sink-a");
+	fake_pulse_set_default(TRUE, "source-a");
+	fake_pulse_start();
+
+	added = removed = 0;
+	devices = g_ptr_array_new_with_free_func(g_object_unref);
+	manager = g_object_new(CSK_TYPE_AUDIO_DEVICE_MANAGER, NULL);
+	g_signal_connect(manager, "device-added", G_CALLBACK(on_device_added), NULL);
+	g_signal_connect(manager, "device-removed", G_CALLBACK(on_device_removed), NULL);
+	wait_until(is_ready, GINT_TO_POINTER(TRUE));
+	wait_until(added_reaches, GUINT_TO_POINTER(2));
+}
+
+static void teardown(void)
+{
+	g_object_unref(manager);
+	manager = NULL;
+	g_ptr_array_unref(devices);
+	devices = NULL;
+	fake_pulse_reset();
+	while(g_main_context_iteration(NULL, FALSE));
+}
+
+static void test_devices(void)
+{
+	setup();
+
+	CskAudioDevice *sink = find_device(CSK_AUDIO_DEVICE_TYPE_OUTPUT, "Speakers");
+	CskAudioDevice *source = find_device(CSK_AUDIO_DEVICE_TYPE_INPUT, "Microphone");
+	g_assert_nonnull(sink);
+	g_assert_nonnull(source);
+	g_assert_true(csk_audio_device_manager_get_default_output(manager) == sink);
+	g_assert_true(csk_audio_device_is_default(sink));
+	g_assert_true(csk_audio_device_is_default(source));
+	g_assert_cmpfloat(csk_audio_device_get_volume(sink), ==, 1);
+
+	// Hotplug a second sink with the same index as the source, which must
+	// still be a separate device
+	fake_pulse_add_device(FALSE, SOURCE, "sink-b", "Headphones", 0.5);
+	wait_until(added_reaches, GUINT_TO_POINTER(3));
+	CskAudioDevice *headphones = find_device(CSK_AUDIO_DEVICE_TYPE_OUTPUT, "Headphones");
+	g_assert_nonnull(headphones);
+	g_assert_true(headphones != source);
+	g_assert_cmpfloat(csk_audio_device_get_volume(headphones), ==, 0.5);
+	g_assert_false(csk_audio_device_is_default(headphones));
+
+	g_object_ref(headphones);
+	fake_pulse_remove_device(FALSE, SOURCE);
+	wait_until(removed_reaches, GUINT_TO_POINTER(1));
+	g_assert_cmpint(csk_audio_device_get_type_(headphones), ==, CSK_AUDIO_DEVICE_TYPE_INVALID);
+	g_assert_true(find_device(CSK_AUDIO_DEVICE_TYPE_INPUT, "Microphone") == source);
+	g_object_unref(headphones);
+
+	teardown();
+}
+
+static gboolean server_volume_is(gconstpointer volume)
+{
+	return fake_pulse_get_volume(FALSE, SINK) == *(const gdouble *)volume;
+}
+
+static gboolean server_muted(gconstpointer data)
+{
+	return fake_pulse_get_mute(FALSE, SINK);
+}
+
+static gboolean device_volume_is(gconstpointer volume)
+{
+	CskAudioDevice *sink = find_device(CSK_AUDIO_DEVICE_TYPE_OUTPUT, "Speakers");
+	return csk_audio_device_get_volume(sink) == *(const gdouble *)volume;
+}
+
+static void volume_round_trip(void)
+{
+	CskAudioDevice *sink = find_device(CSK_AUDIO_DEVICE_TYPE_OUTPUT, "Speakers");
+	g_assert_nonnull(sink);
+
+	// To the server
+	gdouble half = 0.5;
+	csk_audio_device_set_volume(sink, half);
+	g_assert_cmpfloat(csk_audio_device_get_volume(sink), ==, half);
+	wait_until(server_volume_is, &half);
+	g_assert_cmpfloat(fake_pulse_get_volume(TRUE, SOURCE), ==, 1);
+
+	csk_audio_device_set_muted(sink, TRUE);
+	g_assert_true(csk_audio_device_get_muted(sink));
+	wait_until(server_muted, NULL);
+
+	// From the server, as another client would change it
+	gdouble quarter = 0.25;
+	fake_pulse_set_volume(FALSE, SINK, quarter);
+	wait_until(device_volume_is, &quarter);
+	g_assert_true(csk_audio_device_get_muted(sink));
+}
+
+static void test_volume_round_trip(void)
+{
+	setup();
+	volume_round_trip();
+	teardown();
+}
+
+static void test_volume_round_trip_latency(void)
+{
+	setup();
+	fake_pulse_set_latency(20);
+	volume_round_trip();
+	teardown();
+}
+
+#define BURST 100
+
+static gboolean server_volumes_are(gconstpointer volume)
+{
+	gdouble v = *(const gdouble *)volume;
+	return fake_pulse_get_volume(FALSE, SINK) == v && fake_pulse_get_volume(TRUE, SOURCE) == v;
+}
+
+/*
+ * A burst of volume changes, like holding a volume key, sends one write
+ * straight away and one more with the last value once it completes. Sinks
+ * and sources are written through their own calls.
+ */
+static void test_volume_coalescing(void)
+{
+	setup();
+	fake_pulse_set_latency(20);
+	CskAudioDevice *sink = find_device(CSK_AUDIO_DEVICE_TYPE_OUTPUT, "Speakers");
+	CskAudioDevice *source = find_device(CSK_AUDIO_DEVICE_TYPE_INPUT, "Microphone");
+
+	// From near silent up to 50%
+	for(guint i=1;i<=BURST;++i)
+	{
+		csk_audio_device_set_volume(sink, (gfloat)i / (2 * BURST));
+		csk_audio_device_set_volume(source, (gfloat)i / (2 * BURST));
+	}
+	g_assert_cmpuint(fake_pulse_get_volume_writes(FALSE, SINK), ==, 1);
+	g_assert_cmpuint(fake_pulse_get_volume_writes(TRUE, SOURCE), ==, 1);
+
+	gdouble last = 0.5;
+	wait_until(server_volumes_are, &last);
+	while(g_main_context_iteration(NULL, FALSE));
+	g_assert_cmpuint(fake_pulse_get_volume_writes(FALSE, SINK), <=, 2);
+	g_assert_cmpuint(fake_pulse_get_volume_writes(TRUE, SOURCE), <=, 2);
+	g_assert_cmpfloat(csk_audio_device_get_volume(sink), ==, 0.5);
+	g_assert_cmpfloat(csk_audio_device_get_volume(source), ==, 0.5);
+
+	teardown();
+}
+
+static void test_reconnect(void)
+{
+	setup();
+	g_assert_cmpuint(fake_pulse_get_connects(), ==, 1);
+
+	// Losing the server removes every device
+	fake_pulse_stop();
+	g_assert_false(csk_audio_device_manager_is_ready(manager));
+	g_assert_cmpuint(removed, ==, 2);
+	g_assert_cmpuint(devices->len, ==, 0);
+
+	// The manager reconnects after a second, not straight away, and then
+	// waits for the server to come back
+	gint64 stopped = g_get_monotonic_time();
+	while(g_main_context_iteration(NULL, FALSE));
+	g_assert_cmpuint(fake_pulse_get_connects(), ==, 1);
+	wait_until(connects_reach, GUINT_TO_POINTER(2));
+	gint64 elapsed = g_get_monotonic_time() - stopped;
+	g_assert_cmpint(elapsed, >=, G_USEC_PER_SEC / 2); // Seconds timeouts are rounded
+	g_assert_cmpint(elapsed, <=, 3 * G_USEC_PER_SEC);
+	g_assert_false(csk_audio_device_manager_is_ready(manager));
+
+	fake_pulse_start();
+	wait_until(is_ready, GINT_TO_POINTER(TRUE));
+	wait_until(added_reaches, GUINT_TO_POINTER(4));
+	g_assert_cmpuint(fake_pulse_get_connects(), ==, 2);
+	g_assert_nonnull(find_device(CSK_AUDIO_DEVICE_TYPE_OUTPUT, "Speakers"));
+	g_assert_nonnull(find_device(CSK_AUDIO_DEVICE_TYPE_INPUT, "Microphone"));
+
+	// The new connection works
+	volume_round_trip();
+
+	teardown();
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+	g_test_add_func("/audio/devices", test_devices);
+	g_test_add_func("/audio/volume-round-trip", test_volume_round_trip);
+	g_test_add_func("/audio/volume-round-trip-latency", test_volume_round_trip_latency);
+	g_test_add_func("/audio/volume-coalescing", test_volume_coalescing);
+	g_test_add_func("/audio/reconnect", test_reconnect);
+	return g_test_run();
+}
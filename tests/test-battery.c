@@ -0,0 +1,222 @@
+/*
+ * This file is part of graphene-desktop, the desktop environment of VeltOS.
+ * Copyright (C) 2016 Velt Technologies, Aidan Shafran <zelbrium@gmail.com>
+ * Licensed under the Apache License 2 <www.apache.org/licenses/LICENSE-2.0>.
+ *
+ * Runs GrapheneBatteryInfo against a stand-in UPower DisplayDevice on a
+ * private bus, which is used as the system bus. Checks that the state is
+ * read once the proxy is ready, that pushed property changes are decoded
+ * and coalesced into one update signal, and that UPower is never polled.
+ */
+
+#include "settings-battery.h"
+#include <gio/gio.h>
+
+#define DEVICE_PATH "/org/freedesktop/UPower/devices/DisplayDevice"
+#define DEVICE_IFACE "org.freedesktop.UPower.Device"
+
+static const gchar *deviceXml =
+	"<node>"
+	"  <interface name='" DEVICE_IFACE "'>"
+	"    <method name='Refresh'/>"
+	"    <property name='Type' type='u' access='read'/>"
+	"    <property name='State' type='u' access='read'/>"
+	"    <property name='Percentage' type='d' access='read'/>"
+	"    <property name='TimeToFull' type='x' access='read'/>"
+	"    <property name='TimeToEmpty' type='x' access='read'/>"
+	"    <property name='IconName' type='s' access='read'/>"
+	"  </interface>"
+	"</node>";
+
+// The stand-in device's properties
+static guint32 type = 2; // Battery
+static guint32 state = 2; // Discharging
+static gdouble percentage = 80;
+static gint64 timeToFull = 0, timeToEmpty = 3600;
+static const gchar *iconName = "battery-full-symbolic";
+
+static GDBusConnection *upower; // The stand-in's own connection
+static guint methodCalls = 0;
+static guint updates = 0;
+
+static void on_method_call(GDBusConnection *connection, const gchar *sender, const gchar *path, const gchar *iface, const gchar *method, GVariant *params, GDBusMethodInvocation *invocation, gpointer userdata)
+{
+	++methodCalls;
+	g_dbus_method_invocation_return_value(invocation, NULL);
+}
+
+static GVariant * on_get_property(GDBusConnection *connection, const gchar *sender, const gchar *path, const gchar *iface, const gchar *property, GError **error, gpointer userdata)
+{
+	if(g_strcmp0(property, "Type") == 0)
+		return g_variant_new_uint32(type);
+	if(g_strcmp0(property, "State") == 0)
+		return g_variant_new_uint32(state);
+	if(g_strcmp0(property, "Percentage") == 0)
+		return g_variant_new_double(percentage);
+	if(g_strcmp0(property, "TimeToFull") == 0)
+		return g_variant_new_int64(timeToFull);
+	if(g_strcmp0(property, "TimeToEmpty") == 0)
+		return g_variant_new_int64(timeToEmpty);
+	if(g_strcmp0(property, "IconName") == 0)
+		return g_variant_new_string(iconName);
+	g_set_error(error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_PROPERTY, "No property %s", property);
+	return NULL;
+}
+
+static const GDBusInterfaceVTable deviceVTable = {on_method_call, on_get_property, NULL};
+
+// Emits PropertiesChanged for the named properties, with their current values
+static void push(const gchar *first, ...)
+{
+	GVariantBuilder changed;
+	g_variant_builder_init(&changed, G_VARIANT_TYPE("a{sv}"));
+	va_list args;
+	va_start(args, first);
+	for(const gchar *name=first;name;name=va_arg(args, const gchar *))
+		g_variant_builder_add(&changed, "{sv}", name, on_get_property(upower, NULL, DEVICE_PATH, DEVICE_IFACE, name, NULL, NULL));
+	va_end(args);
+
+	g_dbus_connection_emit_signal(upower, NULL, DEVICE_PATH, "org.freedesktop.DBus.Properties", "PropertiesChanged",
+		g_variant_new("(sa{sv}as)", DEVICE_IFACE, &changed, NULL), NULL);
+}
+
+/*
+ * Waits until every signal the stand-in has sent so far is queued on this
+ * thread's main context: the bus delivers them before the reply to a call
+ * made after them. Then runs the main loop until it's idle.
+ */
+static void settle(void)
+{
+	g_dbus_connection_flush_sync(upower, NULL, NULL);
+	GDBusConnection *system = g_bus_get_sync(G_BUS_TYPE_SYSTEM, NULL, NULL);
+	GVariant *r = g_dbus_connection_call_sync(system, g_dbus_connection_get_unique_name(upower), "/",
+		"org.freedesktop.DBus.Peer", "Ping", NULL, NULL, G_DBUS_CALL_FLAGS_NONE, -1, NULL, NULL);
+	g_assert_nonnull(r);
+	g_variant_unref(r);
+	g_object_unref(system);
+	while(g_main_context_iteration(NULL, FALSE));
+}
+
+static gboolean on_timeout(gboolean *timedOut)
+{
+	*timedOut = TRUE;
+	return G_SOURCE_REMOVE;
+}
+
+// Runs the main loop until the update count reaches n, or fails after 5s
+static void wait_for_updates(guint n)
+{
+	gboolean timedOut = FALSE;
+	guint timeout = g_timeout_add_seconds(5, (GSourceFunc)on_timeout, &timedOut);
+	while(updates < n && !timedOut)
+		g_main_context_iteration(NULL, TRUE);
+	g_assert_false(timedOut);
+	g_source_remove(timeout);
+}
+
+static void on_update(GrapheneBatteryInfo *info)
+{
+	++updates;
+}
+
+static GrapheneBatteryInfo *info;
+
+static void test_initial_state(void)
+{
+	g_assert_false(graphene_battery_info_is_available(info));
+	wait_for_updates(1);
+	g_assert_true(graphene_battery_info_is_available(info));
+	g_assert_cmpfloat(graphene_battery_info_get_percent(info), ==, 80);
+	g_assert_cmpuint(graphene_battery_info_get_state(info), ==, 2);
+	g_assert_cmpstr(graphene_battery_info_get_state_string(info), ==, "Discharging");
+	g_assert_cmpint(graphene_battery_info_get_time(info), ==, 3600);
+	gchar *icon = graphene_battery_info_get_icon_name(info);
+	g_assert_cmpstr(icon, ==, "battery-full-symbolic");
+	g_free(icon);
+}
+
+static void test_pushed_changes_coalesce(void)
+{
+	settle();
+	guint before = updates;
+
+	// Plugging in changes several properties, which UPower may push in
+	// more than one signal
+	state = 1; // Charging
+	timeToFull = 1200;
+	timeToEmpty = 0;
+	push("State", "TimeToEmpty", NULL);
+	percentage = 81;
+	iconName = "battery-full-charging-symbolic";
+	push("Percentage", "TimeToFull", "IconName", NULL);
+	settle();
+
+	g_assert_cmpuint(updates, ==, before + 1);
+	g_assert_cmpfloat(graphene_battery_info_get_percent(info), ==, 81);
+	g_assert_cmpstr(graphene_battery_info_get_state_string(info), ==, "Charging");
+	g_assert_cmpint(graphene_battery_info_get_time(info), ==, 1200);
+	gchar *icon = graphene_battery_info_get_icon_name(info);
+	g_assert_cmpstr(icon, ==, "battery-full-charging-symbolic");
+	g_free(icon);
+}
+
+static void test_unchanged_push_is_quiet(void)
+{
+	settle();
+	guint before = updates;
+	push("Percentage", "State", NULL);
+	settle();
+	g_assert_cmpuint(updates, ==, before);
+}
+
+static void test_no_polling(void)
+{
+	// The old implementation called Refresh every 10 seconds; now nothing
+	// but the proxy's initial GetAll (handled by GDBus) reaches the device
+	settle();
+	g_assert_cmpuint(methodCalls, ==, 0);
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+
+	// GTestDBus needs a dbus-daemon to run the private bus
+	gchar *daemon = g_find_program_in_path("dbus-daemon");
+	if(!daemon)
+		return 77;
+	g_free(daemon);
+
+	GTestDBus *bus = g_test_dbus_new(G_TEST_DBUS_NONE);
+	g_test_dbus_up(bus);
+	g_setenv("DBUS_SYSTEM_BUS_ADDRESS", g_test_dbus_get_bus_address(bus), TRUE);
+
+	upower = g_dbus_connection_new_for_address_sync(g_test_dbus_get_bus_address(bus),
+		G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT | G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION,
+		NULL, NULL, NULL);
+	g_assert_nonnull(upower);
+	GDBusNodeInfo *node = g_dbus_node_info_new_for_xml(deviceXml, NULL);
+	g_assert_nonnull(node);
+	g_assert_cmpuint(g_dbus_connection_register_object(upower, DEVICE_PATH, node->interfaces[0], &deviceVTable, NULL, NULL, NULL), !=, 0);
+	GVariant *r = g_dbus_connection_call_sync(upower, "org.freedesktop.DBus", "/org/freedesktop/DBus", "org.freedesktop.DBus",
+		"RequestName", g_variant_new("(su)", "org.freedesktop.UPower", 0), NULL, G_DBUS_CALL_FLAGS_NONE, -1, NULL, NULL);
+	g_assert_nonnull(r);
+	g_variant_unref(r);
+
+	info = graphene_battery_info_get_default();
+	g_signal_connect(info, "update", G_CALLBACK(on_update), NULL);
+
+	g_test_add_func("/battery/initial-state", test_initial_state);
+	g_test_add_func("/battery/pushed-changes-coalesce", test_pushed_changes_coalesce);
+	g_test_add_func("/battery/unchanged-push-is-quiet", test_unchanged_push_is_quiet);
+	g_test_add_func("/battery/no-polling", test_no_polling);
+	int ret = g_test_run();
+
+	g_object_unref(info);
+	g_dbus_node_info_unref(node);
+	g_dbus_connection_close_sync(upower, NULL, NULL);
+	g_object_unref(upower);
+	g_test_dbus_down(bus);
+	g_object_unref(bus);
+	return ret;
+}
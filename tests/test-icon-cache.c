@@ -0,0 +1,191 @@
+/*
+ * This file is part of graphene-desktop, the desktop environment of VeltOS.
+ * Copyright (C) 2016 Velt Technologies, Aidan Shafran <zelbrium@gmail.com>
+ * Licensed under the Apache License 2 <www.apache.org/licenses/LICENSE-2.0>.
+ *
+ * Checks CmkIconLoader's surface cache with a budget of four 32x32 icons,
+ * set through CMK_ICON_CACHE_SIZE: the least recently used surface is
+ * evicted first, the bytes in use always match the cached surfaces, and a
+ * surface loaded both synchronously and by an async job is only counted
+ * once.
+ */
+
+#include "cmk/cmk-icon-loader.h"
+#include <glib/gstdio.h>
+
+#define ICONS 6
+#define ICON_SIZE 32
+#define ICON_BYTES (ICON_SIZE * ICON_SIZE * 4) // ARGB32
+#define BUDGET_KIB 16 // Four icons
+
+static gchar *paths[ICONS];
+
+static void write_icon(const gchar *path, guint i)
+{
+	cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, ICON_SIZE, ICON_SIZE);
+	cairo_t *cr = cairo_create(surface);
+	cairo_set_source_rgb(cr, i / (gdouble)ICONS, 0, 0);
+	cairo_paint(cr);
+	cairo_destroy(cr);
+	g_assert_cmpint(cairo_surface_write_to_png(surface, path), ==, CAIRO_STATUS_SUCCESS);
+	cairo_surface_destroy(surface);
+}
+
+// Loads icon i through the cache, returning TRUE if it was already cached
+static gboolean load(CmkIconLoader *loader, guint i)
+{
+	guint hits, hitsAfter;
+	cmk_icon_loader_get_cache_stats(loader, &hits, NULL, NULL, NULL);
+	cairo_surface_t *surface = cmk_icon_loader_load(loader, paths[i], ICON_SIZE, 1, TRUE);
+	g_assert_nonnull(surface);
+	cairo_surface_destroy(surface);
+	cmk_icon_loader_get_cache_stats(loader, &hitsAfter, NULL, NULL, NULL);
+	return hitsAfter > hits;
+}
+
+static void assert_stats(CmkIconLoader *loader, guint evictions, gsize bytesUsed)
+{
+	guint e;
+	gsize b;
+	cmk_icon_loader_get_cache_stats(loader, NULL, NULL, &e, &b);
+	g_assert_cmpuint(e, ==, evictions);
+	g_assert_cmpuint(b, ==, bytesUsed);
+}
+
+static void test_budget_from_env(void)
+{
+	CmkIconLoader *loader = cmk_icon_loader_new();
+	g_assert_cmpuint(cmk_icon_loader_get_cache_size(loader), ==, BUDGET_KIB * 1024);
+	g_object_unref(loader);
+}
+
+static void test_lru_order(void)
+{
+	CmkIconLoader *loader = cmk_icon_loader_new();
+
+	for(guint i=0;i<4;++i)
+		g_assert_false(load(loader, i));
+	assert_stats(loader, 0, 4 * ICON_BYTES);
+
+	// Most to least recent: 0 3 2 1
+	g_assert_true(load(loader, 0));
+
+	// Evicts 1; now 4 0 3 2
+	g_assert_false(load(loader, 4));
+	assert_stats(loader, 1, 4 * ICON_BYTES);
+
+	// Hits don't evict; now 3 0 4 2
+	g_assert_true(load(loader, 4));
+	g_assert_true(load(loader, 0));
+	g_assert_true(load(loader, 3));
+	assert_stats(loader, 1, 4 * ICON_BYTES);
+
+	// Evicts 2, then 4; now 2 1 3 0
+	g_assert_false(load(loader, 1));
+	g_assert_false(load(loader, 2));
+	assert_stats(loader, 3, 4 * ICON_BYTES);
+	g_assert_true(load(loader, 0));
+	g_assert_true(load(loader, 3));
+	g_assert_true(load(loader, 1));
+	g_assert_true(load(loader, 2));
+	assert_stats(loader, 3, 4 * ICON_BYTES);
+
+	// Now 2 1 3 0. Shrinking keeps the two most recent.
+	cmk_icon_loader_set_cache_size(loader, 2 * ICON_BYTES);
+	assert_stats(loader, 5, 2 * ICON_BYTES);
+	g_assert_true(load(loader, 2));
+	g_assert_true(load(loader, 1));
+	assert_stats(loader, 5, 2 * ICON_BYTES);
+
+	// A surface larger than the whole budget isn't cached
+	cmk_icon_loader_set_cache_size(loader, ICON_BYTES - 1);
+	assert_stats(loader, 7, 0);
+	g_assert_false(load(loader, 5));
+	g_assert_false(load(loader, 5));
+	assert_stats(loader, 7, 0);
+
+	g_object_unref(loader);
+}
+
+static void on_loaded(CmkIconLoader *loader, GAsyncResult *result, gboolean *done)
+{
+	cairo_surface_t *surface = cmk_icon_loader_load_finish(loader, result, NULL);
+	g_assert_nonnull(surface);
+	cairo_surface_destroy(surface);
+	*done = TRUE;
+}
+
+static void test_duplicate_key(void)
+{
+	CmkIconLoader *loader = cmk_icon_loader_new();
+
+	// The async job and the sync load both load icon 0 and try to cache it
+	gboolean done = FALSE;
+	cmk_icon_loader_load_async(loader, paths[0], ICON_SIZE, 1, TRUE, NULL, (GAsyncReadyCallback)on_loaded, &done);
+	g_assert_false(load(loader, 0));
+	while(!done)
+		g_main_context_iteration(NULL, TRUE);
+	assert_stats(loader, 0, ICON_BYTES);
+
+	// If the second insert had added an entry, filling the cache would
+	// evict one more surface than it should, and leave bytes behind
+	for(guint i=1;i<4;++i)
+		g_assert_false(load(loader, i));
+	assert_stats(loader, 0, 4 * ICON_BYTES);
+	g_assert_false(load(loader, 4));
+	g_assert_false(load(loader, 5));
+	assert_stats(loader, 2, 4 * ICON_BYTES);
+	g_assert_false(load(loader, 0));
+	assert_stats(loader, 3, 4 * ICON_BYTES);
+
+	cmk_icon_loader_set_cache_size(loader, 0);
+	assert_stats(loader, 7, 0);
+
+	g_object_unref(loader);
+}
+
+int main(int argc, char **argv)
+{
+	// Before GLib caches the real directories
+	gchar *home = g_dir_make_tmp("graphene-test-XXXXXX", NULL);
+	g_assert(home);
+	gchar *cache = g_build_filename(home, "cache", NULL);
+	g_setenv("HOME", home, TRUE);
+	g_setenv("XDG_CACHE_HOME", cache, TRUE);
+	g_setenv("GSETTINGS_BACKEND", "memory", TRUE);
+	g_setenv("CMK_ICON_CACHE_SIZE", G_STRINGIFY(BUDGET_KIB), TRUE);
+
+	// CmkIconLoader follows the desktop's settings, which need the schema
+	GSettingsSchemaSource *source = g_settings_schema_source_get_default();
+	GSettingsSchema *schema = source ? g_settings_schema_source_lookup(source, "org.gnome.desktop.interface", TRUE) : NULL;
+	if(!schema)
+	{
+		g_rmdir(home);
+		return 77;
+	}
+	g_settings_schema_unref(schema);
+
+	for(guint i=0;i<ICONS;++i)
+	{
+		gchar *name = g_strdup_printf("icon-%u.png", i);
+		paths[i] = g_build_filename(home, name, NULL);
+		g_free(name);
+		write_icon(paths[i], i);
+	}
+
+	g_test_init(&argc, &argv, NULL);
+	g_test_add_func("/icon-cache/budget-from-env", test_budget_from_env);
+	g_test_add_func("/icon-cache/lru-order", test_lru_order);
+	g_test_add_func("/icon-cache/duplicate-key", test_duplicate_key);
+	int r = g_test_run();
+
+	for(guint i=0;i<ICONS;++i)
+	{
+		g_remove(paths[i]);
+		g_free(paths[i]);
+	}
+	g_rmdir(home);
+	g_free(cache);
+	g_free(home);
+	return r;
+}
@@ -0,0 +1,219 @@
+/*
+ * This file is part of graphene-desktop, the desktop environment of VeltOS.
+ * Copyright (C) 2016 Velt Technologies, Aidan Shafran <zelbrium@gmail.com>
+ * Licensed under the Apache License 2 <www.apache.org/licenses/LICENSE-2.0>.
+ *
+ * Checks that icon lookups through CmkIconLoader's on-disk theme index give
+ * the same results as lookups in the GTree built by scanning the theme, on a
+ * synthetic theme in a temporary $HOME/.icons. Also checks that a change to
+ * a theme directory within the same second as indexing invalidates it.
+ */
+
+#include "cmk/cmk-icon-loader.h"
+#include <glib/gstdio.h>
+#include <string.h>
+
+#define THEME "graphene-test"
+#define NUM_ICONS 200
+
+typedef struct
+{
+	const gchar *where;
+	const gchar *keys;
+	guint every; // Directory has every nth icon
+} Group;
+
+// Includes a group with no section and one with no directory, which both
+// have to keep their place in the index's group numbering
+static const Group groups[] = {
+	{"16x16/apps", "Size=16\nType=Fixed\n", 2},
+	{"22x22/apps", "Size=22\nType=Threshold\nThreshold=3\n", 3},
+	{"no-section/apps", NULL, 1},
+	{"32x32@2/apps", "Size=32\nScale=2\nType=Fixed\n", 4},
+	{"48x48/apps", "Size=48\nType=Fixed\n", 5},
+	{"64x64/apps", "Size=64\nType=Fixed\n", 0},
+	{"scalable/apps", "Size=48\nMinSize=8\nMaxSize=512\nType=Scalable\n", 3},
+};
+
+static const guint sizes[] = {8, 16, 20, 22, 24, 32, 48, 64, 96, 256};
+
+static gchar *themeDir;
+
+static void write_file(const gchar *path, const gchar *contents)
+{
+	gchar *dir = g_path_get_dirname(path);
+	g_assert_cmpint(g_mkdir_with_parents(dir, 0755), ==, 0);
+	g_assert(g_file_set_contents(path, contents, -1, NULL));
+	g_free(dir);
+}
+
+static void create_theme(void)
+{
+	GString *index = g_string_new("[Icon Theme]\nName=Graphene Test\nDirectories=");
+	for(guint i=0;i<G_N_ELEMENTS(groups);++i)
+		g_string_append_printf(index, "%s%s", i ? "," : "", groups[i].where);
+	g_string_append(index, "\n");
+
+	for(guint i=0;i<G_N_ELEMENTS(groups);++i)
+	{
+		if(groups[i].keys)
+			g_string_append_printf(index, "\n[%s]\n%s", groups[i].where, groups[i].keys);
+		if(!groups[i].every)
+			continue;
+		for(guint j=0;j<NUM_ICONS;j+=groups[i].every)
+		{
+			// Some icons as png, some as svg, some as both, plus files
+			// the loader should ignore
+			static const gchar *exts[] = {"png", "svg", "xpm"};
+			gchar *path = g_strdup_printf("%s/%s/icon-%u.%s", themeDir, groups[i].where, j, exts[j % 3]);
+			write_file(path, "");
+			g_free(path);
+			if(j % 7 == 0)
+			{
+				path = g_strdup_printf("%s/%s/icon-%u.svg", themeDir, groups[i].where, j);
+				write_file(path, "");
+				g_free(path);
+			}
+		}
+	}
+
+	gchar *path = g_build_filename(themeDir, "index.theme", NULL);
+	write_file(path, index->str);
+	g_free(path);
+	g_string_free(index, TRUE);
+}
+
+static gchar * get_index_path(void)
+{
+	return g_build_filename(g_get_user_cache_dir(), "graphene", "icons", THEME ".index", NULL);
+}
+
+static gint64 get_mtime(const gchar *path)
+{
+	GStatBuf buf;
+	if(g_stat(path, &buf) != 0)
+		return -1;
+	return (gint64)buf.st_mtim.tv_sec * 1000000000 + buf.st_mtim.tv_nsec;
+}
+
+// Every lookup the test compares, including misses, as one list of paths
+static GPtrArray * lookup_all(CmkIconLoader *loader)
+{
+	GPtrArray *results = g_ptr_array_new_with_free_func(g_free);
+	for(guint i=0;i<NUM_ICONS+10;++i)
+	{
+		gchar *name = g_strdup_printf("icon-%u", i);
+		for(guint j=0;j<G_N_ELEMENTS(sizes);++j)
+			for(guint scale=1;scale<=2;++scale)
+				g_ptr_array_add(results, cmk_icon_loader_lookup_full(loader, name, FALSE, THEME, FALSE, sizes[j], scale));
+		g_free(name);
+	}
+	return results;
+}
+
+static void test_index_matches_scan(void)
+{
+	gchar *indexPath = get_index_path();
+	g_unlink(indexPath);
+
+	// No index yet, so this one scans the theme into its GTree and writes
+	// the index
+	CmkIconLoader *scanned = cmk_icon_loader_new();
+	GPtrArray *expected = lookup_all(scanned);
+	g_object_unref(scanned);
+	gint64 indexMtime = get_mtime(indexPath);
+	g_assert_cmpint(indexMtime, >, 0);
+
+	guint found = 0;
+	for(guint i=0;i<expected->len;++i)
+		if(g_ptr_array_index(expected, i))
+			++found;
+	g_assert_cmpuint(found, >, 0);
+	g_assert_cmpuint(found, <, expected->len);
+
+	// This one reads from the index, which it must not rewrite
+	CmkIconLoader *indexed = cmk_icon_loader_new();
+	GPtrArray *actual = lookup_all(indexed);
+	g_object_unref(indexed);
+	g_assert_cmpint(get_mtime(indexPath), ==, indexMtime);
+
+	g_assert_cmpuint(actual->len, ==, expected->len);
+	for(guint i=0;i<expected->len;++i)
+		g_assert_cmpstr(g_ptr_array_index(actual, i), ==, g_ptr_array_index(expected, i));
+
+	g_ptr_array_unref(expected);
+	g_ptr_array_unref(actual);
+	g_free(indexPath);
+}
+
+static void test_index_invalidated(void)
+{
+	CmkIconLoader *loader = cmk_icon_loader_new();
+	g_assert_null(cmk_icon_loader_lookup_full(loader, "icon-new", FALSE, THEME, FALSE, 16, 1));
+	g_object_unref(loader);
+
+	// Almost certainly within the same second as the index was written
+	gchar *path = g_strdup_printf("%s/16x16/apps/icon-new.png", themeDir);
+	write_file(path, "");
+
+	loader = cmk_icon_loader_new();
+	gchar *found = cmk_icon_loader_lookup_full(loader, "icon-new", FALSE, THEME, FALSE, 16, 1);
+	g_object_unref(loader);
+	g_assert_nonnull(found);
+	g_assert(g_str_has_suffix(found, "/16x16/apps/icon-new.png"));
+	g_free(found);
+	g_unlink(path);
+	g_free(path);
+}
+
+static void remove_tree(const gchar *path)
+{
+	GDir *dir = g_dir_open(path, 0, NULL);
+	if(dir)
+	{
+		const gchar *name;
+		while((name = g_dir_read_name(dir)))
+		{
+			gchar *child = g_build_filename(path, name, NULL);
+			remove_tree(child);
+			g_free(child);
+		}
+		g_dir_close(dir);
+	}
+	g_remove(path);
+}
+
+int main(int argc, char **argv)
+{
+	// Before GLib caches the real directories
+	gchar *home = g_dir_make_tmp("graphene-test-XXXXXX", NULL);
+	g_assert(home);
+	gchar *cache = g_build_filename(home, "cache", NULL);
+	g_setenv("HOME", home, TRUE);
+	g_setenv("XDG_CACHE_HOME", cache, TRUE);
+	g_setenv("GSETTINGS_BACKEND", "memory", TRUE);
+
+	// CmkIconLoader follows the desktop's settings, which need the schema
+	GSettingsSchemaSource *source = g_settings_schema_source_get_default();
+	GSettingsSchema *schema = source ? g_settings_schema_source_lookup(source, "org.gnome.desktop.interface", TRUE) : NULL;
+	if(!schema)
+	{
+		remove_tree(home);
+		return 77;
+	}
+	g_settings_schema_unref(schema);
+
+	themeDir = g_build_filename(home, ".icons", THEME, NULL);
+	create_theme();
+
+	g_test_init(&argc, &argv, NULL);
+	g_test_add_func("/icon-index/matches-scan", test_index_matches_scan);
+	g_test_add_func("/icon-index/invalidated", test_index_invalidated);
+	int r = g_test_run();
+
+	remove_tree(home);
+	g_free(themeDir);
+	g_free(cache);
+	g_free(home);
+	return r;
+}
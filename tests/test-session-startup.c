@@ -0,0 +1,333 @@
+/*
+ * This file is part of graphene-desktop, the desktop environment of VeltOS.
+ * Copyright (C) 2016 Velt Technologies, Aidan Shafran <zelbrium@gmail.com>
+ * Licensed under the Apache License 2 <www.apache.org/licenses/LICENSE-2.0>.
+ *
+ * Runs the session's startup on a private bus, which is used as both the
+ * session and system bus, with stand-ins for logind and the PolicyKit
+ * authority. The autostarts run /bin/true and sleep in each startup phase.
+ * The startup trace is checked for the phases running in order, each
+ * waiting for its clients to exit, and a phase whose client never becomes
+ * ready ending at its deadline.
+ */
+
+#include "session.h"
+#include <gio/gio.h>
+#include <glib/gstdio.h>
+
+#define PANEL_DEADLINE 10 // Seconds, from StartupPhases in session.c
+
+static const gchar *standInXml =
+	"<node>"
+	"  <interface name='org.freedesktop.login1.Manager'>"
+	"    <method name='GetSessionByPID'>"
+	"      <arg name='pid' type='u' direction='in'/>"
+	"      <arg name='session' type='o' direction='out'/>"
+	"    </method>"
+	"  </interface>"
+	"  <interface name='org.freedesktop.PolicyKit1.Authority'>"
+	"    <method name='RegisterAuthenticationAgent'>"
+	"      <arg name='subject' type='(sa{sv})' direction='in'/>"
+	"      <arg name='locale' type='s' direction='in'/>"
+	"      <arg name='path' type='s' direction='in'/>"
+	"    </method>"
+	"  </interface>"
+	"</node>";
+
+// Name, Exec and X-GNOME-Autostart-Phase (NULL for Applications)
+static const gchar *autostarts[][3] = {
+	{"init-true", "/bin/true", "Initialization"},
+	{"init-sleep", "sleep 1", "Initialization"},
+	{"wm", "/bin/true", "WindowManager"},
+	{"panel-hang", "sleep 60", "Panel"},
+	{"desktop-true", "/bin/true", "Desktop"},
+	{"app-sleep", "sleep 60", NULL},
+};
+
+static gchar *tmp, *tracePath;
+static guint startups = 0, quits = 0;
+static gboolean quitFailed = FALSE;
+
+static void on_method_call(GDBusConnection *connection, const gchar *sender, const gchar *path, const gchar *iface, const gchar *method, GVariant *params, GDBusMethodInvocation *invocation, gpointer userdata)
+{
+	if(g_strcmp0(method, "GetSessionByPID") == 0)
+		g_dbus_method_invocation_return_value(invocation, g_variant_new("(o)", "/org/freedesktop/login1/session/test"));
+	else
+		g_dbus_method_invocation_return_value(invocation, NULL);
+}
+
+static const GDBusInterfaceVTable standInVTable = {on_method_call, NULL, NULL};
+
+static void on_startup_complete(gpointer userdata)
+{
+	++startups;
+}
+
+static void on_dialog(ClutterActor *dialog, gpointer userdata)
+{
+	g_assert_not_reached();
+}
+
+static void on_quit(gboolean failed, gpointer userdata)
+{
+	++quits;
+	quitFailed = failed;
+}
+
+static void write_autostarts(const gchar *dir)
+{
+	gchar *autostartDir = g_build_filename(dir, "autostart", NULL);
+	g_assert_cmpint(g_mkdir_with_parents(autostartDir, 0700), ==, 0);
+	for(guint i=0;i<G_N_ELEMENTS(autostarts);++i)
+	{
+		gchar *name = g_strdup_printf("%s.desktop", autostarts[i][0]);
+		gchar *path = g_build_filename(autostartDir, name, NULL);
+		gchar *contents = g_strdup_printf("[Desktop Entry]\nType=Application\nName=%s\nExec=%s\n%s%s\n",
+			autostarts[i][0], autostarts[i][1],
+			autostarts[i][2] ? "X-GNOME-Autostart-Phase=" : "",
+			autostarts[i][2] ? autostarts[i][2] : "");
+		g_assert_true(g_file_set_contents(path, contents, -1, NULL));
+		g_free(contents);
+		g_free(path);
+		g_free(name);
+	}
+	g_free(autostartDir);
+}
+
+typedef struct
+{
+	gchar *name;
+	gchar *cat;
+	gchar type;
+	gint64 ts;
+} TraceEvent;
+
+// The trace has one event per line
+static GArray * read_trace(void)
+{
+	gchar *contents = NULL;
+	g_assert_true(g_file_get_contents(tracePath, &contents, NULL, NULL));
+	GRegex *regex = g_regex_new("^\\{\"name\":\"([^\"]*)\",\"cat\":\"(\\w+)\",\"ph\":\"(\\w)\",\"ts\":(\\d+)", G_REGEX_MULTILINE, 0, NULL);
+	GArray *events = g_array_new(FALSE, FALSE, sizeof(TraceEvent));
+	GMatchInfo *match;
+	g_regex_match(regex, contents, 0, &match);
+	for(;g_match_info_matches(match);g_match_info_next(match, NULL))
+	{
+		TraceEvent event;
+		event.name = g_match_info_fetch(match, 1);
+		event.cat = g_match_info_fetch(match, 2);
+		gchar *type = g_match_info_fetch(match, 3);
+		gchar *ts = g_match_info_fetch(match, 4);
+		event.type = type[0];
+		event.ts = g_ascii_strtoll(ts, NULL, 10);
+		g_free(type);
+		g_free(ts);
+		g_array_append_val(events, event);
+	}
+	g_match_info_free(match);
+	g_regex_unref(regex);
+	g_free(contents);
+	return events;
+}
+
+// Returns the index of the event, failing if there isn't exactly one
+static guint find_event(GArray *events, const gchar *name, gchar type)
+{
+	guint found = G_MAXUINT;
+	for(guint i=0;i<events->len;++i)
+	{
+		TraceEvent *event = &g_array_index(events, TraceEvent, i);
+		if(event->type != type || g_strcmp0(event->name, name) != 0)
+			continue;
+		if(found != G_MAXUINT)
+			g_error("More than one '%c' event for %s", type, name);
+		found = i;
+	}
+	if(found == G_MAXUINT)
+		g_error("No '%c' event for %s", type, name);
+	return found;
+}
+
+static gint64 event_ts(GArray *events, guint i)
+{
+	return g_array_index(events, TraceEvent, i).ts;
+}
+
+// The Panel phase is expected to miss its deadline
+static gboolean on_fatal_log(const gchar *domain, GLogLevelFlags level, const gchar *message, gpointer userdata)
+{
+	return !g_str_has_prefix(message, "Startup phase Panel did not complete");
+}
+
+static gboolean on_timeout(gboolean *timedOut)
+{
+	*timedOut = TRUE;
+	return G_SOURCE_REMOVE;
+}
+
+static void test_startup_order(void)
+{
+	graphene_session_init(on_startup_complete, on_dialog, on_quit, NULL);
+
+	gboolean timedOut = FALSE;
+	guint timeout = g_timeout_add_seconds(PANEL_DEADLINE + 20, (GSourceFunc)on_timeout, &timedOut);
+	while(startups == 0 && quits == 0 && !timedOut)
+		g_main_context_iteration(NULL, TRUE);
+	g_assert_false(timedOut);
+	g_source_remove(timeout);
+	g_assert_cmpuint(quits, ==, 0);
+	g_assert_cmpuint(startups, ==, 1);
+
+	// The trace is written once the applications are launched
+	while(g_main_context_iteration(NULL, FALSE));
+	GArray *events = read_trace();
+
+	// Phases begin and end in order, without overlapping
+	static const gchar *phases[] = {"Initialization", "WindowManager", "Panel", "Desktop"};
+	guint prevEnd = 0;
+	for(guint i=0;i<G_N_ELEMENTS(phases);++i)
+	{
+		guint begin = find_event(events, phases[i], 'B');
+		guint end = find_event(events, phases[i], 'E');
+		if(i > 0)
+			g_assert_cmpuint(begin, >, prevEnd);
+		g_assert_cmpuint(end, >, begin);
+		prevEnd = end;
+	}
+
+	// Initialization waits for both of its clients to exit, which takes
+	// about a second
+	guint initEnd = find_event(events, "Initialization", 'E');
+	g_assert_cmpuint(find_event(events, "init-true", 'b'), <, initEnd);
+	g_assert_cmpuint(find_event(events, "init-true", 'e'), <, initEnd);
+	g_assert_cmpuint(find_event(events, "init-sleep", 'b'), <, initEnd);
+	g_assert_cmpuint(find_event(events, "init-sleep", 'e'), <, initEnd);
+	g_assert_cmpint(event_ts(events, initEnd), >=, G_USEC_PER_SEC);
+	g_assert_cmpint(event_ts(events, initEnd), <, 5 * G_USEC_PER_SEC);
+
+	// Graphene is the window manager, so the WindowManager autostart
+	// isn't run
+	for(guint i=0;i<events->len;++i)
+		g_assert_cmpstr(g_array_index(events, TraceEvent, i).name, !=, "wm");
+
+	// The Panel client never becomes ready, so the phase ends at its
+	// deadline, when the session stops waiting for the client. Seconds
+	// timeouts are rounded, so allow a second early.
+	guint panelBegin = find_event(events, "Panel", 'B');
+	guint panelEnd = find_event(events, "Panel", 'E');
+	guint hangBegin = find_event(events, "panel-hang", 'b');
+	guint hangEnd = find_event(events, "panel-hang", 'e');
+	g_assert_cmpuint(hangBegin, >, panelBegin);
+	g_assert_cmpuint(hangEnd, <, panelEnd);
+	gint64 panelTime = event_ts(events, panelEnd) - event_ts(events, panelBegin);
+	g_assert_cmpint(panelTime, >=, (PANEL_DEADLINE - 1) * G_USEC_PER_SEC);
+	g_assert_cmpint(panelTime, <=, (PANEL_DEADLINE + 2) * G_USEC_PER_SEC);
+
+	// Desktop clients start only after the Panel phase
+	guint desktopBegin = find_event(events, "Desktop", 'B');
+	guint desktopEnd = find_event(events, "Desktop", 'E');
+	g_assert_cmpuint(find_event(events, "desktop-true", 'b'), >, desktopBegin);
+	g_assert_cmpuint(find_event(events, "desktop-true", 'e'), <, desktopEnd);
+
+	// Applications are launched once the session is running, and aren't
+	// waited on
+	g_assert_cmpuint(find_event(events, "app-sleep", 'i'), >, desktopEnd);
+
+	for(guint i=0;i<events->len;++i)
+	{
+		g_free(g_array_index(events, TraceEvent, i).name);
+		g_free(g_array_index(events, TraceEvent, i).cat);
+	}
+	g_array_unref(events);
+
+	// Exiting kills the remaining clients
+	graphene_session_exit();
+	g_assert_cmpuint(quits, ==, 1);
+	g_assert_true(quitFailed);
+}
+
+static void remove_tree(const gchar *path)
+{
+	GDir *dir = g_dir_open(path, 0, NULL);
+	if(dir)
+	{
+		const gchar *name;
+		while((name = g_dir_read_name(dir)))
+		{
+			gchar *child = g_build_filename(path, name, NULL);
+			remove_tree(child);
+			g_free(child);
+		}
+		g_dir_close(dir);
+	}
+	g_remove(path);
+}
+
+int main(int argc, char **argv)
+{
+	// Before GLib caches the real directories
+	tmp = g_dir_make_tmp("graphene-test-XXXXXX", NULL);
+	g_assert(tmp);
+	gchar *systemConfig = g_build_filename(tmp, "xdg", NULL);
+	gchar *userConfig = g_build_filename(tmp, "config", NULL);
+	tracePath = g_build_filename(tmp, "startup-trace.json", NULL);
+	g_setenv("HOME", tmp, TRUE);
+	g_setenv("XDG_CONFIG_DIRS", systemConfig, TRUE);
+	g_setenv("XDG_CONFIG_HOME", userConfig, TRUE);
+	g_setenv("GRAPHENE_STARTUP_TRACE", tracePath, TRUE);
+	write_autostarts(systemConfig);
+
+	// The session warns about config directories without an autostart
+	// directory, and warnings are fatal in tests
+	gchar *userAutostart = g_build_filename(userConfig, "autostart", NULL);
+	g_assert_cmpint(g_mkdir_with_parents(userAutostart, 0700), ==, 0);
+	g_free(userAutostart);
+
+	g_test_init(&argc, &argv, NULL);
+	g_test_log_set_fatal_handler(on_fatal_log, NULL);
+
+	// GTestDBus needs a dbus-daemon to run the private bus
+	gchar *daemon = g_find_program_in_path("dbus-daemon");
+	if(!daemon)
+	{
+		remove_tree(tmp);
+		return 77;
+	}
+	g_free(daemon);
+
+	GTestDBus *bus = g_test_dbus_new(G_TEST_DBUS_NONE);
+	g_test_dbus_up(bus);
+	g_setenv("DBUS_SYSTEM_BUS_ADDRESS", g_test_dbus_get_bus_address(bus), TRUE);
+
+	GDBusConnection *standIn = g_dbus_connection_new_for_address_sync(g_test_dbus_get_bus_address(bus),
+		G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT | G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION,
+		NULL, NULL, NULL);
+	g_assert_nonnull(standIn);
+	GDBusNodeInfo *node = g_dbus_node_info_new_for_xml(standInXml, NULL);
+	g_assert_nonnull(node);
+	g_assert_cmpuint(g_dbus_connection_register_object(standIn, "/org/freedesktop/login1", node->interfaces[0], &standInVTable, NULL, NULL, NULL), !=, 0);
+	g_assert_cmpuint(g_dbus_connection_register_object(standIn, "/org/freedesktop/PolicyKit1/Authority", node->interfaces[1], &standInVTable, NULL, NULL, NULL), !=, 0);
+	static const gchar *names[] = {"org.freedesktop.login1", "org.freedesktop.PolicyKit1"};
+	for(guint i=0;i<G_N_ELEMENTS(names);++i)
+	{
+		GVariant *r = g_dbus_connection_call_sync(standIn, "org.freedesktop.DBus", "/org/freedesktop/DBus", "org.freedesktop.DBus",
+			"RequestName", g_variant_new("(su)", names[i], 0), NULL, G_DBUS_CALL_FLAGS_NONE, -1, NULL, NULL);
+		g_assert_nonnull(r);
+		g_variant_unref(r);
+	}
+
+	g_test_add_func("/session/startup-order", test_startup_order);
+	int ret = g_test_run();
+
+	g_dbus_node_info_unref(node);
+	g_dbus_connection_close_sync(standIn, NULL, NULL);
+	g_object_unref(standIn);
+	g_test_dbus_down(bus);
+	g_object_unref(bus);
+	remove_tree(tmp);
+	g_free(tracePath);
+	g_free(userConfig);
+	g_free(systemConfig);
+	g_free(tmp);
+	return ret;
+}
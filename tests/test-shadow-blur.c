@@ -0,0 +1,83 @@
+/*
+ * This file is part of graphene-desktop, the desktop environment of VeltOS.
+ * Copyright (C) 2016 Velt Technologies, Aidan Shafran <zelbrium@gmail.com>
+ * Licensed under the Apache License 2 <www.apache.org/licenses/LICENSE-2.0>.
+ *
+ * Compares CmkShadow's fixed-point shadow renderer with the original float
+ * renderer in shadow-reference.c, for every radius from 1 to MAX_RADIUS and
+ * every edge mask, at the template size CmkShadow renders. Each pixel's
+ * alpha must be within 1 of the reference, and its color channels must be
+ * 0, since the shadow is premultiplied black.
+ */
+
+// render_shadow is private to shadow.c
+#include "cmk/shadow.c"
+#include "shadow-reference.h"
+
+#define MAX_RADIUS 60
+
+// Returns the largest alpha difference from the reference
+static guint compare(guint radius, guint mask)
+{
+	guint size = radius*4 + 2;
+	guint32 *pixels = g_new(guint32, size*size);
+	guchar *alpha = g_new(guchar, size*size);
+	render_shadow(pixels, size, size, radius, mask);
+	reference_render_shadow(alpha, size, size, radius, mask);
+
+	guint maxDiff = 0;
+	for(guint i=0;i<size*size;++i)
+	{
+		if((pixels[i] & 0x00FFFFFF) != 0)
+			g_error("radius %u mask %u: pixel %u has color 0x%08x", radius, mask, i, pixels[i]);
+		guint a = pixels[i] >> 24;
+		maxDiff = MAX(maxDiff, (guint)ABS((gint)a - (gint)alpha[i]));
+	}
+	g_free(pixels);
+	g_free(alpha);
+	return maxDiff;
+}
+
+static void test_matches_reference(void)
+{
+	guint maxDiff = 0;
+	for(guint radius=1;radius<=MAX_RADIUS;++radius)
+	{
+		for(guint mask=0;mask<=CMK_SHADOW_MASK_ALL;++mask)
+		{
+			guint diff = compare(radius, mask);
+			if(diff > 1)
+				g_error("radius %u mask %u: alpha differs from the reference by %u", radius, mask, diff);
+			maxDiff = MAX(maxDiff, diff);
+		}
+	}
+	g_test_message("Largest alpha difference: %u", maxDiff);
+}
+
+// A non-square buffer, as render_shadow allows
+static void test_rectangle(void)
+{
+	guint width = 97, height = 41, radius = 9;
+	guint32 *pixels = g_new(guint32, width*height);
+	guchar *alpha = g_new(guchar, width*height);
+	for(guint mask=0;mask<=CMK_SHADOW_MASK_ALL;++mask)
+	{
+		render_shadow(pixels, width, height, radius, mask);
+		reference_render_shadow(alpha, width, height, radius, mask);
+		for(guint i=0;i<width*height;++i)
+		{
+			g_assert_cmpuint(pixels[i] & 0x00FFFFFF, ==, 0);
+			g_assert_cmpint(ABS((gint)(pixels[i] >> 24) - (gint)alpha[i]), <=, 1);
+		}
+	}
+	g_free(pixels);
+	g_free(alpha);
+}
+
+int main(int argc, char **argv)
+{
+	g_test_init(&argc, &argv, NULL);
+	g_test_add_func("/shadow-blur/matches-reference", test_matches_reference);
+	g_test_add_func("/shadow-blur/rectangle", test_rectangle);
+	return g_test_run();
+}
@@ -0,0 +1,168 @@
+/*
+ * This file is part of graphene-desktop, the desktop environment of VeltOS.
+ * Copyright (C) 2016 Velt Technologies, Aidan Shafran <zelbrium@gmail.com>
+ * Licensed under the Apache License 2 <www.apache.org/licenses/LICENSE-2.0>.
+ *
+ * Opens and closes 1,000 fake windows in a GrapheneTasklist, checking that
+ * every button stays linked to its own window in both directions, including
+ * when a closed window's address is reused for a new one. The tasklist isn't
+ * on a stage, so buttons are added and removed without animating.
+ */
+
+#include "panel-internal.h"
+#include "cmk/button.h"
+#include <string.h>
+
+#define WINDOWS 1000
+
+typedef struct
+{
+	GrapheneWindow window;
+	guint shown, minimized;
+} FakeWindow;
+
+static FakeWindow windows[WINDOWS];
+
+static void fake_show(GrapheneWindow *window)
+{
+	++((FakeWindow *)window)->shown;
+}
+
+static void fake_minimize(GrapheneWindow *window)
+{
+	++((FakeWindow *)window)->minimized;
+}
+
+static void fake_set_icon_box(GrapheneWindow *window, double x, double y, double width, double height)
+{
+}
+
+static void fake_window_init(FakeWindow *fake, GrapheneWindowFlags flags)
+{
+	memset(fake, 0, sizeof(FakeWindow));
+	fake->window.title = "Window";
+	fake->window.flags = flags;
+	fake->window.show = fake_show;
+	fake->window.minimize = fake_minimize;
+	fake->window.setIconBox = fake_set_icon_box;
+}
+
+/*
+ * Activates every button in the tasklist, and checks that each one reached
+ * exactly one of the open windows, once. open is indexed like windows.
+ */
+static void check_buttons(GrapheneTasklist *tasklist, const gboolean *open)
+{
+	guint numOpen = 0;
+	for(guint i=0;i<WINDOWS;++i)
+	{
+		windows[i].shown = windows[i].minimized = 0;
+		if(open[i])
+			++numOpen;
+	}
+	g_assert_cmpint(clutter_actor_get_n_children(CLUTTER_ACTOR(tasklist)), ==, numOpen);
+
+	ClutterActorIter iter;
+	ClutterActor *child;
+	clutter_actor_iter_init(&iter, CLUTTER_ACTOR(tasklist));
+	while(clutter_actor_iter_next(&iter, &child))
+		g_signal_emit_by_name(child, "activate");
+
+	for(guint i=0;i<WINDOWS;++i)
+	{
+		gboolean focused = windows[i].window.flags & GRAPHENE_WINDOW_FLAG_FOCUSED;
+		g_assert_cmpuint(windows[i].shown, ==, (open[i] && !focused) ? 1 : 0);
+		g_assert_cmpuint(windows[i].minimized, ==, (open[i] && focused) ? 1 : 0);
+	}
+}
+
+static void test_open_close(void)
+{
+	GrapheneTasklist *tasklist = graphene_tasklist_new(24);
+	g_object_ref_sink(tasklist);
+	gboolean open[WINDOWS] = {0};
+
+	GTimer *timer = g_timer_new();
+	for(guint i=0;i<WINDOWS;++i)
+	{
+		// Every 10th is focused, and every 50th isn't on the taskbar
+		GrapheneWindowFlags flags = (i % 10 == 0) ? GRAPHENE_WINDOW_FLAG_FOCUSED : 0;
+		if(i % 50 == 1)
+			flags |= GRAPHENE_WINDOW_FLAG_SKIP_TASKBAR;
+		fake_window_init(&windows[i], flags);
+		graphene_tasklist_add_window(tasklist, &windows[i].window);
+		open[i] = !(flags & GRAPHENE_WINDOW_FLAG_SKIP_TASKBAR);
+	}
+	g_test_message("Opened %u windows in %.1f ms", WINDOWS, g_timer_elapsed(timer, NULL) * 1000);
+	check_buttons(tasklist, open);
+
+	// Close every other window
+	g_timer_start(timer);
+	for(guint i=0;i<WINDOWS;i+=2)
+	{
+		graphene_tasklist_remove_window(tasklist, &windows[i].window);
+		open[i] = FALSE;
+	}
+	g_test_message("Closed %u windows in %.1f ms", WINDOWS / 2, g_timer_elapsed(timer, NULL) * 1000);
+	check_buttons(tasklist, open);
+
+	// Closing a closed window does nothing
+	graphene_tasklist_remove_window(tasklist, &windows[0].window);
+	check_buttons(tasklist, open);
+
+	// New windows at the closed windows' addresses get their own buttons
+	for(guint i=0;i<WINDOWS;i+=4)
+	{
+		fake_window_init(&windows[i], 0);
+		graphene_tasklist_add_window(tasklist, &windows[i].window);
+		open[i] = TRUE;
+	}
+	check_buttons(tasklist, open);
+
+	// Windows joining and leaving the taskbar through updates
+	for(guint i=1;i<WINDOWS;i+=50)
+	{
+		windows[i].window.flags &= ~GRAPHENE_WINDOW_FLAG_SKIP_TASKBAR;
+		graphene_tasklist_update_window(tasklist, &windows[i].window);
+		open[i] = TRUE;
+	}
+	for(guint i=3;i<WINDOWS;i+=50)
+	{
+		windows[i].window.flags |= GRAPHENE_WINDOW_FLAG_SKIP_TASKBAR;
+		graphene_tasklist_update_window(tasklist, &windows[i].window);
+		open[i] = FALSE;
+	}
+	check_buttons(tasklist, open);
+
+	// Close everything else, newest first
+	g_timer_start(timer);
+	for(guint i=WINDOWS;i>0;--i)
+	{
+		graphene_tasklist_remove_window(tasklist, &windows[i-1].window);
+		open[i-1] = FALSE;
+	}
+	g_test_message("Closed the rest in %.1f ms", g_timer_elapsed(timer, NULL) * 1000);
+	check_buttons(tasklist, open);
+
+	g_timer_destroy(timer);
+	clutter_actor_destroy(CLUTTER_ACTOR(tasklist));
+	g_object_unref(tasklist);
+}
+
+int main(int argc, char **argv)
+{
+	// Window buttons have icons, which follow the desktop's settings
+	g_setenv("GSETTINGS_BACKEND", "memory", TRUE);
+	GSettingsSchemaSource *source = g_settings_schema_source_get_default();
+	GSettingsSchema *schema = source ? g_settings_schema_source_lookup(source, "org.gnome.desktop.interface", TRUE) : NULL;
+	if(!schema)
+		return 77;
+	g_settings_schema_unref(schema);
+
+	if(clutter_init(&argc, &argv) != CLUTTER_INIT_SUCCESS)
+		return 77;
+
+	g_test_init(&argc, &argv, NULL);
+	g_test_add_func("/tasklist/open-close", test_open_close);
+	return g_test_run();
+}